@@ -0,0 +1,658 @@
+/**
+ * \file
+ *
+ * \brief Host replacement for the ASF umbrella header
+ *
+ * Provides the subset of the XMEGA device header and the ASF drivers used by
+ * the PsDekor firmware so that the unmodified firmware sources can be built
+ * for Linux and run against the simulator in psdekor/host.
+ *
+ * Peripheral instances (PORTA, TCC0, RTC, ...) expand to accessor calls into
+ * the simulator. Every access synchronizes the peripheral model with virtual
+ * time, processes writes made since the previous access and gives pending
+ * interrupts a chance to run - which is what makes busy-wait loops in the
+ * firmware advance time.
+ */
+
+#ifndef ASF_H
+#define ASF_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "../../src/ASF/xmega/utils/status_codes.h"
+
+/************************************************************************/
+/* COMPILER                                                             */
+/************************************************************************/
+
+typedef int8_t   S8;
+typedef uint8_t  U8;
+typedef int16_t  S16;
+typedef uint16_t U16;
+typedef int32_t  S32;
+typedef uint32_t U32;
+typedef int64_t  S64;
+typedef uint64_t U64;
+typedef bool     Bool;
+typedef uint8_t  irqflags_t;
+
+#ifndef likely
+#  define likely(exp)   __builtin_expect(!!(exp), 1)
+#  define unlikely(exp) __builtin_expect(!!(exp), 0)
+#endif
+
+#ifndef __always_inline
+#  define __always_inline inline __attribute__((__always_inline__))
+#endif
+
+#define Min(a, b) (((a) < (b)) ? (a) : (b))
+#define Max(a, b) (((a) > (b)) ? (a) : (b))
+#define min(a, b) Min(a, b)
+#define max(a, b) Max(a, b)
+
+#define Assert(expr) ((void) 0)
+
+/*! \brief Compiler memory barrier, as in the ASF compiler.h */
+#define barrier() __asm__ __volatile__ ("" ::: "memory")
+
+/*! \brief Interrupt vectors become plain functions called by the simulator */
+#define ISR(vector, ...) void vector (void); void vector (void)
+
+/************************************************************************/
+/* DEVICE REGISTERS                                                     */
+/************************************************************************/
+
+typedef volatile uint8_t register8_t;
+typedef volatile uint16_t register16_t;
+
+typedef struct PORT_struct {
+	register8_t DIR;
+	register8_t DIRSET;
+	register8_t DIRCLR;
+	register8_t DIRTGL;
+	register8_t OUT;
+	register8_t OUTSET;
+	register8_t OUTCLR;
+	register8_t OUTTGL;
+	register8_t IN;
+	register8_t INTCTRL;
+	register8_t INT0MASK;
+	register8_t INT1MASK;
+	register8_t INTFLAGS;
+	register8_t REMAP;
+	register8_t PIN0CTRL;
+	register8_t PIN1CTRL;
+	register8_t PIN2CTRL;
+	register8_t PIN3CTRL;
+	register8_t PIN4CTRL;
+	register8_t PIN5CTRL;
+	register8_t PIN6CTRL;
+	register8_t PIN7CTRL;
+} PORT_t;
+
+typedef struct TC_struct {
+	register8_t CTRLA;
+	register8_t CTRLB;
+	register8_t CTRLC;
+	register8_t CTRLD;
+	register8_t CTRLE;
+	register8_t INTCTRLA;
+	register8_t INTCTRLB;
+	register8_t CTRLFCLR;
+	register8_t CTRLFSET;
+	register8_t CTRLGCLR;
+	register8_t CTRLGSET;
+	register8_t INTFLAGS;
+	register8_t TEMP;
+	register16_t CNT;
+	register16_t PER;
+	register16_t CCA;
+	register16_t CCB;
+	register16_t CCC;
+	register16_t CCD;
+	register16_t PERBUF;
+	register16_t CCABUF;
+	register16_t CCBBUF;
+	register16_t CCCBUF;
+	register16_t CCDBUF;
+} TC_t;
+
+typedef TC_t TC0_t;
+typedef TC_t TC1_t;
+
+typedef struct RTC_struct {
+	register8_t CTRL;
+	register8_t STATUS;
+	register8_t INTCTRL;
+	register8_t INTFLAGS;
+	register8_t TEMP;
+	register16_t CNT;
+	register16_t PER;
+	register16_t COMP;
+} RTC_t;
+
+typedef struct CLK_struct {
+	register8_t CTRL;
+	register8_t PSCTRL;
+	register8_t LOCK;
+	register8_t RTCCTRL;
+	register8_t USBCTRL;
+} CLK_t;
+
+typedef struct RST_struct {
+	register8_t STATUS;
+	register8_t CTRL;
+} RST_t;
+
+typedef struct NVM_struct {
+	register8_t INTCTRL;
+} NVM_t;
+
+typedef struct ADC_struct {
+	register8_t CTRLA;
+	register8_t CTRLB;
+	register8_t REFCTRL;
+	register8_t EVCTRL;
+	register8_t PRESCALER;
+	register8_t INTFLAGS;
+	register8_t TEMP;
+	register8_t CALL;
+	register8_t CALH;
+} ADC_t;
+
+typedef struct SPI_struct {
+	register8_t CTRL;
+	register8_t INTCTRL;
+	register8_t STATUS;
+	register8_t DATA;
+} SPI_t;
+
+typedef struct USART_struct {
+	register8_t DATA;
+	register8_t STATUS;
+	register8_t CTRLA;
+	register8_t CTRLB;
+	register8_t CTRLC;
+	register8_t BAUDCTRLA;
+	register8_t BAUDCTRLB;
+} USART_t;
+
+/*! \brief Identifiers of the simulated peripheral instances */
+enum sim_periph {
+	SIM_PORTA,
+	SIM_PORTB,
+	SIM_PORTC,
+	SIM_PORTD,
+	SIM_PORTE,
+	SIM_PORTR,
+	SIM_PORT_COUNT,
+
+	SIM_TCC0 = 0,
+	SIM_TCC1,
+	SIM_TCD1,
+	SIM_TCE0,
+	SIM_TC_COUNT
+};
+
+PORT_t *simPortSync (uint8_t port);
+TC_t *simTcSync (uint8_t tc);
+RTC_t *simRtcSync (void);
+CLK_t *simClkSync (void);
+RST_t *simRstSync (void);
+ADC_t *simAdcSync (void);
+register8_t *simCcpSync (void);
+register8_t *simNvmCmdSync (void);
+NVM_t *simNvmSync (void);
+SPI_t *simSpiDevice (void);
+USART_t *simUsartDevice (void);
+
+#define PORTA   (*simPortSync (SIM_PORTA))
+#define PORTB   (*simPortSync (SIM_PORTB))
+#define PORTC   (*simPortSync (SIM_PORTC))
+#define PORTD   (*simPortSync (SIM_PORTD))
+#define PORTE   (*simPortSync (SIM_PORTE))
+#define PORTR   (*simPortSync (SIM_PORTR))
+#define TCC0    (*simTcSync (SIM_TCC0))
+#define TCC1    (*simTcSync (SIM_TCC1))
+#define TCD1    (*simTcSync (SIM_TCD1))
+#define TCE0    (*simTcSync (SIM_TCE0))
+#define RTC     (*simRtcSync ())
+#define CLK     (*simClkSync ())
+#define RST     (*simRstSync ())
+#define ADCA    (*simAdcSync ())
+#define CCP     (*simCcpSync ())
+#define NVM_CMD (*simNvmCmdSync ())
+#define NVM     (*simNvmSync ())
+#define SPIC    (*simSpiDevice ())
+#define USARTD0 (*simUsartDevice ())
+
+/* PORT */
+#define PORT_INT0LVL_gm     0x03
+#define PORT_INT0LVL_OFF_gc (0x00 << 0)
+#define PORT_INT0LVL_LO_gc  (0x01 << 0)
+#define PORT_INT0LVL_MED_gc (0x02 << 0)
+#define PORT_INT0LVL_HI_gc  (0x03 << 0)
+#define PORT_INT1LVL_gm     0x0C
+#define PORT_INT1LVL_OFF_gc (0x00 << 2)
+#define PORT_INT1LVL_LO_gc  (0x01 << 2)
+#define PORT_INT1LVL_MED_gc (0x02 << 2)
+#define PORT_INT1LVL_HI_gc  (0x03 << 2)
+#define PORT_INT0IF_bm      0x01
+#define PORT_INT1IF_bm      0x02
+#define PORT_ISC_gm         0x07
+#define PORT_OPC_gm         0x38
+#define PORT_INVEN_bm       0x40
+
+/* TC */
+#define TC_CLKSEL_gm         0x0F
+#define TC_CLKSEL_OFF_gc     (0x00 << 0)
+#define TC_CLKSEL_DIV1_gc    (0x01 << 0)
+#define TC_CLKSEL_DIV2_gc    (0x02 << 0)
+#define TC_CLKSEL_DIV4_gc    (0x03 << 0)
+#define TC_CLKSEL_DIV8_gc    (0x04 << 0)
+#define TC_CLKSEL_DIV64_gc   (0x05 << 0)
+#define TC_CLKSEL_DIV256_gc  (0x06 << 0)
+#define TC_CLKSEL_DIV1024_gc (0x07 << 0)
+
+#define TC_WGMODE_gm        0x07
+#define TC_WGMODE_NORMAL_gc (0x00 << 0)
+#define TC_WGMODE_FRQ_gc    (0x01 << 0)
+#define TC_WGMODE_SS_gc     (0x03 << 0)
+#define TC_WGMODE_DS_T_gc   (0x05 << 0)
+#define TC_WGMODE_DS_TB_gc  (0x06 << 0)
+#define TC_WGMODE_DS_B_gc   (0x07 << 0)
+#define TC_WGMODE_DSTOP_gc    TC_WGMODE_DS_T_gc
+#define TC_WGMODE_DSBOTH_gc   TC_WGMODE_DS_TB_gc
+#define TC_WGMODE_DSBOTTOM_gc TC_WGMODE_DS_B_gc
+#define TC0_CCAEN_bm        0x10
+#define TC0_CCBEN_bm        0x20
+#define TC1_CCAEN_bm        0x10
+#define TC1_CCBEN_bm        0x20
+
+#define TC_OVFINTLVL_gm     0x03
+#define TC_OVFINTLVL_OFF_gc (0x00 << 0)
+#define TC_OVFINTLVL_LO_gc  (0x01 << 0)
+#define TC_OVFINTLVL_MED_gc (0x02 << 0)
+#define TC_OVFINTLVL_HI_gc  (0x03 << 0)
+#define TC_ERRINTLVL_OFF_gc (0x00 << 2)
+#define TC_ERRINTLVL_LO_gc  (0x01 << 2)
+#define TC_ERRINTLVL_MED_gc (0x02 << 2)
+#define TC_ERRINTLVL_HI_gc  (0x03 << 2)
+#define TC_CCAINTLVL_gm     0x03
+#define TC_CCAINTLVL_OFF_gc (0x00 << 0)
+#define TC_CCAINTLVL_LO_gc  (0x01 << 0)
+#define TC_CCAINTLVL_MED_gc (0x02 << 0)
+#define TC_CCAINTLVL_HI_gc  (0x03 << 0)
+#define TC_CCBINTLVL_OFF_gc (0x00 << 2)
+#define TC_CCBINTLVL_LO_gc  (0x01 << 2)
+#define TC_CCBINTLVL_MED_gc (0x02 << 2)
+#define TC_CCBINTLVL_HI_gc  (0x03 << 2)
+#define TC_CCCINTLVL_OFF_gc (0x00 << 4)
+#define TC_CCCINTLVL_LO_gc  (0x01 << 4)
+#define TC_CCCINTLVL_MED_gc (0x02 << 4)
+#define TC_CCCINTLVL_HI_gc  (0x03 << 4)
+#define TC_CCDINTLVL_OFF_gc (0x00 << 6)
+#define TC_CCDINTLVL_LO_gc  (0x01 << 6)
+#define TC_CCDINTLVL_MED_gc (0x02 << 6)
+#define TC_CCDINTLVL_HI_gc  (0x03 << 6)
+
+#define TC0_OVFIF_bm 0x01
+#define TC0_ERRIF_bm 0x02
+#define TC0_CCAIF_bm 0x10
+#define TC0_CCBIF_bm 0x20
+#define TC1_OVFIF_bm 0x01
+#define TC1_ERRIF_bm 0x02
+#define TC1_CCAIF_bm 0x10
+#define TC1_CCBIF_bm 0x20
+
+#define TC0_PERBV_bm 0x01
+#define TC0_CCABV_bm 0x02
+#define TC1_PERBV_bm 0x01
+#define TC1_CCABV_bm 0x02
+
+/* RTC */
+#define RTC_PRESCALER_gm         0x07
+#define RTC_PRESCALER_OFF_gc     (0x00 << 0)
+#define RTC_PRESCALER_DIV1_gc    (0x01 << 0)
+#define RTC_PRESCALER_DIV2_gc    (0x02 << 0)
+#define RTC_PRESCALER_DIV8_gc    (0x03 << 0)
+#define RTC_PRESCALER_DIV16_gc   (0x04 << 0)
+#define RTC_PRESCALER_DIV64_gc   (0x05 << 0)
+#define RTC_PRESCALER_DIV256_gc  (0x06 << 0)
+#define RTC_PRESCALER_DIV1024_gc (0x07 << 0)
+#define RTC_SYNCBUSY_bm          0x01
+#define RTC_OVFINTLVL_gm         0x03
+#define RTC_OVFINTLVL_OFF_gc     (0x00 << 0)
+#define RTC_OVFINTLVL_LO_gc      (0x01 << 0)
+#define RTC_OVFINTLVL_MED_gc     (0x02 << 0)
+#define RTC_OVFINTLVL_HI_gc      (0x03 << 0)
+#define RTC_COMPINTLVL_gm        0x0C
+#define RTC_COMPINTLVL_OFF_gc    (0x00 << 2)
+#define RTC_COMPINTLVL_LO_gc     (0x01 << 2)
+#define RTC_COMPINTLVL_MED_gc    (0x02 << 2)
+#define RTC_COMPINTLVL_HI_gc     (0x03 << 2)
+#define RTC_OVFIF_bm             0x01
+#define RTC_COMPIF_bm            0x02
+
+/* CLK */
+#define CLK_RTCSRC_gm      0x0E
+#define CLK_RTCSRC_ULP_gc  (0x00 << 1)
+#define CLK_RTCSRC_TOSC_gc (0x01 << 1)
+#define CLK_RTCSRC_RCOSC_gc (0x02 << 1)
+#define CLK_RTCSRC_TOSC32_gc (0x05 << 1)
+#define CLK_RTCEN_bm       0x01
+
+/* CPU / RST */
+#define CCP_SPM_gc    0x9D
+#define CCP_IOREG_gc  0xD8
+#define RST_SWRST_bm  0x01
+
+/* NVM */
+#define NVM_CMD_NO_OPERATION_gc   0x00
+#define NVM_CMD_READ_CALIB_ROW_gc 0x02
+#define NVM_EELVL_gm              0x03
+#define NVM_EELVL_LO_gc           (0x01 << 0)
+#define ADCACAL0 0x20
+#define ADCACAL1 0x21
+#define EEPROM_SIZE      2048
+#define EEPROM_PAGE_SIZE 32
+
+uint8_t simPgmReadByte (uint16_t address);
+#define pgm_read_byte(address) simPgmReadByte ((uint16_t)(uintptr_t)(address))
+
+/* Flash data stays in host memory */
+#define PROGMEM
+#define memcpy_P(dst, src, n) memcpy ((dst), (src), (n))
+
+/* SLEEP */
+#define SLEEP_SMODE_gm       0x0E
+#define SLEEP_SMODE_IDLE_gc  (0x00 << 1)
+#define SLEEP_SMODE_PDOWN_gc (0x02 << 1)
+#define SLEEP_SMODE_PSAVE_gc (0x03 << 1)
+#define SLEEP_SMODE_STDBY_gc (0x06 << 1)
+#define SLEEP_SMODE_ESTDBY_gc (0x07 << 1)
+#define SLEEP_MODE_IDLE      SLEEP_SMODE_IDLE_gc
+#define SLEEP_MODE_PWR_DOWN  SLEEP_SMODE_PDOWN_gc
+#define SLEEP_MODE_PWR_SAVE  SLEEP_SMODE_PSAVE_gc
+#define SLEEP_MODE_STANDBY   SLEEP_SMODE_STDBY_gc
+#define SLEEP_MODE_EXT_STANDBY SLEEP_SMODE_ESTDBY_gc
+
+void sleep_set_mode (uint8_t mode);
+void sleep_enable (void);
+void sleep_disable (void);
+void sleep_enter (void);
+
+/* USART */
+#define USART_CHSIZE_5BIT_gc  (0x00 << 0)
+#define USART_CHSIZE_6BIT_gc  (0x01 << 0)
+#define USART_CHSIZE_7BIT_gc  (0x02 << 0)
+#define USART_CHSIZE_8BIT_gc  (0x03 << 0)
+#define USART_PMODE_DISABLED_gc (0x00 << 4)
+#define USART_PMODE_EVEN_gc   (0x02 << 4)
+#define USART_PMODE_ODD_gc    (0x03 << 4)
+
+/* SPI */
+#define SPI_MODE_0 0
+#define SPI_MODE_1 1
+#define SPI_MODE_2 2
+#define SPI_MODE_3 3
+
+typedef uint8_t spi_flags_t;
+typedef uint32_t board_spi_select_id_t;
+
+struct spi_device {
+	uint8_t id;
+};
+
+/************************************************************************/
+/* INTERRUPTS / PMIC                                                    */
+/************************************************************************/
+
+void cpu_irq_enable (void);
+void cpu_irq_disable (void);
+bool cpu_irq_is_enabled (void);
+irqflags_t cpu_irq_save (void);
+void cpu_irq_restore (irqflags_t flags);
+void pmic_init (void);
+
+#define sei() cpu_irq_enable ()
+#define cli() cpu_irq_disable ()
+#define Enable_global_interrupt()  cpu_irq_enable ()
+#define Disable_global_interrupt() cpu_irq_disable ()
+
+/************************************************************************/
+/* IOPORT                                                               */
+/************************************************************************/
+
+#define IOPORT_PORTA 0
+#define IOPORT_PORTB 1
+#define IOPORT_PORTC 2
+#define IOPORT_PORTD 3
+#define IOPORT_PORTE 4
+#define IOPORT_PORTR 5
+#define IOPORT_CREATE_PIN(port, pin) ((IOPORT_ ## port) * 8 + (pin))
+
+typedef uint8_t port_pin_t;
+typedef uint16_t port_pin_flags_t;
+typedef uint8_t ioport_pin_t;
+
+enum ioport_direction {
+	IOPORT_DIR_INPUT,
+	IOPORT_DIR_OUTPUT,
+};
+
+enum ioport_value {
+	IOPORT_PIN_LEVEL_LOW,
+	IOPORT_PIN_LEVEL_HIGH,
+};
+
+enum ioport_sense {
+	IOPORT_SENSE_BOTHEDGES,
+	IOPORT_SENSE_RISING,
+	IOPORT_SENSE_FALLING,
+};
+
+#define IOPORT_INIT_LOW           (0 << 1)
+#define IOPORT_INIT_HIGH          (1 << 1)
+#define IOPORT_BOTHEDGES          (0 << 8)
+#define IOPORT_RISING             (1 << 8)
+#define IOPORT_FALLING            (2 << 8)
+#define IOPORT_LEVEL              (3 << 8)
+#define IOPORT_INPUT_DISABLE      (7 << 8)
+#define IOPORT_TOTEM              (0 << 11)
+#define IOPORT_BUSKEEPER          (1 << 11)
+#define IOPORT_PULL_DOWN          (2 << 11)
+#define IOPORT_PULL_UP            (3 << 11)
+#define IOPORT_WIRED_OR           (4 << 11)
+#define IOPORT_WIRED_AND          (5 << 11)
+#define IOPORT_WIRED_OR_PULL_DOWN (6 << 11)
+#define IOPORT_WIRED_AND_PULL_UP  (7 << 11)
+#define IOPORT_INV_ENABLED        (1 << 14)
+#define IOPORT_INV_DISABLE        (0 << 14)
+#define IOPORT_SRL_ENABLED        (1 << 15)
+#define IOPORT_SRL_DISABLED       (0 << 15)
+
+void ioport_configure_pin (port_pin_t pin, port_pin_flags_t flags);
+void ioport_set_pin_level (port_pin_t pin, bool level);
+bool ioport_get_pin_level (port_pin_t pin);
+void ioport_set_pin_dir (port_pin_t pin, enum ioport_direction dir);
+void arch_ioport_set_pin_sense_mode (ioport_pin_t pin, uint8_t pin_sense);
+#define ioport_set_pin_sense_mode(pin, sense) \
+	arch_ioport_set_pin_sense_mode ((pin), (sense))
+
+/************************************************************************/
+/* SYSCLK / DELAY                                                       */
+/************************************************************************/
+
+#define SYSCLK_SRC_RC2MHZ  0
+#define SYSCLK_SRC_RC32MHZ 1
+#define SYSCLK_SRC_RC32KHZ 2
+#define SYSCLK_SRC_XOSC    3
+#define SYSCLK_SRC_PLL     4
+
+void sysclk_init (void);
+void sysclk_set_source (uint8_t src);
+void sysclk_enable_peripheral_clock (const volatile void *module);
+void sysclk_disable_peripheral_clock (const volatile void *module);
+uint32_t sysclk_get_cpu_hz (void);
+uint32_t sysclk_get_per_hz (void);
+uint32_t sysclk_get_peripheral_bus_hz (const volatile void *module);
+
+#define OSC_ID_RC2MHZ  (1 << 0)
+#define OSC_ID_RC32MHZ (1 << 1)
+
+void osc_enable (uint8_t id);
+void osc_disable (uint8_t id);
+bool osc_is_ready (uint8_t id);
+
+void delay_cycles (unsigned long n);
+void delay_us (uint32_t us);
+#define delay_ms(ms) delay_us ((uint32_t)(ms) * 1000UL)
+#define delay_s(s)   delay_us ((uint32_t)(s) * 1000000UL)
+
+/************************************************************************/
+/* USART                                                                */
+/************************************************************************/
+
+typedef struct usart_rs232_options {
+	uint32_t baudrate;
+	uint8_t charlength;
+	uint8_t paritytype;
+	bool stopbits;
+} usart_rs232_options_t;
+
+bool usart_init_rs232 (USART_t *usart, const usart_rs232_options_t *opt);
+void usart_tx_disable (USART_t *usart);
+void usart_rx_disable (USART_t *usart);
+enum status_code usart_putchar (USART_t *usart, uint8_t c);
+bool usart_set_baudrate (USART_t *usart, uint32_t baud, uint32_t cpu_hz);
+bool usart_tx_is_complete (USART_t *usart);
+void usart_clear_tx_complete (USART_t *usart);
+
+/************************************************************************/
+/* ADC                                                                  */
+/************************************************************************/
+
+#define ADC_CH0 (1U << 0)
+
+enum adc_sign {
+	ADC_SIGN_OFF,
+	ADC_SIGN_ON,
+};
+
+enum adc_resolution {
+	ADC_RES_12,
+	ADC_RES_12_LEFT,
+	ADC_RES_8,
+};
+
+enum adc_reference {
+	ADC_REF_BANDGAP,
+	ADC_REF_VCC,
+	ADC_REF_AREFA,
+	ADC_REF_AREFB,
+	ADC_REF_VCCDIV2,
+};
+
+enum adc_trigger {
+	ADC_TRIG_MANUAL,
+	ADC_TRIG_FREERUN,
+	ADC_TRIG_EVENT_SINGLE,
+	ADC_TRIG_FREERUN_SWEEP,
+	ADC_TRIG_EVENT_SWEEP,
+	ADC_TRIG_EVENT_SYNCSWEEP,
+};
+
+enum adcch_positive_input {
+	ADCCH_POS_PIN0,
+	ADCCH_POS_TEMPSENSE = 0x20,
+	ADCCH_POS_BANDGAP,
+	ADCCH_POS_SCALED_VCC,
+};
+
+enum adcch_negative_input {
+	ADCCH_NEG_PIN0,
+	ADCCH_NEG_NONE = 0x40,
+};
+
+typedef int16_t adc_result_t;
+typedef void (*adc_callback_t) (ADC_t *adc, uint8_t ch_mask, adc_result_t res);
+
+struct adc_config {
+	uint8_t ctrla;
+	uint8_t ctrlb;
+	uint8_t refctrl;
+	uint8_t evctrl;
+	uint8_t prescaler;
+	uint32_t clock_hz;
+};
+
+struct adc_channel_config {
+	uint8_t ctrl;
+	uint8_t muxctrl;
+	uint8_t intctrl;
+	uint8_t scan;
+};
+
+void adc_read_configuration (ADC_t *adc, struct adc_config *conf);
+void adc_write_configuration (ADC_t *adc, const struct adc_config *conf);
+void adcch_read_configuration (ADC_t *adc, uint8_t ch_mask,
+                               struct adc_channel_config *ch_conf);
+void adcch_write_configuration (ADC_t *adc, uint8_t ch_mask,
+                                const struct adc_channel_config *ch_conf);
+void adc_set_conversion_parameters (struct adc_config *conf,
+                                    enum adc_sign sign,
+                                    enum adc_resolution res,
+                                    enum adc_reference ref);
+void adc_set_conversion_trigger (struct adc_config *conf,
+                                 enum adc_trigger trig, uint8_t nr_of_ch,
+                                 uint8_t base_ev_ch);
+void adc_set_clock_rate (struct adc_config *conf, uint32_t clk_adc);
+void adcch_set_input (struct adc_channel_config *ch_conf,
+                      enum adcch_positive_input pos,
+                      enum adcch_negative_input neg, uint8_t gain);
+void adcch_enable_interrupt (struct adc_channel_config *ch_conf);
+void adc_set_callback (ADC_t *adc, adc_callback_t callback);
+void adc_enable (ADC_t *adc);
+void adc_disable (ADC_t *adc);
+void adc_start_conversion (ADC_t *adc, uint8_t ch_mask);
+
+/************************************************************************/
+/* NVM (EEPROM)                                                         */
+/************************************************************************/
+
+void nvm_wait_until_ready (void);
+uint8_t nvm_eeprom_read_byte (uint16_t addr);
+void nvm_eeprom_read_buffer (uint16_t address, void *buf, uint16_t len);
+void nvm_eeprom_flush_buffer (void);
+void nvm_eeprom_load_byte_to_buffer (uint8_t byte_addr, uint8_t value);
+void nvm_eeprom_load_page_to_buffer (const uint8_t *values);
+void nvm_eeprom_atomic_write_page (uint8_t page_addr);
+void nvm_eeprom_split_write_page (uint8_t page_addr);
+void nvm_eeprom_erase_page (uint8_t page_addr);
+void nvm_eeprom_erase_bytes_in_page (uint8_t page_addr);
+void nvm_eeprom_erase_all (void);
+void nvm_eeprom_write_byte (uint16_t address, uint8_t value);
+void nvm_eeprom_fill_buffer_with_value (uint8_t value);
+
+/************************************************************************/
+/* NVM (flash, application table section only)                         */
+/************************************************************************/
+
+typedef uint32_t flash_addr_t;
+
+#define FLASH_SIZE             (128*1024L)
+#define FLASH_PAGE_SIZE        256
+#define APPTABLE_SECTION_START 0x1E000
+#define APPTABLE_SECTION_SIZE  8192
+
+void nvm_flash_read_buffer (flash_addr_t address, void *buf, uint16_t len);
+void nvm_flash_erase_and_write_buffer (flash_addr_t address, const void *buf,
+                                       uint16_t len, bool b_blank_check);
+
+#include <board.h>
+
+#endif // ASF_H
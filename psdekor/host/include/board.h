@@ -0,0 +1,14 @@
+/**
+ * \file
+ *
+ * \brief Host replacement for the ASF generic board header
+ */
+
+#ifndef BOARD_H
+#define BOARD_H
+
+#include "../../src/ASF/common/boards/user_board/user_board.h"
+
+void board_init (void);
+
+#endif // BOARD_H
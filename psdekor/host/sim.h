@@ -0,0 +1,244 @@
+/*!
+ * \file sim.h
+ * \brief Internal interfaces of the PsDekor host simulator
+ *
+ * The simulator runs the unmodified firmware on a virtual clock. Time only
+ * advances when the firmware touches simulated hardware (each access is
+ * charged a few CPU cycles), when it busy-waits on a peripheral or when it
+ * sleeps. All peripheral models are event driven: they report the time of
+ * their next event and are brought up to date by #simRunUntil().
+ */
+
+#ifndef HOST_SIM_H
+#define HOST_SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/*! \brief Virtual time in nanoseconds since power-up */
+typedef uint64_t sim_time_t;
+
+#define SIM_NEVER    UINT64_MAX
+#define SIM_NS(x)    ((sim_time_t)(x))
+#define SIM_US(x)    ((sim_time_t)(x) * 1000ULL)
+#define SIM_MS(x)    ((sim_time_t)(x) * 1000000ULL)
+#define SIM_S(x)     ((sim_time_t)(x) * 1000000000ULL)
+
+/*! \brief CPU cycles charged for every access to simulated hardware */
+#define SIM_ACCESS_CYCLES 4
+/*! \brief CPU cycles charged for interrupt entry and exit */
+#define SIM_ISR_CYCLES    10
+
+/*! \brief Sleep modes as seen by the simulator */
+enum sim_sleep_mode {
+	SIM_SLEEP_IDLE,
+	SIM_SLEEP_PSAVE,
+	SIM_SLEEP_PDOWN,
+	SIM_SLEEP_MODE_COUNT
+};
+
+/************************************************************************/
+/* sim_core.c                                                           */
+/************************************************************************/
+
+/*! \brief Current virtual time */
+sim_time_t simNow (void);
+
+/*! \brief Nanoseconds per CPU cycle times 1000 (picoseconds per cycle) */
+uint64_t simCpuCyclePs (void);
+
+/*!
+ * \brief Called at the start of every firmware visible hardware access.
+ * Charges #SIM_ACCESS_CYCLES and brings all models up to date.
+ */
+void simEnter (void);
+
+/*!
+ * \brief Called at the end of every hardware access. Dispatches pending
+ * interrupts when the access was not nested in another one.
+ */
+void simLeave (void);
+
+/*! \brief Advances time while the CPU is busy (e.g. polling a peripheral) */
+void simBusy (sim_time_t duration);
+
+/*! \brief Advances all models up to \a t without dispatching interrupts */
+void simRunUntil (sim_time_t t);
+
+/*! \brief Global interrupt flag (SREG.I) */
+bool simIrqEnabled (void);
+
+/*! \brief Puts the CPU into \a mode until an interrupt wakes it up */
+void simSleep (enum sim_sleep_mode mode);
+
+/*! \brief Ends the simulation run; never returns */
+void simExit (const char *reason) __attribute__((noreturn));
+
+/*! \brief Stops the run at time \a t */
+void simSetEndTime (sim_time_t t);
+
+/*! \brief Runs \a entry on the virtual CPU until #simExit() is called */
+const char *simRun (void (*entry) (void));
+
+/*! \brief Statistics collected by the core */
+struct sim_core_stats {
+	uint64_t accesses;
+	uint64_t dispatches;
+	uint64_t stalls;
+	sim_time_t sleep_ns[SIM_SLEEP_MODE_COUNT];
+	uint64_t sleeps[SIM_SLEEP_MODE_COUNT];
+};
+
+const struct sim_core_stats *simCoreStats (void);
+
+/************************************************************************/
+/* sim_xmega.c                                                          */
+/************************************************************************/
+
+void simXmegaInit (void);
+sim_time_t simXmegaNextEvent (void);
+void simXmegaRun (sim_time_t now);
+
+/*!
+ * \brief Returns the index of the most urgent interrupt that may preempt
+ * code running at PMIC level \a level, or -1.
+ */
+int simXmegaPendingIrq (uint8_t level);
+
+/*! \brief Acknowledges interrupt \a irq and returns its handler and level */
+void (*simXmegaAckIrq (int irq, uint8_t *level)) (void);
+
+/*! \brief Name of interrupt \a irq */
+const char *simXmegaIrqName (int irq);
+
+/*! \brief Freezes or resumes clocks that stop in \a mode */
+void simXmegaSleep (enum sim_sleep_mode mode, bool enter);
+
+/*! \brief External driver of pin \a pin: 0, 1 or -1 (not driven) */
+void simPinDrive (uint8_t pin, int level);
+
+/*! \brief Output level the MCU drives on \a pin, -1 if it is an input */
+int simPinOutput (uint8_t pin);
+
+/*! \brief Commits pending register writes of all peripherals */
+void simXmegaCommit (void);
+
+/*! \brief Physical level of \a pin */
+bool simPinLevel (uint8_t pin);
+
+/*! \brief PINnCTRL register of \a pin */
+uint8_t simPinCtrl (uint8_t pin);
+
+/*! \brief Current CPU frequency */
+uint32_t simCpuHz (void);
+
+/*! \brief Synchronised RTC writes and writes lost while SYNCBUSY was set */
+uint64_t simRtcWrites (void);
+uint64_t simRtcLostWrites (void);
+
+/*! \brief Number of characters sent on the debug USART */
+uint64_t simUsartChars (void);
+uint64_t simUsartBadChars (void);
+
+/*! \brief Loads/saves the EEPROM image (returns false on I/O errors) */
+bool simEepromLoad (const char *path);
+bool simEepromSave (const char *path);
+
+#define SIM_EEPROM_PAGES 64
+
+/*! \brief Write statistics of the EEPROM */
+struct sim_eeprom_stats {
+	uint32_t page_writes[SIM_EEPROM_PAGES];
+	uint32_t page_erases[SIM_EEPROM_PAGES];
+	uint64_t bytes_read;
+	sim_time_t busy_ns;
+};
+
+const struct sim_eeprom_stats *simEepromStats (void);
+
+/*! \brief Raw EEPROM contents */
+const uint8_t *simEepromData (void);
+
+/*! \brief Loads/saves the application table section of the flash */
+bool simFlashLoad (const char *path);
+bool simFlashSave (const char *path);
+
+/*! \brief Statistics of the application table section */
+struct sim_flash_stats {
+	uint32_t page_writes;
+	uint32_t page_erases;
+	uint64_t bytes_read;
+	sim_time_t busy_ns;
+};
+
+const struct sim_flash_stats *simFlashStats (void);
+
+/************************************************************************/
+/* sim_spi.c                                                            */
+/************************************************************************/
+
+/*!
+ * \brief Marks the start of firmware operation \a name
+ *
+ * SPI traffic and virtual time are accounted to every operation that is
+ * active (inclusive accounting). Operations nest; a recursive entry of an
+ * operation that is already active is only counted once.
+ */
+void simOpEnter (const char *name);
+
+/*! \brief Marks the end of the innermost operation */
+void simOpLeave (void);
+
+#define SIM_MAX_OPS 32
+
+/*! \brief Statistics of one firmware operation */
+struct sim_op_stats {
+	const char *name;
+	uint32_t calls;
+	uint64_t transactions;  /*!< SEN activations */
+	uint64_t bytes;         /*!< bytes shifted through the SPI */
+	sim_time_t bus_ns;      /*!< SPI clock time of these bytes */
+	sim_time_t total_ns;    /*!< virtual time spent in the operation */
+	sim_time_t max_ns;      /*!< longest single call */
+};
+
+/*!
+ * \brief Operation statistics, index 0 holds the totals of the whole run
+ * \param count Receives the number of entries
+ */
+const struct sim_op_stats *simOpStats (unsigned *count);
+
+/*! \brief Resets all operation statistics */
+void simOpReset (void);
+
+/*! \brief End of the byte being shifted by spiTxRxStart, or SIM_NEVER */
+sim_time_t simSpiNextEvent (void);
+
+/*! \brief Sets the SPI interrupt flag when the byte has been shifted */
+void simSpiRun (sim_time_t now);
+
+/*! \brief State of the SPI interrupt flag */
+bool simSpiIrqPending (void);
+
+/*! \brief SPI interrupt handler of the firmware's interrupt driven driver */
+void simSpiIsr (void);
+
+/*! \brief Statistics of the interrupt driven transfers (CONF_SPI_ASYNC) */
+struct sim_spi_async_stats {
+	uint32_t transfers;
+	uint64_t bytes;
+	uint64_t interrupts;
+	sim_time_t transfer_ns; /*!< from spiTxRxStart to the last interrupt */
+	sim_time_t isr_ns;      /*!< spent in the interrupt handler */
+};
+
+const struct sim_spi_async_stats *simSpiAsyncStats (void);
+
+/*!
+ * \brief Resolves a return address of the firmware with addr2line
+ * \return "function (file:line)" or the address, valid until the next call
+ */
+const char *simCodeLocation (const void *caller);
+
+#endif /* HOST_SIM_H */
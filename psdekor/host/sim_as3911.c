@@ -0,0 +1,1090 @@
+/*!
+ * \file sim_as3911.c
+ * \brief Register level model of the AS3911 NFC reader IC
+ *
+ * Timing follows the 106 kbit/s ISO14443A air interface: one bit lasts
+ * 128/fc, a card answers after the frame delay time and the no-response
+ * timer counts in steps of 64/fc (or 4096/fc). Cards are powered by the
+ * reader field and lose their state when the field is switched off.
+ *
+ * Interrupts are latched in the interrupt registers even when they are
+ * masked; the mask registers only gate the INTR pin.
+ */
+
+#include <string.h>
+
+#include <asf.h>
+#include "sim.h"
+#include "sim_as3911.h"
+#include "sim_world.h"
+
+#include "as3911.h"
+#include "as3911_com.h"
+#include "as3911_interrupt.h"
+
+#define FC_HZ               13560000ULL
+#define FC_NS(n)            (((sim_time_t)(n) * 1000000000ULL + FC_HZ / 2) / FC_HZ)
+#define BIT_NS              FC_NS(128)
+
+#define FIFO_DEPTH          96
+#define OSC_STARTUP_NS      SIM_US(700)
+#define CARD_POWER_UP_NS    SIM_US(1000)
+/*! \brief Frame delay time of a PICC answer (n = 9) */
+#define FDT_NS              FC_NS(1236)
+/*! \brief Time a wake-up measurement keeps the oscillator on */
+#define WAKEUP_MEASURE_NS   SIM_US(300)
+
+#define IRQ_MAIN_MASK       U32_C(0x0000fc)
+#define IRQ_TIMER_MASK      U32_C(0x00ff00)
+#define IRQ_ERROR_MASK      U32_C(0xff0000)
+
+enum chip_event {
+	EV_OSC,
+	EV_DCT,
+	EV_TX_END,
+	EV_RXS,
+	EV_RXE,
+	EV_NRE,
+	EV_GPE,
+	EV_WUT,
+	EV_COUNT
+};
+
+enum card_state {
+	CARD_OFF,
+	CARD_IDLE,
+	CARD_READY,
+	CARD_ACTIVE,
+	CARD_HALT
+};
+
+struct card_model {
+	uint8_t uid[10];
+	uint8_t len;
+	uint8_t levels;
+	uint8_t cl[3][5];       /*!< UID CLn + BCC of every cascade level */
+	bool present;
+	enum card_state state;
+	bool halted;            /*!< woken up from HALT by WUPA */
+	uint8_t level;          /*!< cascade level while READY */
+	sim_time_t powered_at;
+};
+
+enum spi_mode {
+	SPI_FIRST,
+	SPI_WRITE,
+	SPI_READ,
+	SPI_FIFO_LOAD,
+	SPI_FIFO_READ,
+	SPI_TEST,
+	SPI_IGNORE
+};
+
+static struct {
+	uint8_t reg[0x40];
+	uint32_t irq;
+	bool pin;
+
+	uint8_t fifo[FIFO_DEPTH];
+	uint8_t fifo_len;
+	uint8_t fifo_pos;
+	uint8_t status2;
+	uint8_t collision;
+
+	enum spi_mode spi;
+	uint8_t spi_addr;
+
+	sim_time_t ev[EV_COUNT];
+	bool osc_ok;
+	bool field;
+	sim_time_t field_since;
+	sim_time_t osc_since;
+	bool rx_masked;
+
+	/* frame in flight */
+	uint8_t tx[FIFO_DEPTH + 2];
+	uint16_t tx_bits;
+	uint8_t dct_cmd;
+
+	/* answer in flight */
+	uint8_t rx[16];
+	uint16_t rx_start;      /*!< absolute bit position of the first bit */
+	uint16_t rx_end;
+	int16_t rx_coll;        /*!< absolute bit position of a collision */
+	bool rx_crc;
+
+	uint8_t aa[3];          /*!< auto averages: amplitude, phase, capacitance */
+
+	struct card_model cards[SIM_CHIP_MAX_CARDS];
+	uint8_t ncards;
+
+	struct sim_chip_stats stats;
+} chip;
+
+/************************************************************************/
+/* INTERRUPTS                                                           */
+/************************************************************************/
+
+static uint32_t irq_mask (void)
+{
+	return (uint32_t) chip.reg[AS3911_REG_IRQ_MASK_MAIN] |
+	       ((uint32_t) chip.reg[AS3911_REG_IRQ_MASK_TIMER_NFC] << 8) |
+	       ((uint32_t) chip.reg[AS3911_REG_IRQ_MASK_ERROR_WUP] << 16);
+}
+
+static void update_pin (void)
+{
+	bool pin = (chip.irq & ~irq_mask () & AS3911_IRQ_MASK_ALL) != 0;
+
+	if (pin != chip.pin) {
+		chip.pin = pin;
+		simPinDrive (AS3911_INTR_PIN, pin);
+	}
+}
+
+static void raise (uint32_t irq)
+{
+	chip.irq |= irq;
+	update_pin ();
+}
+
+/************************************************************************/
+/* FIELD AND CARDS                                                      */
+/************************************************************************/
+
+static void update_field (void)
+{
+	sim_time_t now = simNow ();
+	uint8_t op = chip.reg[AS3911_REG_OP_CONTROL];
+	bool on = (op & AS3911_REG_OP_CONTROL_en) &&
+	          (op & AS3911_REG_OP_CONTROL_tx_en) && chip.osc_ok;
+	uint8_t i;
+
+	if (on == chip.field)
+		return;
+
+	chip.field = on;
+	if (on) {
+		chip.field_since = now;
+	} else {
+		chip.stats.field_ns += now - chip.field_since;
+	}
+
+	for (i = 0; i < chip.ncards; ++i) {
+		if (!chip.cards[i].present)
+			continue;
+		chip.cards[i].state = on ? CARD_IDLE : CARD_OFF;
+		chip.cards[i].halted = false;
+		chip.cards[i].powered_at = now;
+	}
+}
+
+static bool card_ready (const struct card_model *c)
+{
+	return c->present && c->state != CARD_OFF &&
+	       simNow () >= c->powered_at + CARD_POWER_UP_NS;
+}
+
+static void card_reset (struct card_model *c)
+{
+	c->state = c->halted ? CARD_HALT : CARD_IDLE;
+}
+
+int simChipAddCard (const uint8_t *uid, uint8_t len)
+{
+	struct card_model *c;
+	uint8_t l;
+	uint8_t i;
+
+	if (chip.ncards >= SIM_CHIP_MAX_CARDS ||
+	    (len != 4 && len != 7 && len != 10))
+		return -1;
+
+	c = &chip.cards[chip.ncards];
+	memset (c, 0, sizeof *c);
+	memcpy (c->uid, uid, len);
+	c->len = len;
+	c->levels = len == 4 ? 1 : len == 7 ? 2 : 3;
+
+	for (l = 0; l < c->levels; ++l) {
+		if (l + 1 < c->levels) {
+			c->cl[l][0] = 0x88;
+			memcpy (&c->cl[l][1], &uid[3 * l], 3);
+		} else {
+			memcpy (&c->cl[l][0], &uid[3 * l], 4);
+		}
+		c->cl[l][4] = 0;
+		for (i = 0; i < 4; ++i)
+			c->cl[l][4] ^= c->cl[l][i];
+	}
+
+	return chip.ncards++;
+}
+
+void simChipCardPresent (int card, bool present)
+{
+	struct card_model *c;
+
+	if (card < 0 || card >= chip.ncards)
+		return;
+
+	c = &chip.cards[card];
+	if (c->present == present)
+		return;
+
+	c->present = present;
+	c->halted = false;
+	c->state = present && chip.field ? CARD_IDLE : CARD_OFF;
+	c->powered_at = simNow ();
+}
+
+bool simChipFieldOn (void)
+{
+	return chip.field;
+}
+
+/*! \brief Number of cards coupled to the antenna */
+static uint8_t cards_in_field (void)
+{
+	uint8_t n = 0;
+	uint8_t i;
+
+	for (i = 0; i < chip.ncards; ++i)
+		n += chip.cards[i].present;
+	return n;
+}
+
+/************************************************************************/
+/* MEASUREMENTS                                                         */
+/************************************************************************/
+
+enum measurement {
+	MEASURE_AMPLITUDE,
+	MEASURE_PHASE,
+	MEASURE_CAPACITANCE
+};
+
+static uint8_t measure (enum measurement m)
+{
+	static const enum sim_antenna_value quantity[] = {
+		SIM_ANTENNA_AMPLITUDE, SIM_ANTENNA_PHASE, SIM_ANTENNA_CAPACITANCE
+	};
+	int v = simWorldAntenna (quantity[m], cards_in_field ());
+
+	if (v < 0)
+		v = 0;
+	if (v > 0xff)
+		v = 0xff;
+	return v;
+}
+
+/*!
+ * \brief One measurement of the wake-up timer
+ * \return true if the measured value differs enough from the reference
+ */
+static bool wakeup_measure (enum measurement m, uint8_t conf_reg)
+{
+	static const uint8_t weight[] = { 4, 8, 16, 32 };
+	uint8_t conf = chip.reg[conf_reg];
+	uint8_t value = measure (m);
+	uint8_t ref;
+	uint8_t delta = conf >> 4;
+	bool fire;
+	int diff;
+
+	chip.reg[conf_reg + 3] = value;
+	ref = (conf & AS3911_REG_PHASE_MEASURE_CONF_pm_ae) ? chip.aa[m]
+	                                                   : chip.reg[conf_reg + 1];
+	diff = (int) value - ref;
+	fire = (diff < 0 ? -diff : diff) > delta;
+
+	if ((conf & AS3911_REG_PHASE_MEASURE_CONF_pm_ae) &&
+	    (!fire || (conf & AS3911_REG_PHASE_MEASURE_CONF_pm_aam))) {
+		diff = (int) value - chip.aa[m];
+		chip.aa[m] += diff / weight[(conf >> 1) & 3];
+		chip.reg[conf_reg + 2] = chip.aa[m];
+	}
+
+	return fire;
+}
+
+static sim_time_t wakeup_period (void)
+{
+	uint8_t wut = chip.reg[AS3911_REG_WUP_TIMER_CONTROL];
+	uint8_t steps = ((wut >> 4) & 7) + 1;
+
+	return (wut & AS3911_REG_WUP_TIMER_CONTROL_wur) ? SIM_MS (10 * steps)
+	                                                : SIM_MS (100 * steps);
+}
+
+static void wakeup_timer (void)
+{
+	uint8_t wut = chip.reg[AS3911_REG_WUP_TIMER_CONTROL];
+	uint32_t irq = 0;
+
+	++chip.stats.wakeup_measurements;
+	chip.stats.osc_ns += WAKEUP_MEASURE_NS;
+
+	if ((wut & AS3911_REG_WUP_TIMER_CONTROL_wam) &&
+	    wakeup_measure (MEASURE_AMPLITUDE, AS3911_REG_AMPLITUDE_MEASURE_CONF))
+		irq |= AS3911_IRQ_MASK_WAM;
+	if ((wut & AS3911_REG_WUP_TIMER_CONTROL_wph) &&
+	    wakeup_measure (MEASURE_PHASE, AS3911_REG_PHASE_MEASURE_CONF))
+		irq |= AS3911_IRQ_MASK_WPH;
+	if ((wut & AS3911_REG_WUP_TIMER_CONTROL_wcap) &&
+	    wakeup_measure (MEASURE_CAPACITANCE, AS3911_REG_CAPACITANCE_MEASURE_CONF))
+		irq |= AS3911_IRQ_MASK_WCAP;
+	if (wut & AS3911_REG_WUP_TIMER_CONTROL_wto)
+		irq |= AS3911_IRQ_MASK_WT;
+
+	if (irq & (AS3911_IRQ_MASK_WAM | AS3911_IRQ_MASK_WPH | AS3911_IRQ_MASK_WCAP))
+		++chip.stats.wakeup_irqs;
+	if (irq)
+		raise (irq);
+
+	chip.ev[EV_WUT] = simNow () + wakeup_period ();
+}
+
+/************************************************************************/
+/* OPERATION CONTROL                                                    */
+/************************************************************************/
+
+static void abort_rf (void)
+{
+	chip.ev[EV_TX_END] = SIM_NEVER;
+	chip.ev[EV_RXS] = SIM_NEVER;
+	chip.ev[EV_RXE] = SIM_NEVER;
+	chip.ev[EV_NRE] = SIM_NEVER;
+}
+
+static void op_control_changed (uint8_t old)
+{
+	uint8_t op = chip.reg[AS3911_REG_OP_CONTROL];
+	sim_time_t now = simNow ();
+
+	if ((op ^ old) & AS3911_REG_OP_CONTROL_en) {
+		if (op & AS3911_REG_OP_CONTROL_en) {
+			chip.osc_since = now;
+			chip.ev[EV_OSC] = now + OSC_STARTUP_NS;
+		} else {
+			chip.stats.osc_ns += now - chip.osc_since;
+			chip.osc_ok = false;
+			chip.ev[EV_OSC] = SIM_NEVER;
+			abort_rf ();
+		}
+	}
+
+	if ((op & AS3911_REG_OP_CONTROL_wu) && !(op & AS3911_REG_OP_CONTROL_en)) {
+		if (chip.ev[EV_WUT] == SIM_NEVER) {
+			chip.aa[MEASURE_AMPLITUDE] = chip.reg[AS3911_REG_AMPLITUDE_MEASURE_REF];
+			chip.aa[MEASURE_PHASE] = chip.reg[AS3911_REG_PHASE_MEASURE_REF];
+			chip.aa[MEASURE_CAPACITANCE] = chip.reg[AS3911_REG_CAPACITANCE_MEASURE_REF];
+			chip.ev[EV_WUT] = now + wakeup_period ();
+		}
+	} else {
+		chip.ev[EV_WUT] = SIM_NEVER;
+	}
+
+	update_field ();
+}
+
+static void set_default (void)
+{
+	uint8_t old = chip.reg[AS3911_REG_OP_CONTROL];
+	uint8_t i;
+
+	memset (chip.reg, 0, sizeof chip.reg);
+	chip.reg[AS3911_REG_IC_IDENTITY] = 0x09;
+	chip.irq = 0;
+	chip.fifo_len = chip.fifo_pos = 0;
+	chip.status2 = 0;
+	chip.collision = 0;
+	for (i = 0; i < EV_COUNT; ++i)
+		chip.ev[i] = SIM_NEVER;
+	op_control_changed (old);
+	update_pin ();
+}
+
+/************************************************************************/
+/* ISO14443A                                                            */
+/************************************************************************/
+
+static uint16_t crc_a (const uint8_t *data, uint8_t len)
+{
+	uint16_t crc = 0x6363;
+	uint8_t b;
+
+	while (len--) {
+		b = *data++;
+		b ^= crc & 0xff;
+		b ^= b << 4;
+		crc = (crc >> 8) ^ ((uint16_t) b << 8) ^ ((uint16_t) b << 3) ^ (b >> 4);
+	}
+
+	return crc;
+}
+
+static bool get_bit (const uint8_t *data, uint16_t bit)
+{
+	return (data[bit / 8] >> (bit % 8)) & 1;
+}
+
+static void put_bit (uint8_t *data, uint16_t bit, bool value)
+{
+	if (value)
+		data[bit / 8] |= 1 << (bit % 8);
+	else
+		data[bit / 8] &= ~(1 << (bit % 8));
+}
+
+/*! \brief Air time of \a bits bits (parity after every full byte) */
+static sim_time_t air_time (uint16_t bits)
+{
+	return BIT_NS * (2 + bits + bits / 8);
+}
+
+/*!
+ * \brief Adds the answer of one card (bits \a start to \a end of \a data,
+ * absolute positions) to the answer in flight.
+ */
+static void merge_answer (const uint8_t *data, uint16_t start, uint16_t end,
+                          bool first)
+{
+	uint16_t bit;
+	bool v;
+
+	if (first) {
+		memset (chip.rx, 0, sizeof chip.rx);
+		chip.rx_start = start;
+		chip.rx_end = end;
+		chip.rx_coll = -1;
+		for (bit = start; bit < end; ++bit)
+			put_bit (chip.rx, bit, get_bit (data, bit));
+		return;
+	}
+
+	for (bit = start; bit < end; ++bit) {
+		if (chip.rx_coll >= 0 && bit > chip.rx_coll)
+			break;
+		v = get_bit (data, bit);
+		if (v != get_bit (chip.rx, bit)) {
+			chip.rx_coll = bit;
+			put_bit (chip.rx, bit, 1);
+			break;
+		}
+	}
+}
+
+/*! \brief Lets the cards react to the frame that has just been sent */
+static bool cards_answer (void)
+{
+	uint8_t frame[16];
+	struct card_model *c;
+	uint8_t cmd = chip.tx[0];
+	uint8_t lvl;
+	uint16_t known;
+	uint16_t crc;
+	bool answered = false;
+	uint8_t i;
+
+	if (!chip.field)
+		return false;
+
+	chip.rx_crc = false;
+
+	/* REQA / WUPA (short frame) */
+	if (chip.tx_bits == 7 && (cmd == 0x26 || cmd == 0x52)) {
+		for (i = 0; i < chip.ncards; ++i) {
+			c = &chip.cards[i];
+			if (!card_ready (c))
+				continue;
+			if (c->state == CARD_HALT && cmd == 0x52)
+				c->halted = true;
+			else if (c->state != CARD_IDLE)
+				continue;
+			c->state = CARD_READY;
+			c->level = 0;
+			frame[0] = c->levels == 1 ? 0x04 : c->levels == 2 ? 0x44 : 0x84;
+			frame[1] = 0x00;
+			merge_answer (frame, 0, 16, !answered);
+			answered = true;
+		}
+		return answered;
+	}
+
+	if (chip.tx_bits < 16)
+		return false;
+
+	/* HLTA */
+	if (cmd == 0x50 && chip.tx_bits == 32) {
+		for (i = 0; i < chip.ncards; ++i) {
+			c = &chip.cards[i];
+			if (card_ready (c) && c->state == CARD_ACTIVE) {
+				c->state = CARD_HALT;
+				c->halted = true;
+			}
+		}
+		return false;
+	}
+
+	if (cmd != 0x93 && cmd != 0x95 && cmd != 0x97) {
+		for (i = 0; i < chip.ncards; ++i)
+			if (card_ready (&chip.cards[i]))
+				card_reset (&chip.cards[i]);
+		return false;
+	}
+
+	lvl = (cmd - 0x93) / 2;
+
+	/* SELECT: SEL, NVB 0x70, UID CLn, BCC and CRC */
+	if (chip.tx[1] == 0x70 && chip.tx_bits == 72) {
+		for (i = 0; i < chip.ncards; ++i) {
+			c = &chip.cards[i];
+			if (!card_ready (c) || c->state != CARD_READY || c->level != lvl)
+				continue;
+			if (memcmp (c->cl[lvl], &chip.tx[2], 5) != 0) {
+				card_reset (c);
+				continue;
+			}
+			if (lvl + 1 < c->levels) {
+				frame[0] = 0x04;
+				c->level = lvl + 1;
+			} else {
+				frame[0] = 0x08;
+				c->state = CARD_ACTIVE;
+			}
+			crc = crc_a (frame, 1);
+			frame[1] = crc & 0xff;
+			frame[2] = crc >> 8;
+			merge_answer (frame, 0, 24, !answered);
+			answered = true;
+		}
+		chip.rx_crc = answered;
+		return answered;
+	}
+
+	/* anticollision: the cards whose UID CLn starts with the transmitted
+	 * bits answer with the remaining ones */
+	known = chip.tx_bits - 16;
+	if (known >= 40)
+		return false;
+
+	for (i = 0; i < chip.ncards; ++i) {
+		uint16_t bit;
+
+		c = &chip.cards[i];
+		if (!card_ready (c) || c->state != CARD_READY || c->level != lvl)
+			continue;
+		for (bit = 0; bit < known; ++bit)
+			if (get_bit (c->cl[lvl], bit) != get_bit (chip.tx, 16 + bit))
+				break;
+		if (bit < known)
+			continue;
+
+		memset (frame, 0, sizeof frame);
+		memcpy (&frame[2], c->cl[lvl], 5);
+		merge_answer (frame, 16 + known, 56, !answered);
+		answered = true;
+	}
+
+	return answered;
+}
+
+static void start_transmission (bool crc)
+{
+	sim_time_t now = simNow ();
+	uint16_t bits;
+	uint16_t len;
+
+	if (!(chip.reg[AS3911_REG_OP_CONTROL] & AS3911_REG_OP_CONTROL_en))
+		return;
+
+	bits = ((uint16_t) chip.reg[AS3911_REG_NUM_TX_BYTES1] << 8) |
+	       chip.reg[AS3911_REG_NUM_TX_BYTES2];
+	len = (bits + 7) / 8;
+	if (len > chip.fifo_len - chip.fifo_pos) {
+		chip.status2 |= AS3911_REG_FIFO_RX_STATUS2_fifo_unf;
+		len = chip.fifo_len - chip.fifo_pos;
+		bits = len * 8;
+	}
+
+	memcpy (chip.tx, &chip.fifo[chip.fifo_pos], len);
+	chip.fifo_len = chip.fifo_pos = 0;
+
+	if (crc && len + 2 <= (uint16_t) sizeof chip.tx) {
+		uint16_t c = crc_a (chip.tx, len);
+
+		chip.tx[len] = c & 0xff;
+		chip.tx[len + 1] = c >> 8;
+		bits = (len + 2) * 8;
+	}
+
+	chip.tx_bits = bits;
+	chip.rx_masked = false;
+	chip.ev[EV_NRE] = SIM_NEVER;
+	chip.ev[EV_TX_END] = now + air_time (bits);
+	++chip.stats.frames_tx;
+}
+
+static void start_short_frame (uint8_t cmd)
+{
+	if (!(chip.reg[AS3911_REG_OP_CONTROL] & AS3911_REG_OP_CONTROL_en))
+		return;
+
+	chip.tx[0] = cmd;
+	chip.tx_bits = 7;
+	chip.rx_masked = false;
+	chip.ev[EV_NRE] = SIM_NEVER;
+	chip.ev[EV_TX_END] = simNow () + air_time (7);
+	++chip.stats.frames_tx;
+}
+
+static void tx_end (void)
+{
+	sim_time_t now = simNow ();
+	uint32_t nrt;
+
+	chip.ev[EV_TX_END] = SIM_NEVER;
+	raise (AS3911_IRQ_MASK_TXE);
+
+	nrt = ((uint32_t) chip.reg[AS3911_REG_NO_RESPONSE_TIMER1] << 8) |
+	      chip.reg[AS3911_REG_NO_RESPONSE_TIMER2];
+	if (nrt) {
+		nrt *= (chip.reg[AS3911_REG_GPT_CONTROL] &
+		        AS3911_REG_GPT_CONTROL_nrt_step) ? 4096 : 64;
+		chip.ev[EV_NRE] = now + FC_NS (nrt);
+	}
+
+	if (!(chip.reg[AS3911_REG_OP_CONTROL] & AS3911_REG_OP_CONTROL_rx_en))
+		return;
+
+	if (cards_answer ()) {
+		chip.ev[EV_RXS] = now + FDT_NS;
+	}
+}
+
+static void rx_start (void)
+{
+	uint16_t end = chip.rx_end;
+
+	chip.ev[EV_RXS] = SIM_NEVER;
+	chip.ev[EV_NRE] = SIM_NEVER;
+	if (chip.rx_masked)
+		return;
+
+	if (chip.rx_coll >= 0)
+		end = chip.rx_coll + 1;
+	chip.ev[EV_RXE] = simNow () + air_time (end - chip.rx_start);
+	chip.stats.rx_ns += chip.ev[EV_RXE] - simNow ();
+	raise (AS3911_IRQ_MASK_RXS);
+}
+
+static void rx_end (void)
+{
+	uint16_t first = chip.rx_start / 8;
+	uint16_t end = chip.rx_end;
+	uint16_t last;
+	uint16_t n;
+	uint32_t irq = AS3911_IRQ_MASK_RXE;
+
+	chip.ev[EV_RXE] = SIM_NEVER;
+
+	if (chip.rx_coll >= 0) {
+		end = chip.rx_coll + 1;
+		chip.collision = ((chip.rx_coll / 8) << AS3911_REG_COLLISION_STATUS_shift_c_byte) |
+		                 ((chip.rx_coll % 8) << AS3911_REG_COLLISION_STATUS_shift_c_bit);
+		irq |= AS3911_IRQ_MASK_COL;
+		++chip.stats.collisions;
+	}
+
+	last = (end + 7) / 8;
+	n = last - first;
+	if (chip.rx_crc && !(chip.reg[AS3911_REG_AUX] & AS3911_REG_AUX_crc_2_fifo))
+		n -= 2;
+
+	chip.fifo_pos = 0;
+	chip.fifo_len = n;
+	memcpy (chip.fifo, &chip.rx[first], n);
+	/* bits of the first byte that have not been received read as 0 */
+	chip.fifo[0] &= 0xff << (chip.rx_start % 8);
+
+	chip.status2 = (end % 8)
+	             ? (((end % 8) << AS3911_REG_FIFO_RX_STATUS2_shift_fifo_lb) |
+	                AS3911_REG_FIFO_RX_STATUS2_np_lb)
+	             : 0;
+
+	++chip.stats.frames_rx;
+	chip.stats.rx_done_at = simNow ();
+	raise (irq);
+}
+
+/************************************************************************/
+/* DIRECT COMMANDS                                                      */
+/************************************************************************/
+
+static void start_dct (uint8_t cmd, sim_time_t duration)
+{
+	chip.dct_cmd = cmd;
+	chip.ev[EV_DCT] = simNow () + duration;
+}
+
+static void dct_done (void)
+{
+	uint8_t mpsv;
+	uint16_t mv;
+
+	chip.ev[EV_DCT] = SIM_NEVER;
+
+	switch (chip.dct_cmd) {
+	case AS3911_CMD_MEASURE_AMPLITUDE:
+		chip.reg[AS3911_REG_AD_RESULT] = measure (MEASURE_AMPLITUDE);
+		break;
+	case AS3911_CMD_MEASURE_PHASE:
+		chip.reg[AS3911_REG_AD_RESULT] = measure (MEASURE_PHASE);
+		break;
+	case AS3911_CMD_MEASURE_CAPACITANCE:
+		chip.reg[AS3911_REG_AD_RESULT] = measure (MEASURE_CAPACITANCE);
+		break;
+	case AS3911_CMD_MEASURE_VDD:
+		mpsv = chip.reg[AS3911_REG_REGULATOR_CONTROL] &
+		       AS3911_REG_REGULATOR_CONTROL_mask_mpsv;
+		mv = mpsv == AS3911_REG_REGULATOR_CONTROL_mpsv_vdd
+		   ? simWorldVccMv () : 3000;
+		chip.reg[AS3911_REG_AD_RESULT] = (mv * 1000UL + 11719) / 23438;
+		break;
+	case AS3911_CMD_CALIBRATE_ANTENNA:
+		chip.reg[AS3911_REG_ANT_CAL_RESULT] = 0x50;
+		break;
+	case AS3911_CMD_CALIBRATE_MODULATION:
+		chip.reg[AS3911_REG_AM_MOD_DEPTH_RESULT] = 0x3c;
+		break;
+	case AS3911_CMD_CALIBRATE_C_SENSOR:
+		chip.reg[AS3911_REG_CAP_SENSOR_RESULT] =
+			(0x0c << 3) | AS3911_REG_CAP_SENSOR_RESULT_cs_cal_end;
+		break;
+	case AS3911_CMD_ADJUST_REGULATORS:
+		chip.reg[AS3911_REG_REGULATOR_RESULT] = 0xb0;
+		break;
+	}
+
+	raise (AS3911_IRQ_MASK_DCT);
+}
+
+static void execute (uint8_t cmd)
+{
+	uint16_t gpt;
+
+	++chip.stats.commands;
+
+	switch (cmd) {
+	case AS3911_CMD_SET_DEFAULT:
+		set_default ();
+		break;
+	case AS3911_CMD_CLEAR_FIFO:
+		chip.fifo_len = chip.fifo_pos = 0;
+		chip.status2 = 0;
+		chip.collision = 0;
+		abort_rf ();
+		break;
+	case AS3911_CMD_TRANSMIT_WITH_CRC:
+		start_transmission (true);
+		break;
+	case AS3911_CMD_TRANSMIT_WITHOUT_CRC:
+		start_transmission (false);
+		break;
+	case AS3911_CMD_TRANSMIT_REQA:
+		start_short_frame (0x26);
+		break;
+	case AS3911_CMD_TRANSMIT_WUPA:
+		start_short_frame (0x52);
+		break;
+	case AS3911_CMD_MASK_RECEIVE_DATA:
+		chip.rx_masked = true;
+		chip.ev[EV_RXS] = SIM_NEVER;
+		chip.ev[EV_RXE] = SIM_NEVER;
+		break;
+	case AS3911_CMD_UNMASK_RECEIVE_DATA:
+		chip.rx_masked = false;
+		break;
+	case AS3911_CMD_MEASURE_AMPLITUDE:
+	case AS3911_CMD_MEASURE_PHASE:
+	case AS3911_CMD_MEASURE_VDD:
+		start_dct (cmd, SIM_US(25));
+		break;
+	case AS3911_CMD_MEASURE_CAPACITANCE:
+		start_dct (cmd, SIM_US(200));
+		break;
+	case AS3911_CMD_CALIBRATE_ANTENNA:
+	case AS3911_CMD_CALIBRATE_MODULATION:
+		start_dct (cmd, SIM_US(250));
+		break;
+	case AS3911_CMD_CALIBRATE_C_SENSOR:
+		start_dct (cmd, SIM_MS(3));
+		break;
+	case AS3911_CMD_ADJUST_REGULATORS:
+		start_dct (cmd, SIM_MS(1));
+		break;
+	case AS3911_CMD_START_TIMER:
+		gpt = ((uint16_t) chip.reg[AS3911_REG_GPT1] << 8) |
+		      chip.reg[AS3911_REG_GPT2];
+		chip.ev[EV_GPE] = simNow () + FC_NS ((uint32_t) gpt * 8);
+		break;
+	case AS3911_CMD_START_WUP_TIMER:
+		chip.ev[EV_WUT] = simNow () + wakeup_period ();
+		break;
+	default:
+		break;
+	}
+}
+
+/************************************************************************/
+/* REGISTER ACCESS                                                      */
+/************************************************************************/
+
+static uint8_t read_register (uint8_t addr)
+{
+	uint8_t v;
+
+	switch (addr) {
+	case AS3911_REG_IRQ_MAIN:
+		v = chip.irq & IRQ_MAIN_MASK;
+		if (chip.irq & IRQ_TIMER_MASK)
+			v |= 0x02;
+		if (chip.irq & IRQ_ERROR_MASK)
+			v |= 0x01;
+		chip.irq &= ~IRQ_MAIN_MASK;
+		update_pin ();
+		return v;
+	case AS3911_REG_IRQ_TIMER_NFC:
+		v = chip.irq >> 8;
+		chip.irq &= ~IRQ_TIMER_MASK;
+		update_pin ();
+		return v;
+	case AS3911_REG_IRQ_ERROR_WUP:
+		v = chip.irq >> 16;
+		chip.irq &= ~IRQ_ERROR_MASK;
+		update_pin ();
+		return v;
+	case AS3911_REG_FIFO_RX_STATUS1:
+		return chip.fifo_len - chip.fifo_pos;
+	case AS3911_REG_FIFO_RX_STATUS2:
+		return chip.status2;
+	case AS3911_REG_COLLISION_STATUS:
+		return chip.collision;
+	case AS3911_REG_AUX_DISPLAY:
+		v = 0;
+		if (chip.osc_ok)
+			v |= AS3911_REG_AUX_DISPLAY_osc_ok;
+		if (chip.field)
+			v |= AS3911_REG_AUX_DISPLAY_tx_on;
+		if (chip.ev[EV_NRE] != SIM_NEVER)
+			v |= AS3911_REG_AUX_DISPLAY_nrt_on;
+		if (chip.ev[EV_GPE] != SIM_NEVER)
+			v |= AS3911_REG_AUX_DISPLAY_gpt_on;
+		if (chip.ev[EV_RXE] != SIM_NEVER)
+			v |= AS3911_REG_AUX_DISPLAY_rx_on;
+		return v;
+	default:
+		return addr < sizeof chip.reg ? chip.reg[addr] : 0;
+	}
+}
+
+static void write_register (uint8_t addr, uint8_t value)
+{
+	uint8_t old;
+
+	switch (addr) {
+	case AS3911_REG_IRQ_MAIN:
+	case AS3911_REG_IRQ_TIMER_NFC:
+	case AS3911_REG_IRQ_ERROR_WUP:
+	case AS3911_REG_FIFO_RX_STATUS1:
+	case AS3911_REG_FIFO_RX_STATUS2:
+	case AS3911_REG_COLLISION_STATUS:
+	case AS3911_REG_NFCIP1_BIT_RATE:
+	case AS3911_REG_AD_RESULT:
+	case AS3911_REG_ANT_CAL_RESULT:
+	case AS3911_REG_AM_MOD_DEPTH_RESULT:
+	case AS3911_REG_REGULATOR_RESULT:
+	case AS3911_REG_RSSI_RESULT:
+	case AS3911_REG_GAIN_RED_STATE:
+	case AS3911_REG_CAP_SENSOR_RESULT:
+	case AS3911_REG_AUX_DISPLAY:
+	case AS3911_REG_AMPLITUDE_MEASURE_AA_RESULT:
+	case AS3911_REG_AMPLITUDE_MEASURE_RESULT:
+	case AS3911_REG_PHASE_MEASURE_AA_RESULT:
+	case AS3911_REG_PHASE_MEASURE_RESULT:
+	case AS3911_REG_CAPACITANCE_MEASURE_AA_RESULT:
+	case AS3911_REG_CAPACITANCE_MEASURE_RESULT:
+	case AS3911_REG_IC_IDENTITY:
+		return;
+	}
+
+	if (addr >= sizeof chip.reg)
+		return;
+
+	old = chip.reg[addr];
+	chip.reg[addr] = value;
+
+	switch (addr) {
+	case AS3911_REG_OP_CONTROL:
+		op_control_changed (old);
+		break;
+	case AS3911_REG_IRQ_MASK_MAIN:
+	case AS3911_REG_IRQ_MASK_TIMER_NFC:
+	case AS3911_REG_IRQ_MASK_ERROR_WUP:
+		update_pin ();
+		break;
+	}
+}
+
+void simChipSelect (bool selected)
+{
+	chip.spi = selected ? SPI_FIRST : SPI_IGNORE;
+}
+
+uint8_t simChipTransfer (uint8_t mosi)
+{
+	uint8_t miso = 0;
+
+	switch (chip.spi) {
+	case SPI_FIRST:
+		if ((mosi & 0xc0) == 0x00) {
+			chip.spi = SPI_WRITE;
+			chip.spi_addr = mosi & 0x3f;
+		} else if ((mosi & 0xc0) == 0x40) {
+			chip.spi = SPI_READ;
+			chip.spi_addr = mosi & 0x3f;
+		} else if (mosi == 0xbf) {
+			chip.spi = SPI_FIFO_READ;
+		} else if ((mosi & 0xc0) == 0x80) {
+			chip.spi = SPI_FIFO_LOAD;
+			if (chip.fifo_pos) {
+				memmove (chip.fifo, &chip.fifo[chip.fifo_pos],
+				         chip.fifo_len - chip.fifo_pos);
+				chip.fifo_len -= chip.fifo_pos;
+				chip.fifo_pos = 0;
+			}
+		} else if (mosi == AS3911_CMD_TEST_ACCESS) {
+			chip.spi = SPI_TEST;
+		} else {
+			execute (mosi);
+			chip.spi = SPI_IGNORE;
+		}
+		break;
+	case SPI_WRITE:
+		write_register (chip.spi_addr++ & 0x3f, mosi);
+		break;
+	case SPI_READ:
+		miso = read_register (chip.spi_addr++ & 0x3f);
+		break;
+	case SPI_FIFO_LOAD:
+		if (chip.fifo_len < FIFO_DEPTH)
+			chip.fifo[chip.fifo_len++] = mosi;
+		else
+			chip.status2 |= AS3911_REG_FIFO_RX_STATUS2_fifo_ovr;
+		break;
+	case SPI_FIFO_READ:
+		if (chip.fifo_pos < chip.fifo_len)
+			miso = chip.fifo[chip.fifo_pos++];
+		else
+			chip.status2 |= AS3911_REG_FIFO_RX_STATUS2_fifo_unf;
+		break;
+	case SPI_TEST:
+		/* test register address followed by data: not modeled */
+		chip.spi = SPI_IGNORE;
+		break;
+	case SPI_IGNORE:
+		break;
+	}
+
+	return miso;
+}
+
+/************************************************************************/
+/* MODEL INTERFACE                                                      */
+/************************************************************************/
+
+void simChipInit (void)
+{
+	uint8_t i;
+
+	chip.spi = SPI_IGNORE;
+	for (i = 0; i < EV_COUNT; ++i)
+		chip.ev[i] = SIM_NEVER;
+	set_default ();
+}
+
+const struct sim_chip_stats *simChipStats (void)
+{
+	static struct sim_chip_stats stats;
+	sim_time_t now = simNow ();
+
+	stats = chip.stats;
+	if (chip.field)
+		stats.field_ns += now - chip.field_since;
+	if (chip.reg[AS3911_REG_OP_CONTROL] & AS3911_REG_OP_CONTROL_en)
+		stats.osc_ns += now - chip.osc_since;
+
+	return &stats;
+}
+
+sim_time_t simChipNextEvent (void)
+{
+	sim_time_t next = SIM_NEVER;
+	uint8_t i;
+
+	for (i = 0; i < EV_COUNT; ++i)
+		if (chip.ev[i] < next)
+			next = chip.ev[i];
+
+	return next;
+}
+
+void simChipRun (sim_time_t now)
+{
+	enum chip_event ev;
+	uint8_t i;
+
+	for (;;) {
+		ev = EV_COUNT;
+		for (i = 0; i < EV_COUNT; ++i)
+			if (chip.ev[i] <= now && (ev == EV_COUNT || chip.ev[i] < chip.ev[ev]))
+				ev = i;
+
+		switch (ev) {
+		case EV_OSC:
+			chip.ev[EV_OSC] = SIM_NEVER;
+			chip.osc_ok = true;
+			raise (AS3911_IRQ_MASK_OSC);
+			update_field ();
+			break;
+		case EV_DCT:
+			dct_done ();
+			break;
+		case EV_TX_END:
+			tx_end ();
+			break;
+		case EV_RXS:
+			rx_start ();
+			break;
+		case EV_RXE:
+			rx_end ();
+			break;
+		case EV_NRE:
+			chip.ev[EV_NRE] = SIM_NEVER;
+			++chip.stats.timeouts;
+			chip.stats.rx_done_at = simNow ();
+			raise (AS3911_IRQ_MASK_NRE);
+			break;
+		case EV_GPE:
+			chip.ev[EV_GPE] = SIM_NEVER;
+			raise (AS3911_IRQ_MASK_GPE);
+			break;
+		case EV_WUT:
+			wakeup_timer ();
+			break;
+		case EV_COUNT:
+			return;
+		}
+	}
+}
@@ -0,0 +1,60 @@
+/*!
+ * \file sim_as3911.h
+ * \brief Register level model of the AS3911 NFC reader IC
+ *
+ * The model sits behind the SPI bus (see sim_spi.c) and drives the INTR pin
+ * of the MCU. It implements the register file, the FIFO, the interrupt
+ * registers, the direct commands the firmware uses, the wake-up timer with
+ * phase/amplitude/capacitance measurements and the ISO14443A bit level
+ * behaviour of the cards placed in the field.
+ */
+
+#ifndef HOST_SIM_AS3911_H
+#define HOST_SIM_AS3911_H
+
+#include "sim.h"
+
+/*! \brief Maximum number of cards known to the model */
+#define SIM_CHIP_MAX_CARDS 128
+
+void simChipInit (void);
+sim_time_t simChipNextEvent (void);
+void simChipRun (sim_time_t now);
+
+/*! \brief SEN line of the chip (true = selected) */
+void simChipSelect (bool selected);
+
+/*! \brief Shifts one byte through the SPI interface, returns MISO */
+uint8_t simChipTransfer (uint8_t mosi);
+
+/*!
+ * \brief Registers an ISO14443A card with a 4, 7 or 10 byte UID
+ * \return Index of the card or -1 if the table is full
+ */
+int simChipAddCard (const uint8_t *uid, uint8_t len);
+
+/*! \brief Moves card \a card into or out of the antenna field */
+void simChipCardPresent (int card, bool present);
+
+/*! \brief True while the reader field is on */
+bool simChipFieldOn (void);
+
+/*! \brief Statistics collected by the chip model */
+struct sim_chip_stats {
+	uint32_t commands;
+	uint32_t frames_tx;
+	uint32_t frames_rx;
+	uint32_t collisions;
+	uint32_t timeouts;              /*!< NRE interrupts */
+	uint32_t wakeup_measurements;
+	uint32_t wakeup_irqs;
+	sim_time_t field_ns;            /*!< time the reader field was on */
+	sim_time_t osc_ns;              /*!< time the oscillator was on */
+	sim_time_t rx_ns;               /*!< time spent receiving frames */
+	sim_time_t rx_done_at;          /*!< end of the last frame received or
+	                                 *   no response timeout */
+};
+
+const struct sim_chip_stats *simChipStats (void);
+
+#endif /* HOST_SIM_AS3911_H */
@@ -0,0 +1,412 @@
+/*!
+ * \file sim_core.c
+ * \brief Virtual CPU of the PsDekor host simulator
+ *
+ * Owns the virtual clock, the global interrupt flag, the PMIC level of the
+ * running code, interrupt dispatch and the sleep controller.
+ *
+ * Firmware loops that spin on a volatile flag without touching hardware
+ * (e.g. in buzzer.c) never give the simulator control. A virtual-time
+ * interval timer detects such stalls and lets time jump to the next event
+ * from the signal handler so the interrupt that ends the loop can run.
+ */
+
+#define _GNU_SOURCE
+
+#include <link.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <asf.h>
+#include "sim.h"
+#include "sim_as3911.h"
+#include "sim_world.h"
+
+/*! \brief Interval of the stall detector (CPU time of the host process) */
+#define SIM_STALL_CHECK_US 20000
+
+static struct {
+	sim_time_t now;
+	sim_time_t end;
+	bool irq_enabled;
+	uint8_t level;          /*!< PMIC level of the running code, 0 = main */
+	uint8_t depth;          /*!< nesting of #simEnter() */
+	bool running;
+
+	uint8_t sleep_mode;
+	bool sleep_enabled;
+	uint64_t sleep_mark;    /*!< dispatch count at #sleep_enable() */
+
+	volatile uint64_t stall_mark;
+
+	sigjmp_buf exit_jmp;
+	const char *exit_reason;
+
+	struct sim_core_stats stats;
+} core;
+
+sim_time_t simNow (void)
+{
+	return core.now;
+}
+
+uint64_t simCpuCyclePs (void)
+{
+	return 1000000000000ULL / simCpuHz ();
+}
+
+const struct sim_core_stats *simCoreStats (void)
+{
+	return &core.stats;
+}
+
+bool simIrqEnabled (void)
+{
+	return core.irq_enabled;
+}
+
+void simSetEndTime (sim_time_t t)
+{
+	core.end = t;
+}
+
+static sim_time_t next_event (void)
+{
+	sim_time_t next = simXmegaNextEvent ();
+	sim_time_t t;
+
+	t = simChipNextEvent ();
+	if (t < next)
+		next = t;
+	t = simWorldNextEvent ();
+	if (t < next)
+		next = t;
+
+	return next;
+}
+
+void simRunUntil (sim_time_t t)
+{
+	sim_time_t next;
+
+	for (;;) {
+		next = next_event ();
+		if (next > t)
+			break;
+		if (next > core.now)
+			core.now = next;
+		simXmegaRun (core.now);
+		simChipRun (core.now);
+		simWorldRun (core.now);
+	}
+
+	if (t > core.now)
+		core.now = t;
+}
+
+void simExit (const char *reason)
+{
+	core.exit_reason = reason;
+	core.running = false;
+	siglongjmp (core.exit_jmp, 1);
+}
+
+static void check_end (void)
+{
+	if (core.now >= core.end)
+		simExit ("time limit reached");
+	if (simWorldFinished ())
+		simExit ("scenario finished");
+}
+
+static void dispatch (void)
+{
+	int irq;
+	uint8_t saved;
+	uint8_t level;
+	void (*handler) (void);
+
+	while (core.irq_enabled && (irq = simXmegaPendingIrq (core.level)) >= 0) {
+		handler = simXmegaAckIrq (irq, &level);
+		if (!handler) {
+			fprintf (stderr, "[sim] no handler for interrupt %s\n",
+			         simXmegaIrqName (irq));
+			simExit ("bad interrupt");
+		}
+
+		++core.stats.dispatches;
+		core.depth++;
+		simRunUntil (core.now + SIM_ISR_CYCLES * simCpuCyclePs () / 1000);
+		core.depth--;
+
+		saved = core.level;
+		core.level = level;
+		handler ();
+		core.level = saved;
+	}
+}
+
+/*
+ * Outside of simRun (set-up, report) accesses neither advance time nor
+ * dispatch interrupts, the run may already have ended.
+ */
+void simEnter (void)
+{
+	++core.stats.accesses;
+	if (core.depth++ == 0 && core.running) {
+		simXmegaCommit ();
+		simRunUntil (core.now + SIM_ACCESS_CYCLES * simCpuCyclePs () / 1000);
+	}
+}
+
+void simLeave (void)
+{
+	if (--core.depth == 0 && core.running) {
+		check_end ();
+		dispatch ();
+	}
+}
+
+void simBusy (sim_time_t duration)
+{
+	simRunUntil (core.now + duration);
+}
+
+/************************************************************************/
+/* INTERRUPT FLAG                                                       */
+/************************************************************************/
+
+void cpu_irq_enable (void)
+{
+	simEnter ();
+	core.irq_enabled = true;
+	simLeave ();
+}
+
+void cpu_irq_disable (void)
+{
+	simEnter ();
+	core.irq_enabled = false;
+	simLeave ();
+}
+
+bool cpu_irq_is_enabled (void)
+{
+	return core.irq_enabled;
+}
+
+irqflags_t cpu_irq_save (void)
+{
+	irqflags_t flags = core.irq_enabled;
+
+	cpu_irq_disable ();
+	return flags;
+}
+
+void cpu_irq_restore (irqflags_t flags)
+{
+	simEnter ();
+	core.irq_enabled = flags;
+	simLeave ();
+}
+
+/************************************************************************/
+/* SLEEP CONTROLLER                                                     */
+/************************************************************************/
+
+void sleep_set_mode (uint8_t mode)
+{
+	core.sleep_mode = mode;
+}
+
+void sleep_enable (void)
+{
+	core.sleep_enabled = true;
+	core.sleep_mark = core.stats.dispatches;
+}
+
+void sleep_disable (void)
+{
+	core.sleep_enabled = false;
+}
+
+void sleep_enter (void)
+{
+	enum sim_sleep_mode mode;
+
+	if (!core.sleep_enabled)
+		return;
+
+	switch (core.sleep_mode) {
+	case SLEEP_SMODE_PSAVE_gc:
+	case SLEEP_SMODE_ESTDBY_gc:
+		mode = SIM_SLEEP_PSAVE;
+		break;
+	case SLEEP_SMODE_PDOWN_gc:
+	case SLEEP_SMODE_STDBY_gc:
+		mode = SIM_SLEEP_PDOWN;
+		break;
+	default:
+		mode = SIM_SLEEP_IDLE;
+		break;
+	}
+
+	simSleep (mode);
+}
+
+void simSleep (enum sim_sleep_mode mode)
+{
+	const char *reason = NULL;
+	sim_time_t start;
+	sim_time_t next;
+
+	simEnter ();
+
+	/* an interrupt that became pending between sleep_enable and sleep_enter
+	 * (typically right at the sei() of the SLEEP_*_LOCKED macros) wakes the
+	 * CPU immediately */
+	if (core.stats.dispatches != core.sleep_mark) {
+		simLeave ();
+		return;
+	}
+
+	start = core.now;
+	++core.stats.sleeps[mode];
+	simXmegaSleep (mode, true);
+
+	while (!core.irq_enabled || simXmegaPendingIrq (core.level) < 0) {
+		next = next_event ();
+		if (next == SIM_NEVER)
+			reason = core.irq_enabled ? "sleeping without wake-up source"
+			                          : "sleeping with interrupts disabled";
+		else if (next >= core.end)
+			reason = "time limit reached";
+		if (reason) {
+			if (next != SIM_NEVER)
+				core.now = core.end;
+			break;
+		}
+		simRunUntil (next);
+		if (simWorldFinished ()) {
+			reason = "scenario finished";
+			break;
+		}
+	}
+
+	simXmegaSleep (mode, false);
+	core.stats.sleep_ns[mode] += core.now - start;
+	if (reason)
+		simExit (reason);
+
+	simLeave ();
+}
+
+/************************************************************************/
+/* STALL DETECTION                                                      */
+/************************************************************************/
+
+static void stall_handler (int sig)
+{
+	sim_time_t next;
+
+	(void) sig;
+
+	if (!core.running || core.depth)
+		return;
+
+	if (core.stall_mark != core.stats.accesses) {
+		core.stall_mark = core.stats.accesses;
+		return;
+	}
+
+	/* No hardware access for a full check interval: the firmware spins on
+	 * memory that only an interrupt can change. */
+	++core.stats.stalls;
+	next = next_event ();
+	if (!core.irq_enabled || next == SIM_NEVER)
+		simExit ("firmware hangs in a loop");
+
+	core.depth++;
+	simRunUntil (next < core.end ? next : core.end);
+	core.depth--;
+	check_end ();
+	dispatch ();
+}
+
+const char *simRun (void (*entry) (void))
+{
+	struct itimerval itv;
+	struct sigaction sa;
+
+	memset (&sa, 0, sizeof sa);
+	sa.sa_handler = stall_handler;
+	sa.sa_flags = SA_NODEFER;
+	sigaction (SIGVTALRM, &sa, NULL);
+
+	if (!core.end)
+		core.end = SIM_NEVER;
+
+	if (sigsetjmp (core.exit_jmp, 1) == 0) {
+		core.running = true;
+		itv.it_interval.tv_sec = 0;
+		itv.it_interval.tv_usec = SIM_STALL_CHECK_US;
+		itv.it_value = itv.it_interval;
+		setitimer (ITIMER_VIRTUAL, &itv, NULL);
+
+		entry ();
+		core.exit_reason = "firmware returned";
+	}
+
+	memset (&itv, 0, sizeof itv);
+	setitimer (ITIMER_VIRTUAL, &itv, NULL);
+	core.running = false;
+	core.depth = 0;
+
+	return core.exit_reason;
+}
+
+/************************************************************************/
+/* CODE ADDRESSES                                                       */
+/************************************************************************/
+
+static int load_bias (struct dl_phdr_info *info, size_t size, void *data)
+{
+	(void) size;
+	*(uintptr_t *) data = info->dlpi_addr;
+	return 1; /* the first object is the executable */
+}
+
+const char *simCodeLocation (const void *caller)
+{
+	static char buf[160];
+	char exe[256];
+	char func[64];
+	char line[64];
+	char cmd[400];
+	uintptr_t bias = 0;
+	ssize_t len;
+	FILE *f;
+
+	snprintf (buf, sizeof buf, "%p", caller);
+
+	len = readlink ("/proc/self/exe", exe, sizeof exe - 1);
+	if (len <= 0)
+		return buf;
+	exe[len] = 0;
+	dl_iterate_phdr (load_bias, &bias);
+
+	/* the return address points behind the call */
+	snprintf (cmd, sizeof cmd, "addr2line -f -s -e '%s' 0x%lx 2>/dev/null", exe,
+	          (unsigned long) ((uintptr_t) caller - bias - 1));
+	f = popen (cmd, "r");
+	if (!f)
+		return buf;
+	if (fscanf (f, "%63s %63s", func, line) == 2 && func[0] != '?')
+		snprintf (buf, sizeof buf, "%s (%s)", func, line);
+	pclose (f);
+
+	return buf;
+}
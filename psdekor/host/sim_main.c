@@ -0,0 +1,600 @@
+/*!
+ * \file sim_main.c
+ * \brief Command line front end of the PsDekor host simulator
+ *
+ * Runs the firmware (main.c is compiled with main renamed to firmware_main)
+ * against the simulated XMEGA, the AS3911 model and a scenario, then prints
+ * where the virtual time and the SPI traffic went.
+ *
+ * The firmware functions listed in WRAPPED_OPS are linked with
+ * -Wl,--wrap so that their calls are accounted as operations without
+ * touching the firmware sources. RfidStartScan and RfidStartScanFast wrap
+ * the static unit1StartScan of Rfid.c.
+ *
+ * The debug traces of the firmware (utils/wait_trace.c, utils/energy.c)
+ * run on the virtual clock; wait callers are resolved with addr2line.
+ */
+
+#include <getopt.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <asf.h>
+#include "ams_types.h"
+#include "sorex_hal/Communication/Rfid.h"
+#include "sorex_hal/Communication/RfidWakeRef.h"
+#include "sorex_hal/Communication/RfidQualify.h"
+#include "sorex_hal/Communication/RfidWakeSchedule.h"
+#include "as3911.h"
+#include "as3911_com.h"
+#include "iso14443a.h"
+#include "logger.h"
+#include "uart.h"
+#include "application/application.h"
+#include "utils/wait_trace.h"
+#include "utils/energy.h"
+#include "utils/event_queue.h"
+#include "sim.h"
+#include "sim_as3911.h"
+#include "sim_world.h"
+
+extern int firmware_main (void);
+
+/************************************************************************/
+/* OPERATION WRAPPERS                                                   */
+/************************************************************************/
+
+#define WRAP(ret, name, params, args)                                   \
+	ret __real_ ## name params;                                     \
+	ret __wrap_ ## name params;                                     \
+	ret __wrap_ ## name params                                      \
+	{                                                               \
+		ret r;                                                  \
+		simOpEnter (#name);                                     \
+		r = __real_ ## name args;                               \
+		simOpLeave ();                                          \
+		return r;                                               \
+	}
+
+#define WRAP_VOID(name)                                                 \
+	void __real_ ## name (void);                                    \
+	void __wrap_ ## name (void);                                    \
+	void __wrap_ ## name (void)                                     \
+	{                                                               \
+		simOpEnter (#name);                                     \
+		__real_ ## name ();                                     \
+		simOpLeave ();                                          \
+	}
+
+WRAP_VOID (MainStateMachine)
+WRAP (Status, RfidInitialize, (UnitId unitId, RfidInitializedCallBack callback),
+      (unitId, callback))
+WRAP (Status, RfidStartScan,
+      (UnitId unitId, byte scanId, RfidScanFinishedCallback callback),
+      (unitId, scanId, callback))
+WRAP (Status, RfidStartScanFast,
+      (UnitId unitId, byte scanId, byte polls, RfidScanFinishedCallback callback),
+      (unitId, scanId, polls, callback))
+WRAP (Status, RfidStartScanPolicy,
+      (UnitId unitId, byte scanId, const struct RfidScanPolicy *policy,
+       RfidScanFinishedCallback callback),
+      (unitId, scanId, policy, callback))
+WRAP (s8, iso14443AInitialize, (void), ())
+WRAP (s8, iso14443ADeinitialize, (u8 keep_on), (keep_on))
+WRAP (s8, iso14443ASelect, (iso14443ACommand_t cmd, iso14443AProximityCard_t *card),
+      (cmd, card))
+WRAP (s8, iso14443ASendHlta, (void), ())
+WRAP (s8, as3911TxNBytes, (const u8 *frame, u16 numbytes, u8 numbits, as3911TxFlag_t flags),
+      (frame, numbytes, numbits, flags))
+/*! \brief Time from the end of a reception to the return of as3911RxNBytes */
+static struct {
+	uint32_t count;
+	sim_time_t total_ns;
+	sim_time_t max_ns;
+} rx_tail;
+
+s8 __real_as3911RxNBytes (u8 *buf, u16 maxlength, u16 *length, u16 timeout_ms);
+s8 __wrap_as3911RxNBytes (u8 *buf, u16 maxlength, u16 *length, u16 timeout_ms);
+s8 __wrap_as3911RxNBytes (u8 *buf, u16 maxlength, u16 *length, u16 timeout_ms)
+{
+	sim_time_t start = simNow ();
+	sim_time_t t;
+	s8 r;
+
+	simOpEnter ("as3911RxNBytes");
+	r = __real_as3911RxNBytes (buf, maxlength, length, timeout_ms);
+	simOpLeave ();
+
+	/* the frame or the no response timeout ended during this call */
+	if (simChipStats ()->rx_done_at >= start) {
+		t = simNow () - simChipStats ()->rx_done_at;
+		++rx_tail.count;
+		rx_tail.total_ns += t;
+		if (t > rx_tail.max_ns)
+			rx_tail.max_ns = t;
+	}
+
+	return r;
+}
+
+WRAP (s8, as3911ReadFifo, (u8 *buf, u8 length), (buf, length))
+WRAP (s8, as3911WriteFifo, (const u8 *values, u8 length), (values, length))
+WRAP (s8, as3911ExecuteCommandAndGetResult, (u8 cmd, u8 resreg, u8 sleeptime, u8 *result),
+      (cmd, resreg, sleeptime, result))
+WRAP (s8, cardmanAddKey, (const u8 *uid, const u8 len), (uid, len))
+WRAP (s8, cardmanDeleteKey, (const u8 *uid, const u8 len), (uid, len))
+WRAP (s8, cardmanDeleteAllKeys, (void), ())
+
+/************************************************************************/
+/* LOGGER                                                               */
+/************************************************************************/
+
+s8 dbgLog (const char *format, ...)
+{
+	char buf[256];
+	va_list ap;
+	char *p;
+
+	va_start (ap, format);
+	vsnprintf (buf, sizeof buf, format, ap);
+	va_end (ap);
+
+	for (p = buf; *p; ++p)
+		uartTxByte (*p);
+
+	return ERR_NONE;
+}
+
+void dbgHexDump (const unsigned char *buffer, u16 length)
+{
+	u16 i;
+
+	for (i = 0; i < length; ++i)
+		dbgLog ("%02x%s", buffer[i], (i % 8 == 7 || i + 1 == length) ? "\n" : " ");
+}
+
+/************************************************************************/
+/* DEBUG TRACES                                                         */
+/************************************************************************/
+
+static trace_time_t trace_clock (void)
+{
+	return (trace_time_t)(simNow () / 1000);
+}
+
+static const char *const state_names[] = {
+	[MSTATE_INITIALIZE] = "INITIALIZE",
+	[MSTATE_PREPARE_WAKE_UP] = "PREPARE_WAKE_UP",
+	[MSTATE_DEEP_SLEEP] = "DEEP_SLEEP",
+	[MSTATE_BACKOFF] = "BACKOFF",
+	[MSTATE_WOKE_UP] = "WOKE_UP",
+	[MSTATE_ENTER_PROGRAMMING_MODE_1] = "ENTER_PROGRAMMING_MODE_1",
+	[MSTATE_ENTER_PROGRAMMING_MODE_2] = "ENTER_PROGRAMMING_MODE_2",
+	[MSTATE_WAIT_PROG_MODE_1] = "WAIT_PROG_MODE_1",
+	[MSTATE_WAIT_PROG_MODE_2] = "WAIT_PROG_MODE_2",
+	[MSTATE_ENTER_SOFTWARE_KEY] = "ENTER_SOFTWARE_KEY",
+	[MSTATE_ENTER_SOFTWARE_RTC] = "ENTER_SOFTWARE_RTC",
+	[MSTATE_ENTER_SOFTWARE_DOOR] = "ENTER_SOFTWARE_DOOR",
+	[MSTATE_FOUND_UNKNOWN_CARD] = "FOUND_UNKNOWN_CARD",
+	[MSTATE_EXIT_PROG_OR_LEARN_MODE] = "EXIT_PROG_OR_LEARN_MODE",
+	[MSTATE_ENTER_LEARN_MODE] = "ENTER_LEARN_MODE",
+	[MSTATE_WAIT_LEARN_MODE] = "WAIT_LEARN_MODE",
+	[MSTATE_ERROR_SET_PROG_CARD_FAILED] = "ERROR_SET_PROG_CARD_FAILED",
+	[MSTATE_ERROR_MULTIPLE_CARDS] = "ERROR_MULTIPLE_CARDS",
+};
+
+static const char *const wait_kinds[WAIT_KIND_COUNT] = {
+	[WAIT_KIND_DELAY] = "delay",
+	[WAIT_KIND_DELAY_POLL] = "poll",
+	[WAIT_KIND_TIMER] = "timer",
+};
+
+static const char *state_name (unsigned state)
+{
+	static char buf[16];
+
+	if (state == WAIT_TRACE_STATE_NONE)
+		return "(start-up)";
+	if (state < sizeof state_names / sizeof state_names[0] && state_names[state])
+		return state_names[state];
+	snprintf (buf, sizeof buf, "%u", state);
+	return buf;
+}
+
+static void report_waits (void)
+{
+	const struct wait_trace_entry *e;
+	const struct wait_trace_state *st;
+	u8 count;
+	unsigned i;
+
+	e = waitTraceEntries (&count);
+	printf ("\n%-26s %-6s %-42s %6s %12s %12s %10s\n", "wait in state", "kind",
+	        "caller", "count", "requested ms", "actual ms", "max ms");
+	for (i = 0; i < count; ++i, ++e) {
+		printf ("%-26s %-6s %-50s %6u %12.3f %12.3f %10.3f\n",
+		        state_name (e->state), wait_kinds[e->kind], simCodeLocation (e->caller),
+		        e->count, e->requested_us / 1e3, e->actual_us / 1e3,
+		        e->max_actual_us / 1e3);
+	}
+
+	st = waitTraceStates ();
+	printf ("\n%-26s %6s %12s %12s %10s %11s\n", "state", "calls", "total ms",
+	        "waiting ms", "max ms", "over budget");
+	for (i = 0; i < WAIT_TRACE_STATES; ++i, ++st) {
+		if (!st->count)
+			continue;
+		printf ("%-26s %6u %12.3f %12.3f %10.3f %11u\n", state_name (i),
+		        st->count, st->total_us / 1e3, st->wait_us / 1e3,
+		        st->max_us / 1e3, st->over_budget);
+	}
+}
+
+static double uah (energy_charge_t charge)
+{
+	return (double) charge / ENERGY_PC_PER_UAH;
+}
+
+static void report_bucket (const char *name, const struct energy_bucket *b)
+{
+	printf ("%-26s %12.3f %12.3f\n", name, b->time_us / 1e3, uah (b->charge));
+}
+
+static void report_energy (void)
+{
+	static const char *const modes[ENERGY_MODE_COUNT] = {
+		"active", "idle", "power-save", "power-down"
+	};
+	static const char *const loads[ENERGY_LOAD_COUNT] = {
+		"AS3911 ready", "RF field", "motor", "buzzer", "32 MHz oscillator"
+	};
+	const struct energy_summary *sum = energySummary ();
+	unsigned i;
+
+	printf ("\n%-26s %12s %12s\n", "energy", "time ms", "uAh");
+	for (i = 0; i < ENERGY_STATES; ++i) {
+		if (sum->state[i].time_us)
+			report_bucket (state_name (i), &sum->state[i]);
+	}
+	for (i = 0; i < ENERGY_MODE_COUNT; ++i)
+		report_bucket (modes[i], &sum->mode[i]);
+	for (i = 0; i < ENERGY_LOAD_COUNT; ++i)
+		report_bucket (loads[i], &sum->load[i]);
+	report_bucket ("at 32 MHz (base)", &sum->fast);
+	report_bucket ("total", &sum->total);
+
+	printf ("  %u wake-up cycles, last %.3f uAh, max %.3f uAh",
+	        sum->cycles, uah (sum->last_cycle), uah (sum->max_cycle));
+	if (sum->cycles)
+		printf (", mean %.3f uAh", uah (sum->total.charge) / sum->cycles);
+	printf ("\n");
+	if (sum->total.time_us)
+		printf ("  %.1f uAh per day at this rate\n",
+		        uah (sum->total.charge) * 86400e6 / sum->total.time_us);
+}
+
+/************************************************************************/
+/* BUILT-IN SCENARIOS                                                   */
+/************************************************************************/
+
+#define CARDS \
+	"card prog 04a1b2c3\n" \
+	"card key  04112233445566\n" \
+	"card other 08deadbe\n"
+
+#define LEARN \
+	"6000 mark learn programming card\n" \
+	"6000 learn-press\n" \
+	"6100 learn-release\n" \
+	"7000 card-enter prog\n" \
+	"8000 card-leave prog\n"
+
+#define ENROLL \
+	"14000 mark enroll key card\n" \
+	"14000 card-enter prog\n" \
+	"15000 card-leave prog\n" \
+	"16000 card-enter key\n" \
+	"17000 card-leave key\n"
+
+#define UNLOCK \
+	"30000 mark unlock\n" \
+	"30000 card-enter key\n" \
+	"31000 card-leave key\n"
+
+/* More keys than the log fits behind the pages of a version 1 database */
+#define KEY_CARDS \
+	"card k01 04010000000001\n" "card k02 04010000000002\n" \
+	"card k03 04010000000003\n" "card k04 04010000000004\n" \
+	"card k05 04010000000005\n" "card k06 04010000000006\n" \
+	"card k07 04010000000007\n" "card k08 04010000000008\n" \
+	"card k09 04010000000009\n" "card k10 0401000000000a\n" \
+	"card k11 0401000000000b\n" "card k12 0401000000000c\n" \
+	"card k13 0401000000000d\n" "card k14 0401000000000e\n" \
+	"card k15 0401000000000f\n" "card k16 04010000000010\n" \
+	"card k17 04010000000011\n" "card k18 04010000000012\n" \
+	"card k19 04010000000013\n"
+
+/* Programming card at s seconds, the key card two seconds later */
+#define ENROLL_KEY(card, s, k) \
+	s "000 card-enter prog\n" s "800 card-leave prog\n" \
+	k "000 card-enter " card "\n" k "800 card-leave " card "\n"
+
+#define ENROLL_KEYS \
+	"20000 mark enroll 19 more keys\n" \
+	ENROLL_KEY ("k01", "20", "22") ENROLL_KEY ("k02", "24", "26") \
+	ENROLL_KEY ("k03", "28", "30") ENROLL_KEY ("k04", "32", "34") \
+	ENROLL_KEY ("k05", "36", "38") ENROLL_KEY ("k06", "40", "42") \
+	ENROLL_KEY ("k07", "44", "46") ENROLL_KEY ("k08", "48", "50") \
+	ENROLL_KEY ("k09", "52", "54") ENROLL_KEY ("k10", "56", "58") \
+	ENROLL_KEY ("k11", "60", "62") ENROLL_KEY ("k12", "64", "66") \
+	ENROLL_KEY ("k13", "68", "70") ENROLL_KEY ("k14", "72", "74") \
+	ENROLL_KEY ("k15", "76", "78") ENROLL_KEY ("k16", "80", "82") \
+	ENROLL_KEY ("k17", "84", "86") ENROLL_KEY ("k18", "88", "90") \
+	ENROLL_KEY ("k19", "92", "94")
+
+static const struct {
+	const char *name;
+	const char *help;
+	const char *script;
+} scenarios[] = {
+	{ "boot", "power up, initialise and enter deep sleep",
+	  CARDS "10000 end\n" },
+	{ "learn", "set the programming card with the learn button",
+	  CARDS LEARN "12000 end\n" },
+	{ "enroll", "learn, then add a key card with the programming card",
+	  CARDS LEARN ENROLL "25000 end\n" },
+	{ "unlock", "learn, enroll and open the lock with the key card",
+	  CARDS LEARN ENROLL UNLOCK "45000 end\n" },
+	{ "stranger", "an unknown card wakes the reader without opening the lock",
+	  CARDS "6000 card-enter other\n" "7000 card-leave other\n" "15000 end\n" },
+	{ "timers", "the door timer expires right before learn mode arms its busy-polled timeout",
+	  CARDS "6000 learn-press\n" "6001 door-open\n" "6100 learn-release\n" "12000 end\n" },
+	{ "keys", "learn and enroll 20 key cards, keep the database with -e",
+	  CARDS KEY_CARDS LEARN ENROLL ENROLL_KEYS "100000 end\n" },
+	{ "power-cut", "lose power while the card database is set up (-e)",
+	  CARDS "80 power-off\n" },
+	{ "open", "open the lock with the key card of a kept database (-e)",
+	  CARDS "6000 mark unlock\n" "6000 card-enter key\n" "7000 card-leave key\n"
+	  "15000 end\n" },
+};
+
+#define NUM_SCENARIOS (sizeof scenarios / sizeof scenarios[0])
+
+/************************************************************************/
+/* REPORT                                                               */
+/************************************************************************/
+
+static double ms (sim_time_t t)
+{
+	return t / 1e6;
+}
+
+static void report (const char *reason)
+{
+	const struct sim_core_stats *core = simCoreStats ();
+	const struct sim_chip_stats *chip = simChipStats ();
+	const struct sim_eeprom_stats *ee = simEepromStats ();
+	const struct sim_flash_stats *flash = simFlashStats ();
+	const struct sim_world_stats *world = simWorldStats ();
+	const struct RfidWakeRefStats *wake_ref = RfidWakeRefGetStats ();
+	const struct RfidWakeScheduleStats *sched = RfidWakeScheduleGetStats ();
+	const struct event_queue_stats *events = eventQueueGetStats ();
+	const struct sim_op_stats *ops;
+	unsigned num_ops;
+	unsigned writes = 0;
+	unsigned erases = 0;
+	unsigned max_writes = 0;
+	unsigned i;
+
+	printf ("\n==== %s after %.3f ms\n", reason, ms (simNow ()));
+
+	printf ("\nCPU: %llu accesses, %llu interrupts, %llu stalls\n",
+	        (unsigned long long) core->accesses,
+	        (unsigned long long) core->dispatches,
+	        (unsigned long long) core->stalls);
+	printf ("  idle   %6llu x %12.3f ms\n",
+	        (unsigned long long) core->sleeps[SIM_SLEEP_IDLE], ms (core->sleep_ns[SIM_SLEEP_IDLE]));
+	printf ("  psave  %6llu x %12.3f ms\n",
+	        (unsigned long long) core->sleeps[SIM_SLEEP_PSAVE], ms (core->sleep_ns[SIM_SLEEP_PSAVE]));
+	printf ("  pdown  %6llu x %12.3f ms\n",
+	        (unsigned long long) core->sleeps[SIM_SLEEP_PDOWN], ms (core->sleep_ns[SIM_SLEEP_PDOWN]));
+	printf ("RTC: %llu writes, %llu lost while SYNCBUSY\n",
+	        (unsigned long long) simRtcWrites (),
+	        (unsigned long long) simRtcLostWrites ());
+	printf ("UART: %llu characters, %llu sent off the baud rate\n",
+	        (unsigned long long) simUsartChars (),
+	        (unsigned long long) simUsartBadChars ());
+
+	ops = simOpStats (&num_ops);
+	printf ("\n%-34s %7s %8s %9s %12s %12s %12s\n", "operation", "calls",
+	        "SEN", "SPI bytes", "SPI bus ms", "total ms", "max ms");
+	for (i = 0; i < num_ops; ++i) {
+		if (!ops[i].calls)
+			continue;
+		printf ("%-34s %7u %8llu %9llu %12.3f %12.3f %12.3f\n", ops[i].name,
+		        ops[i].calls, (unsigned long long) ops[i].transactions,
+		        (unsigned long long) ops[i].bytes, ms (ops[i].bus_ns),
+		        ms (ops[i].total_ns), ms (ops[i].max_ns));
+	}
+
+	printf ("\nAS3911: %u commands, %u frames sent, %u received, %u collisions, "
+	        "%u timeouts\n", chip->commands, chip->frames_tx, chip->frames_rx,
+	        chip->collisions, chip->timeouts);
+	printf ("  wake-up: %u measurements, %u interrupts\n",
+	        chip->wakeup_measurements, chip->wakeup_irqs);
+	printf ("  field on %.3f ms, oscillator on %.3f ms, receiving %.3f ms\n",
+	        ms (chip->field_ns), ms (chip->osc_ns), ms (chip->rx_ns));
+	if (rx_tail.count)
+		printf ("  end of reception to return of as3911RxNBytes: %u x, "
+		        "mean %.3f ms, max %.3f ms\n", rx_tail.count,
+		        ms (rx_tail.total_ns) / rx_tail.count, ms (rx_tail.max_ns));
+#ifdef CONF_AS3911_SHADOW_REGS
+	printf ("  shadow registers: %lu read hits, %lu writes skipped\n",
+	        (unsigned long) as3911ShadowGetStats ()->readHits,
+	        (unsigned long) as3911ShadowGetStats ()->writesSkipped);
+#endif
+#ifdef CONF_SPI_ASYNC
+	printf ("  SPI interrupt transfers: %u, %llu bytes, %.3f ms, "
+	        "%.3f ms in the interrupt\n", simSpiAsyncStats ()->transfers,
+	        (unsigned long long) simSpiAsyncStats ()->bytes,
+	        ms (simSpiAsyncStats ()->transfer_ns),
+	        ms (simSpiAsyncStats ()->isr_ns));
+#endif
+	for (i = 0; i < RFID_POLICY_CLASSES; ++i) {
+		const struct RfidPolicyStats *policy = RfidPolicyGetStats (i);
+
+		if (policy->Scans)
+			printf ("  %s wake-up scans: %u, hits %u, gave up %u\n",
+			        i == RfidPolicyStrong ? "strong" : "marginal",
+			        policy->Scans, policy->Hits, policy->GaveUp);
+	}
+	printf ("  wake-up qualification: %u card, %u unsure, %u settled, %u hand\n",
+	        RfidQualifyGetStats (RfidQualifyCard),
+	        RfidQualifyGetStats (RfidQualifyUnsure),
+	        RfidQualifyGetStats (RfidQualifySettled),
+	        RfidQualifyGetStats (RfidQualifyHand));
+	printf ("  wake-up reference: %u re-arms, %u measured, %u wake-ups, "
+	        "%u false (%.1f per day), %u card taken away\n", wake_ref->Arms,
+	        wake_ref->Measurements, wake_ref->Wakes, wake_ref->FalseWakes,
+	        wake_ref->FalseWakes * 86400e9 / simNow (), wake_ref->CardLeft);
+	printf ("  wake-up schedule: quiet/normal/busy %u/%u/%u slots, "
+	        "%u/%u/%u re-arms, %u cards\n", sched->Slots[RfidWakeQuiet],
+	        sched->Slots[RfidWakeNormal], sched->Slots[RfidWakeBusy],
+	        sched->Arms[RfidWakeQuiet], sched->Arms[RfidWakeNormal],
+	        sched->Arms[RfidWakeBusy], sched->Cards);
+
+	for (i = 0; i < SIM_EEPROM_PAGES; ++i) {
+		writes += ee->page_writes[i];
+		erases += ee->page_erases[i];
+		if (ee->page_writes[i] > max_writes)
+			max_writes = ee->page_writes[i];
+	}
+	printf ("\nEEPROM: %u page writes, %u page erases, max %u writes per page, "
+	        "busy %.3f ms\n", writes, erases, max_writes, ms (ee->busy_ns));
+	if (flash->page_writes || flash->bytes_read)
+		printf ("Flash: %u page writes, %u page erases, %llu bytes read, "
+		        "busy %.3f ms\n", flash->page_writes, flash->page_erases,
+		        (unsigned long long) flash->bytes_read, ms (flash->busy_ns));
+
+	printf ("\nEvents: %u posted, %u dropped, at most %u queued\n",
+	        events->posted, events->dropped, events->peak);
+
+	printf ("\nLock: opened %u times, closed %u times, motor on %.3f ms\n",
+	        world->lock_opened, world->lock_closed, ms (world->motor_ns));
+	for (i = 0; i < world->latencies; ++i)
+		printf ("  card to open lock: %.3f ms\n", ms (world->latency[i]));
+
+	report_waits ();
+	report_energy ();
+}
+
+/************************************************************************/
+/* MAIN                                                                 */
+/************************************************************************/
+
+static void usage (const char *prog)
+{
+	unsigned i;
+
+	fprintf (stderr,
+	         "usage: %s [-v] [-s scenario | -f script] [-t seconds] [-e eeprom]\n"
+	         "       [-F flash]\n"
+	         "  -v  print the firmware log and scenario events\n"
+	         "  -s  run a built-in scenario (default: unlock)\n"
+	         "  -f  run a scenario file (see sim_world.h)\n"
+	         "  -t  limit the run to this many seconds of virtual time\n"
+	         "  -e  load the EEPROM from this file and save it after the run\n"
+	         "  -F  load the application table section of the flash from this\n"
+	         "      file and save it after the run\n"
+	         "scenarios:\n", prog);
+	for (i = 0; i < NUM_SCENARIOS; ++i)
+		fprintf (stderr, "  %-10s %s\n", scenarios[i].name, scenarios[i].help);
+}
+
+static void run_firmware (void)
+{
+	firmware_main ();
+}
+
+int main (int argc, char **argv)
+{
+	const char *scenario = "unlock";
+	const char *script = NULL;
+	const char *eeprom = NULL;
+	const char *flash = NULL;
+	const char *reason;
+	double seconds = 120;
+	bool verbose = false;
+	unsigned i;
+	int c;
+
+	while ((c = getopt (argc, argv, "vs:f:t:e:F:h")) != -1) {
+		switch (c) {
+		case 'v':
+			verbose = true;
+			break;
+		case 's':
+			scenario = optarg;
+			break;
+		case 'f':
+			script = optarg;
+			break;
+		case 't':
+			seconds = atof (optarg);
+			break;
+		case 'e':
+			eeprom = optarg;
+			break;
+		case 'F':
+			flash = optarg;
+			break;
+		default:
+			usage (argv[0]);
+			return c == 'h' ? 0 : 2;
+		}
+	}
+
+	simXmegaInit ();
+	simChipInit ();
+
+	if (script) {
+		if (!simWorldLoadScript (script))
+			return 1;
+	} else {
+		for (i = 0; i < NUM_SCENARIOS; ++i)
+			if (!strcmp (scenarios[i].name, scenario))
+				break;
+		if (i == NUM_SCENARIOS) {
+			usage (argv[0]);
+			return 2;
+		}
+		if (!simWorldLoadScriptText (scenarios[i].name, scenarios[i].script))
+			return 1;
+	}
+
+	simWorldSetVerbose (verbose);
+	simWorldInit ();
+
+	if (eeprom && !simEepromLoad (eeprom))
+		fprintf (stderr, "[sim] starting with an erased EEPROM\n");
+	if (flash && !simFlashLoad (flash))
+		fprintf (stderr, "[sim] starting with an erased flash\n");
+
+	traceClockSet (trace_clock);
+	simSetEndTime (SIM_NS (seconds * 1e9));
+	reason = simRun (run_firmware);
+
+	report (reason);
+
+	if (eeprom && !simEepromSave (eeprom)) {
+		perror (eeprom);
+		return 1;
+	}
+	if (flash && !simFlashSave (flash)) {
+		perror (flash);
+		return 1;
+	}
+
+	return 0;
+}
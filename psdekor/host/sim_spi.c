@@ -0,0 +1,400 @@
+/*!
+ * \file sim_spi.c
+ * \brief Host replacement of as3911/hal/spi_driver.c
+ *
+ * Implements the spi_driver.h interface on top of the AS3911 model. Every
+ * byte costs the SPI clock time plus the CPU cycles of the polling loop of
+ * the original driver. Like the original driver the SPI clock divider (2 to
+ * 128) is chosen for the clock of #clkGetCpuHz when the interface is set up
+ * and by #spiClockChanged; the bus time is that divider at the current CPU
+ * clock. Bytes, SEN activations and bus time are accounted to the firmware
+ * operations marked with #simOpEnter()/#simOpLeave().
+ *
+ * With CONF_SPI_ASYNC the interrupt driven transfers of spiTxRxStart are
+ * modelled byte by byte: the SPI interrupt is raised when a byte has been
+ * shifted, its handler (the one of the original driver, here #simSpiIsr())
+ * costs #SPI_ISR_CYCLES and writes the next byte.
+ */
+
+#include <string.h>
+
+#include <asf.h>
+#include "ams_types.h"
+#include "errno.h"
+#include "spi_driver.h"
+#include "clock.h"
+#include "platform.h"
+#include "sim.h"
+#include "sim_as3911.h"
+
+/*! \brief CPU cycles of spi_put/spi_is_rx_full/spi_get per byte */
+#define SPI_LOOP_CYCLES 14
+
+/*! \brief CPU cycles of the SPI interrupt handler (pushes, body, pops) */
+#define SPI_ISR_CYCLES 48
+
+static struct spiConfig current_config = {
+	.spi_dev = NULL
+};
+
+/*! \brief Programmed SPI clock divider */
+static uint8_t spi_div = 2;
+
+/************************************************************************/
+/* OPERATION ACCOUNTING                                                 */
+/************************************************************************/
+
+#define OP_STACK_DEPTH 16
+
+static struct {
+	struct sim_op_stats ops[SIM_MAX_OPS];
+	unsigned num_ops;
+	bool active[SIM_MAX_OPS];
+	struct {
+		unsigned op;
+		bool counted;   /*!< false for recursive entries */
+		sim_time_t start;
+	} stack[OP_STACK_DEPTH];
+	unsigned depth;
+} acct = {
+	.ops = { { .name = "(whole run)" } },
+	.num_ops = 1,
+};
+
+static unsigned find_op (const char *name)
+{
+	unsigned i;
+
+	for (i = 1; i < acct.num_ops; ++i)
+		if (acct.ops[i].name == name || !strcmp (acct.ops[i].name, name))
+			return i;
+
+	if (acct.num_ops == SIM_MAX_OPS)
+		return 0;
+
+	acct.ops[acct.num_ops].name = name;
+	return acct.num_ops++;
+}
+
+void simOpEnter (const char *name)
+{
+	unsigned op = find_op (name);
+
+	if (acct.depth == OP_STACK_DEPTH) {
+		fprintf (stderr, "[sim] operations nested too deep\n");
+		simExit ("internal error");
+	}
+
+	acct.stack[acct.depth].op = op;
+	acct.stack[acct.depth].counted = op && !acct.active[op];
+	acct.stack[acct.depth].start = simNow ();
+	if (acct.stack[acct.depth].counted) {
+		acct.active[op] = true;
+		++acct.ops[op].calls;
+	}
+	++acct.depth;
+}
+
+void simOpLeave (void)
+{
+	sim_time_t t;
+	unsigned op;
+
+	if (!acct.depth)
+		return;
+
+	--acct.depth;
+	if (!acct.stack[acct.depth].counted)
+		return;
+
+	op = acct.stack[acct.depth].op;
+	t = simNow () - acct.stack[acct.depth].start;
+	acct.active[op] = false;
+	acct.ops[op].total_ns += t;
+	if (t > acct.ops[op].max_ns)
+		acct.ops[op].max_ns = t;
+}
+
+static void account (uint64_t transactions, uint64_t bytes, sim_time_t bus_ns)
+{
+	unsigned i;
+
+	for (i = 0; i < acct.num_ops; ++i) {
+		if (i && !acct.active[i])
+			continue;
+		acct.ops[i].transactions += transactions;
+		acct.ops[i].bytes += bytes;
+		acct.ops[i].bus_ns += bus_ns;
+	}
+}
+
+const struct sim_op_stats *simOpStats (unsigned *count)
+{
+	acct.ops[0].calls = 1;
+	acct.ops[0].total_ns = simNow ();
+	acct.ops[0].max_ns = simNow ();
+	*count = acct.num_ops;
+	return acct.ops;
+}
+
+void simOpReset (void)
+{
+	unsigned i;
+
+	for (i = 0; i < acct.num_ops; ++i) {
+		acct.ops[i].calls = 0;
+		acct.ops[i].transactions = 0;
+		acct.ops[i].bytes = 0;
+		acct.ops[i].bus_ns = 0;
+		acct.ops[i].total_ns = 0;
+		acct.ops[i].max_ns = 0;
+	}
+}
+
+/************************************************************************/
+/* SPI DRIVER                                                           */
+/************************************************************************/
+
+/*! \brief Smallest divider that doesn't exceed the configured baud rate */
+static void set_clock (uint32_t per_hz)
+{
+	spi_div = 2;
+	while (spi_div < 128 && per_hz / spi_div > current_config.baudrate)
+		spi_div <<= 1;
+}
+
+s8 spiInitialize (const spiConfig_t *config)
+{
+	if (unlikely (config == NULL) || unlikely (config->spi_dev == NULL))
+		return ERR_PARAM;
+
+	current_config = *config;
+	current_config.needs_reinit = false;
+	set_clock (clkGetCpuHz ());
+
+	return ERR_NONE;
+}
+
+s8 spiReinitialize (void)
+{
+	if (unlikely (current_config.spi_dev == NULL))
+		return ERR_REQUEST;
+
+	if (current_config.needs_reinit)
+		set_clock (clkGetCpuHz ());
+	current_config.needs_reinit = false;
+	return ERR_NONE;
+}
+
+s8 spiClockChanged (u32 per_hz)
+{
+	if (unlikely (current_config.spi_dev == NULL))
+		return ERR_REQUEST;
+
+	if (!current_config.needs_reinit)
+		set_clock (per_hz);
+	return ERR_NONE;
+}
+
+s8 spiPause (void)
+{
+	if (unlikely (current_config.spi_dev == NULL))
+		return ERR_REQUEST;
+
+	current_config.needs_reinit = true;
+	return ERR_NONE;
+}
+
+s8 spiDeinitialize (void)
+{
+	if (unlikely (current_config.spi_dev == NULL))
+		return ERR_REQUEST;
+
+	current_config.spi_dev = NULL;
+	return ERR_NONE;
+}
+
+/*! \brief State of the transfer started by spiTxRxStart */
+static struct {
+	const u8 *tx;
+	u8 *rx;
+	u16 remaining;
+	u16 length;
+	volatile bool busy;
+	bool flag;              /*!< SPI interrupt flag */
+	u8 data;                /*!< byte received by the running shift */
+	sim_time_t shift_end;   /*!< end of the running shift or SIM_NEVER */
+	sim_time_t start;
+	sim_time_t bus_ns;
+	struct sim_spi_async_stats stats;
+} async = {
+	.shift_end = SIM_NEVER,
+};
+
+/*! \brief Duration of one byte on the bus including the polling loop */
+static sim_time_t byte_time (sim_time_t *bus_ns)
+{
+	*bus_ns = 8ULL * spi_div * 1000000000ULL / simCpuHz ();
+	return *bus_ns + SPI_LOOP_CYCLES * simCpuCyclePs () / 1000;
+}
+
+s8 spiTxRx (const u8 *txData, u8 *rxData, u16 length)
+{
+	sim_time_t bus_ns;
+	sim_time_t bus_total = 0;
+	u8 tmp;
+	u16 i;
+
+	if (unlikely (txData == NULL) || unlikely (length == 0))
+		return ERR_PARAM;
+
+	if (unlikely (current_config.spi_dev == NULL))
+		return ERR_REQUEST;
+
+	if (unlikely (async.busy))
+		return ERR_BUSY;
+
+	for (i = 0; i < length; ++i) {
+		simEnter ();
+		simBusy (byte_time (&bus_ns));
+		tmp = simChipTransfer (txData[i]);
+		simLeave ();
+
+		bus_total += bus_ns;
+		if (rxData != NULL)
+			rxData[i] = tmp;
+	}
+
+	account (0, length, bus_total);
+
+	return ERR_NONE;
+}
+
+/*! \brief Writes \a byte to DATA, which starts shifting it */
+static void async_shift (u8 byte)
+{
+	sim_time_t bus_ns;
+
+	byte_time (&bus_ns);
+	async.data = simChipTransfer (byte);
+	async.shift_end = simNow () + bus_ns;
+	async.bus_ns += bus_ns;
+}
+
+#ifdef CONF_SPI_ASYNC
+s8 spiTxRxStart (const u8 *txData, u8 *rxData, u16 length)
+{
+	sim_time_t bus_ns;
+
+	if (async.busy)
+		return ERR_BUSY;
+
+	/* the interrupt only pays off if a byte takes long enough */
+	byte_time (&bus_ns);
+	if ((length < SPI_ASYNC_MIN_LENGTH) ||
+	    (bus_ns * 1000 < SPI_ASYNC_MIN_BYTE_CYCLES * simCpuCyclePs ()) ||
+	    !cpu_irq_is_enabled ())
+		return spiTxRx (txData, rxData, length);
+
+	if (unlikely (txData == NULL))
+		return ERR_PARAM;
+
+	if (unlikely (current_config.spi_dev == NULL))
+		return ERR_REQUEST;
+
+	async.tx = txData + 1;
+	async.rx = rxData;
+	async.remaining = length;
+	async.length = length;
+	async.busy = true;
+	async.bus_ns = 0;
+
+	simEnter ();
+	async.start = simNow ();
+	async_shift (txData[0]);
+	simLeave ();
+
+	return ERR_NONE;
+}
+
+void spiTxRxWait (void)
+{
+	if (!async.busy)
+		return;
+
+	cpu_irq_disable ();
+	while (async.busy) {
+		SLEEP_CPU_LOCKED ();
+		cpu_irq_disable ();
+	}
+	cpu_irq_enable ();
+}
+#endif /* CONF_SPI_ASYNC */
+
+sim_time_t simSpiNextEvent (void)
+{
+	return async.shift_end;
+}
+
+void simSpiRun (sim_time_t now)
+{
+	if (async.shift_end <= now) {
+		async.shift_end = SIM_NEVER;
+		async.flag = true;
+	}
+}
+
+bool simSpiIrqPending (void)
+{
+	return async.flag;
+}
+
+void simSpiIsr (void)
+{
+	sim_time_t start = simNow ();
+
+	async.flag = false;
+	++async.stats.interrupts;
+
+	simEnter ();
+	simBusy (SPI_ISR_CYCLES * simCpuCyclePs () / 1000);
+	if (async.rx != NULL)
+		*async.rx++ = async.data;
+	if (--async.remaining)
+		async_shift (*async.tx++);
+	async.stats.isr_ns += simNow () - start;
+	simLeave ();
+
+	if (async.remaining)
+		return;
+
+	account (0, async.length, async.bus_ns);
+	++async.stats.transfers;
+	async.stats.bytes += async.length;
+	async.stats.transfer_ns += simNow () - async.start;
+	async.busy = false;
+}
+
+const struct sim_spi_async_stats *simSpiAsyncStats (void)
+{
+	return &async.stats;
+}
+
+void spiActivateSEN (void)
+{
+	if (unlikely (current_config.spi_dev == NULL))
+		return;
+
+	ioport_set_pin_level (current_config.sen, current_config.invert_sen ? 0 : 1);
+	simChipSelect (true);
+	account (1, 0, 0);
+}
+
+void spiDeactivateSEN (void)
+{
+	if (unlikely (current_config.spi_dev == NULL))
+		return;
+
+	ioport_set_pin_level (current_config.sen, current_config.invert_sen ? 1 : 0);
+	simChipSelect (false);
+}
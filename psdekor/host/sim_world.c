@@ -0,0 +1,574 @@
+/*!
+ * \file sim_world.c
+ * \brief Environment of the simulated locker
+ *
+ * The lock is modelled as a cam driven by the motor: every
+ * #LOCK_HALF_TURN_NS of motor run time it toggles between closed and open.
+ * While it is open the lock switch pulls SW_LOCK_CLOSED to ground. All
+ * other switches (learn button, door switches) are closing to ground too.
+ */
+
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <asf.h>
+#include "sim.h"
+#include "sim_as3911.h"
+#include "sim_world.h"
+
+/*! \brief Motor run time for moving the lock from closed to open (and back) */
+#define LOCK_HALF_TURN_NS   SIM_MS(150)
+
+#define MAX_ACTIONS         2048
+#define MAX_NAME            16
+#define MAX_MARK            48
+
+/* Antenna environment without cards and the shift caused by every card */
+#define ANTENNA_AMPLITUDE   0x70
+#define ANTENNA_PHASE       0x80
+#define ANTENNA_CAPACITANCE 0x40
+#define CARD_AMPLITUDE      (-6)
+#define CARD_PHASE          (-8)
+#define CARD_CAPACITANCE    2
+
+struct action {
+	sim_time_t at;
+	enum sim_action action;
+	int arg;
+	char text[MAX_MARK];
+};
+
+struct card {
+	char name[MAX_NAME];
+	int chip_idx;
+	bool present;
+};
+
+static struct {
+	struct action actions[MAX_ACTIONS];
+	unsigned num_actions;
+	unsigned next_action;
+
+	struct card cards[SIM_CHIP_MAX_CARDS];
+	unsigned num_cards;
+
+	bool finished;
+	bool verbose;
+	uint16_t vcc_mv;
+	int phase;
+	int amplitude;
+	int capacitance;
+	int noise;
+	uint32_t seed;
+
+	bool learn_pressed;
+	bool door_open;
+
+	bool motor_on;
+	sim_time_t motor_since;
+	sim_time_t cam_ns;      /*!< motor run time within the current half turn */
+	bool lock_open;
+
+	sim_time_t card_entered;
+
+	char line[128];
+	unsigned line_len;
+
+	struct sim_world_stats stats;
+} world;
+
+const struct sim_world_stats *simWorldStats (void)
+{
+	return &world.stats;
+}
+
+void simWorldSetVerbose (bool verbose)
+{
+	world.verbose = verbose;
+}
+
+static void log_time (void)
+{
+	sim_time_t now = simNow ();
+
+	printf ("[%5llu.%06llu] ", (unsigned long long) (now / SIM_S(1)),
+	        (unsigned long long) (now % SIM_S(1) / 1000));
+}
+
+/************************************************************************/
+/* SWITCHES AND LOCK                                                    */
+/************************************************************************/
+
+static void drive_switches (void)
+{
+	simPinDrive (SW_LEARN, world.learn_pressed ? 0 : -1);
+	simPinDrive (SW_DOOR_CLOSED, world.door_open ? -1 : 0);
+	simPinDrive (SW_DOOR_OPENED, world.door_open ? 0 : -1);
+	simPinDrive (SW_LOCK_CLOSED, world.lock_open ? 0 : -1);
+}
+
+/*! \brief Accounts the motor run time up to \a now */
+static void run_motor (sim_time_t now)
+{
+	sim_time_t run;
+
+	if (!world.motor_on || now <= world.motor_since)
+		return;
+
+	run = now - world.motor_since;
+	world.motor_since = now;
+	world.stats.motor_ns += run;
+	world.cam_ns += run;
+
+	while (world.cam_ns >= LOCK_HALF_TURN_NS) {
+		world.cam_ns -= LOCK_HALF_TURN_NS;
+		world.lock_open = !world.lock_open;
+		if (world.lock_open) {
+			++world.stats.lock_opened;
+			if (world.card_entered != SIM_NEVER &&
+			    world.stats.latencies < SIM_WORLD_MAX_LATENCIES)
+				world.stats.latency[world.stats.latencies++] =
+					now - world.card_entered;
+			world.card_entered = SIM_NEVER;
+		} else {
+			++world.stats.lock_closed;
+		}
+		if (world.verbose) {
+			log_time ();
+			printf ("[world] lock %s\n", world.lock_open ? "open" : "closed");
+		}
+		simPinDrive (SW_LOCK_CLOSED, world.lock_open ? 0 : -1);
+	}
+}
+
+void simWorldPortChanged (uint8_t port)
+{
+	bool on;
+
+	if (port != MOTOR_PIN / 8)
+		return;
+
+	on = simPinOutput (MOTOR_PIN) == 1;
+	if (on == world.motor_on)
+		return;
+
+	run_motor (simNow ());
+	world.motor_on = on;
+	world.motor_since = simNow ();
+}
+
+/************************************************************************/
+/* SUPPLY, UART AND ANTENNA                                             */
+/************************************************************************/
+
+uint16_t simWorldVccMv (void)
+{
+	return world.vcc_mv;
+}
+
+void simWorldUartTx (uint8_t c)
+{
+	++world.stats.uart_chars;
+
+	if (c == '\r')
+		return;
+	if (c != '\n' && world.line_len < sizeof world.line - 1) {
+		world.line[world.line_len++] = c;
+		return;
+	}
+	if (c != '\n')
+		return;
+
+	world.line[world.line_len] = 0;
+	world.line_len = 0;
+	if (world.verbose) {
+		log_time ();
+		printf ("%s\n", world.line);
+	}
+}
+
+static int noise (void)
+{
+	if (!world.noise)
+		return 0;
+
+	world.seed = world.seed * 1103515245u + 12345u;
+	return (int) ((world.seed >> 16) % (2 * world.noise + 1)) - world.noise;
+}
+
+int simWorldAntenna (enum sim_antenna_value value, uint8_t cards)
+{
+	int v;
+
+	switch (value) {
+	case SIM_ANTENNA_AMPLITUDE:
+		v = world.amplitude + CARD_AMPLITUDE * cards;
+		break;
+	case SIM_ANTENNA_PHASE:
+		v = world.phase + CARD_PHASE * cards;
+		break;
+	default:
+		v = world.capacitance + CARD_CAPACITANCE * cards;
+		break;
+	}
+
+	v += noise ();
+	if (v < 0)
+		v = 0;
+	if (v > 0xff)
+		v = 0xff;
+
+	return v;
+}
+
+/************************************************************************/
+/* SCENARIO                                                             */
+/************************************************************************/
+
+int simWorldAddCard (const char *name, const uint8_t *uid, uint8_t len)
+{
+	struct card *card;
+
+	if (world.num_cards >= SIM_CHIP_MAX_CARDS || simWorldFindCard (name) >= 0)
+		return -1;
+
+	card = &world.cards[world.num_cards];
+	card->chip_idx = simChipAddCard (uid, len);
+	if (card->chip_idx < 0)
+		return -1;
+
+	strncpy (card->name, name, sizeof card->name - 1);
+	card->present = false;
+
+	return world.num_cards++;
+}
+
+int simWorldFindCard (const char *name)
+{
+	unsigned i;
+
+	for (i = 0; i < world.num_cards; ++i)
+		if (!strcmp (world.cards[i].name, name))
+			return i;
+
+	return -1;
+}
+
+static bool schedule (sim_time_t at, enum sim_action action, int arg,
+                      const char *text)
+{
+	struct action *a;
+	unsigned i;
+
+	if (world.num_actions >= MAX_ACTIONS)
+		return false;
+
+	/* keep the list sorted, actions with equal times stay in order */
+	for (i = world.num_actions; i > 0 && world.actions[i - 1].at > at; --i)
+		world.actions[i] = world.actions[i - 1];
+
+	a = &world.actions[i];
+	a->at = at;
+	a->action = action;
+	a->arg = arg;
+	a->text[0] = 0;
+	if (text)
+		strncpy (a->text, text, sizeof a->text - 1);
+	++world.num_actions;
+
+	return true;
+}
+
+bool simWorldSchedule (sim_time_t at, enum sim_action action, int arg)
+{
+	return schedule (at, action, arg, NULL);
+}
+
+static int parse_uid (const char *hex, uint8_t *uid)
+{
+	int len = 0;
+	unsigned v;
+
+	while (hex[0] && hex[1] && len < 10) {
+		if (sscanf (hex, "%2x", &v) != 1)
+			return -1;
+		uid[len++] = v;
+		hex += 2;
+	}
+
+	return hex[0] ? -1 : len;
+}
+
+static const struct {
+	const char *name;
+	enum sim_action action;
+} action_names[] = {
+	{ "card-enter", SIM_ACTION_CARD_ENTER },
+	{ "card-leave", SIM_ACTION_CARD_LEAVE },
+	{ "learn-press", SIM_ACTION_LEARN_PRESS },
+	{ "learn-release", SIM_ACTION_LEARN_RELEASE },
+	{ "door-open", SIM_ACTION_DOOR_OPEN },
+	{ "door-close", SIM_ACTION_DOOR_CLOSE },
+	{ "vcc", SIM_ACTION_VCC },
+	{ "phase", SIM_ACTION_PHASE },
+	{ "amplitude", SIM_ACTION_AMPLITUDE },
+	{ "capacitance", SIM_ACTION_CAPACITANCE },
+	{ "noise", SIM_ACTION_NOISE },
+	{ "mark", SIM_ACTION_MARK },
+	{ "power-off", SIM_ACTION_POWER_OFF },
+	{ "end", SIM_ACTION_END },
+};
+
+static bool parse_line (char *line, const char *path, unsigned lineno)
+{
+	char *tok[3];
+	char *p = line;
+	uint8_t uid[10];
+	unsigned long long ms;
+	int n = 0;
+	int len;
+	int arg = 0;
+	unsigned i;
+
+	if ((p = strchr (line, '#')))
+		*p = 0;
+
+	/* the last token of a mark keeps its spaces */
+	for (p = line; n < 3; ++n) {
+		while (isspace ((unsigned char) *p))
+			++p;
+		if (!*p)
+			break;
+		tok[n] = p;
+		if (n == 2) {
+			++n;
+			break;
+		}
+		while (*p && !isspace ((unsigned char) *p))
+			++p;
+		if (*p)
+			*p++ = 0;
+	}
+	if (n == 3) {
+		for (p = tok[2] + strlen (tok[2]); p > tok[2] && isspace ((unsigned char) p[-1]); )
+			*--p = 0;
+	}
+	if (!n)
+		return true;
+
+	if (!strcmp (tok[0], "card")) {
+		if (n != 3 || (len = parse_uid (tok[2], uid)) < 0 ||
+		    (len != 4 && len != 7 && len != 10)) {
+			fprintf (stderr, "%s:%u: expected: card <name> <4, 7 or 10 byte uid>\n",
+			         path, lineno);
+			return false;
+		}
+		if (simWorldAddCard (tok[1], uid, len) < 0) {
+			fprintf (stderr, "%s:%u: cannot add card %s\n", path, lineno, tok[1]);
+			return false;
+		}
+		return true;
+	}
+
+	if (n < 2 || sscanf (tok[0], "%llu", &ms) != 1) {
+		fprintf (stderr, "%s:%u: expected: <ms> <action> [argument]\n", path, lineno);
+		return false;
+	}
+
+	for (i = 0; i < sizeof action_names / sizeof action_names[0]; ++i)
+		if (!strcmp (tok[1], action_names[i].name))
+			break;
+	if (i == sizeof action_names / sizeof action_names[0]) {
+		fprintf (stderr, "%s:%u: unknown action %s\n", path, lineno, tok[1]);
+		return false;
+	}
+
+	switch (action_names[i].action) {
+	case SIM_ACTION_CARD_ENTER:
+	case SIM_ACTION_CARD_LEAVE:
+		if (n != 3 || (arg = simWorldFindCard (tok[2])) < 0) {
+			fprintf (stderr, "%s:%u: unknown card\n", path, lineno);
+			return false;
+		}
+		break;
+	case SIM_ACTION_VCC:
+	case SIM_ACTION_PHASE:
+	case SIM_ACTION_AMPLITUDE:
+	case SIM_ACTION_CAPACITANCE:
+	case SIM_ACTION_NOISE:
+		if (n != 3) {
+			fprintf (stderr, "%s:%u: %s needs a value\n", path, lineno, tok[1]);
+			return false;
+		}
+		arg = atoi (tok[2]);
+		break;
+	default:
+		break;
+	}
+
+	if (!schedule (SIM_MS(ms), action_names[i].action, arg,
+	               action_names[i].action == SIM_ACTION_MARK && n == 3 ? tok[2] : NULL)) {
+		fprintf (stderr, "%s:%u: too many actions\n", path, lineno);
+		return false;
+	}
+
+	return true;
+}
+
+static bool load_stream (FILE *f, const char *name)
+{
+	char line[256];
+	unsigned lineno = 0;
+	bool ok = true;
+
+	while (ok && fgets (line, sizeof line, f))
+		ok = parse_line (line, name, ++lineno);
+
+	fclose (f);
+	return ok;
+}
+
+bool simWorldLoadScript (const char *path)
+{
+	FILE *f = fopen (path, "r");
+
+	if (!f) {
+		perror (path);
+		return false;
+	}
+
+	return load_stream (f, path);
+}
+
+bool simWorldLoadScriptText (const char *name, const char *text)
+{
+	FILE *f = fmemopen ((void *) text, strlen (text), "r");
+
+	if (!f) {
+		perror (name);
+		return false;
+	}
+
+	return load_stream (f, name);
+}
+
+static void execute (const struct action *a)
+{
+	struct card *card;
+
+	if (world.verbose && a->action != SIM_ACTION_MARK) {
+		log_time ();
+		printf ("[world] %s", action_names[a->action].name);
+		if (a->action == SIM_ACTION_CARD_ENTER || a->action == SIM_ACTION_CARD_LEAVE)
+			printf (" %s", world.cards[a->arg].name);
+		else if (a->action == SIM_ACTION_VCC || a->action == SIM_ACTION_PHASE ||
+		         a->action == SIM_ACTION_AMPLITUDE ||
+		         a->action == SIM_ACTION_CAPACITANCE ||
+		         a->action == SIM_ACTION_NOISE)
+			printf (" %d", a->arg);
+		printf ("\n");
+	}
+
+	switch (a->action) {
+	case SIM_ACTION_CARD_ENTER:
+	case SIM_ACTION_CARD_LEAVE:
+		card = &world.cards[a->arg];
+		card->present = a->action == SIM_ACTION_CARD_ENTER;
+		simChipCardPresent (card->chip_idx, card->present);
+		if (card->present)
+			world.card_entered = simNow ();
+		break;
+	case SIM_ACTION_LEARN_PRESS:
+	case SIM_ACTION_LEARN_RELEASE:
+		world.learn_pressed = a->action == SIM_ACTION_LEARN_PRESS;
+		drive_switches ();
+		break;
+	case SIM_ACTION_DOOR_OPEN:
+	case SIM_ACTION_DOOR_CLOSE:
+		world.door_open = a->action == SIM_ACTION_DOOR_OPEN;
+		drive_switches ();
+		break;
+	case SIM_ACTION_VCC:
+		world.vcc_mv = a->arg;
+		break;
+	case SIM_ACTION_PHASE:
+		world.phase = a->arg;
+		break;
+	case SIM_ACTION_AMPLITUDE:
+		world.amplitude = a->arg;
+		break;
+	case SIM_ACTION_CAPACITANCE:
+		world.capacitance = a->arg;
+		break;
+	case SIM_ACTION_NOISE:
+		world.noise = a->arg;
+		break;
+	case SIM_ACTION_MARK:
+		log_time ();
+		printf ("---- %s\n", a->text);
+		break;
+	case SIM_ACTION_POWER_OFF:
+		simExit ("power off");
+	case SIM_ACTION_END:
+		world.finished = true;
+		break;
+	}
+}
+
+/************************************************************************/
+/* EVENTS                                                               */
+/************************************************************************/
+
+void simWorldInit (void)
+{
+	unsigned i;
+
+	world.vcc_mv = 3000;
+	world.phase = ANTENNA_PHASE;
+	world.amplitude = ANTENNA_AMPLITUDE;
+	world.capacitance = ANTENNA_CAPACITANCE;
+	world.noise = 1;
+	world.seed = 1;
+	world.door_open = false;
+	world.lock_open = false;
+	world.card_entered = SIM_NEVER;
+	world.next_action = 0;
+	world.finished = false;
+	for (i = 0; i < world.num_cards; ++i)
+		world.cards[i].present = false;
+
+	drive_switches ();
+}
+
+sim_time_t simWorldNextEvent (void)
+{
+	sim_time_t next = SIM_NEVER;
+
+	if (world.next_action < world.num_actions)
+		next = world.actions[world.next_action].at;
+
+	if (world.motor_on) {
+		sim_time_t t = world.motor_since + LOCK_HALF_TURN_NS - world.cam_ns;
+		if (t < next)
+			next = t;
+	}
+
+	return next;
+}
+
+void simWorldRun (sim_time_t now)
+{
+	run_motor (now);
+
+	while (!world.finished && world.next_action < world.num_actions &&
+	       world.actions[world.next_action].at <= now)
+		execute (&world.actions[world.next_action++]);
+}
+
+bool simWorldFinished (void)
+{
+	return world.finished;
+}
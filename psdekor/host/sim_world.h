@@ -0,0 +1,112 @@
+/*!
+ * \file sim_world.h
+ * \brief Environment of the simulated locker: cards, buttons, door, lock
+ *
+ * The world drives the switch inputs of the MCU, moves the lock when the
+ * motor runs, supplies VCC and the antenna environment of the AS3911 and
+ * replays a scenario of timed actions (see #simWorldLoadScript()).
+ */
+
+#ifndef HOST_SIM_WORLD_H
+#define HOST_SIM_WORLD_H
+
+#include "sim.h"
+
+/*! \brief Quantities measured by the AS3911 on its antenna */
+enum sim_antenna_value {
+	SIM_ANTENNA_AMPLITUDE,
+	SIM_ANTENNA_PHASE,
+	SIM_ANTENNA_CAPACITANCE
+};
+
+/*! \brief Scenario actions */
+enum sim_action {
+	SIM_ACTION_CARD_ENTER,          /*!< arg: card index */
+	SIM_ACTION_CARD_LEAVE,          /*!< arg: card index */
+	SIM_ACTION_LEARN_PRESS,
+	SIM_ACTION_LEARN_RELEASE,
+	SIM_ACTION_DOOR_OPEN,
+	SIM_ACTION_DOOR_CLOSE,
+	SIM_ACTION_VCC,                 /*!< arg: mV */
+	SIM_ACTION_PHASE,               /*!< arg: antenna phase without cards */
+	SIM_ACTION_AMPLITUDE,           /*!< arg: antenna amplitude without cards */
+	SIM_ACTION_CAPACITANCE,         /*!< arg: antenna capacitance without cards */
+	SIM_ACTION_NOISE,               /*!< arg: measurement noise (LSB) */
+	SIM_ACTION_MARK,                /*!< prints a marker into the log */
+	SIM_ACTION_POWER_OFF,           /*!< ends the run at once, like a power loss */
+	SIM_ACTION_END
+};
+
+void simWorldInit (void);
+sim_time_t simWorldNextEvent (void);
+void simWorldRun (sim_time_t now);
+
+/*! \brief True once the scenario has reached its end action */
+bool simWorldFinished (void);
+
+/*! \brief Called by the port model whenever a pin of port \a port changed */
+void simWorldPortChanged (uint8_t port);
+
+/*! \brief Supply voltage of the MCU and the AS3911 */
+uint16_t simWorldVccMv (void);
+
+/*! \brief Called for every character the firmware sends on its debug UART */
+void simWorldUartTx (uint8_t c);
+
+/*! \brief Measurement of the AS3911 with \a cards cards in the field */
+int simWorldAntenna (enum sim_antenna_value value, uint8_t cards);
+
+/*!
+ * \brief Adds a card to the world
+ * \return Index of the card or -1 on errors
+ */
+int simWorldAddCard (const char *name, const uint8_t *uid, uint8_t len);
+
+/*! \brief Index of the card called \a name, -1 if unknown */
+int simWorldFindCard (const char *name);
+
+/*! \brief Schedules \a action at time \a at */
+bool simWorldSchedule (sim_time_t at, enum sim_action action, int arg);
+
+/*!
+ * \brief Reads a scenario from \a path
+ *
+ * Every line holds one entry, '#' starts a comment:
+ *
+ *     card <name> <uid as hex, e.g. 04a1b2c3>
+ *     <time in ms> card-enter <name>
+ *     <time in ms> card-leave <name>
+ *     <time in ms> learn-press | learn-release
+ *     <time in ms> door-open | door-close
+ *     <time in ms> vcc <mV>
+ *     <time in ms> phase <value>
+ *     <time in ms> amplitude <value>
+ *     <time in ms> capacitance <value>
+ *     <time in ms> noise <LSB>
+ *     <time in ms> mark <text>
+ *     <time in ms> end
+ */
+bool simWorldLoadScript (const char *path);
+
+/*! \brief Same as #simWorldLoadScript() for a script held in memory */
+bool simWorldLoadScriptText (const char *name, const char *text);
+
+/*! \brief Echo the firmware log to stdout */
+void simWorldSetVerbose (bool verbose);
+
+#define SIM_WORLD_MAX_LATENCIES 32
+
+/*! \brief Statistics collected by the world */
+struct sim_world_stats {
+	uint32_t lock_opened;
+	uint32_t lock_closed;
+	sim_time_t motor_ns;
+	uint64_t uart_chars;
+	/*! \brief Time from a card entering the field until the lock opened */
+	sim_time_t latency[SIM_WORLD_MAX_LATENCIES];
+	uint8_t latencies;
+};
+
+const struct sim_world_stats *simWorldStats (void);
+
+#endif /* HOST_SIM_WORLD_H */
@@ -0,0 +1,1766 @@
+/*!
+ * \file sim_xmega.c
+ * \brief ATxmega32A4U peripheral models of the PsDekor host simulator
+ *
+ * Models the peripherals the firmware uses: I/O ports with pin change
+ * interrupts, TCC0/TCC1/TCD1/TCE0, the RTC, the ADC (VCC measurement), the
+ * EEPROM controller, the application table section of the flash, the debug
+ * USART, the system clock and the PMIC, which also dispatches the SPI
+ * interrupt of the interrupt driven transfers modelled in sim_spi.c.
+ *
+ * Register semantics: registers live in plain structs handed out to the
+ * firmware by the sync accessors. Strobe registers (DIRSET, OUTCLR, INTFLAGS,
+ * ...) read back as zero so that any write to them is visible; writes to
+ * other registers are found by comparing against a shadow copy. Writes are
+ * committed at the next hardware access, before virtual time advances.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <asf.h>
+#include "sim.h"
+#include "sim_world.h"
+
+/************************************************************************/
+/* CLOCK / PMIC                                                         */
+/************************************************************************/
+
+#define RC2MHZ_HZ  2000000UL
+#define RC32MHZ_HZ 32000000UL
+#define RC32KHZ_HZ 32768UL
+#define ULP_RTC_HZ 1024UL
+
+static uint32_t cpu_hz = RC2MHZ_HZ;
+static bool rc32m_on;           /*!< 32 MHz RC oscillator enabled (and ready) */
+static uint8_t pmic_levels;
+static enum sim_sleep_mode sleep_mode = SIM_SLEEP_IDLE;
+static bool sleeping;
+
+void pmic_init (void)
+{
+	pmic_levels = 0x07;
+}
+
+uint32_t simCpuHz (void)
+{
+	return cpu_hz;
+}
+
+/************************************************************************/
+/* I/O PORTS                                                            */
+/************************************************************************/
+
+struct port_model {
+	PORT_t reg;
+	uint8_t phys;           /*!< physical pin levels */
+	uint8_t in;             /*!< IN register value (after inversion) */
+	uint8_t flags;          /*!< INT0IF / INT1IF */
+	uint8_t ext_en;         /*!< pins driven by the outside world */
+	uint8_t ext_val;
+};
+
+static struct port_model ports[SIM_PORT_COUNT];
+
+static void port_update (uint8_t idx)
+{
+	struct port_model *p = &ports[idx];
+	PORT_t *r = &p->reg;
+	uint8_t old_dir = r->DIR;
+	uint8_t old_out = r->OUT;
+	uint8_t phys = 0;
+	uint8_t in = 0;
+	uint8_t bm;
+	uint8_t ctrl;
+	uint8_t opc;
+	uint8_t isc;
+	uint8_t changed;
+	uint8_t i;
+	bool level;
+
+	r->DIR = ((r->DIR | r->DIRSET) & ~r->DIRCLR) ^ r->DIRTGL;
+	r->OUT = ((r->OUT | r->OUTSET) & ~r->OUTCLR) ^ r->OUTTGL;
+	r->DIRSET = r->DIRCLR = r->DIRTGL = 0;
+	r->OUTSET = r->OUTCLR = r->OUTTGL = 0;
+	p->flags &= ~r->INTFLAGS;
+	r->INTFLAGS = 0;
+
+	for (i = 0; i < 8; ++i) {
+		bm = 1 << i;
+		ctrl = (&r->PIN0CTRL)[i];
+		opc = (ctrl & PORT_OPC_gm) >> 3;
+
+		if (r->DIR & bm)
+			level = ((r->OUT & bm) != 0) ^ ((ctrl & PORT_INVEN_bm) != 0);
+		else if (p->ext_en & bm)
+			level = (p->ext_val & bm) != 0;
+		else if (opc == 3 || opc == 7)
+			level = true;
+		else if (opc == 2 || opc == 6)
+			level = false;
+		else
+			level = (p->phys & bm) != 0;
+
+		if (level)
+			phys |= bm;
+		if (level ^ ((ctrl & PORT_INVEN_bm) != 0))
+			in |= bm;
+	}
+
+	changed = in ^ p->in;
+	for (i = 0; i < 8 && changed; ++i) {
+		bm = 1 << i;
+		if (!(changed & bm))
+			continue;
+		isc = (&r->PIN0CTRL)[i] & PORT_ISC_gm;
+		/* in power-save/-down only pin 2 of each port senses edges
+		 * asynchronously, all others wake up on both edges or level */
+		if (sleeping && sleep_mode != SIM_SLEEP_IDLE && i != 2 &&
+		    (isc == IOPORT_SENSE_RISING || isc == IOPORT_SENSE_FALLING))
+			continue;
+		if (isc == IOPORT_SENSE_BOTHEDGES ||
+		    (isc == IOPORT_SENSE_RISING && (in & bm)) ||
+		    (isc == IOPORT_SENSE_FALLING && !(in & bm))) {
+			if (r->INT0MASK & bm)
+				p->flags |= PORT_INT0IF_bm;
+			if (r->INT1MASK & bm)
+				p->flags |= PORT_INT1IF_bm;
+		}
+	}
+
+	p->phys = phys;
+	p->in = in;
+	r->IN = in;
+
+	if (old_dir != r->DIR || old_out != r->OUT || changed)
+		simWorldPortChanged (idx);
+}
+
+/*! \brief Interrupt flags of a port including low-level sensed pins */
+static uint8_t port_flags (uint8_t idx)
+{
+	struct port_model *p = &ports[idx];
+	uint8_t flags = p->flags;
+	uint8_t i;
+
+	for (i = 0; i < 8; ++i) {
+		if (((&p->reg.PIN0CTRL)[i] & PORT_ISC_gm) != 3 || (p->in & (1 << i)))
+			continue;
+		if (p->reg.INT0MASK & (1 << i))
+			flags |= PORT_INT0IF_bm;
+		if (p->reg.INT1MASK & (1 << i))
+			flags |= PORT_INT1IF_bm;
+	}
+
+	return flags;
+}
+
+PORT_t *simPortSync (uint8_t port)
+{
+	simEnter ();
+	simLeave ();
+	port_update (port);
+	return &ports[port].reg;
+}
+
+void simPinDrive (uint8_t pin, int level)
+{
+	struct port_model *p = &ports[pin / 8];
+	uint8_t bm = 1 << (pin % 8);
+
+	if (level < 0) {
+		p->ext_en &= ~bm;
+	} else {
+		p->ext_en |= bm;
+		if (level)
+			p->ext_val |= bm;
+		else
+			p->ext_val &= ~bm;
+	}
+	port_update (pin / 8);
+}
+
+int simPinOutput (uint8_t pin)
+{
+	PORT_t *r = &ports[pin / 8].reg;
+	uint8_t bm = 1 << (pin % 8);
+
+	if (!(r->DIR & bm))
+		return -1;
+	return (ports[pin / 8].phys & bm) != 0;
+}
+
+bool simPinLevel (uint8_t pin)
+{
+	return (ports[pin / 8].phys & (1 << (pin % 8))) != 0;
+}
+
+uint8_t simPinCtrl (uint8_t pin)
+{
+	return (&ports[pin / 8].reg.PIN0CTRL)[pin % 8];
+}
+
+void ioport_configure_pin (port_pin_t pin, port_pin_flags_t flags)
+{
+	PORT_t *r = &ports[pin / 8].reg;
+	uint8_t bm = 1 << (pin % 8);
+
+	simEnter ();
+	(&r->PIN0CTRL)[pin % 8] = flags >> 8;
+	if (flags & IOPORT_DIR_OUTPUT) {
+		if (flags & IOPORT_INIT_HIGH)
+			r->OUTSET = bm;
+		else
+			r->OUTCLR = bm;
+		r->DIRSET = bm;
+	} else {
+		r->DIRCLR = bm;
+	}
+	port_update (pin / 8);
+	simLeave ();
+}
+
+void ioport_set_pin_dir (port_pin_t pin, enum ioport_direction dir)
+{
+	PORT_t *r = &ports[pin / 8].reg;
+
+	simEnter ();
+	if (dir == IOPORT_DIR_OUTPUT)
+		r->DIRSET = 1 << (pin % 8);
+	else
+		r->DIRCLR = 1 << (pin % 8);
+	port_update (pin / 8);
+	simLeave ();
+}
+
+void ioport_set_pin_level (port_pin_t pin, bool level)
+{
+	PORT_t *r = &ports[pin / 8].reg;
+
+	simEnter ();
+	if (level)
+		r->OUTSET = 1 << (pin % 8);
+	else
+		r->OUTCLR = 1 << (pin % 8);
+	port_update (pin / 8);
+	simLeave ();
+}
+
+bool ioport_get_pin_level (port_pin_t pin)
+{
+	bool level;
+
+	simEnter ();
+	port_update (pin / 8);
+	level = (ports[pin / 8].in & (1 << (pin % 8))) != 0;
+	simLeave ();
+
+	return level;
+}
+
+void arch_ioport_set_pin_sense_mode (ioport_pin_t pin, uint8_t pin_sense)
+{
+	volatile uint8_t *ctrl = &ports[pin / 8].reg.PIN0CTRL + pin % 8;
+
+	simEnter ();
+	*ctrl = (*ctrl & ~PORT_ISC_gm) | (pin_sense & PORT_ISC_gm);
+	port_update (pin / 8);
+	simLeave ();
+}
+
+/************************************************************************/
+/* TIMER/COUNTERS                                                       */
+/************************************************************************/
+
+struct tc_model {
+	TC_t reg;
+	TC_t shadow;
+	bool clk_en;            /*!< peripheral clock enabled (PR register) */
+	bool frozen;            /*!< clock stopped by sleep mode */
+	bool down;              /*!< dual slope: counting down */
+	uint8_t flags;
+	bool perbv;
+	bool ccabv;
+	uint16_t cnt;           /*!< counter value at \a base_ps */
+	uint64_t base_ps;       /*!< time of the last whole tick in ps */
+};
+
+static struct tc_model tcs[SIM_TC_COUNT];
+
+static const uint16_t tc_div[] = { 0, 1, 2, 4, 8, 64, 256, 1024 };
+
+static uint64_t tc_tick_ps (const struct tc_model *t)
+{
+	uint8_t clksel = t->shadow.CTRLA & TC_CLKSEL_gm;
+
+	if (!t->clk_en || t->frozen || clksel == 0 || clksel > 7)
+		return 0;
+	return simCpuCyclePs () * tc_div[clksel];
+}
+
+static bool tc_dual_slope (const struct tc_model *t)
+{
+	return (t->shadow.CTRLB & TC_WGMODE_gm) >= TC_WGMODE_DS_T_gc;
+}
+
+/*! \brief Counter value at time \a now (never beyond the next event) */
+static uint16_t tc_count_at (const struct tc_model *t, sim_time_t now)
+{
+	uint64_t tick = tc_tick_ps (t);
+	uint64_t ticks;
+
+	if (!tick || now * 1000 <= t->base_ps)
+		return t->cnt;
+
+	ticks = (now * 1000 - t->base_ps) / tick;
+	if (t->down)
+		return ticks >= t->cnt ? 0 : t->cnt - ticks;
+	return ticks > 0xffff - t->cnt ? 0xffff : t->cnt + ticks;
+}
+
+/*! \brief Ticks from the current base until the next event of \a t */
+static uint32_t tc_ticks_to_event (const struct tc_model *t)
+{
+	uint16_t per = t->shadow.PER;
+	uint16_t cca = t->shadow.CCA;
+	uint32_t ticks;
+
+	if (tc_dual_slope (t)) {
+		if (t->down) {
+			ticks = t->cnt ? t->cnt : 1;
+			if (cca < t->cnt && t->cnt - cca < ticks)
+				ticks = t->cnt - cca;
+		} else {
+			ticks = per > t->cnt ? per - t->cnt : 1;
+			if (cca > t->cnt && cca - t->cnt < ticks)
+				ticks = cca - t->cnt;
+		}
+	} else {
+		if (t->cnt <= per)
+			ticks = per - t->cnt + 1;
+		else
+			ticks = 0x10000 - t->cnt;
+		if (cca > t->cnt && cca - t->cnt < ticks)
+			ticks = cca - t->cnt;
+	}
+
+	return ticks;
+}
+
+static sim_time_t tc_next_event (const struct tc_model *t)
+{
+	uint64_t tick = tc_tick_ps (t);
+
+	if (!tick)
+		return SIM_NEVER;
+	return (t->base_ps + tc_ticks_to_event (t) * tick + 999) / 1000;
+}
+
+/*! \brief Moves the base of \a t to the last whole tick before \a now */
+static void tc_rebase (struct tc_model *t, sim_time_t now)
+{
+	uint64_t tick = tc_tick_ps (t);
+	uint16_t cnt = tc_count_at (t, now);
+
+	if (!tick) {
+		t->base_ps = now * 1000;
+		return;
+	}
+	t->base_ps += (uint64_t) (t->down ? t->cnt - cnt : cnt - t->cnt) * tick;
+	t->cnt = cnt;
+}
+
+static void tc_update_buffers (struct tc_model *t)
+{
+	if (t->perbv) {
+		t->reg.PER = t->shadow.PER = t->reg.PERBUF;
+		t->perbv = false;
+	}
+	if (t->ccabv) {
+		t->reg.CCA = t->shadow.CCA = t->reg.CCABUF;
+		t->ccabv = false;
+	}
+}
+
+static void tc_run (struct tc_model *t, sim_time_t now)
+{
+	uint64_t tick;
+	uint32_t ticks;
+	sim_time_t ev;
+	uint16_t per;
+	uint8_t wg;
+
+	while ((ev = tc_next_event (t)) <= now) {
+		tick = tc_tick_ps (t);
+		ticks = tc_ticks_to_event (t);
+		per = t->shadow.PER;
+		wg = t->shadow.CTRLB & TC_WGMODE_gm;
+
+		if (tc_dual_slope (t)) {
+			if (t->down) {
+				t->cnt -= ticks;
+				if (t->cnt == 0) {
+					t->down = false;
+					if (wg != TC_WGMODE_DS_T_gc)
+						t->flags |= TC0_OVFIF_bm;
+					tc_update_buffers (t);
+				}
+			} else {
+				t->cnt += ticks;
+				if (t->cnt >= per) {
+					t->cnt = per;
+					t->down = true;
+					if (wg != TC_WGMODE_DS_B_gc)
+						t->flags |= TC0_OVFIF_bm;
+				}
+			}
+		} else {
+			if ((uint32_t) t->cnt + ticks > (t->cnt <= per ? per : 0xffff)) {
+				t->cnt = 0;
+				t->flags |= TC0_OVFIF_bm;
+				tc_update_buffers (t);
+			} else {
+				t->cnt += ticks;
+			}
+		}
+
+		if (t->cnt == t->shadow.CCA)
+			t->flags |= TC0_CCAIF_bm;
+
+		t->base_ps += ticks * tick;
+		(void) ev;
+	}
+}
+
+/*! \brief Applies firmware writes made since the last access */
+static void tc_commit (struct tc_model *t)
+{
+	TC_t *r = &t->reg;
+	TC_t *s = &t->shadow;
+	sim_time_t now = simNow ();
+
+	t->flags &= ~r->INTFLAGS;
+	r->INTFLAGS = 0;
+
+	if (r->CTRLGSET & TC0_PERBV_bm)
+		t->perbv = true;
+	if (r->CTRLGSET & TC0_CCABV_bm)
+		t->ccabv = true;
+	r->CTRLGSET = r->CTRLGCLR = 0;
+	if (r->CTRLFSET & 0x04) {       /* CMD_RESTART */
+		t->cnt = 0;
+		t->down = false;
+		t->base_ps = now * 1000;
+	}
+	r->CTRLFSET = r->CTRLFCLR = 0;
+
+	/* count up to now with the old settings */
+	tc_rebase (t, now);
+	if (r->CTRLA != s->CTRLA || r->CTRLB != s->CTRLB) {
+		s->CTRLA = r->CTRLA;
+		s->CTRLB = r->CTRLB;
+		t->base_ps = now * 1000;
+	}
+
+	if (r->CNT != s->CNT) {
+		t->cnt = r->CNT;
+		t->base_ps = now * 1000;
+		if (!tc_dual_slope (t))
+			t->down = false;
+	}
+	if (r->PER != s->PER)
+		s->PER = r->PER;
+	if (r->CCA != s->CCA)
+		s->CCA = r->CCA;
+	if (r->PERBUF != s->PERBUF) {
+		s->PERBUF = r->PERBUF;
+		t->perbv = true;
+	}
+	if (r->CCABUF != s->CCABUF) {
+		s->CCABUF = r->CCABUF;
+		t->ccabv = true;
+	}
+}
+
+static void tc_materialize (struct tc_model *t)
+{
+	t->reg.CNT = t->shadow.CNT = tc_count_at (t, simNow ());
+}
+
+TC_t *simTcSync (uint8_t tc)
+{
+	simEnter ();
+	simLeave ();
+	tc_commit (&tcs[tc]);
+	tc_materialize (&tcs[tc]);
+	return &tcs[tc].reg;
+}
+
+/************************************************************************/
+/* RTC                                                                  */
+/************************************************************************/
+
+/*! \brief Time a write needs to reach the RTC clock domain (2 RTC cycles) */
+#define RTC_SYNC_NS (2 * 1000000000ULL / ULP_RTC_HZ)
+
+static struct {
+	RTC_t reg;
+	RTC_t shadow;
+	CLK_t clk;
+	CLK_t clk_shadow;
+	bool clk_en;
+	bool frozen;
+	uint8_t flags;
+	uint16_t cnt;
+	sim_time_t base;        /*!< time of the last whole RTC tick */
+	sim_time_t sync_until;
+	uint64_t writes;        /*!< synchronised writes */
+	uint64_t lost;          /*!< writes while SYNCBUSY was set */
+} rtc;
+
+static const uint16_t rtc_div[] = { 0, 1, 2, 8, 16, 64, 256, 1024 };
+
+static sim_time_t rtc_tick_ns (void)
+{
+	uint8_t presc = rtc.shadow.CTRL & RTC_PRESCALER_gm;
+
+	if (!rtc.clk_en || rtc.frozen || !presc ||
+	    (rtc.clk_shadow.RTCCTRL & (CLK_RTCEN_bm | CLK_RTCSRC_gm)) !=
+	    (CLK_RTCSRC_ULP_gc | CLK_RTCEN_bm))
+		return 0;
+	return rtc_div[presc] * 1000000000ULL / ULP_RTC_HZ;
+}
+
+static uint16_t rtc_count_at (sim_time_t now)
+{
+	sim_time_t tick = rtc_tick_ns ();
+	uint64_t ticks;
+
+	if (!tick || now <= rtc.base)
+		return rtc.cnt;
+	ticks = (now - rtc.base) / tick;
+	return ticks > (uint64_t) (0xffff - rtc.cnt) ? 0xffff : rtc.cnt + ticks;
+}
+
+static uint32_t rtc_ticks_to_event (void)
+{
+	uint16_t per = rtc.shadow.PER;
+	uint16_t comp = rtc.shadow.COMP;
+	uint32_t ticks;
+
+	ticks = rtc.cnt < per ? per - rtc.cnt + 1 : (rtc.cnt == per ? 1 : 0x10000 - rtc.cnt);
+	if (comp > rtc.cnt && comp - rtc.cnt < ticks)
+		ticks = comp - rtc.cnt;
+	return ticks;
+}
+
+static sim_time_t rtc_next_event (void)
+{
+	sim_time_t tick = rtc_tick_ns ();
+
+	if (!tick)
+		return SIM_NEVER;
+	return rtc.base + rtc_ticks_to_event () * tick;
+}
+
+static void rtc_rebase (sim_time_t now)
+{
+	sim_time_t tick = rtc_tick_ns ();
+	uint16_t cnt = rtc_count_at (now);
+
+	if (tick && now > rtc.base)
+		rtc.base += (sim_time_t) (cnt - rtc.cnt) * tick;
+	else
+		rtc.base = now;
+	rtc.cnt = cnt;
+}
+
+static void rtc_run (sim_time_t now)
+{
+	sim_time_t tick;
+	uint32_t ticks;
+
+	while (rtc_next_event () <= now) {
+		tick = rtc_tick_ns ();
+		ticks = rtc_ticks_to_event ();
+		rtc.base += ticks * tick;
+		if ((uint32_t) rtc.cnt + ticks > (rtc.cnt <= rtc.shadow.PER ? rtc.shadow.PER : 0xffff)) {
+			rtc.cnt = 0;
+			rtc.flags |= RTC_OVFIF_bm;
+		} else {
+			rtc.cnt += ticks;
+		}
+		if (rtc.cnt == rtc.shadow.COMP)
+			rtc.flags |= RTC_COMPIF_bm;
+	}
+}
+
+static void rtc_commit (void)
+{
+	sim_time_t now = simNow ();
+	RTC_t *r = &rtc.reg;
+	RTC_t *s = &rtc.shadow;
+	bool written = false;
+
+	rtc.flags &= ~r->INTFLAGS;
+	r->INTFLAGS = 0;
+
+	if (rtc.clk.RTCCTRL != rtc.clk_shadow.RTCCTRL) {
+		rtc_rebase (now);
+		rtc.clk_shadow.RTCCTRL = rtc.clk.RTCCTRL;
+		rtc.base = now;
+	}
+
+	/* the RTC ignores writes while it synchronises the previous one */
+	if (now < rtc.sync_until &&
+	    (r->CTRL != s->CTRL || r->CNT != s->CNT || r->PER != s->PER ||
+	     r->COMP != s->COMP)) {
+		r->CTRL = s->CTRL;
+		r->CNT = s->CNT;
+		r->PER = s->PER;
+		r->COMP = s->COMP;
+		rtc.lost++;
+		return;
+	}
+
+	if (r->CTRL != s->CTRL) {
+		rtc_rebase (now);
+		s->CTRL = r->CTRL;
+		rtc.base = now;
+		written = true;
+	}
+	if (r->CNT != s->CNT) {
+		rtc_rebase (now);
+		rtc.cnt = s->CNT = r->CNT;
+		rtc.base = now;
+		written = true;
+	}
+	if (r->PER != s->PER) {
+		s->PER = r->PER;
+		written = true;
+	}
+	if (r->COMP != s->COMP) {
+		s->COMP = r->COMP;
+		written = true;
+	}
+
+	if (written) {
+		rtc.sync_until = now + RTC_SYNC_NS;
+		rtc.writes++;
+	}
+}
+
+RTC_t *simRtcSync (void)
+{
+	simEnter ();
+	simLeave ();
+	rtc_commit ();
+	rtc.reg.CNT = rtc.shadow.CNT = rtc_count_at (simNow ());
+	rtc.reg.STATUS = simNow () < rtc.sync_until ? RTC_SYNCBUSY_bm : 0;
+	return &rtc.reg;
+}
+
+uint64_t simRtcWrites (void)
+{
+	return rtc.writes;
+}
+
+uint64_t simRtcLostWrites (void)
+{
+	return rtc.lost;
+}
+
+CLK_t *simClkSync (void)
+{
+	simEnter ();
+	simLeave ();
+	rtc_commit ();
+	return &rtc.clk;
+}
+
+/************************************************************************/
+/* RST / CCP / NVM_CMD                                                  */
+/************************************************************************/
+
+static RST_t rst;
+static register8_t ccp;
+static register8_t nvm_cmd;
+static NVM_t nvm;
+
+static void rst_commit (void)
+{
+	if (rst.CTRL & RST_SWRST_bm)
+		simExit ("software reset");
+}
+
+RST_t *simRstSync (void)
+{
+	simEnter ();
+	simLeave ();
+	rst_commit ();
+	return &rst;
+}
+
+register8_t *simCcpSync (void)
+{
+	return &ccp;
+}
+
+register8_t *simNvmCmdSync (void)
+{
+	simEnter ();
+	simLeave ();
+	return &nvm_cmd;
+}
+
+NVM_t *simNvmSync (void)
+{
+	simEnter ();
+	simLeave ();
+	return &nvm;
+}
+
+uint8_t simPgmReadByte (uint16_t address)
+{
+	simEnter ();
+	simLeave ();
+
+	if (nvm_cmd != NVM_CMD_READ_CALIB_ROW_gc)
+		return 0xff;
+
+	switch (address) {
+	case ADCACAL0:
+		return 0x44;
+	case ADCACAL1:
+		return 0x04;
+	default:
+		return 0xff;
+	}
+}
+
+/************************************************************************/
+/* ADC                                                                  */
+/************************************************************************/
+
+/*! \brief ADC clock cycles of a signed 12 bit single ended conversion */
+#define ADC_CONVERSION_CYCLES 7
+
+static struct {
+	ADC_t reg;
+	bool enabled;
+	bool clk_en;
+	uint32_t clock_hz;
+	adc_callback_t callback;
+	sim_time_t done;
+	sim_time_t remaining;   /*!< conversion time left while frozen */
+	bool flag;
+	adc_result_t result;
+	uint32_t noise;
+	uint64_t conversions;
+} adc;
+
+ADC_t *simAdcSync (void)
+{
+	simEnter ();
+	simLeave ();
+	return &adc.reg;
+}
+
+void adc_read_configuration (ADC_t *a, struct adc_config *conf)
+{
+	(void) a;
+	memset (conf, 0, sizeof *conf);
+	conf->clock_hz = adc.clock_hz;
+}
+
+void adc_write_configuration (ADC_t *a, const struct adc_config *conf)
+{
+	(void) a;
+	adc.clock_hz = conf->clock_hz;
+}
+
+void adcch_read_configuration (ADC_t *a, uint8_t ch_mask,
+                               struct adc_channel_config *ch_conf)
+{
+	(void) a;
+	(void) ch_mask;
+	memset (ch_conf, 0, sizeof *ch_conf);
+}
+
+void adcch_write_configuration (ADC_t *a, uint8_t ch_mask,
+                                const struct adc_channel_config *ch_conf)
+{
+	(void) a;
+	(void) ch_mask;
+	(void) ch_conf;
+}
+
+void adc_set_conversion_parameters (struct adc_config *conf,
+                                    enum adc_sign sign,
+                                    enum adc_resolution res,
+                                    enum adc_reference ref)
+{
+	(void) sign;
+	(void) res;
+	conf->refctrl = ref;
+}
+
+void adc_set_conversion_trigger (struct adc_config *conf,
+                                 enum adc_trigger trig, uint8_t nr_of_ch,
+                                 uint8_t base_ev_ch)
+{
+	(void) conf;
+	(void) trig;
+	(void) nr_of_ch;
+	(void) base_ev_ch;
+}
+
+void adc_set_clock_rate (struct adc_config *conf, uint32_t clk_adc)
+{
+	uint32_t presc = 4;
+
+	/* the prescaler is a power of two between 4 and 512 */
+	while (presc < 512 && cpu_hz / presc > clk_adc)
+		presc <<= 1;
+	conf->clock_hz = cpu_hz / presc;
+}
+
+void adcch_set_input (struct adc_channel_config *ch_conf,
+                      enum adcch_positive_input pos,
+                      enum adcch_negative_input neg, uint8_t gain)
+{
+	(void) neg;
+	(void) gain;
+	ch_conf->muxctrl = pos;
+}
+
+void adcch_enable_interrupt (struct adc_channel_config *ch_conf)
+{
+	ch_conf->intctrl = 1;
+}
+
+void adc_set_callback (ADC_t *a, adc_callback_t callback)
+{
+	(void) a;
+	adc.callback = callback;
+}
+
+void adc_enable (ADC_t *a)
+{
+	(void) a;
+	simEnter ();
+	adc.enabled = true;
+	simLeave ();
+}
+
+void adc_disable (ADC_t *a)
+{
+	(void) a;
+	simEnter ();
+	adc.enabled = false;
+	adc.done = SIM_NEVER;
+	simLeave ();
+}
+
+void adc_start_conversion (ADC_t *a, uint8_t ch_mask)
+{
+	uint32_t hz = adc.clock_hz ? adc.clock_hz : cpu_hz / 4;
+
+	(void) a;
+	(void) ch_mask;
+
+	simEnter ();
+	if (adc.enabled && adc.done == SIM_NEVER)
+		adc.done = simNow () + ADC_CONVERSION_CYCLES * 1000000000ULL / hz;
+	simLeave ();
+}
+
+static void adc_run (sim_time_t now)
+{
+	int32_t res;
+
+	if (adc.done > now)
+		return;
+
+	adc.done = SIM_NEVER;
+	adc.noise = adc.noise * 1103515245 + 12345;
+
+	/* scaled VCC (VCC / 10) against the 1.0 V band gap, signed 12 bit */
+	res = (int32_t) simWorldVccMv () * 2048 / 10000;
+	res += (int32_t) ((adc.noise >> 16) % 5) - 2;
+	if (res > 2047)
+		res = 2047;
+	adc.result = res;
+	adc.flag = true;
+	++adc.conversions;
+}
+
+static void adc_isr (void)
+{
+	if (adc.callback)
+		adc.callback (&adc.reg, ADC_CH0, adc.result);
+}
+
+/************************************************************************/
+/* USART                                                                */
+/************************************************************************/
+
+static struct {
+	USART_t reg;
+	uint32_t baudrate;      /*!< requested by usart_init_rs232 */
+	bool clk_en;
+	sim_time_t busy_until;
+	uint64_t chars;
+	uint64_t bad_chars;     /*!< sent more than 5 % off the baud rate */
+} usart;
+
+USART_t *simUsartDevice (void)
+{
+	return &usart.reg;
+}
+
+/*! \brief Baud rate of BAUDCTRLA/BAUDCTRLB at the current clock */
+static double usart_baud (void)
+{
+	unsigned bsel = ((usart.reg.BAUDCTRLB & 0x0f) << 8) | usart.reg.BAUDCTRLA;
+	int bscale = (int8_t) usart.reg.BAUDCTRLB >> 4;
+
+	if (bscale >= 0)
+		return cpu_hz / (16.0 * (1 << bscale) * (bsel + 1));
+	return cpu_hz / (16.0 * ((double) bsel / (1 << -bscale) + 1));
+}
+
+/*! \brief Same as the ASF (xmega/drivers/usart/usart.c), CLK2X is not used */
+bool usart_set_baudrate (USART_t *u, uint32_t baud, uint32_t hz)
+{
+	int8_t exp;
+	uint32_t div;
+	uint32_t limit;
+	uint32_t ratio;
+
+	if (baud > hz / 16 || baud < hz / 8388608)
+		return false;
+
+	baud *= 2;
+	limit = 0xfffU >> 4;
+	ratio = hz / baud;
+	for (exp = -7; exp < 7; exp++) {
+		if (ratio < limit)
+			break;
+		limit <<= 1;
+		if (exp < -3)
+			limit |= 1;
+	}
+
+	if (exp < 0) {
+		hz -= 8 * baud;
+		if (exp <= -3) {
+			div = ((hz << (-exp - 3)) + baud / 2) / baud;
+		} else {
+			baud <<= exp + 3;
+			div = (hz + baud / 2) / baud;
+		}
+	} else {
+		baud <<= exp + 3;
+		div = (hz + baud / 2) / baud - 1;
+	}
+
+	simEnter ();
+	u->BAUDCTRLB = (uint8_t)(((div >> 8) & 0x0f) | ((uint8_t) exp << 4));
+	u->BAUDCTRLA = (uint8_t) div;
+	simLeave ();
+
+	return true;
+}
+
+bool usart_init_rs232 (USART_t *u, const usart_rs232_options_t *opt)
+{
+	usart.baudrate = opt->baudrate;
+	/* the ASF takes the clock of conf_clock.h */
+	return usart_set_baudrate (u, opt->baudrate, sysclk_get_cpu_hz ());
+}
+
+void usart_tx_disable (USART_t *u)
+{
+	(void) u;
+}
+
+void usart_rx_disable (USART_t *u)
+{
+	(void) u;
+}
+
+enum status_code usart_putchar (USART_t *u, uint8_t c)
+{
+	double baud;
+
+	(void) u;
+
+	simEnter ();
+	/* wait for the data register to become empty */
+	if (usart.busy_until > simNow ())
+		simBusy (usart.busy_until - simNow ());
+	baud = usart_baud ();
+	usart.busy_until = simNow () + (sim_time_t)(10 * 1e9 / baud);
+	if (usart.baudrate &&
+	    (baud > usart.baudrate * 1.05 || baud < usart.baudrate * 0.95))
+		++usart.bad_chars;
+	++usart.chars;
+	simWorldUartTx (c);
+	simLeave ();
+
+	return STATUS_OK;
+}
+
+bool usart_tx_is_complete (USART_t *u)
+{
+	bool done;
+
+	(void) u;
+
+	simEnter ();
+	done = simNow () >= usart.busy_until;
+	simLeave ();
+
+	return done;
+}
+
+void usart_clear_tx_complete (USART_t *u)
+{
+	(void) u;
+
+	simEnter ();
+	simLeave ();
+}
+
+uint64_t simUsartBadChars (void)
+{
+	return usart.bad_chars;
+}
+
+uint64_t simUsartChars (void)
+{
+	return usart.chars;
+}
+
+/************************************************************************/
+/* SPI (registers only; transfers are modeled in sim_spi.c)             */
+/************************************************************************/
+
+static SPI_t spic;
+
+SPI_t *simSpiDevice (void)
+{
+	return &spic;
+}
+
+/************************************************************************/
+/* EEPROM                                                               */
+/************************************************************************/
+
+#define EEPROM_ATOMIC_WRITE_NS SIM_US(8000)
+#define EEPROM_SPLIT_NS        SIM_US(4000)
+#define EEPROM_READ_BYTE_NS    SIM_NS(1500)
+
+static struct {
+	uint8_t mem[EEPROM_SIZE];
+	uint8_t buf[EEPROM_PAGE_SIZE];
+	uint32_t loaded;
+	sim_time_t busy_until;
+	struct sim_eeprom_stats stats;
+} ee;
+
+const struct sim_eeprom_stats *simEepromStats (void)
+{
+	return &ee.stats;
+}
+
+const uint8_t *simEepromData (void)
+{
+	return ee.mem;
+}
+
+bool simEepromLoad (const char *path)
+{
+	FILE *f = fopen (path, "rb");
+	size_t n;
+
+	if (!f)
+		return false;
+	n = fread (ee.mem, 1, sizeof ee.mem, f);
+	fclose (f);
+	return n == sizeof ee.mem;
+}
+
+bool simEepromSave (const char *path)
+{
+	FILE *f = fopen (path, "wb");
+	size_t n;
+
+	if (!f)
+		return false;
+	n = fwrite (ee.mem, 1, sizeof ee.mem, f);
+	return fclose (f) == 0 && n == sizeof ee.mem;
+}
+
+void nvm_wait_until_ready (void)
+{
+	simEnter ();
+	if (ee.busy_until > simNow ())
+		simBusy (ee.busy_until - simNow ());
+	simLeave ();
+}
+
+static void ee_start (uint8_t page, sim_time_t duration, bool erase, bool write)
+{
+	uint8_t i;
+
+	for (i = 0; i < EEPROM_PAGE_SIZE; ++i) {
+		if (!(ee.loaded & (1UL << i)))
+			continue;
+		if (erase)
+			ee.mem[page * EEPROM_PAGE_SIZE + i] = 0xff;
+		if (write)
+			ee.mem[page * EEPROM_PAGE_SIZE + i] &= ee.buf[i];
+	}
+	if (erase)
+		++ee.stats.page_erases[page];
+	if (write)
+		++ee.stats.page_writes[page];
+
+	ee.loaded = 0;
+	memset (ee.buf, 0xff, sizeof ee.buf);
+	ee.busy_until = simNow () + duration;
+	ee.stats.busy_ns += duration;
+}
+
+uint8_t nvm_eeprom_read_byte (uint16_t addr)
+{
+	uint8_t val;
+
+	nvm_wait_until_ready ();
+	simEnter ();
+	val = ee.mem[addr % EEPROM_SIZE];
+	++ee.stats.bytes_read;
+	simLeave ();
+
+	return val;
+}
+
+void nvm_eeprom_read_buffer (uint16_t address, void *buf, uint16_t len)
+{
+	uint16_t i;
+
+	nvm_wait_until_ready ();
+	simEnter ();
+	for (i = 0; i < len; ++i)
+		((uint8_t *) buf)[i] = ee.mem[(address + i) % EEPROM_SIZE];
+	ee.stats.bytes_read += len;
+	simBusy (len * EEPROM_READ_BYTE_NS);
+	simLeave ();
+}
+
+void nvm_eeprom_flush_buffer (void)
+{
+	nvm_wait_until_ready ();
+	simEnter ();
+	ee.loaded = 0;
+	memset (ee.buf, 0xff, sizeof ee.buf);
+	simLeave ();
+}
+
+void nvm_eeprom_load_byte_to_buffer (uint8_t byte_addr, uint8_t value)
+{
+	nvm_wait_until_ready ();
+	simEnter ();
+	ee.buf[byte_addr % EEPROM_PAGE_SIZE] = value;
+	ee.loaded |= 1UL << (byte_addr % EEPROM_PAGE_SIZE);
+	simLeave ();
+}
+
+void nvm_eeprom_load_page_to_buffer (const uint8_t *values)
+{
+	uint8_t i;
+
+	for (i = 0; i < EEPROM_PAGE_SIZE; ++i)
+		nvm_eeprom_load_byte_to_buffer (i, values[i]);
+}
+
+void nvm_eeprom_fill_buffer_with_value (uint8_t value)
+{
+	uint8_t i;
+
+	nvm_eeprom_flush_buffer ();
+	for (i = 0; i < EEPROM_PAGE_SIZE; ++i)
+		nvm_eeprom_load_byte_to_buffer (i, value);
+}
+
+void nvm_eeprom_atomic_write_page (uint8_t page_addr)
+{
+	nvm_wait_until_ready ();
+	simEnter ();
+	ee_start (page_addr % SIM_EEPROM_PAGES, EEPROM_ATOMIC_WRITE_NS, true, true);
+	simLeave ();
+}
+
+void nvm_eeprom_split_write_page (uint8_t page_addr)
+{
+	nvm_wait_until_ready ();
+	simEnter ();
+	ee_start (page_addr % SIM_EEPROM_PAGES, EEPROM_SPLIT_NS, false, true);
+	simLeave ();
+}
+
+void nvm_eeprom_erase_bytes_in_page (uint8_t page_addr)
+{
+	nvm_wait_until_ready ();
+	simEnter ();
+	ee_start (page_addr % SIM_EEPROM_PAGES, EEPROM_SPLIT_NS, true, false);
+	simLeave ();
+}
+
+void nvm_eeprom_erase_page (uint8_t page_addr)
+{
+	nvm_eeprom_fill_buffer_with_value (0xff);
+	nvm_eeprom_erase_bytes_in_page (page_addr);
+}
+
+void nvm_eeprom_erase_all (void)
+{
+	uint8_t page;
+
+	for (page = 0; page < SIM_EEPROM_PAGES; ++page)
+		nvm_eeprom_erase_page (page);
+}
+
+void nvm_eeprom_write_byte (uint16_t address, uint8_t value)
+{
+	nvm_eeprom_flush_buffer ();
+	nvm_eeprom_load_byte_to_buffer (address % EEPROM_PAGE_SIZE, value);
+	nvm_eeprom_atomic_write_page (address / EEPROM_PAGE_SIZE);
+}
+
+/************************************************************************/
+/* FLASH (application table section)                                    */
+/************************************************************************/
+
+#define FLASH_ERASE_WRITE_NS   SIM_US(8000)
+#define FLASH_WRITE_NS         SIM_US(4000)
+/* Word load or LPM loop of the ASF driver */
+#define FLASH_BYTE_CYCLES      8
+
+static struct {
+	uint8_t mem[APPTABLE_SECTION_SIZE];
+	struct sim_flash_stats stats;
+} flash;
+
+const struct sim_flash_stats *simFlashStats (void)
+{
+	return &flash.stats;
+}
+
+bool simFlashLoad (const char *path)
+{
+	FILE *f = fopen (path, "rb");
+	size_t n;
+
+	if (!f)
+		return false;
+	n = fread (flash.mem, 1, sizeof flash.mem, f);
+	fclose (f);
+	return n == sizeof flash.mem;
+}
+
+bool simFlashSave (const char *path)
+{
+	FILE *f = fopen (path, "wb");
+	size_t n;
+
+	if (!f)
+		return false;
+	n = fwrite (flash.mem, 1, sizeof flash.mem, f);
+	return fclose (f) == 0 && n == sizeof flash.mem;
+}
+
+static uint8_t *flash_at (flash_addr_t address)
+{
+	if ((address < APPTABLE_SECTION_START) ||
+	    (address >= APPTABLE_SECTION_START + APPTABLE_SECTION_SIZE)) {
+		fprintf (stderr, "[sim] flash access outside the application "
+		         "table section: 0x%05lx\n", (unsigned long) address);
+		abort ();
+	}
+
+	return &flash.mem[address - APPTABLE_SECTION_START];
+}
+
+void nvm_flash_read_buffer (flash_addr_t address, void *buf, uint16_t len)
+{
+	uint16_t i;
+
+	nvm_wait_until_ready ();
+	simEnter ();
+	for (i = 0; i < len; ++i)
+		((uint8_t *) buf)[i] = *flash_at (address + i);
+	flash.stats.bytes_read += len;
+	simBusy (len * FLASH_BYTE_CYCLES * simCpuCyclePs () / 1000);
+	simLeave ();
+}
+
+/* The CPU halts while the application section is written */
+void nvm_flash_erase_and_write_buffer (flash_addr_t address, const void *buf,
+                                       uint16_t len, bool b_blank_check)
+{
+	flash_addr_t page = address - address % FLASH_PAGE_SIZE;
+	const uint8_t *src = buf;
+	uint8_t *mem;
+	bool erase;
+	uint16_t i;
+
+	while (len) {
+		nvm_wait_until_ready ();
+		simEnter ();
+		mem = flash_at (page);
+		erase = false;
+		for (i = 0; b_blank_check && i < FLASH_PAGE_SIZE; ++i)
+			erase |= mem[i] != 0xff;
+		for (i = 0; i < FLASH_PAGE_SIZE; ++i) {
+			uint8_t val = 0xff;
+
+			if (len && (page + i == address)) {
+				val = *src++;
+				++address;
+				--len;
+			}
+			mem[i] = erase ? val : (mem[i] & val);
+		}
+		if (erase)
+			++flash.stats.page_erases;
+		++flash.stats.page_writes;
+		flash.stats.busy_ns += erase ? FLASH_ERASE_WRITE_NS : FLASH_WRITE_NS;
+		simBusy (FLASH_PAGE_SIZE * FLASH_BYTE_CYCLES * simCpuCyclePs () / 1000 +
+		         (erase ? FLASH_ERASE_WRITE_NS : FLASH_WRITE_NS));
+		simLeave ();
+		page += FLASH_PAGE_SIZE;
+	}
+}
+
+/************************************************************************/
+/* SYSCLK / DELAY                                                       */
+/************************************************************************/
+
+static bool *periph_clock (const volatile void *module)
+{
+	uint8_t i;
+
+	for (i = 0; i < SIM_TC_COUNT; ++i) {
+		if (module == &tcs[i].reg)
+			return &tcs[i].clk_en;
+	}
+	if (module == &rtc.reg)
+		return &rtc.clk_en;
+	if (module == &adc.reg)
+		return &adc.clk_en;
+	if (module == &usart.reg)
+		return &usart.clk_en;
+	return NULL;
+}
+
+static void set_periph_clock (const volatile void *module, bool on)
+{
+	bool *clk;
+	uint8_t i;
+
+	simEnter ();
+	clk = periph_clock (module);
+	if (clk && *clk != on) {
+		for (i = 0; i < SIM_TC_COUNT; ++i) {
+			tc_commit (&tcs[i]);
+		}
+		rtc_commit ();
+		rtc_rebase (simNow ());
+		*clk = on;
+	}
+	simLeave ();
+}
+
+void sysclk_init (void)
+{
+	cpu_hz = RC2MHZ_HZ;
+}
+
+void sysclk_set_source (uint8_t src)
+{
+	uint8_t i;
+
+	simEnter ();
+	for (i = 0; i < SIM_TC_COUNT; ++i)
+		tc_commit (&tcs[i]);
+
+	switch (src) {
+	case SYSCLK_SRC_RC32MHZ:
+		/* the switch is ignored unless the oscillator is ready */
+		if (rc32m_on)
+			cpu_hz = RC32MHZ_HZ;
+		break;
+	case SYSCLK_SRC_RC32KHZ:
+		cpu_hz = RC32KHZ_HZ;
+		break;
+	default:
+		cpu_hz = RC2MHZ_HZ;
+		break;
+	}
+	simLeave ();
+}
+
+void osc_enable (uint8_t id)
+{
+	simEnter ();
+	if (id == OSC_ID_RC32MHZ)
+		rc32m_on = true;
+	simLeave ();
+}
+
+void osc_disable (uint8_t id)
+{
+	simEnter ();
+	if (id == OSC_ID_RC32MHZ && cpu_hz != RC32MHZ_HZ)
+		rc32m_on = false;
+	simLeave ();
+}
+
+bool osc_is_ready (uint8_t id)
+{
+	bool ready;
+
+	simEnter ();
+	ready = (id == OSC_ID_RC32MHZ) ? rc32m_on : true;
+	simLeave ();
+
+	return ready;
+}
+
+void sysclk_enable_peripheral_clock (const volatile void *module)
+{
+	set_periph_clock (module, true);
+}
+
+void sysclk_disable_peripheral_clock (const volatile void *module)
+{
+	set_periph_clock (module, false);
+}
+
+/*
+ * Like the ASF the sysclk_get_* functions return the clock of conf_clock.h
+ * (CONFIG_SYSCLK_SOURCE, 2 MHz), not the current one.
+ */
+uint32_t sysclk_get_cpu_hz (void)
+{
+	return RC2MHZ_HZ;
+}
+
+uint32_t sysclk_get_per_hz (void)
+{
+	return RC2MHZ_HZ;
+}
+
+uint32_t sysclk_get_peripheral_bus_hz (const volatile void *module)
+{
+	(void) module;
+	return RC2MHZ_HZ;
+}
+
+void delay_cycles (unsigned long n)
+{
+	simEnter ();
+	simBusy ((sim_time_t) n * simCpuCyclePs () / 1000);
+	simLeave ();
+}
+
+/*! \brief Counts the cycles of the clock of conf_clock.h, like the ASF */
+void delay_us (uint32_t us)
+{
+	delay_cycles (us * (RC2MHZ_HZ / 1000000UL));
+}
+
+/************************************************************************/
+/* INTERRUPT CONTROLLER                                                 */
+/************************************************************************/
+
+enum irq_source {
+	IRQ_PORT_INT0,
+	IRQ_PORT_INT1,
+	IRQ_RTC_OVF,
+	IRQ_RTC_COMP,
+	IRQ_TC_OVF,
+	IRQ_TC_CCA,
+	IRQ_NVM_EE,
+	IRQ_ADC_CH0,
+	IRQ_SPI
+};
+
+/* handlers the firmware may define */
+#define SIM_VECTORS(X) \
+	X(PORTC_INT0_vect, 2,  IRQ_PORT_INT0, SIM_PORTC) \
+	X(PORTC_INT1_vect, 3,  IRQ_PORT_INT1, SIM_PORTC) \
+	X(PORTR_INT0_vect, 4,  IRQ_PORT_INT0, SIM_PORTR) \
+	X(PORTR_INT1_vect, 5,  IRQ_PORT_INT1, SIM_PORTR) \
+	X(RTC_OVF_vect,    10, IRQ_RTC_OVF,   0)         \
+	X(RTC_COMP_vect,   11, IRQ_RTC_COMP,  0)         \
+	X(TCC0_OVF_vect,   14, IRQ_TC_OVF,    SIM_TCC0)  \
+	X(TCC0_CCA_vect,   16, IRQ_TC_CCA,    SIM_TCC0)  \
+	X(TCC1_OVF_vect,   20, IRQ_TC_OVF,    SIM_TCC1)  \
+	X(NVM_EE_vect,     32, IRQ_NVM_EE,    0)         \
+	X(PORTB_INT0_vect, 34, IRQ_PORT_INT0, SIM_PORTB) \
+	X(PORTB_INT1_vect, 35, IRQ_PORT_INT1, SIM_PORTB) \
+	X(PORTE_INT0_vect, 43, IRQ_PORT_INT0, SIM_PORTE) \
+	X(PORTE_INT1_vect, 44, IRQ_PORT_INT1, SIM_PORTE) \
+	X(TCE0_OVF_vect,   47, IRQ_TC_OVF,    SIM_TCE0)  \
+	X(TCE0_CCA_vect,   49, IRQ_TC_CCA,    SIM_TCE0)  \
+	X(PORTD_INT0_vect, 64, IRQ_PORT_INT0, SIM_PORTD) \
+	X(PORTD_INT1_vect, 65, IRQ_PORT_INT1, SIM_PORTD) \
+	X(PORTA_INT0_vect, 66, IRQ_PORT_INT0, SIM_PORTA) \
+	X(PORTA_INT1_vect, 67, IRQ_PORT_INT1, SIM_PORTA) \
+	X(TCD1_OVF_vect,   83, IRQ_TC_OVF,    SIM_TCD1)  \
+	X(TCD1_CCA_vect,   85, IRQ_TC_CCA,    SIM_TCD1)
+
+#define SIM_DECLARE_VECTOR(name, num, src, unit) \
+	extern void name (void) __attribute__((weak));
+SIM_VECTORS(SIM_DECLARE_VECTOR)
+
+struct irq_vector {
+	const char *name;
+	uint8_t num;
+	enum irq_source src;
+	uint8_t unit;
+	void (*handler) (void);
+};
+
+#define SIM_VECTOR_ENTRY(name, num, src, unit) { #name, num, src, unit, name },
+static const struct irq_vector vectors[] = {
+	SIM_VECTORS(SIM_VECTOR_ENTRY)
+	{ "ADCA_CH0_vect", 71, IRQ_ADC_CH0, 0, adc_isr },
+	{ "SPIC_INT_vect", 12, IRQ_SPI,     0, simSpiIsr },
+};
+
+#define VECTOR_COUNT (sizeof vectors / sizeof vectors[0])
+
+/*! \brief Level of interrupt \a v, 0 if it is not pending */
+static uint8_t irq_pending_level (const struct irq_vector *v)
+{
+	struct port_model *p;
+	struct tc_model *t;
+	uint8_t lvl = 0;
+
+	switch (v->src) {
+	case IRQ_PORT_INT0:
+		p = &ports[v->unit];
+		if (port_flags (v->unit) & PORT_INT0IF_bm)
+			lvl = p->reg.INTCTRL & PORT_INT0LVL_gm;
+		break;
+	case IRQ_PORT_INT1:
+		p = &ports[v->unit];
+		if (port_flags (v->unit) & PORT_INT1IF_bm)
+			lvl = (p->reg.INTCTRL & PORT_INT1LVL_gm) >> 2;
+		break;
+	case IRQ_RTC_OVF:
+		if (rtc.flags & RTC_OVFIF_bm)
+			lvl = rtc.reg.INTCTRL & RTC_OVFINTLVL_gm;
+		break;
+	case IRQ_RTC_COMP:
+		if (rtc.flags & RTC_COMPIF_bm)
+			lvl = (rtc.reg.INTCTRL & RTC_COMPINTLVL_gm) >> 2;
+		break;
+	case IRQ_TC_OVF:
+		t = &tcs[v->unit];
+		if (t->flags & TC0_OVFIF_bm)
+			lvl = t->reg.INTCTRLA & TC_OVFINTLVL_gm;
+		break;
+	case IRQ_TC_CCA:
+		t = &tcs[v->unit];
+		if (t->flags & TC0_CCAIF_bm)
+			lvl = t->reg.INTCTRLB & TC_CCAINTLVL_gm;
+		break;
+	case IRQ_NVM_EE:
+		/* level interrupt while the EEPROM is ready; it is no wake-up
+		 * source in power-save and power-down */
+		if ((ee.busy_until <= simNow ()) &&
+		    (!sleeping || (sleep_mode == SIM_SLEEP_IDLE)))
+			lvl = nvm.INTCTRL & NVM_EELVL_gm;
+		break;
+	case IRQ_ADC_CH0:
+		if (adc.flag)
+			lvl = 1;
+		break;
+	case IRQ_SPI:
+		/* only enabled during spiTxRxStart, at SPI_ASYNC_INTLVL */
+		if (simSpiIrqPending ())
+			lvl = 2;
+		break;
+	}
+
+	if (!lvl || !(pmic_levels & (1 << (lvl - 1))))
+		return 0;
+	return lvl;
+}
+
+int simXmegaPendingIrq (uint8_t level)
+{
+	uint8_t best_level = level;
+	int best = -1;
+	uint8_t lvl;
+	unsigned i;
+
+	for (i = 0; i < VECTOR_COUNT; ++i) {
+		lvl = irq_pending_level (&vectors[i]);
+		/* lower vector numbers win within a level (table is sorted) */
+		if (lvl > best_level) {
+			best_level = lvl;
+			best = i;
+		}
+	}
+
+	return best;
+}
+
+void (*simXmegaAckIrq (int irq, uint8_t *level)) (void)
+{
+	const struct irq_vector *v = &vectors[irq];
+
+	*level = irq_pending_level (v);
+
+	switch (v->src) {
+	case IRQ_PORT_INT0:
+		ports[v->unit].flags &= ~PORT_INT0IF_bm;
+		break;
+	case IRQ_PORT_INT1:
+		ports[v->unit].flags &= ~PORT_INT1IF_bm;
+		break;
+	case IRQ_RTC_OVF:
+		rtc.flags &= ~RTC_OVFIF_bm;
+		break;
+	case IRQ_RTC_COMP:
+		rtc.flags &= ~RTC_COMPIF_bm;
+		break;
+	case IRQ_TC_OVF:
+		tcs[v->unit].flags &= ~TC0_OVFIF_bm;
+		break;
+	case IRQ_TC_CCA:
+		tcs[v->unit].flags &= ~TC0_CCAIF_bm;
+		break;
+	case IRQ_NVM_EE:
+		break;
+	case IRQ_ADC_CH0:
+		adc.flag = false;
+		break;
+	case IRQ_SPI:
+		break;
+	}
+
+	return v->handler;
+}
+
+const char *simXmegaIrqName (int irq)
+{
+	return vectors[irq].name;
+}
+
+/************************************************************************/
+/* MODEL INTERFACE                                                      */
+/************************************************************************/
+
+void simXmegaInit (void)
+{
+	uint8_t i;
+
+	memset (ee.mem, 0xff, sizeof ee.mem);
+	memset (ee.buf, 0xff, sizeof ee.buf);
+	memset (flash.mem, 0xff, sizeof flash.mem);
+	adc.done = SIM_NEVER;
+	adc.remaining = SIM_NEVER;
+	for (i = 0; i < SIM_TC_COUNT; ++i)
+		tcs[i].reg.PER = tcs[i].shadow.PER = 0xffff;
+	rtc.reg.PER = rtc.shadow.PER = 0xffff;
+	for (i = 0; i < SIM_PORT_COUNT; ++i)
+		port_update (i);
+}
+
+/*! \brief Commits register writes of all peripherals */
+void simXmegaCommit (void)
+{
+	uint8_t i;
+
+	for (i = 0; i < SIM_PORT_COUNT; ++i)
+		port_update (i);
+	for (i = 0; i < SIM_TC_COUNT; ++i)
+		tc_commit (&tcs[i]);
+	rtc_commit ();
+	rst_commit ();
+}
+
+sim_time_t simXmegaNextEvent (void)
+{
+	sim_time_t next = adc.done;
+	sim_time_t t;
+	uint8_t i;
+
+	t = simSpiNextEvent ();
+	if (t < next)
+		next = t;
+
+	for (i = 0; i < SIM_TC_COUNT; ++i) {
+		t = tc_next_event (&tcs[i]);
+		if (t < next)
+			next = t;
+	}
+	t = rtc_next_event ();
+	if (t < next)
+		next = t;
+	if ((nvm.INTCTRL & NVM_EELVL_gm) && (ee.busy_until > simNow ()) &&
+	    (ee.busy_until < next))
+		next = ee.busy_until;
+
+	return next;
+}
+
+void simXmegaRun (sim_time_t now)
+{
+	uint8_t i;
+
+	for (i = 0; i < SIM_TC_COUNT; ++i)
+		tc_run (&tcs[i], now);
+	rtc_run (now);
+	adc_run (now);
+	simSpiRun (now);
+}
+
+void simXmegaSleep (enum sim_sleep_mode mode, bool enter)
+{
+	sim_time_t now = simNow ();
+	uint8_t i;
+
+	sleep_mode = mode;
+	sleeping = enter;
+
+	if (mode == SIM_SLEEP_IDLE)
+		return;
+
+	/* the peripheral clock stops in power-save and power-down */
+	for (i = 0; i < SIM_TC_COUNT; ++i) {
+		tc_rebase (&tcs[i], now);
+		tcs[i].frozen = enter;
+	}
+	if (enter) {
+		adc.remaining = adc.done == SIM_NEVER ? SIM_NEVER : adc.done - now;
+		adc.done = SIM_NEVER;
+	} else if (adc.remaining != SIM_NEVER) {
+		adc.done = now + adc.remaining;
+	}
+
+	/* the RTC keeps running in power-save only */
+	if (mode == SIM_SLEEP_PDOWN) {
+		rtc_rebase (now);
+		rtc.frozen = enter;
+		rtc.base = now;
+	}
+}
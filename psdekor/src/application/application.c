@@ -22,7 +22,11 @@
 #include "uart.h"
 #include "delay_wrapper.h"
 #include "utils/debug.h"
-#include "utils/reschedule.h"
+#include "utils/soft_timer.h"
+#include "utils/wait_trace.h"
+#include "utils/energy.h"
+#include "utils/event_queue.h"
+#include "utils/counter.h"
 #include "buzzer/sounds.h"
 #include "spi_driver.h"
 #include "cardman/card_utils.h"
@@ -30,6 +34,10 @@
 #include "application/software_functions.h"
 #include "application/timeouts.h"
 #include "cardman/cards_manager.h"
+#include "cardman/eeprom_queue.h"
+#include "sorex_hal/Communication/RfidWakeRef.h"
+#include "sorex_hal/Communication/RfidQualify.h"
+#include "sorex_hal/Communication/RfidWakeSchedule.h"
 
 /*! uncomment this line for using capactive detection */
 #define PHASE_DETECT
@@ -37,10 +45,54 @@
 /*! wake-up-timer range				0 = 100ms, 1 = 10ms */
 #define PHASE_DETECT_WUR			0
 
-/*! typical wake-up time (see datasheet, page 108, figure 101: typical wakeup time) */
-#define PHASE_DETECT_WUT0			0
-#define PHASE_DETECT_WUT1			0
-#define PHASE_DETECT_WUT2			1
+/*! typical wake-up time per load of the slot, (wut + 1) x range (see datasheet, page 108, figure 101: typical wakeup time) */
+#define PHASE_DETECT_WUT_QUIET		7	/* 800 ms */
+#define PHASE_DETECT_WUT_NORMAL		4	/* 500 ms */
+#define PHASE_DETECT_WUT_BUSY		1	/* 200 ms */
+
+/*! \brief Period bits of AS3911_REG_WUP_TIMER_CONTROL */
+#define WAKE_UP_PERIOD(wur, wut)	(((wur) << 7) | ((wut) << 4))
+
+/*! \brief Wake-up source passed to the scan policy */
+#ifdef PHASE_DETECT
+# define WAKE_UP_REASON				RfidWakePhase
+# define WAKE_UP_IRQ				AS3911_IRQ_MASK_WPH
+#else
+# define WAKE_UP_REASON				RfidWakeCapacitance
+# define WAKE_UP_IRQ				AS3911_IRQ_MASK_WCAP
+#endif
+
+/*!
+ * \brief Phase measurement configuration besides the threshold (pm_d), which
+ *        follows the noise band (RfidWakeRefThreshold)
+ */
+#define PHASE_DETECT_MEASURE_CONF	(AS3911_REG_PHASE_MEASURE_CONF_pm_aam \
+					 | AS3911_REG_PHASE_MEASURE_CONF_pm_ae)
+
+/*! \brief Wake-up timer registers besides period, reference and threshold, written before sleeping */
+static const u8 wake_up_profile[] PROGMEM = {
+#ifndef PHASE_DETECT
+	AS3911_TABLE_RUN(AS3911_REG_CAPACITANCE_MEASURE_CONF, 1),
+		0b00111001, /* cm_ae, cm_aew0, cm_aam, cm_d0 */
+#endif
+	AS3911_TABLE_END
+};
+
+/*! \brief AS3911_REG_WUP_TIMER_CONTROL per load of the slot (RfidWakeScheduleArm) */
+static const u8 wake_up_timer[RFID_WAKE_LOADS] = {
+#ifdef PHASE_DETECT
+	[RfidWakeQuiet] = AS3911_REG_WUP_TIMER_CONTROL_wph
+		| WAKE_UP_PERIOD(PHASE_DETECT_WUR, PHASE_DETECT_WUT_QUIET),
+	[RfidWakeNormal] = AS3911_REG_WUP_TIMER_CONTROL_wph
+		| WAKE_UP_PERIOD(PHASE_DETECT_WUR, PHASE_DETECT_WUT_NORMAL),
+	[RfidWakeBusy] = AS3911_REG_WUP_TIMER_CONTROL_wph
+		| WAKE_UP_PERIOD(PHASE_DETECT_WUR, PHASE_DETECT_WUT_BUSY),
+#else
+	[RfidWakeQuiet] = AS3911_REG_WUP_TIMER_CONTROL_wcap | WAKE_UP_PERIOD(1, 7), /* 80 ms */
+	[RfidWakeNormal] = AS3911_REG_WUP_TIMER_CONTROL_wcap | WAKE_UP_PERIOD(1, 4), /* 50 ms */
+	[RfidWakeBusy] = AS3911_REG_WUP_TIMER_CONTROL_wcap | WAKE_UP_PERIOD(1, 2), /* 30 ms */
+#endif
+};
 
 /* If enabled a beep will be triggered at every wake-up */
 //#define DBG_BEEP_ON_WAKE_UP 
@@ -52,34 +104,85 @@
 #define DOOR_ITERATION_TIMEOUT_MS 1
 
 /*! \brief Timeout after door-interrupt until interrupts are activated again */
-#define DOOR_PULL_UP_TIMEOUT_TICKS 10
+#define DOOR_PULL_UP_TIMEOUT_MS 5
+
+/*! \brief Max. polls without an answer after a card before the wake-up scan ends */
+#define WOKE_UP_SCAN_POLLS 2
 
 /*! \brief main application state of this application. */
 static enum MainState current_state = MSTATE_INITIALIZE;
 
-/*! \brief This variable will be set, if a learn interrupt has been registered */
-static volatile u8 learn = 0;
-
-/*! \brief This variable will be set, if a door-change interrupt has been registered */
-static volatile u8 door_changed = 0;
+/*! \brief Set while the wake-up timer of the AS3911 runs */
+static bool_t rf_armed = false;
 
-/*! \brief This variable will be set, if an capacitive wake up interrupt has been registered */
-static u8 wcap_intr = 0;
-
-/*! \brief This variable will be set, if an RTC interrupt has been registered */
-static u8 rtc_intr = 0;
+/*! \brief AS3911_REG_WUP_TIMER_CONTROL of the running wake-up timer */
+static u8 rf_timer_control = 0;
 
 //mu 08.10.2017
 /*! \brief This variable will count the bad detections from the RFID-Chip, if the value is higher then 5 --> Delay for 2 seconds (for the battery) */
 static u8 bad_detection_counter = 0;
 /*! \brief This define sets the max. allowed wrong RFID detections before the timer will be started */
 #define Bad_Detection_Counter_Execute_Value 3 /*! \G?ther 18.12.2017: ich starte die Verz?erung bereits nach 3 Leseversuchen*/
-/*! \brief This define sets the time delay which will block the code execution to save some energy */
-#define Bad_Detection_Counter_Execute_Time_ms 2000
+
+/*! \brief Probes of the first backoff, doubles with every further one up to #BACKOFF_MAX_LEVEL */
+#define BACKOFF_MIN_PROBES 1
+/*! \brief Doublings of the backoff (32 s) */
+#define BACKOFF_MAX_LEVEL 5
+/*! \brief Interval of the probes for a card during a backoff (in seconds) */
+#define BACKOFF_PROBE_S 1
+/*! \brief Measurements averaged by a probe */
+#define BACKOFF_PROBE_MEASUREMENTS 4
+/*!
+ * \brief Change of the mean of a probe that ends the backoff, the mean is
+ *        less noisy than the single measurements of the wake-up timer
+ */
+#define BACKOFF_PROBE_DELTA RFID_WAKE_REF_MIN_DELTA
+/*! \brief Time without false wake-ups that ends a series of backoffs (in milliseconds) */
+#define BACKOFF_CALM_MS U32_C(60000)
+
+/*! \brief Doublings of the next backoff */
+static u8 backoff_level = 0;
+/*! \brief Probes left in the running backoff */
+static u8 backoff_probes = 0;
+/*! \brief Antenna measured when the backoff started */
+static u8 backoff_ref = 0;
+/*! \brief Set if a probe of the backoff started MSTATE_WOKE_UP */
+static bool_t backoff_woke = false;
 
 /*! \brief Holds last scan result (RFID card) */
 struct scan_result_s scan_result;
 
+#ifdef CONF_ENABLE_ENERGY_TRACE
+/*! \brief Dump the energy summary every that many wake-ups */
+# define ENERGY_DUMP_INTERVAL 16
+#endif
+
+#ifdef CONF_ENABLE_WAIT_TRACE
+/*! \brief Dump the wait trace every that many wake-ups */
+# define WAIT_TRACE_DUMP_INTERVAL 16
+
+/*!
+ * \brief Latency budgets of the main states in ms (0 = none)
+ *
+ * A state exceeding its budget is logged by the wait trace. MSTATE_DEEP_SLEEP
+ * includes the sleep itself and the states waiting for a card or button
+ * include their RTC timeouts, so they have no budget.
+ */
+static const u16 state_budget_ms[] = {
+	[MSTATE_INITIALIZE] = 300,                 /* closes the lock */
+	[MSTATE_PREPARE_WAKE_UP] = 20,
+	[MSTATE_WOKE_UP] = 1500,
+	[MSTATE_ENTER_SOFTWARE_KEY] = 5000,        /* open, TIMEOUT_RTC_LOCK_OPEN_WAIT_TIME, close */
+	[MSTATE_ENTER_SOFTWARE_DOOR] = 5000,
+	[MSTATE_FOUND_UNKNOWN_CARD] = 1000,
+	[MSTATE_EXIT_PROG_OR_LEARN_MODE] = 500,
+};
+
+# define STATE_BUDGET_MS(state) \
+	(((state) < sizeof(state_budget_ms) / sizeof(state_budget_ms[0])) ? \
+	 state_budget_ms[(state)] : 0)
+#endif
+
 #define MAIN_STATE_TRANSITION(next_state) do {								\
 	current_state = next_state;									\
 } while (0)
@@ -95,7 +198,7 @@ static inline void disable_wakeup (void)
 	as3911DisableInterrupts(AS3911_IRQ_MASK_ALL);
 	as3911ClearInterrupts ();
 
-	wcap_intr = 0;
+	rf_armed = false;
 }
 
 /*!
@@ -113,7 +216,7 @@ static inline void enable_learn_interrupt (void)
 }
 
 /*!
- * \brief Disables and resets learn interrupt
+ * \brief Disables and resets learn interrupt, queued learn events are ignored
  */
 static inline void disable_learn_interrupt (void)
 {
@@ -121,8 +224,193 @@ static inline void disable_learn_interrupt (void)
 	LEARN_INTR_PORT.INT0MASK &= ~LEARN_INTR_PIN_bm;
 	LEARN_INTR_PORT.INTFLAGS |= PORT_INT0IF_bm;
 	IRQ_DEC_ENABLE();
+}
+
+/*!
+ * \brief Checks if the learn interrupt is enabled
+ */
+static inline bool_t learn_interrupt_enabled (void)
+{
+	return (LEARN_INTR_PORT.INT0MASK & LEARN_INTR_PIN_bm) != 0;
+}
+
+/*!
+ * \brief Callback of SOFT_TIMER_SCHEDULE, ends a slot of the wake-up schedule
+ * \param timer enum soft_timer
+ */
+static void schedule_slot_elapsed (u8 timer)
+{
+	softTimerStart (timer, RFID_WAKE_SCHEDULE_SLOT_MS, schedule_slot_elapsed);
+	eventPost (EVENT_SCHEDULE, 0);
+}
+
+/*!
+ * \brief Starts the wake-up timer with the period of the slot and the
+ *        reference of the tracker
+ */
+static void rf_arm (void)
+{
+	u8 val;
+
+	as3911DisableInterrupts(AS3911_IRQ_MASK_ALL);
+	as3911ClearInterrupts ();
 
-	learn = 0;
+	rf_timer_control = wake_up_timer[RfidWakeScheduleArm ()];
+	as3911WriteRegister (AS3911_REG_WUP_TIMER_CONTROL, rf_timer_control);
+
+#ifdef PHASE_DETECT
+
+	if (RfidWakeRefNeedsMeasurement ()) {
+		as3911ExecuteCommandAndGetResult (AS3911_CMD_MEASURE_PHASE, AS3911_REG_AD_RESULT, 100, &val);
+		RfidWakeRefMeasured (val);
+	}
+	val = RfidWakeRefArm ();
+
+	DLOG("Phase: %hu, threshold %hu\r\n", (u16)val, (u16)RfidWakeRefThreshold ());
+
+	as3911WriteRegisterRange (AS3911_REG_PHASE_MEASURE_REF, &val, 1);
+	as3911WriteRegisterTable (wake_up_profile);
+	as3911WriteRegister (AS3911_REG_PHASE_MEASURE_CONF,
+		PHASE_DETECT_MEASURE_CONF | (RfidWakeRefThreshold () << 4));
+	as3911WriteRegister (AS3911_REG_OP_CONTROL, AS3911_REG_OP_CONTROL_wu);
+	as3911ClearInterrupts ();
+	as3911EnableInterrupts(AS3911_IRQ_MASK_WPH);
+
+#else
+
+	as3911WriteRegister(AS3911_REG_CAP_SENSOR_CONTROL, 0x01); /* maximal gain, auto calibration */
+
+	as3911ExecuteCommandAndGetResult(AS3911_CMD_CALIBRATE_C_SENSOR,
+	AS3911_REG_CAP_SENSOR_RESULT, 255, &val);
+
+	as3911ExecuteCommandAndGetResult (AS3911_CMD_MEASURE_CAPACITANCE,
+	AS3911_REG_AD_RESULT, 100, &val);
+
+	DLOG("Capacity: %hu\r\n", (u16)val);
+
+	as3911WriteRegisterRange (AS3911_REG_CAPACITANCE_MEASURE_REF, &val, 1);
+	as3911WriteRegisterTable (wake_up_profile);
+	as3911WriteRegister (AS3911_REG_OP_CONTROL, AS3911_REG_OP_CONTROL_wu);
+	as3911ClearInterrupts ();
+	as3911EnableInterrupts(AS3911_IRQ_MASK_WCAP);
+
+#endif
+	rf_armed = true;
+}
+
+/*!
+ * \brief Stops the wake-up timer before the AS3911 is used otherwise
+ * \param woke TRUE if the timer woke the MCU up.
+ */
+static void rf_disarm (bool_t woke)
+{
+#ifdef PHASE_DETECT
+	u8 rx[2];
+
+	/* auto-average and last measurement of the timer */
+	as3911ReadMultipleRegisters (AS3911_REG_PHASE_MEASURE_AA_RESULT, rx, 2);
+	if (woke)
+		RfidWakeRefWoke (rx[0], rx[1]);
+	else
+		RfidWakeRefTracked (rx[0], rx[1]);
+#endif
+	disable_wakeup ();
+}
+
+/*!
+ * \brief Measures the antenna with the wake-up timer off
+ * \return Mean of #BACKOFF_PROBE_MEASUREMENTS measurements.
+ */
+static u8 backoff_measure (void)
+{
+	u16 sum = 0;
+	u8 val;
+	u8 i;
+
+	for (i = 0; i < BACKOFF_PROBE_MEASUREMENTS; ++i) {
+#ifdef PHASE_DETECT
+		as3911ExecuteCommandAndGetResult (AS3911_CMD_MEASURE_PHASE, AS3911_REG_AD_RESULT, 100, &val);
+#else
+		as3911ExecuteCommandAndGetResult (AS3911_CMD_MEASURE_CAPACITANCE, AS3911_REG_AD_RESULT, 100, &val);
+#endif
+		sum += val;
+	}
+
+	return (sum + BACKOFF_PROBE_MEASUREMENTS / 2) / BACKOFF_PROBE_MEASUREMENTS;
+}
+
+/*!
+ * \brief Probes for a card during a backoff
+ * \return TRUE if the antenna moved away from the reference of the backoff.
+ */
+static bool_t backoff_probe (void)
+{
+	u8 val = backoff_measure ();
+
+	return ((val > backoff_ref) ? val - backoff_ref : backoff_ref - val) >
+	       BACKOFF_PROBE_DELTA;
+}
+
+/*!
+ * \brief Counts a false wake-up and starts a backoff after
+ *        #Bad_Detection_Counter_Execute_Value in a row
+ *
+ * The backoff switches the AS3911 off. Every #BACKOFF_PROBE_S the RTC wakes
+ * the MCU to measure the antenna (backoff_probe), the backoff lasts
+ * twice as many probes as the previous one, until #BACKOFF_CALM_MS passed
+ * without false wake-ups.
+ * \return Next main state.
+ */
+static enum MainState false_wake (void)
+{
+	if (!softTimerIsRunning (SOFT_TIMER_FALSE_WAKE)) {
+		bad_detection_counter = 0;
+		backoff_level = 0;
+	}
+	softTimerStart (SOFT_TIMER_FALSE_WAKE, BACKOFF_CALM_MS, NULL);
+
+	if (bad_detection_counter < Bad_Detection_Counter_Execute_Value)
+		++bad_detection_counter;
+	if (bad_detection_counter < Bad_Detection_Counter_Execute_Value)
+		return MSTATE_PREPARE_WAKE_UP;
+
+	backoff_probes = BACKOFF_MIN_PROBES << backoff_level;
+	if (backoff_level < BACKOFF_MAX_LEVEL)
+		++backoff_level;
+	DLOG("Backoff %hu s\r\n", (u16)backoff_probes * BACKOFF_PROBE_S);
+
+	disable_wakeup ();
+	backoff_ref = backoff_measure ();
+	rtcStartINTR (SOFT_TIMER_BACKOFF, BACKOFF_PROBE_S);
+
+	return MSTATE_BACKOFF;
+}
+
+/*!
+ * \brief Qualifies a wake-up and measures how far the antenna moved since the
+ *        wake-up timer started
+ * \param sig Receives the measurements of the qualification.
+ * \param verdict Receives the verdict of the qualification.
+ * \return Difference of the new measurement to the auto-averaged reference of
+ *         the wake-up timer (the measure conf registers enable auto-averaging).
+ */
+static u8 wake_up_delta (struct RfidWakeSignature *sig,
+                         enum RfidQualifyVerdict *verdict)
+{
+	u8 val = 0;
+	u8 ref = 0;
+
+#ifdef PHASE_DETECT
+	as3911ReadRegister (AS3911_REG_PHASE_MEASURE_AA_RESULT, &ref);
+	*verdict = RfidQualifyWake (ref, sig);
+	val = sig->Phase;
+#else
+	as3911ReadRegister (AS3911_REG_CAPACITANCE_MEASURE_AA_RESULT, &ref);
+	*verdict = RfidQualifyWake (RfidQualifyGetReference ()->Phase, sig);
+	val = sig->Capacitance;
+#endif
+
+	return (val > ref) ? val - ref : ref - val;
 }
 
 /*!
@@ -137,7 +425,7 @@ Status IdentifyCardCallback (UnitId unitId, byte scanId, void *result)
 	static u8 counter = 0;
 	u8 i;
 	iso14443AProximityCard_t *card = result;
-	struct card *c;
+	struct card *c = NULL;
 
 	DLOG("\r\n  > Found RFID tag [unit=%hhu, count=%hhx]: ", unitId, counter++);
 
@@ -147,12 +435,15 @@ Status IdentifyCardCallback (UnitId unitId, byte scanId, void *result)
 	}
 	DLOG ("\r\n");
 
+	/* the card shifts the antenna, the next re-arm measures again */
+	RfidWakeRefInvalidate ();
+
 	cardCopy (card->uid, card->actlength, &scan_result.card);
 	scan_result.type = cardmanGetCardType (card->uid, card->actlength, &c);
-	scan_result.extra = c->extra[0];
+	/* cardmanGetCardType doesn't set c for unknown cards */
+	scan_result.extra = c ? c->extra[0] : 0;
 
-	if (scan_result.found_card_counter < 0xff)	/* Do not overflow! */
-		++scan_result.found_card_counter;
+	counterInc8 (&scan_result.found_card_counter);
 
 	return ERR_NONE;
 }
@@ -160,7 +451,7 @@ Status IdentifyCardCallback (UnitId unitId, byte scanId, void *result)
 /*! \brief Interrupt used to register that the learn button has been pressed/released */
 ISR(PORTB_INT0_vect)
 {
-	learn = 1;
+	eventPost (EVENT_LEARN, 0);
 }
 
 enum TriggerSource {
@@ -177,19 +468,17 @@ static volatile enum {
 /************************************************************************/
 /*                                                                      */
 /************************************************************************/
-static int8_t door_intr_activate_open_cb (uint8_t status)
+static void door_intr_activate_open_cb (u8 timer)
 {
 	DOOR_OPEN_INTR_PORT.INT1MASK |= DOOR_OPEN_INTR_PIN_bm;
-	return 0;
 }
 
 /************************************************************************/
 /*                                                                      */
 /************************************************************************/
-static int8_t door_intr_activate_closed_cb (uint8_t status)
+static void door_intr_activate_closed_cb (u8 timer)
 {
 	DOOR_CLOSE_INTR_PORT.INT1MASK |= DOOR_CLOSE_INTR_PIN_bm;
-	return 0;
 }
 
 /************************************************************************/
@@ -206,14 +495,16 @@ static void door_intr_change_trigger_locked(enum TriggerSource trigger)
 		ioport_configure_pin (SW_DOOR_OPENED, IOPORT_DIR_INPUT | IOPORT_PULL_UP);
 		DOOR_OPEN_INTR_PORT.INT1MASK |= DOOR_OPEN_INTR_PIN_bm;
 		s_door_state = DOOR_STATE_CLOSED;
-		rsched_reschedule(DOOR_PULL_UP_TIMEOUT_TICKS, door_intr_activate_open_cb);
+		softTimerStart(SOFT_TIMER_DOOR_OPEN, DOOR_PULL_UP_TIMEOUT_MS,
+		               door_intr_activate_open_cb);
 		break;
 
 	case TRIGGER_SOURCE_SW_CLOSED:
 		ioport_configure_pin (SW_DOOR_CLOSED, IOPORT_DIR_INPUT | IOPORT_PULL_UP);
 		ioport_configure_pin (SW_DOOR_OPENED, IOPORT_DIR_INPUT | IOPORT_PULL_DOWN);
 		s_door_state = DOOR_STATE_OPEN;
-		rsched_reschedule(DOOR_PULL_UP_TIMEOUT_TICKS, door_intr_activate_closed_cb);
+		softTimerStart(SOFT_TIMER_DOOR_CLOSED, DOOR_PULL_UP_TIMEOUT_MS,
+		               door_intr_activate_closed_cb);
 		break;
 	}
 }
@@ -221,14 +512,14 @@ static void door_intr_change_trigger_locked(enum TriggerSource trigger)
 /*! \brief Interrupt used to register that the door close state has changed */
 ISR(PORTA_INT1_vect)
 {
-	door_changed = 1;
+	eventPost (EVENT_DOOR, 0);
 	door_intr_change_trigger_locked(TRIGGER_SOURCE_SW_OPEN);
 }
 
 /*! \brief Interrupt used to register door open state changes */
 ISR(PORTE_INT1_vect)
 {
-	door_changed = 1;
+	eventPost (EVENT_DOOR, 0);
 	door_intr_change_trigger_locked(TRIGGER_SOURCE_SW_CLOSED);
 }
 
@@ -305,7 +596,13 @@ static void door_intr_print_state (void)
 static void preprocess_door_intr (void)
 {
 	door_intr_print_state();
-	rsched_wait_pending_locked();
+
+	/* The door interrupts are enabled again by the RTC in power-save */
+	while (softTimerIsRunning (SOFT_TIMER_DOOR_OPEN) ||
+	       softTimerIsRunning (SOFT_TIMER_DOOR_CLOSED)) {
+		SoftwareSleep ();
+		cpu_irq_disable();
+	}
 }
 
 /************************************************************************/
@@ -316,517 +613,662 @@ static void postprocess_door_intr (void)
 	door_intr_print_state();
 }
 
-
-/************************************************************************/
-/*                                                                      */
-/************************************************************************/
-void MainStateMachine (void)
+/*!
+ * \brief Handles an event of the interrupts in the sleep states
+ *
+ * Only the learn button and a wake-up of the timer stop the wake-up timer,
+ * the door, the RTC timeouts and a slot with the same period leave it
+ * running, the MCU sleeps again without re-arming it.
+ * \param ev The event.
+ * \return TRUE if the event started another state.
+ */
+static bool_t handle_event (const struct event *ev)
 {
-	static u32 woke_counter = U32_C(0);
-	s8 err;
-	u8 val, val1;
-	u32 ret;
-
-	u8 sw = cardmanGetSoftwareFunction();
-	
-	switch (current_state) {
-	case MSTATE_INITIALIZE:
-		/* enable door interrupt */
-		//ioport_set_pin_sense_mode (SW_DOOR_CLOSED, IOPORT_SENSE_BOTHEDGES);
-			/* door */
-		DOOR_CLOSE_INTR_PORT.INTCTRL = PORT_INT1LVL_LO_gc;
-		DOOR_OPEN_INTR_PORT.INTCTRL = PORT_INT1LVL_LO_gc;
-
-		door_intr_change_trigger_locked(TRIGGER_SOURCE_SW_CLOSED);
+	switch (ev->type) {
+	case EVENT_LEARN:
+		/* presses before the learn interrupt has been disabled */
+		if (!learn_interrupt_enabled ())
+			break;
+		if (rf_armed)
+			rf_disarm (false);
+		disable_learn_interrupt ();
+		MAIN_STATE_TRANSITION(MSTATE_ENTER_LEARN_MODE);
+		return true;
+
+	case EVENT_DOOR:
+		disable_learn_interrupt ();
+		MAIN_STATE_TRANSITION(MSTATE_ENTER_SOFTWARE_DOOR);
+		return true;
+
+	case EVENT_TIMEOUT:
+		/* the flags are cleared by MSTATE_ENTER_SOFTWARE_RTC */
+		if ((ev->arg != SOFT_TIMER_ALARM) && (ev->arg != SOFT_TIMER_GYM))
+			break;
+		MAIN_STATE_TRANSITION(MSTATE_ENTER_SOFTWARE_RTC);
+		return true;
 
-		SoftwareStateMachine(SW_TRIGGER_INIT_SOFTWARE);
-		MAIN_STATE_TRANSITION(MSTATE_PREPARE_WAKE_UP);
+	case EVENT_RF_WAKE_UP:
+		/* a wake-up of a timer that has been stopped since */
+		if (!rf_armed || !as3911GetInterrupt (WAKE_UP_IRQ))
+			break;
+		rf_disarm (true);
+		MAIN_STATE_TRANSITION(MSTATE_WOKE_UP);
+		return true;
+
+	case EVENT_SCHEDULE:
+		if ((wake_up_timer[RfidWakeScheduleNextSlot ()] != rf_timer_control) &&
+		    rf_armed)
+			rf_disarm (false);
 		break;
 
-	case MSTATE_PREPARE_WAKE_UP:
-		enable_learn_interrupt ();
-		as3911DisableInterrupts(AS3911_IRQ_MASK_ALL);
-		as3911ClearInterrupts ();
-		
-		
-		
-		
-		
-#ifdef PHASE_DETECT		
-
-		as3911ExecuteCommandAndGetResult (AS3911_CMD_MEASURE_PHASE, AS3911_REG_AD_RESULT, 100, &val);
-
-		DLOG("Phase: %hu\r\n", (u16)val);
-		
-		uint8_t wup_timer_reg = 0x00	| AS3911_REG_WUP_TIMER_CONTROL_wph | (PHASE_DETECT_WUR << 7)
-										| (PHASE_DETECT_WUT2 << 6) | (PHASE_DETECT_WUT1 << 5)
-										| (PHASE_DETECT_WUT0 << 4);
-		
-				
-		as3911WriteRegister (AS3911_REG_PHASE_MEASURE_REF, val);
-		as3911WriteRegister (AS3911_REG_PHASE_MEASURE_CONF, 0b00111001); //0b00111001
-		
-		as3911WriteRegister (AS3911_REG_WUP_TIMER_CONTROL, wup_timer_reg);
-		as3911WriteRegister (AS3911_REG_OP_CONTROL, AS3911_REG_OP_CONTROL_wu);
-		as3911ClearInterrupts ();
-		as3911EnableInterrupts(AS3911_IRQ_MASK_WPH);
-		
-#else
+	default:
+		DLOG("Unexpected event %hhu\r\n", ev->type);
+		break;
+	}
 
-		as3911WriteRegister(AS3911_REG_CAP_SENSOR_CONTROL, 0x01); /* maximal gain, auto calibration */
+	return false;
+}
 
-		as3911ExecuteCommandAndGetResult(AS3911_CMD_CALIBRATE_C_SENSOR,
-		AS3911_REG_CAP_SENSOR_RESULT, 255, &val);
+/*! \brief Main state MSTATE_INITIALIZE */
+static void state_initialize (void)
+{
+	/* enable door interrupt */
+	//ioport_set_pin_sense_mode (SW_DOOR_CLOSED, IOPORT_SENSE_BOTHEDGES);
+		/* door */
+	DOOR_CLOSE_INTR_PORT.INTCTRL = PORT_INT1LVL_LO_gc;
+	DOOR_OPEN_INTR_PORT.INTCTRL = PORT_INT1LVL_LO_gc;
 
-		as3911ExecuteCommandAndGetResult (AS3911_CMD_MEASURE_CAPACITANCE,
-		AS3911_REG_AD_RESULT, 100, &val);
+	door_intr_change_trigger_locked(TRIGGER_SOURCE_SW_CLOSED);
 
-		DLOG("Capacity: %hu\r\n", (u16)val);
+	RfidQualifyCalibrate ();
+	softTimerStart (SOFT_TIMER_SCHEDULE, RFID_WAKE_SCHEDULE_SLOT_MS,
+	                schedule_slot_elapsed);
+	SoftwareStateMachine(SW_TRIGGER_INIT_SOFTWARE);
+	MAIN_STATE_TRANSITION(MSTATE_PREPARE_WAKE_UP);
+}
 
-		as3911WriteRegister (AS3911_REG_CAPACITANCE_MEASURE_REF, val);
-		as3911WriteRegister (AS3911_REG_CAPACITANCE_MEASURE_CONF, 0b00111001); /* cm_ae, cm_aew0, cm_aam, cm_d0 */
-		as3911WriteRegister (AS3911_REG_WUP_TIMER_CONTROL,0b11000000 | AS3911_REG_WUP_TIMER_CONTROL_wcap ); /* 50 ms */
-		as3911WriteRegister (AS3911_REG_OP_CONTROL, AS3911_REG_OP_CONTROL_wu);
-		as3911ClearInterrupts ();
-		as3911EnableInterrupts(AS3911_IRQ_MASK_WCAP);
+/*!
+ * \brief Main state MSTATE_PREPARE_WAKE_UP
+ *
+ * Arms the wake-up timer if the last states stopped it. Queued events are
+ * handled first, they may need the AS3911 anyway.
+ */
+static void state_prepare_wake_up (void)
+{
+	/* Runs in the background while the AS3911 is calibrated */
+	cardmanEraseStalePage ();
+	if (!rf_armed && !eventPending ())
+		rf_arm ();
+	buzzerStop(); /* Make sure, buzzer is off */
+	MAIN_STATE_TRANSITION(MSTATE_DEEP_SLEEP);
+}
 
-#endif
-		buzzerStop(); /* Make sure, buzzer is off */
-		MAIN_STATE_TRANSITION(MSTATE_DEEP_SLEEP);
-		break;
+/*!
+ * \brief Main state MSTATE_DEEP_SLEEP
+ *
+ * Handles the queued events, then sleeps until the next one; it is handled
+ * by the next call.
+ */
+static void state_deep_sleep (void)
+{
+	static u32 woke_counter = U32_C(0);
+	struct event ev;
 
-	case MSTATE_DEEP_SLEEP:
-		spiPause ();
+	while (eventGet (&ev)) {
+		if (handle_event (&ev))
+			return;
+	}
 
-		SoftwareCheckAlarm();
+	if (!rf_armed) {
+		MAIN_STATE_TRANSITION(MSTATE_PREPARE_WAKE_UP);
+		return;
+	}
 
-		cpu_irq_disable();
-		
-	//TESTEN UM ENERGIE zu sparen!!!
-		// mu 16.10.2017
-		
-		if(bad_detection_counter >= Bad_Detection_Counter_Execute_Value)
-		{
-			rtcStartINTR(Bad_Detection_Counter_Execute_Time_ms / 1000);
-			
-			while(!rtcGetInterrupt())
-			{
-				SoftwareSleep();
-			}
+	enable_learn_interrupt ();
+	spiPause ();
 
-			if(cardmanGetNumberOfKeys() == 0)
-			{
-				buzzerStart(SignalWakeUp, false);
-				buzzerWaitTillFinished();
-				delayNMilliSeconds(70);
-			}
-			//buzzerStart(SignalWakeUp, false);
-			//buzzerWaitTillFinished();
-			//delayNMilliSeconds(70);
-		}
-		
+	SoftwareCheckAlarm();
 
-		preprocess_door_intr();
-		DLOG("SLEEP\r\n");
-		if ((learn == 0) && (door_changed == 0) && (rtc_intr == 0) &&
-			(wcap_intr == 0) && (!rtcPollInterrupt_LOCKED())) {
+	/* The NVM interrupt doesn't wake the MCU from power-save */
+	eepromQueueFlush ();
+	cpu_irq_disable();
+	
+	preprocess_door_intr();
+	DLOG("SLEEP\r\n");
+	/* software timers without an event (door debounce, the steps of long
+	 * timeouts) wake the MCU too, it sleeps again after them */
+	if (!eventPending ()) {
+		do {
 			SoftwareSleep ();
+			cpu_irq_disable ();
+		} while (!eventPending ());
+		cpu_irq_enable ();
 
-			//mu 08.10.2017
-			//IF COUNTER >= 5 sleep 2 Sekunden. (TODO: go to deep Sleep and wake up only by a timer)
-			//if(bad_detection_counter >= Bad_Detection_Counter_Execute_Value)
-			//{
-				//delayNMilliSeconds(2000); //Bad_Detection_Counter_Execute_Time_ms);
-			//}
+		postprocess_door_intr();
 
-			postprocess_door_intr();
-
-			if (woke_counter < U32_C(0xffffffff))
-				++woke_counter;
+		counterInc32 (&woke_counter);
+		energyWakeCycle ();
 #ifdef DBG_BEEP_ON_WAKE_UP
-			if (is_function_control_enabled()) {
-				buzzerStart(SignalWakeUp, false);
-				buzzerWaitTillFinished();
-				delayNMilliSeconds(70);
-			}
-#endif
-
-			spiReinitialize ();
-			uartInitialize (115200, NULL);
-			DLOG("\r\n====> Wake-Up Counter: %lu\r\n", woke_counter);
-		} else {
-			cpu_irq_enable(); /* Turn on IRQ's again */
+		if (is_function_control_enabled()) {
+			buzzerStart(SignalWakeUp, false);
+			buzzerWaitTillFinished();
+			delayNMilliSeconds(70);
 		}
+#endif
 
-		if (rtcGetInterrupt ())
-			rtc_intr = 1;
-
-#ifdef PHASE_DETECT 
-		ret = as3911GetInterrupt (AS3911_IRQ_MASK_WPH);
-		disable_wakeup ();
+		spiReinitialize ();
+		uartInitialize (115200, NULL);
+		DLOG("\r\n====> Wake-Up Counter: %lu\r\n", woke_counter);
+#ifdef CONF_ENABLE_WAIT_TRACE
+		if ((woke_counter % WAIT_TRACE_DUMP_INTERVAL) == 0)
+			waitTraceDump ();
+#endif
+#ifdef CONF_ENABLE_ENERGY_TRACE
+		if ((woke_counter % ENERGY_DUMP_INTERVAL) == 0)
+			energyDump ();
+#endif
+	} else {
+		cpu_irq_enable(); /* Turn on IRQ's again */
+	}
+}
 
-		if (ret & AS3911_IRQ_MASK_WPH)
-		wcap_intr = 1;			
-#else
-		ret = as3911GetInterrupt (AS3911_IRQ_MASK_WCAP);
-		disable_wakeup ();
+/*! \brief Main state MSTATE_ENTER_LEARN_MODE */
+static void state_enter_learn_mode (void)
+{
+	buzzerStart(SignalModeFast, true);
+	DLOG("Learn Mode\r\n");
+	rtcStart (SOFT_TIMER_MODE, TIMEOUT_RTC_LEARN_MODE);
+	MAIN_STATE_TRANSITION(MSTATE_WAIT_LEARN_MODE);
+}
 
-		if (ret & AS3911_IRQ_MASK_WCAP)
-			wcap_intr = 1;
-			
+/*! \brief Main state MSTATE_WAIT_LEARN_MODE */
+static void state_wait_learn_mode (void)
+{
+	s8 err;
+	u8 val;
 
-#endif 
-
-		
-		
-		if (learn) {
-			disable_learn_interrupt ();
-			MAIN_STATE_TRANSITION(MSTATE_ENTER_LEARN_MODE);
-		} else if (door_changed) {
-			door_changed = 0;
-			disable_learn_interrupt ();
-			MAIN_STATE_TRANSITION(MSTATE_ENTER_SOFTWARE_DOOR);
-		} else if (rtc_intr) {
-			rtc_intr = 0;
-			MAIN_STATE_TRANSITION(MSTATE_ENTER_SOFTWARE_RTC);
-		} else if (wcap_intr) {
-			wcap_intr = 0;
-			MAIN_STATE_TRANSITION(MSTATE_WOKE_UP);
+	if (rtcIsFinished (SOFT_TIMER_MODE)) {
+		buzzerStop ();
+		delayNMilliSeconds (500);
+		MAIN_STATE_TRANSITION(MSTATE_EXIT_PROG_OR_LEARN_MODE);
+	}
+	scan_result.found_card_counter = 0;
+	RfidStartScan (RFID_UNIT_1, 0, IdentifyCardCallback);
+	if (scan_result.found_card_counter == 1) {
+		if (scan_result.type == CARD_TYPE_GYM_SOFTWARD_CARD) {
+			DLOG("GYM mode card NO-AUTO\r\n");
+
+			////////////////////////
+			val = rtcXSecondsPassed(SOFT_TIMER_MODE, 10) ? 1 : 0;
+			if (val) { /* Wait 2 seconds before changing state... */
+				buzzerStop();
+				rtcStop (SOFT_TIMER_MODE);
+				DLOG("Delete all keys!\r\n");
+				cardmanDeleteAllKeys ();
+				buzzerStart(SignalAllDeleted, false);
+				buzzerWaitTillFinished ();
+				delayNMilliSeconds(200);
+				SoftwareStateMachine(SW_TRIGGER_CHANGE_NCARDS);
+			}
+			////////////////////////
+			cardmanSetSoftwareFunctionOpenDelay(SW_FUNCTION_GYM, 0);
+			buzzerStart(SignalAllDeleted, false);
+			buzzerWaitTillFinished();
+			eepromQueueFlush ();
+			CCP = CCP_IOREG_gc;
+			RST.CTRL =  RST_SWRST_bm;
+			for(;;);
 		} else {
-			MAIN_STATE_TRANSITION(MSTATE_PREPARE_WAKE_UP);
-		}
-		break;
-
-	case MSTATE_ENTER_LEARN_MODE:
-		buzzerStart(SignalModeFast, true);
-		DLOG("Learn Mode\r\n");
-		rtcStart (TIMEOUT_RTC_LEARN_MODE);
-		MAIN_STATE_TRANSITION(MSTATE_WAIT_LEARN_MODE);
-		break;
-
-	case MSTATE_WAIT_LEARN_MODE:
-		if (rtcIsFinished ()) {
 			buzzerStop ();
-			delayNMilliSeconds (500);
-			MAIN_STATE_TRANSITION(MSTATE_EXIT_PROG_OR_LEARN_MODE);
-		}
-		scan_result.found_card_counter = 0;
-		err = RfidStartScan (RFID_UNIT_1, 0, IdentifyCardCallback);
-		if (scan_result.found_card_counter == 1) {
+			rtcStop (SOFT_TIMER_MODE);
+			
 			if (scan_result.type == CARD_TYPE_GYM_SOFTWARD_CARD) {
-				DLOG("GYM mode card NO-AUTO\r\n");
-
-				////////////////////////
-				val = rtcXSecondsPassed(10) ? 1 : 0;
-				if (val) { /* Wait 2 seconds before changing state... */
-					buzzerStop();
-					rtcStop ();
-					DLOG("Delete all keys!\r\n");
-					cardmanDeleteAllKeys ();
-					buzzerStart(SignalAllDeleted, false);
-					buzzerWaitTillFinished ();
-					delayNMilliSeconds(200);
-					SoftwareStateMachine(SW_TRIGGER_CHANGE_NCARDS);
-				}
-				////////////////////////
-				cardmanSetSoftwareFunctionOpenDelay(SW_FUNCTION_GYM, 0);
+				
+			} else if (scan_result.type == CARD_TYPE_GYM_SOFTWARD_CARD_6) {
+				
+				DLOG("GYM mode card 6 hours\r\n");
+				cardmanSetSoftwareFunctionOpenDelay(SW_FUNCTION_GYM, 6);
 				buzzerStart(SignalAllDeleted, false);
 				buzzerWaitTillFinished();
+				eepromQueueFlush ();
 				CCP = CCP_IOREG_gc;
 				RST.CTRL =  RST_SWRST_bm;
 				for(;;);
-			} else {
-				buzzerStop ();
-				rtcStop ();
-				
-				if (scan_result.type == CARD_TYPE_GYM_SOFTWARD_CARD) {
-					
-				} else if (scan_result.type == CARD_TYPE_GYM_SOFTWARD_CARD_6) {
-					
-					DLOG("GYM mode card 6 hours\r\n");
-					cardmanSetSoftwareFunctionOpenDelay(SW_FUNCTION_GYM, 6);
-					buzzerStart(SignalAllDeleted, false);
-					buzzerWaitTillFinished();
-					CCP = CCP_IOREG_gc;
-					RST.CTRL =  RST_SWRST_bm;
-					for(;;);
-				} else if (scan_result.type == CARD_TYPE_GYM_SOFTWARD_CARD_12) {
-					
-					DLOG("GYM mode card 12 hours\r\n");
-					cardmanSetSoftwareFunctionOpenDelay(SW_FUNCTION_GYM, 12);
-					buzzerStart(SignalAllDeleted, false);
-					buzzerWaitTillFinished();
-					CCP = CCP_IOREG_gc;
-					RST.CTRL =  RST_SWRST_bm;
-					for(;;);
-				} else if (scan_result.type == CARD_TYPE_GYM_SOFTWARD_CARD_24) {
+			} else if (scan_result.type == CARD_TYPE_GYM_SOFTWARD_CARD_12) {
 				
-					DLOG("GYM mode card 24 hours\r\n");
-					cardmanSetSoftwareFunctionOpenDelay(SW_FUNCTION_GYM, 24);
-					buzzerStart(SignalAllDeleted, false);
-					buzzerWaitTillFinished();
-					CCP = CCP_IOREG_gc;
-					RST.CTRL =  RST_SWRST_bm;
-					for(;;);
+				DLOG("GYM mode card 12 hours\r\n");
+				cardmanSetSoftwareFunctionOpenDelay(SW_FUNCTION_GYM, 12);
+				buzzerStart(SignalAllDeleted, false);
+				buzzerWaitTillFinished();
+				eepromQueueFlush ();
+				CCP = CCP_IOREG_gc;
+				RST.CTRL =  RST_SWRST_bm;
+				for(;;);
+			} else if (scan_result.type == CARD_TYPE_GYM_SOFTWARD_CARD_24) {
+			
+				DLOG("GYM mode card 24 hours\r\n");
+				cardmanSetSoftwareFunctionOpenDelay(SW_FUNCTION_GYM, 24);
+				buzzerStart(SignalAllDeleted, false);
+				buzzerWaitTillFinished();
+				eepromQueueFlush ();
+				CCP = CCP_IOREG_gc;
+				RST.CTRL =  RST_SWRST_bm;
+				for(;;);
 
-					
-				} else  {
-				
-					err = cardmanSetProgrammingCard (scan_result.card.uid, scan_result.card.len);
-					if (err) {
-						DLOG("Couldn't set Programming card [err: %hhd]\r\n", err);
-						delayNMilliSeconds (500);
-						MAIN_STATE_TRANSITION(MSTATE_ERROR_SET_PROG_CARD_FAILED);
-					} else {
-						DLOG("Programming card has been set!\r\n");
-						delayNMilliSeconds (500);
-						buzzerStart (SignalPositive, false);
-						buzzerWaitTillFinished ();
-						MAIN_STATE_TRANSITION(MSTATE_EXIT_PROG_OR_LEARN_MODE);
-					}
 				
+			} else  {
+			
+				err = cardmanSetProgrammingCard (scan_result.card.uid, scan_result.card.len);
+				if (err) {
+					DLOG("Couldn't set Programming card [err: %hhd]\r\n", err);
+					delayNMilliSeconds (500);
+					MAIN_STATE_TRANSITION(MSTATE_ERROR_SET_PROG_CARD_FAILED);
+				} else {
+					DLOG("Programming card has been set!\r\n");
+					delayNMilliSeconds (500);
+					buzzerStart (SignalPositive, false);
+					buzzerWaitTillFinished ();
+					MAIN_STATE_TRANSITION(MSTATE_EXIT_PROG_OR_LEARN_MODE);
 				}
+			
 			}
 		}
-		break;
+	}
+}
 
-	case MSTATE_WOKE_UP:
-		scan_result.found_card_counter = 0;
-		delayNMilliSeconds (10);
-		err = RfidStartScan (RFID_UNIT_1, 0, IdentifyCardCallback);
-		if (scan_result.found_card_counter == 0) {
-			if (learn == 1) {
-				disable_learn_interrupt ();
-				disable_wakeup ();
-				MAIN_STATE_TRANSITION(MSTATE_ENTER_LEARN_MODE);
-			} else {
-				MAIN_STATE_TRANSITION(MSTATE_PREPARE_WAKE_UP);
-				if(bad_detection_counter <= Bad_Detection_Counter_Execute_Value) bad_detection_counter++;	//mu 08.10.2017
-			}
-		} else if (scan_result.found_card_counter == 1) {
-			bad_detection_counter = 0;	//mu 08.10.2017
-			disable_learn_interrupt ();
-
-			if (sw & SW_FUNCTION_GYM && scan_result.type != CARD_TYPE_SOFTWARE_CARD) {
-							door_intr_activate_open_cb(1);
-							door_intr_activate_closed_cb(1);
-							
-				gym_card_callback(&scan_result);
+/*!
+ * \brief Main state MSTATE_BACKOFF
+ *
+ * Sleeps with the AS3911 off until the next probe of false_wake or an event
+ * of the learn button, the door or the RTC ends the backoff.
+ */
+static void state_backoff (void)
+{
+	struct event ev;
+
+	while (eventGet (&ev)) {
+		if ((ev.type == EVENT_TIMEOUT) && (ev.arg == SOFT_TIMER_BACKOFF)) {
+			if (!rtcGetInterrupt (SOFT_TIMER_BACKOFF))
+				continue;
+			if (--backoff_probes == 0) {
+				DLOG("Backoff done\r\n");
+				if (cardmanGetNumberOfKeys() == 0) {
+					buzzerStart(SignalWakeUp, false);
+					buzzerWaitTillFinished();
+					delayNMilliSeconds(70);
+				}
 				MAIN_STATE_TRANSITION(MSTATE_PREPARE_WAKE_UP);
-				
+			} else if (backoff_probe ()) {
+				/* a card (or more noise) ends the backoff like a wake-up */
+				backoff_woke = true;
+				MAIN_STATE_TRANSITION(MSTATE_WOKE_UP);
 			} else {
-
-				switch (scan_result.type) {
-					case CARD_TYPE_KEY:
-						DLOG("It's a key [page: %hhd]!\r\n", scan_result.extra);
-						MAIN_STATE_TRANSITION(MSTATE_ENTER_SOFTWARE_KEY);
-						break;
-
-					case CARD_TYPE_PROGRAMMING_CARD:
-						DLOG("It's a programming card [used: %hhd]!\r\n",scan_result.extra);
-						MAIN_STATE_TRANSITION(MSTATE_ENTER_PROGRAMMING_MODE_1);
-						break;
-
-					case CARD_TYPE_SOFTWARE_CARD:
-					case CARD_TYPE_GYM_SOFTWARD_CARD:
-						DLOG ("It's a software card [sw-function: %hhd]!\r\n", scan_result.extra);
-
-						buzzerStart (SignalSetSoftware, false);
-						buzzerWaitTillFinished ();
-						SoftwareStateMachine (SW_TRIGGER_DEINIT_SOFTWARE);
-						cardmanSetSoftwareFunction (scan_result.extra);
-						DLOG("Change software version:\r\n");
-						SoftwarePrintVersion();
-						SoftwareStateMachine (SW_TRIGGER_INIT_SOFTWARE);
-						MAIN_STATE_TRANSITION(MSTATE_EXIT_PROG_OR_LEARN_MODE);
-
-						//MAIN_STATE_TRANSITION(MSTATE_WAIT_PROG_MODE_1);
-						break;
-					
-					case CARD_TYPE_UNKNOWN:
-						MAIN_STATE_TRANSITION(MSTATE_FOUND_UNKNOWN_CARD);
-						break;
-				}
+				rtcStartINTR (SOFT_TIMER_BACKOFF, BACKOFF_PROBE_S);
 			}
-		} else {
-			disable_learn_interrupt ();
-			MAIN_STATE_TRANSITION(MSTATE_ERROR_MULTIPLE_CARDS);
+			return;
 		}
-		break;
 
-	case MSTATE_ENTER_SOFTWARE_KEY: {
-		
-		buzzerStart(SignalPositive, false);
-		buzzerWaitTillFinished();
-		SoftwareStateMachine (SW_TRIGGER_KEY);
+		if (handle_event (&ev)) {
+			/* the next false wake-up continues the series */
+			rtcStop (SOFT_TIMER_BACKOFF);
+			rtcGetInterrupt (SOFT_TIMER_BACKOFF);
+			return;
+		}
+	}
 
-		MAIN_STATE_TRANSITION(MSTATE_PREPARE_WAKE_UP);
-		break;
+	spiPause ();
+
+	SoftwareCheckAlarm();
+
+	eepromQueueFlush ();
+	cpu_irq_disable ();
+	while (!eventPending ()) {
+		SoftwareSleep ();
+		cpu_irq_disable ();
+		energyWakeCycle ();
 	}
+	cpu_irq_enable ();
 
-	case MSTATE_ENTER_SOFTWARE_RTC:
-		SoftwareStateMachine (SW_TRIGGER_RTC);
-		gym_rtc_callback();
-		MAIN_STATE_TRANSITION(MSTATE_PREPARE_WAKE_UP);
-		break;
+	spiReinitialize ();
+	uartInitialize (115200, NULL);
+}
 
-	case MSTATE_ENTER_SOFTWARE_DOOR:
-		if (is_function_control_enabled()) {
-			if (isDoorClosed()) {
-				buzzerStart(SignalTestOn, false);
-			} else {
-				buzzerStart(SignalTestOff, false);
+/*! \brief Main state MSTATE_WOKE_UP */
+static void state_woke_up (void)
+{
+	u8 sw = cardmanGetSoftwareFunction();
+	u8 delta;
+	struct RfidScanPolicy policy;
+	struct RfidWakeSignature sig;
+	enum RfidQualifyVerdict verdict;
+
+	scan_result.found_card_counter = 0;
+	delayNMilliSeconds (10);
+	delta = wake_up_delta (&sig, &verdict);
+	DLOG("Wake-up delta: %hu, qualify %hu (%hu/%hu/%hu)\r\n", (u16)delta,
+	     (u16)verdict, (u16)sig.Phase, (u16)sig.Amplitude, (u16)sig.Capacitance);
+	/* door slams don't get a scan */
+	if (verdict != RfidQualifySettled) {
+		RfidPolicySelect (WAKE_UP_REASON, delta,
+		                  verdict == RfidQualifyCard, &policy);
+		/* a hand may hold a card at the edge of the range */
+		if ((verdict == RfidQualifyHand) &&
+		    (policy.Class == RfidPolicyMarginal))
+			policy.Attempts = RFID_QUALIFY_HAND_ATTEMPTS;
+		if (policy.PollsAfterTag > WOKE_UP_SCAN_POLLS)
+			policy.PollsAfterTag = WOKE_UP_SCAN_POLLS;
+		RfidStartScanPolicy (RFID_UNIT_1, 0, &policy, IdentifyCardCallback);
+	}
+	if (scan_result.found_card_counter != 0)
+		RfidWakeScheduleCard ();
+	/* nothing answered: the burst saw the empty field (or a hand) */
+	if ((scan_result.found_card_counter == 0) && (verdict != RfidQualifyHand))
+		RfidQualifyLearn (&sig);
+	if (scan_result.found_card_counter == 0) {
+#ifdef PHASE_DETECT
+		/* a probe didn't wake the timer up, only moves the baseline. The
+		 * baseline doesn't follow a hand, a card in it may come closer */
+		if (backoff_woke)
+			RfidWakeRefMeasured (sig.Phase);
+		else if (verdict != RfidQualifyHand)
+			RfidWakeRefFalseWake (sig.Phase);
+#endif
+		/* someone at the locker taps soon, don't back off */
+		if (verdict == RfidQualifyHand)
+			MAIN_STATE_TRANSITION(MSTATE_PREPARE_WAKE_UP);
+		else
+			MAIN_STATE_TRANSITION(false_wake ());
+	} else if (scan_result.found_card_counter == 1) {
+		bad_detection_counter = 0;	//mu 08.10.2017
+		backoff_level = 0;
+		disable_learn_interrupt ();
+
+		if (sw & SW_FUNCTION_GYM && scan_result.type != CARD_TYPE_SOFTWARE_CARD) {
+						door_intr_activate_open_cb(SOFT_TIMER_DOOR_OPEN);
+						door_intr_activate_closed_cb(SOFT_TIMER_DOOR_CLOSED);
+						
+			gym_card_callback(&scan_result);
+			MAIN_STATE_TRANSITION(MSTATE_PREPARE_WAKE_UP);
+			
+		} else {
+
+			switch (scan_result.type) {
+				case CARD_TYPE_KEY:
+					DLOG("It's a key [page: %hhd]!\r\n", scan_result.extra);
+					MAIN_STATE_TRANSITION(MSTATE_ENTER_SOFTWARE_KEY);
+					break;
+
+				case CARD_TYPE_PROGRAMMING_CARD:
+					DLOG("It's a programming card [used: %hhd]!\r\n",scan_result.extra);
+					MAIN_STATE_TRANSITION(MSTATE_ENTER_PROGRAMMING_MODE_1);
+					break;
+
+				case CARD_TYPE_SOFTWARE_CARD:
+				case CARD_TYPE_GYM_SOFTWARD_CARD:
+					DLOG ("It's a software card [sw-function: %hhd]!\r\n", scan_result.extra);
+
+					buzzerStart (SignalSetSoftware, false);
+					buzzerWaitTillFinished ();
+					SoftwareStateMachine (SW_TRIGGER_DEINIT_SOFTWARE);
+					cardmanSetSoftwareFunction (scan_result.extra);
+					DLOG("Change software version:\r\n");
+					SoftwarePrintVersion();
+					SoftwareStateMachine (SW_TRIGGER_INIT_SOFTWARE);
+					MAIN_STATE_TRANSITION(MSTATE_EXIT_PROG_OR_LEARN_MODE);
+
+					//MAIN_STATE_TRANSITION(MSTATE_WAIT_PROG_MODE_1);
+					break;
+				
+				case CARD_TYPE_UNKNOWN:
+					MAIN_STATE_TRANSITION(MSTATE_FOUND_UNKNOWN_CARD);
+					break;
 			}
-			buzzerWaitTillFinished();
 		}
-		SoftwareStateMachine (SW_TRIGGER_DOOR);
-		MAIN_STATE_TRANSITION(MSTATE_PREPARE_WAKE_UP);
-		break;
+	} else {
+		disable_learn_interrupt ();
+		MAIN_STATE_TRANSITION(MSTATE_ERROR_MULTIPLE_CARDS);
+	}
 
-	case MSTATE_FOUND_UNKNOWN_CARD:
-		DLOG("I don't know this card!\r\n");
-		buzzerStart (SignalNegative, false);
-		buzzerWaitTillFinished ();
-		MAIN_STATE_TRANSITION(MSTATE_PREPARE_WAKE_UP);
-		break;
+	backoff_woke = false;
+}
 
-	case MSTATE_ENTER_PROGRAMMING_MODE_2:
-		rtcStart (TIMEOUT_RTC_DELETE_ALL);
-		buzzerStart(SignalModeSlow, true);
-		MAIN_STATE_TRANSITION(MSTATE_WAIT_PROG_MODE_2);
-		break;
+/*! \brief Main state MSTATE_ENTER_SOFTWARE_KEY */
+static void state_enter_software_key (void)
+{
+	buzzerStart(SignalPositive, false);
+	buzzerWaitTillFinished();
+	SoftwareStateMachine (SW_TRIGGER_KEY);
 
-	case MSTATE_ENTER_PROGRAMMING_MODE_1:
-		rtcStart (TIMEOUT_RTC_PROG_MODE_1);
-		buzzerStart (SignalModeFast, true);
-		MAIN_STATE_TRANSITION(MSTATE_WAIT_PROG_MODE_1);
-		break;
+	MAIN_STATE_TRANSITION(MSTATE_PREPARE_WAKE_UP);
+}
 
-	case MSTATE_WAIT_PROG_MODE_1:
-		scan_result.found_card_counter = 0;
-		err = RfidStartScan (RFID_UNIT_1, 0, IdentifyCardCallback);
-		if (scan_result.found_card_counter == 1) {
-			val = rtcXSecondsPassed(TIMEOUT_RTC_SWITCH_TO_PROG2) ? 1 : 0;
+/*! \brief Main state MSTATE_ENTER_SOFTWARE_RTC */
+static void state_enter_software_rtc (void)
+{
+	if (rtcGetInterrupt (SOFT_TIMER_ALARM))
+		SoftwareStateMachine (SW_TRIGGER_RTC);
+	if (rtcGetInterrupt (SOFT_TIMER_GYM))
+		gym_rtc_callback();
+	MAIN_STATE_TRANSITION(MSTATE_PREPARE_WAKE_UP);
+}
 
-			switch (scan_result.type) {
-			case CARD_TYPE_PROGRAMMING_CARD:
-                val1 = rtcXSecondsPassed(10) ? 1 : 0;
-				if (val1) { /* Wait 10 seconds before delete... */
-					buzzerStop();
-					rtcStop ();
-					DLOG("Delete all keys!\r\n");
-					cardmanDeleteAllKeys ();
-					buzzerStart(SignalAllDeleted, false);
-					buzzerWaitTillFinished ();
-					delayNMilliSeconds(200);
-					SoftwareStateMachine(SW_TRIGGER_CHANGE_NCARDS);
-				}
-				// if (val) { /* Wait 2 seconds before changing state... */
-				// 	rtcStop ();
-				// 	MAIN_STATE_TRANSITION(MSTATE_ENTER_PROGRAMMING_MODE_2);
-				// }
-				break;
-
-			case CARD_TYPE_KEY:
-				DLOG("Delete card %hhd\r\n", scan_result.extra);
-				cardmanDeleteKey (scan_result.card.uid, scan_result.card.len);
-				buzzerStart (SignalNegative, false);
-				buzzerWaitTillFinished ();
-				SoftwareStateMachine(SW_TRIGGER_CHANGE_NCARDS);
-				MAIN_STATE_TRANSITION(MSTATE_EXIT_PROG_OR_LEARN_MODE);
-				break;
+/*! \brief Main state MSTATE_ENTER_SOFTWARE_DOOR */
+static void state_enter_software_door (void)
+{
+	if (is_function_control_enabled()) {
+		if (isDoorClosed()) {
+			buzzerStart(SignalTestOn, false);
+		} else {
+			buzzerStart(SignalTestOff, false);
+		}
+		buzzerWaitTillFinished();
+	}
+	SoftwareStateMachine (SW_TRIGGER_DOOR);
+	MAIN_STATE_TRANSITION(MSTATE_PREPARE_WAKE_UP);
+}
+
+/*! \brief Main state MSTATE_FOUND_UNKNOWN_CARD */
+static void state_found_unknown_card (void)
+{
+	DLOG("I don't know this card!\r\n");
+	buzzerStart (SignalNegative, false);
+	buzzerWaitTillFinished ();
+	MAIN_STATE_TRANSITION(MSTATE_PREPARE_WAKE_UP);
+}
 
-			case CARD_TYPE_UNKNOWN:
-				DLOG("Add card!\r\n");
-				cardmanAddKey (scan_result.card.uid, scan_result.card.len);
-				buzzerStart (SignalPositive, false);
+/*! \brief Main state MSTATE_ENTER_PROGRAMMING_MODE_2 */
+static void state_enter_programming_mode_2 (void)
+{
+	rtcStart (SOFT_TIMER_MODE, TIMEOUT_RTC_DELETE_ALL);
+	buzzerStart(SignalModeSlow, true);
+	MAIN_STATE_TRANSITION(MSTATE_WAIT_PROG_MODE_2);
+}
+
+/*! \brief Main state MSTATE_ENTER_PROGRAMMING_MODE_1 */
+static void state_enter_programming_mode_1 (void)
+{
+	rtcStart (SOFT_TIMER_MODE, TIMEOUT_RTC_PROG_MODE_1);
+	buzzerStart (SignalModeFast, true);
+	MAIN_STATE_TRANSITION(MSTATE_WAIT_PROG_MODE_1);
+}
+
+/*! \brief Main state MSTATE_WAIT_PROG_MODE_1 */
+static void state_wait_prog_mode_1 (void)
+{
+	u8 val1;
+
+	scan_result.found_card_counter = 0;
+	RfidStartScan (RFID_UNIT_1, 0, IdentifyCardCallback);
+	if (scan_result.found_card_counter == 1) {
+		switch (scan_result.type) {
+		case CARD_TYPE_PROGRAMMING_CARD:
+            val1 = rtcXSecondsPassed(SOFT_TIMER_MODE, 10) ? 1 : 0;
+			if (val1) { /* Wait 10 seconds before delete... */
+				buzzerStop();
+				rtcStop (SOFT_TIMER_MODE);
+				DLOG("Delete all keys!\r\n");
+				cardmanDeleteAllKeys ();
+				buzzerStart(SignalAllDeleted, false);
 				buzzerWaitTillFinished ();
+				delayNMilliSeconds(200);
 				SoftwareStateMachine(SW_TRIGGER_CHANGE_NCARDS);
-				MAIN_STATE_TRANSITION(MSTATE_EXIT_PROG_OR_LEARN_MODE);
-				break;
+			}
+			// val = rtcXSecondsPassed(SOFT_TIMER_MODE, TIMEOUT_RTC_SWITCH_TO_PROG2) ? 1 : 0;
+			// if (val) { /* Wait 2 seconds before changing state... */
+			// 	rtcStop (SOFT_TIMER_MODE);
+			// 	MAIN_STATE_TRANSITION(MSTATE_ENTER_PROGRAMMING_MODE_2);
+			// }
+			break;
 
-			case CARD_TYPE_SOFTWARE_CARD:
-				buzzerStart (SignalSetSoftware, false);
-				buzzerWaitTillFinished ();
-				SoftwareStateMachine (SW_TRIGGER_DEINIT_SOFTWARE);
-				cardmanSetSoftwareFunction (scan_result.extra);
-				DLOG("Change software version:\r\n");
-				SoftwarePrintVersion();
-				SoftwareStateMachine (SW_TRIGGER_INIT_SOFTWARE);
-				MAIN_STATE_TRANSITION(MSTATE_EXIT_PROG_OR_LEARN_MODE);
-				break;
+		case CARD_TYPE_KEY:
+			DLOG("Delete card %hhd\r\n", scan_result.extra);
+			cardmanDeleteKey (scan_result.card.uid, scan_result.card.len);
+			buzzerStart (SignalNegative, false);
+			buzzerWaitTillFinished ();
+			SoftwareStateMachine(SW_TRIGGER_CHANGE_NCARDS);
+			MAIN_STATE_TRANSITION(MSTATE_EXIT_PROG_OR_LEARN_MODE);
+			break;
 
-			default:
-				DLOG("Illegal card type %hhx\r\n", (u8)scan_result.type);
-				MAIN_STATE_TRANSITION(MSTATE_EXIT_PROG_OR_LEARN_MODE);
-				break;
-			}
-		} else if (scan_result.found_card_counter == 0) {
-			if (rtcIsFinished ()) {
-				buzzerStop ();
-				rtcStop ();
-				MAIN_STATE_TRANSITION(MSTATE_EXIT_PROG_OR_LEARN_MODE);
-			}
-		} else {
-			buzzerStop();			
-			rtcStop();
-			MAIN_STATE_TRANSITION(MSTATE_ERROR_MULTIPLE_CARDS);
+		case CARD_TYPE_UNKNOWN:
+			DLOG("Add card!\r\n");
+			cardmanAddKey (scan_result.card.uid, scan_result.card.len);
+			buzzerStart (SignalPositive, false);
+			buzzerWaitTillFinished ();
+			SoftwareStateMachine(SW_TRIGGER_CHANGE_NCARDS);
+			MAIN_STATE_TRANSITION(MSTATE_EXIT_PROG_OR_LEARN_MODE);
+			break;
+
+		case CARD_TYPE_SOFTWARE_CARD:
+			buzzerStart (SignalSetSoftware, false);
+			buzzerWaitTillFinished ();
+			SoftwareStateMachine (SW_TRIGGER_DEINIT_SOFTWARE);
+			cardmanSetSoftwareFunction (scan_result.extra);
+			DLOG("Change software version:\r\n");
+			SoftwarePrintVersion();
+			SoftwareStateMachine (SW_TRIGGER_INIT_SOFTWARE);
+			MAIN_STATE_TRANSITION(MSTATE_EXIT_PROG_OR_LEARN_MODE);
+			break;
+
+		default:
+			DLOG("Illegal card type %hhx\r\n", (u8)scan_result.type);
+			MAIN_STATE_TRANSITION(MSTATE_EXIT_PROG_OR_LEARN_MODE);
+			break;
 		}
-		break;
+	} else if (scan_result.found_card_counter == 0) {
+		if (rtcIsFinished (SOFT_TIMER_MODE)) {
+			buzzerStop ();
+			rtcStop (SOFT_TIMER_MODE);
+			MAIN_STATE_TRANSITION(MSTATE_EXIT_PROG_OR_LEARN_MODE);
+		}
+	} else {
+		buzzerStop();			
+		rtcStop(SOFT_TIMER_MODE);
+		MAIN_STATE_TRANSITION(MSTATE_ERROR_MULTIPLE_CARDS);
+	}
+}
 
-	case MSTATE_WAIT_PROG_MODE_2:
-		scan_result.found_card_counter = 0;
-		err = RfidStartScan (RFID_UNIT_1, 0, IdentifyCardCallback);
-		if (scan_result.found_card_counter == 1) {
-			switch (scan_result.type) {
-			case CARD_TYPE_PROGRAMMING_CARD:
-				if (rtcIsFinished ()) {
-					buzzerStop();
-					// DLOG("Delete all keys!\r\n");
-					// cardmanDeleteAllKeys ();
-					// buzzerStart (SignalAllDeleted, false);
-					// buzzerWaitTillFinished ();
-					delayNMilliSeconds(200);
-					SoftwareStateMachine(SW_TRIGGER_CHANGE_NCARDS);
-					MAIN_STATE_TRANSITION(MSTATE_EXIT_PROG_OR_LEARN_MODE);
-				}
-				break;
-
-			case CARD_TYPE_KEY:
-			case CARD_TYPE_UNKNOWN:
-			case CARD_TYPE_SOFTWARE_CARD:
-			case CARD_TYPE_GYM_SOFTWARD_CARD:
-			default:
-				MAIN_STATE_TRANSITION(MSTATE_ENTER_PROGRAMMING_MODE_1);
-				break;
+/*! \brief Main state MSTATE_WAIT_PROG_MODE_2 */
+static void state_wait_prog_mode_2 (void)
+{
+	scan_result.found_card_counter = 0;
+	RfidStartScan (RFID_UNIT_1, 0, IdentifyCardCallback);
+	if (scan_result.found_card_counter == 1) {
+		switch (scan_result.type) {
+		case CARD_TYPE_PROGRAMMING_CARD:
+			if (rtcIsFinished (SOFT_TIMER_MODE)) {
+				buzzerStop();
+				// DLOG("Delete all keys!\r\n");
+				// cardmanDeleteAllKeys ();
+				// buzzerStart (SignalAllDeleted, false);
+				// buzzerWaitTillFinished ();
+				delayNMilliSeconds(200);
+				SoftwareStateMachine(SW_TRIGGER_CHANGE_NCARDS);
+				MAIN_STATE_TRANSITION(MSTATE_EXIT_PROG_OR_LEARN_MODE);
 			}
-		} else {
-			buzzerStop ();			
-			rtcStop ();
+			break;
+
+		case CARD_TYPE_KEY:
+		case CARD_TYPE_UNKNOWN:
+		case CARD_TYPE_SOFTWARE_CARD:
+		case CARD_TYPE_GYM_SOFTWARD_CARD:
+		default:
 			MAIN_STATE_TRANSITION(MSTATE_ENTER_PROGRAMMING_MODE_1);
+			break;
 		}
-		break;
+	} else {
+		buzzerStop ();			
+		rtcStop (SOFT_TIMER_MODE);
+		MAIN_STATE_TRANSITION(MSTATE_ENTER_PROGRAMMING_MODE_1);
+	}
+}
 
-	case MSTATE_ERROR_MULTIPLE_CARDS:
-		DLOG("Multiple Cards\r\n");
-	case MSTATE_EXIT_PROG_OR_LEARN_MODE:
-		buzzerStop();
-		rtcStop();
-		SoftwareRestartAlarm();
-		MAIN_STATE_TRANSITION(MSTATE_PREPARE_WAKE_UP);
-		break;
+/*! \brief Main state MSTATE_EXIT_PROG_OR_LEARN_MODE */
+static void state_exit_prog_or_learn_mode (void)
+{
+	buzzerStop();
+	rtcStop(SOFT_TIMER_MODE);
+	SoftwareRestartAlarm();
+	MAIN_STATE_TRANSITION(MSTATE_PREPARE_WAKE_UP);
+}
 
-	case MSTATE_ERROR_SET_PROG_CARD_FAILED:
-		DLOG("Couldn't set Programming Card\r\n");
-		buzzerStart(SignalError, false);
-		buzzerWaitTillFinished ();
-		rtcStop();
-		SoftwareRestartAlarm();
-		MAIN_STATE_TRANSITION(MSTATE_PREPARE_WAKE_UP);
-		break;
+/*! \brief Main state MSTATE_ERROR_MULTIPLE_CARDS */
+static void state_error_multiple_cards (void)
+{
+	DLOG("Multiple Cards\r\n");
+	state_exit_prog_or_learn_mode ();
+}
 
-	default:
+/*! \brief Main state MSTATE_ERROR_SET_PROG_CARD_FAILED */
+static void state_error_set_prog_card_failed (void)
+{
+	DLOG("Couldn't set Programming Card\r\n");
+	buzzerStart(SignalError, false);
+	buzzerWaitTillFinished ();
+	rtcStop(SOFT_TIMER_MODE);
+	SoftwareRestartAlarm();
+	MAIN_STATE_TRANSITION(MSTATE_PREPARE_WAKE_UP);
+}
+
+/*! \brief Handler of a main state */
+typedef void main_state_handler_t (void);
+
+/*! \brief Handlers of the main states */
+static main_state_handler_t *const state_handlers[] = {
+	[MSTATE_INITIALIZE] = state_initialize,
+	[MSTATE_PREPARE_WAKE_UP] = state_prepare_wake_up,
+	[MSTATE_DEEP_SLEEP] = state_deep_sleep,
+	[MSTATE_BACKOFF] = state_backoff,
+	[MSTATE_WOKE_UP] = state_woke_up,
+	[MSTATE_ENTER_PROGRAMMING_MODE_1] = state_enter_programming_mode_1,
+	[MSTATE_ENTER_PROGRAMMING_MODE_2] = state_enter_programming_mode_2,
+	[MSTATE_WAIT_PROG_MODE_1] = state_wait_prog_mode_1,
+	[MSTATE_WAIT_PROG_MODE_2] = state_wait_prog_mode_2,
+	[MSTATE_ENTER_SOFTWARE_KEY] = state_enter_software_key,
+	[MSTATE_ENTER_SOFTWARE_RTC] = state_enter_software_rtc,
+	[MSTATE_ENTER_SOFTWARE_DOOR] = state_enter_software_door,
+	[MSTATE_FOUND_UNKNOWN_CARD] = state_found_unknown_card,
+	[MSTATE_EXIT_PROG_OR_LEARN_MODE] = state_exit_prog_or_learn_mode,
+	[MSTATE_ENTER_LEARN_MODE] = state_enter_learn_mode,
+	[MSTATE_WAIT_LEARN_MODE] = state_wait_learn_mode,
+	[MSTATE_ERROR_SET_PROG_CARD_FAILED] = state_error_set_prog_card_failed,
+	[MSTATE_ERROR_MULTIPLE_CARDS] = state_error_multiple_cards,
+};
+
+/************************************************************************/
+/*                                                                      */
+/************************************************************************/
+void MainStateMachine (void)
+{
+	waitTraceStateEnter (current_state, STATE_BUDGET_MS(current_state));
+	energySetState (current_state);
+
+	if ((current_state < sizeof(state_handlers) / sizeof(state_handlers[0])) &&
+	    state_handlers[current_state]) {
+		state_handlers[current_state] ();
+	} else {
 		DLOG("Unexpected state %hhu\r\n", current_state);
 		MAIN_STATE_TRANSITION(MSTATE_PREPARE_WAKE_UP);
 	}
-}
\ No newline at end of file
+
+	waitTraceStateLeave ();
+}
@@ -17,6 +17,7 @@ enum MainState {
 
 	MSTATE_PREPARE_WAKE_UP,				/* Implemented */
 	MSTATE_DEEP_SLEEP,				/* Implemented */
+	MSTATE_BACKOFF,					/* AS3911 off after false wake-ups */
 	MSTATE_WOKE_UP,					/* Implemented */
 	MSTATE_ENTER_PROGRAMMING_MODE_1,
 	MSTATE_ENTER_PROGRAMMING_MODE_2,
@@ -12,6 +12,7 @@
 #include "buzzer/buzzer.h"
 #include "cardman/cards_manager.h"
 #include "application/software_functions.h"
+#include "utils/energy.h"
 
 
 #define MOTOR_DLOG DLOG
@@ -21,11 +22,13 @@
 static void motor_off (void)
 {
 	MOTOR_PORT.OUTCLR = MOTOR_PIN_bm;
+	energySetLoad (ENERGY_LOAD_MOTOR, false);
 }
 
 static void motor_on (void)
 {
 	MOTOR_PORT.OUTSET = MOTOR_PIN_bm;
+	energySetLoad (ENERGY_LOAD_MOTOR, true);
 }
 
 /*! \brief PWM on/off time (milliseconds) */
@@ -169,10 +172,16 @@ void setSlaveLock (bool_t lock_open, bool_t slave_mode)
 static uint8_t ReadCalibrationByte(uint8_t index) {
 
 	uint8_t result;
+	/* Keep the EEPROM queue off the NVM controller meanwhile, this waits
+	 * for the page write in progress only */
+	irqflags_t flags = cpu_irq_save ();
+
+	nvm_wait_until_ready ();
 	NVM_CMD = NVM_CMD_READ_CALIB_ROW_gc;
 	result = pgm_read_byte(index);
 
 	NVM_CMD = NVM_CMD_NO_OPERATION_gc;
+	cpu_irq_restore (flags);
 
 	return(result);
 }
@@ -307,7 +316,7 @@ static s8 drive_motor (bool_t open_lock)
 				 *         lock if VCC is low.
 				 */
 			}
-			if (rtcIsFinished ()) {
+			if (rtcIsFinished (SOFT_TIMER_MOTOR)) {
 				err = ERR_TIMEOUT;
 				goto out;
 			}
@@ -358,7 +367,7 @@ s8 motorOpenLock (bool_t slave)
 
 	adcInitVCCMeasurement ();
 
-	rtcStart(TIMEOUT_RTC_MOTOR);
+	rtcStart (SOFT_TIMER_MOTOR, TIMEOUT_RTC_MOTOR);
 	motor_on();
 	delayNMilliSeconds (MOTOR_START_HALF_MS);
 	adcStart ();
@@ -368,7 +377,7 @@ s8 motorOpenLock (bool_t slave)
 
 	err = drive_motor (true);
 
-	rtcStop ();
+	rtcStop (SOFT_TIMER_MOTOR);
 	adcDeinit ();
 	
 	setSlaveLock(true, slave);
@@ -410,7 +419,7 @@ s8 motorCloseLock (bool_t slave)
 
 	adcInitVCCMeasurement ();
 
-	rtcStart (TIMEOUT_RTC_MOTOR);
+	rtcStart (SOFT_TIMER_MOTOR, TIMEOUT_RTC_MOTOR);
 	motor_on();
 	delayNMilliSeconds (MOTOR_START_HALF_MS);
 	adcStart ();
@@ -419,7 +428,7 @@ s8 motorCloseLock (bool_t slave)
 	motor_off();
 
 	err = drive_motor (false);
-	rtcStop ();
+	rtcStop (SOFT_TIMER_MOTOR);
 	adcDeinit ();
 
 	setSlaveLock(false, slave);
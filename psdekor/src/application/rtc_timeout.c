@@ -6,133 +6,83 @@
  */ 
 #include "application/rtc_timeout.h"
 #include "utils/debug.h"
-										\
-#define RTC_IRQ_DISABLE() do {                                                  \
-	IRQ_INC_DISABLE();                                                      \
-	RTC.INTCTRL = RTC_OVFINTLVL_OFF_gc | RTC_COMPINTLVL_OFF_gc;             \
-	IRQ_DEC_ENABLE();                                                       \
-} while (0)
-
-#define RTC_IRQ_ENABLE() do {                                                   \
-	IRQ_INC_DISABLE();                                                      \
-	RTC.INTCTRL = RTC_OVFINTLVL_LO_gc | RTC_COMPINTLVL_OFF_gc;              \
-	IRQ_DEC_ENABLE();                                                       \
-} while (0)
-
-static void wait_for_rtc (void)
-{
-	while (RTC.STATUS & RTC_SYNCBUSY_bm) {
-		delayNMilliSeconds (5);
-	}
-}
+#include "utils/event_queue.h"
 
 #define TIMEOUT_INTR_DISABLED 0
 #define TIMEOUT_INTR_ENABLED 1
 #define TIMEOUT_INTR_OCCURED 2
 
-static volatile bool_t timeoutDone = true;
-static volatile u8 timeout_intr = TIMEOUT_INTR_DISABLED;
+/*! \brief Flag of #rtcStartINTR per timer */
+static volatile u8 timeout_intr[SOFT_TIMERS];
 
-
-ISR(RTC_OVF_vect)
+/*! \brief Callback of the software timers */
+static void expired (u8 timer)
 {
-	rtcStop ();
-	if (timeout_intr == TIMEOUT_INTR_ENABLED)
-		timeout_intr = TIMEOUT_INTR_OCCURED;
+	if (timeout_intr[timer] == TIMEOUT_INTR_ENABLED) {
+		timeout_intr[timer] = TIMEOUT_INTR_OCCURED;
+		eventPost (EVENT_TIMEOUT, timer);
+	}
 }
 
-static void start (const u8 seconds);
-
-static void start (const u8 seconds)
+void rtcStartINTR (u8 timer, const u8 seconds)
 {
-	u16 tmp;
-
-	DLOG("RTC start %u sec\r\n", seconds);
-
-	if (unlikely(seconds == 0)) {
-		rtcStop ();
-		return;
-	}
-
-	tmp = seconds;
-	tmp *= 125;
+	irqflags_t flags;
 
-	if (timeoutDone) {
-		sysclk_enable_peripheral_clock (&RTC);
-		CLK.RTCCTRL = CLK_RTCSRC_ULP_gc | CLK_RTCEN_bm;
-	}
-
-	RTC.CTRL = RTC_PRESCALER_OFF_gc;
-	wait_for_rtc ();
-	RTC.PER = tmp;
-	wait_for_rtc ();
-	RTC.CNT = 0;
-	wait_for_rtc ();
-
-	timeoutDone = false;
-	RTC.CTRL = RTC_PRESCALER_DIV8_gc;
-	wait_for_rtc ();
+	DLOG("RTC %hhu start %u sec\r\n", timer, seconds);
 
-	RTC.INTFLAGS |= RTC_OVFIF_bm;
-	RTC_IRQ_ENABLE();
+	/* an expiry of the previous start mustn't set the new flag */
+	flags = cpu_irq_save ();
+	timeout_intr[timer] = TIMEOUT_INTR_ENABLED;
+	softTimerStart (timer, (u32)seconds * U32_C(1000), expired);
+	cpu_irq_restore (flags);
 }
 
-void rtcStartINTR (const u8 seconds)
+void rtcStart (u8 timer, const u8 seconds)
 {
-	RTC_IRQ_DISABLE();
-	timeout_intr = TIMEOUT_INTR_ENABLED;
-	start (seconds);
-}
+	irqflags_t flags;
 
-void rtcStart (const u8 seconds)
-{
-	RTC_IRQ_DISABLE();
-	timeout_intr = TIMEOUT_INTR_DISABLED;
-	start (seconds);
+	DLOG("RTC %hhu start %u sec\r\n", timer, seconds);
+
+	/* an expiry of the previous start mustn't set the new flag */
+	flags = cpu_irq_save ();
+	timeout_intr[timer] = TIMEOUT_INTR_DISABLED;
+	softTimerStart (timer, (u32)seconds * U32_C(1000), expired);
+	cpu_irq_restore (flags);
 }
 
-void rtcStop (void)
+void rtcStop (u8 timer)
 {
-	RTC_IRQ_DISABLE();
-
-	DLOG("RTC STOP\r\n");
-
-	timeoutDone = true;
-	CLK.RTCCTRL = 0;
-	sysclk_disable_peripheral_clock(&RTC);
+	DLOG("RTC %hhu STOP\r\n", timer);
+	softTimerStop (timer);
 }
 
-bool_t rtcIsFinished (void)
+bool_t rtcIsFinished (u8 timer)
 {
-	return timeoutDone;
+	return !softTimerIsRunning (timer);
 }
 
-bool_t rtcXSecondsPassed (const u8 x)
+bool_t rtcXSecondsPassed (u8 timer, const u8 x)
 {
-	u16 tmp = x;
-
-	tmp *= 125;
-	
-	if (RTC.CNT > tmp)
+	if (softTimerElapsedMs (timer) > (u32)x * U32_C(1000))
 		return true;
 	else
-		return timeoutDone;
+		return !softTimerIsRunning (timer);
 }
 
-bool_t rtcGetInterrupt (void)
+bool_t rtcGetInterrupt (u8 timer)
 {
 	u8 intr;
 
 	IRQ_INC_DISABLE();
-	intr = timeout_intr;
+	intr = timeout_intr[timer];
 	if (intr == TIMEOUT_INTR_OCCURED)
-		timeout_intr = TIMEOUT_INTR_DISABLED;
+		timeout_intr[timer] = TIMEOUT_INTR_DISABLED;
 	IRQ_DEC_ENABLE();
 
 	return (intr == TIMEOUT_INTR_OCCURED);
 }
 
-bool_t rtcPollInterrupt_LOCKED (void)
+bool_t rtcPollInterrupt_LOCKED (u8 timer)
 {
-	return (timeout_intr == TIMEOUT_INTR_OCCURED);
-}
\ No newline at end of file
+	return (timeout_intr[timer] == TIMEOUT_INTR_OCCURED);
+}
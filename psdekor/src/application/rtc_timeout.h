@@ -11,35 +11,48 @@
 
 #include "platform.h"
 #include "delay_wrapper.h"
+#include "utils/soft_timer.h"
+
+/*
+ * Timeouts in seconds of the application. Each one runs on its own software
+ * timer (enum soft_timer), so e.g. the motor timeout doesn't stop a running
+ * alarm.
+ */
 
 /*!
- * \brief Starts (or restarts) the RTC timer.
+ * \brief Starts (or restarts) a timeout.
+ * \param timer enum soft_timer
  * \param seconds Timeout in seconds.
  */
-extern void rtcStart (const u8 seconds);
+extern void rtcStart (u8 timer, const u8 seconds);
 
 /*!
- * \brief Starts (or restarts the RTC timer and sets a flag when the
- *        interrupt occurs.
+ * \brief Starts (or restarts) a timeout and sets a flag when it expires.
+ *
+ * The expiry also posts an #EVENT_TIMEOUT with the timer.
+ * \param timer enum soft_timer
  * \param seconds Timeout in seconds.
  */
-extern void rtcStartINTR (const u8 seconds);
+extern void rtcStartINTR (u8 timer, const u8 seconds);
 
 /*!
- * \brief Stops the RTC timer.
+ * \brief Stops a timeout.
+ * \param timer enum soft_timer
  */
-extern void rtcStop (void);
+extern void rtcStop (u8 timer);
 
 /*!
  * \brief Checks if the configured timeout period has experied.
+ * \param timer enum soft_timer
  * \return True, if configured period is over or the timer has
  *         not been started, False otherwise.
  */
-extern bool_t rtcIsFinished (void);
+extern bool_t rtcIsFinished (u8 timer);
 
 /*!
  * \brief Checks if x seconds have passed since the timer has
  *        been started.
+ * \param timer enum soft_timer
  * \param x Number of seconds.
  * \return True if x seconds have passed since the timer has been started.
  *         If the timer has not been started or has already expired (and
@@ -50,13 +63,19 @@ extern bool_t rtcIsFinished (void);
  * otherwise this function will return true as soon as the first
  * period expired.
  */
-extern bool_t rtcXSecondsPassed (const u8 x);
+extern bool_t rtcXSecondsPassed (u8 timer, const u8 x);
 
 /*!
- * \brief Checks if interrupt has occurred
+ * \brief Checks if the flag of #rtcStartINTR is set and clears it
+ * \param timer enum soft_timer
  */
-extern bool_t rtcGetInterrupt (void);
+extern bool_t rtcGetInterrupt (u8 timer);
 
-extern bool_t rtcPollInterrupt_LOCKED (void);
+/*!
+ * \brief Checks if the flag of #rtcStartINTR is set, with interrupts
+ *        disabled
+ * \param timer enum soft_timer
+ */
+extern bool_t rtcPollInterrupt_LOCKED (u8 timer);
 
-#endif /* RTC_TIMEOUT_H_ */
\ No newline at end of file
+#endif /* RTC_TIMEOUT_H_ */
@@ -9,6 +9,7 @@
 #include "application/software_functions.h"
 #include "utils/debug.h"
 #include "application/rtc_timeout.h"
+#include "utils/soft_timer.h"
 #include "application/timeouts.h"
 #include "application/motor_control.h"
 #include "buzzer/sounds.h"
@@ -62,8 +63,8 @@ void gym_rtc_callback(void) {
 		buzzerStart(SignalPositive, false);
 		buzzerWaitTillFinished();
 	} else {
-		rtcGetInterrupt();
-		rtcStartINTR(auto_open_delay_steps);
+		rtcGetInterrupt(SOFT_TIMER_GYM);
+		rtcStartINTR(SOFT_TIMER_GYM, auto_open_delay_steps);
 	}
 }
 
@@ -111,8 +112,8 @@ void gym_card_callback(struct scan_result_s *scan) {
 
 			if (auto_open_delay > 0) {
 				auto_open_delay_remain = (auto_open_delay * 60 * 60) / auto_open_delay_steps;
-				rtcGetInterrupt();
-				rtcStartINTR(auto_open_delay_steps);
+				rtcGetInterrupt(SOFT_TIMER_GYM);
+				rtcStartINTR(SOFT_TIMER_GYM, auto_open_delay_steps);
 			}
 		
 		
@@ -147,11 +148,11 @@ static s8 open_door (bool_t slave)
 	if (err != ERR_NONE)
 		return err;
 
-	rtcGetInterrupt ();
-	rtcStartINTR (TIMEOUT_RTC_LOCK_OPEN_WAIT_TIME);
+	rtcGetInterrupt (SOFT_TIMER_LOCK_OPEN);
+	rtcStartINTR (SOFT_TIMER_LOCK_OPEN, TIMEOUT_RTC_LOCK_OPEN_WAIT_TIME);
 	cpu_irq_disable();
-	while (!rtcGetInterrupt ()) {
-		PSAVE_MCU_LOCKED();
+	while (!rtcGetInterrupt (SOFT_TIMER_LOCK_OPEN)) {
+		SoftwareSleep();
 		cpu_irq_disable();
 	}
 	cpu_irq_enable();
@@ -192,8 +193,8 @@ static void key_function (void)
 		switch (sw1_state.alarm_state) {
 		case ALARM_STATE_01S:
 			sw1_state.alarm_state = ALARM_STATE_DISABLED;
-			rtcStop ();
-			rtcGetInterrupt ();
+			rtcStop (SOFT_TIMER_ALARM);
+			rtcGetInterrupt (SOFT_TIMER_ALARM);
 			DLOG("ALARM: Disabled alarm by key (from main)\r\n");
 			break;
 
@@ -239,8 +240,8 @@ static void door_function (void)
 /************************************************************************/
 static void rtc_function (void)
 {
-	rtcStop ();
-	rtcGetInterrupt ();
+	rtcStop (SOFT_TIMER_ALARM);
+	rtcGetInterrupt (SOFT_TIMER_ALARM);
 
 	if ((cardmanGetSoftwareFunction() & SW_FUNCTION_ALARM) == 0) {
 		DLOG("RTC: Spurious RTC...\r\n");
@@ -285,7 +286,7 @@ static void rtc_function (void)
 			}
 		}
 
-		rtcStartINTR(TIMEOUT_RTC_REPEATING_ALARM);
+		rtcStartINTR(SOFT_TIMER_ALARM, TIMEOUT_RTC_REPEATING_ALARM);
 	}
 }
 
@@ -311,8 +312,10 @@ static void init_function (void)
 /************************************************************************/
 static void deinit_function (void)
 {
-	rtcStop ();
-	rtcGetInterrupt ();
+	rtcStop (SOFT_TIMER_ALARM);
+	rtcGetInterrupt (SOFT_TIMER_ALARM);
+	rtcStop (SOFT_TIMER_GYM);
+	rtcGetInterrupt (SOFT_TIMER_GYM);
 }
 
 /************************************************************************/
@@ -324,8 +327,8 @@ void SoftwareCheckAlarm (void)
 		if (cardmanGetNumberOfKeys() == 0) {
 			if (sw1_state.alarm_state != ALARM_STATE_OFF) {
 				sw1_state.alarm_state = ALARM_STATE_OFF;
-				rtcStop();
-				rtcGetInterrupt(); /* Clear IRQ Flag */
+				rtcStop(SOFT_TIMER_ALARM);
+				rtcGetInterrupt(SOFT_TIMER_ALARM); /* Clear IRQ Flag */
 				DLOG("ALARM: Disable alarm (no keys set)\r\n");
 			}
 		} else if (isDoorClosed()) {
@@ -335,8 +338,8 @@ void SoftwareCheckAlarm (void)
 			
 			case ALARM_STATE_01S:
 			case ALARM_STATE_20S:
-				rtcStop();
-				rtcGetInterrupt(); /* Clear IRQ Flag */
+				rtcStop(SOFT_TIMER_ALARM);
+				rtcGetInterrupt(SOFT_TIMER_ALARM); /* Clear IRQ Flag */
 				DLOG("ALARM: Door has been closed (CheckAlarm)\r\n");
 			case ALARM_STATE_DISABLED:
 				sw1_state.alarm_state = ALARM_STATE_OFF;
@@ -351,7 +354,7 @@ void SoftwareCheckAlarm (void)
 			case ALARM_STATE_OFF:
 				DLOG("ALARM: Enable alarm in 20s (CheckAlarm)\r\n");
 				sw1_state.alarm_state = ALARM_STATE_20S;
-				rtcStartINTR(TIMEOUT_RTC_FIRST_ALARM);
+				rtcStartINTR(SOFT_TIMER_ALARM, TIMEOUT_RTC_FIRST_ALARM);
 				break;
 
 			case ALARM_STATE_01S:
@@ -393,6 +396,7 @@ void SoftwareStateMachine (enum sw_trigger trigger)
 
 void SoftwareSleep (void)
 {
+	softTimerSync();
 	PSAVE_MCU_LOCKED();
 	//PDOWN_MCU_LOCKED();
 /*
@@ -445,7 +449,7 @@ void SoftwareRestartAlarm (void)
 			sw1_state.alarm_state = ALARM_STATE_20S;
 		case ALARM_STATE_20S:
 			DLOG("ALARM: Reset Alarm (20s)\r\n");
-			rtcStartINTR(TIMEOUT_RTC_FIRST_ALARM);
+			rtcStartINTR(SOFT_TIMER_ALARM, TIMEOUT_RTC_FIRST_ALARM);
 			break;
 		}
 	}
@@ -49,6 +49,18 @@
 #include <limits.h>
 #include "logger.h"
 
+/*
+******************************************************************************
+* LOCAL MACROS
+******************************************************************************
+*/
+/*! frame delay time PICC to PCD (ISO14443-3: 1172/fc) in us, kept after a
+ * received frame so that the next transmission cannot start too early */
+#define AS3911_FDT_PCD_US           87
+
+/*! maximum number of additional reads of the FIFO status while receiving */
+#define AS3911_FIFO_STATUS_REREADS  3
+
 /*
 ******************************************************************************
 * LOCAL VARIABLES
@@ -58,6 +70,14 @@ static bool_t as3911ReceivePrepared; /*!< flag indicating whether receive
                                        has been prepared */
 static u32 as3911NoResponseTime_64fcs;
 
+/*! antenna trim settings written by #as3911Initialize */
+static const u8 as3911AntCalTable[] PROGMEM = {
+    AS3911_TABLE_RUN(AS3911_REG_ANT_CAL_CONTROL, 2),
+        0x30,   /* AS3911_REG_ANT_CAL_CONTROL */
+        0x80,   /* AS3911_REG_ANT_CAL_TARGET */
+    AS3911_TABLE_END
+};
+
 /*
 ******************************************************************************
 * LOCAL FUNCTION PROTOTYPES
@@ -85,6 +105,33 @@ static s8 as3911DecodeErrorInterrupts(u32 mask)
     return err;
 }
 
+/*! 
+ * Reads the number of bytes in the FIFO. While a reception is running the
+ * AS3911 may update the counter during the read (clock synchronisation), so
+ * it is read again until two reads agree. After the end of receive interrupt
+ * the counter is stable and one read is enough.
+ */
+static s8 as3911ReadFifoStatus(bool_t rxEnded, u8* count)
+{
+    s8 err;
+    u8 again;
+    u8 i;
+
+    err = as3911ReadRegister(AS3911_REG_FIFO_RX_STATUS1, count);
+
+    for (i = 0; !rxEnded && (ERR_NONE == err) && (i < AS3911_FIFO_STATUS_REREADS); i++)
+    {
+        err = as3911ReadRegister(AS3911_REG_FIFO_RX_STATUS1, &again);
+        if (again == *count)
+        {
+            break;
+        }
+        *count = again;
+    }
+
+    return err;
+}
+
 /*
 ******************************************************************************
 * GLOBAL FUNCTIONS
@@ -122,8 +169,7 @@ s8 as3911Initialize()
     boardPeripheralPinInitialize(BOARD_PERIPHERAL_AS3911_INT);
 
     /* trim settings for VHBR board, will anyway changed later on */
-    as3911WriteRegister(AS3911_REG_ANT_CAL_TARGET, 0x80);
-    as3911WriteRegister(AS3911_REG_ANT_CAL_CONTROL, 0x30);
+    as3911WriteRegisterTable(as3911AntCalTable);
 
     /* enable oscillator frequency stable interrupt */
     err = as3911EnableInterrupts(AS3911_IRQ_MASK_OSC);
@@ -332,20 +378,30 @@ s8 as3911RxNBytes(u8* buf, u16 maxlength, u16* length, u16 timeout_ms)
         goto out;
     }
 
+    if (mask & AS3911_IRQ_MASK_RXE)
+    {
+        /* short frame: the end of receive came together with the start,
+         * only the errors reported with it are still to be collected */
+        mask |= as3911GetInterrupt(AS3911_IRQ_MASK_CRC |
+                                   AS3911_IRQ_MASK_PAR |
+                                   AS3911_IRQ_MASK_ERR1);
+    }
+
     do
     {
-        /* wait either for FIFO waterlevel or end of receive interrupt */
-        mask = as3911WaitForInterruptsTimed(AS3911_IRQ_MASK_RXE |
-                                            AS3911_IRQ_MASK_FWL |
-                                            AS3911_IRQ_MASK_CRC |
-                                            AS3911_IRQ_MASK_PAR |
-                                            AS3911_IRQ_MASK_ERR1|
-                                            0
-                                            , 10);
-
-        err = as3911ReadRegister(AS3911_REG_FIFO_RX_STATUS1, &bytesToRead);
-        /* Reading it two times to work around clock syncronisation bug in AS3911 */
-        err = as3911ReadRegister(AS3911_REG_FIFO_RX_STATUS1, &bytesToRead);
+        if (!(mask & AS3911_IRQ_MASK_RXE))
+        {
+            /* wait either for FIFO waterlevel or end of receive interrupt */
+            mask = as3911WaitForInterruptsTimed(AS3911_IRQ_MASK_RXE |
+                                                AS3911_IRQ_MASK_FWL |
+                                                AS3911_IRQ_MASK_CRC |
+                                                AS3911_IRQ_MASK_PAR |
+                                                AS3911_IRQ_MASK_ERR1|
+                                                0
+                                                , 10);
+        }
+
+        err = as3911ReadFifoStatus((mask & AS3911_IRQ_MASK_RXE) != 0, &bytesToRead);
 
         /* also read out number of received bits in last byte and handle it */
         EVAL_ERR_NE_GOTO(ERR_NONE, err, out);
@@ -374,7 +430,10 @@ s8 as3911RxNBytes(u8* buf, u16 maxlength, u16* length, u16 timeout_ms)
     err = as3911DecodeErrorInterrupts(mask);
 
 out:
-    delayNMicroSeconds(500);
+    if (*length > 0)
+    {
+        delayNMicroSeconds(AS3911_FDT_PCD_US);
+    }
     as3911DisableInterrupts(AS3911_IRQ_MASK_RXS |
                         AS3911_IRQ_MASK_RXE |
                         AS3911_IRQ_MASK_FWL |
@@ -594,9 +653,11 @@ s8 as3911StartGPTimer_8fcs(u16 gpt_8fcs)
 s8 as3911SetGPTime_8fcs(u16 gpt_8fcs)
 {
     s8 err = ERR_NONE;
+    u8 buf[2];
 
-    as3911WriteRegister(AS3911_REG_GPT1, gpt_8fcs >> 8);
-    as3911WriteRegister(AS3911_REG_GPT2, gpt_8fcs & 0xff);
+    buf[0] = gpt_8fcs >> 8;
+    buf[1] = gpt_8fcs & 0xff;
+    as3911WriteRegisterRange(AS3911_REG_GPT1, buf, 2);
 
     return err;
 }
@@ -605,6 +666,7 @@ s8 as3911SetNoResponseTime_64fcs(u32 nrt_64fcs)
 {
     s8 err = ERR_NONE;
     u8 nrt_step = 0;
+    u8 buf[2];
 
     as3911NoResponseTime_64fcs = nrt_64fcs;
     if (nrt_64fcs > USHRT_MAX)
@@ -620,8 +682,9 @@ s8 as3911SetNoResponseTime_64fcs(u32 nrt_64fcs)
     }
 
     as3911ModifyRegister(AS3911_REG_GPT_CONTROL, AS3911_REG_GPT_CONTROL_nrt_step, nrt_step);
-    as3911WriteRegister(AS3911_REG_NO_RESPONSE_TIMER1, nrt_64fcs >> 8);
-    as3911WriteRegister(AS3911_REG_NO_RESPONSE_TIMER2, nrt_64fcs & 0xff);
+    buf[0] = nrt_64fcs >> 8;
+    buf[1] = nrt_64fcs & 0xff;
+    as3911WriteRegisterRange(AS3911_REG_NO_RESPONSE_TIMER1, buf, 2);
 
     return err;
 }
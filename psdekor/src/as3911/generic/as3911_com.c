@@ -63,14 +63,58 @@
 #define AS3911_FIFO_READ   (0xbf)
 #define AS3911_CMD_MODE    (3 << 6)
 
+#ifdef CONF_AS3911_SHADOW_REGS
+#define AS3911_SHADOW_SIZE (AS3911_REG_IC_IDENTITY + 1)
+#define AS3911_SHADOW_BIT(reg) (1 << ((reg) & 7))
+#endif
+
 extern volatile u32 as3911InterruptStatus;
 extern volatile u32 as3911InterruptMask;
+
+#ifdef CONF_AS3911_SHADOW_REGS
+/*
+******************************************************************************
+* LOCAL VARIABLES
+******************************************************************************
+*/
+/*! Bit (reg & 7) of byte (reg >> 3) set: register reg is cached. Interrupt,
+    FIFO status and result registers are changed by the chip and the
+    interrupt masks are kept in as3911InterruptMask, so they are not cached.
+    NUM_TX_BYTES is left out as well since the chip may clear it. */
+static const u8 as3911ShadowCacheable[AS3911_SHADOW_SIZE / 8] = {
+    0xff,   /* 0x00 - 0x07: IO_CONF1 .. AUX */
+    0xff,   /* 0x08 - 0x0f: STREAM_MODE .. NO_RESPONSE_TIMER1 */
+    0x0f,   /* 0x10 - 0x13: NO_RESPONSE_TIMER2 .. GPT2 */
+    0x00,
+    0xd6,   /* ANT_CAL_CONTROL, ANT_CAL_TARGET, AM_MOD_DEPTH_CONTROL, RFO_AM_ON/OFF_LEVEL */
+    0x46,   /* FIELD_THRESHOLD, REGULATOR_CONTROL, CAP_SENSOR_CONTROL */
+    0xce,   /* WUP_TIMER_CONTROL, AMPLITUDE_MEASURE_CONF/REF, PHASE_MEASURE_CONF/REF */
+    0x0c    /* CAPACITANCE_MEASURE_CONF/REF */
+};
+
+/*! Copy of the cached registers */
+static u8 as3911Shadow[AS3911_SHADOW_SIZE];
+
+/*! Bit set: the register in as3911Shadow is valid */
+static u8 as3911ShadowValid[AS3911_SHADOW_SIZE / 8];
+
+/*! Set by as3911TestPrefix(): the next read accesses a test register */
+static bool_t as3911ShadowBypass;
+
+static as3911ShadowStats_t as3911ShadowStatistics;
+#endif
+
 /*
 ******************************************************************************
 * LOCAL FUNCTION PROTOTYPES
 ******************************************************************************
 */
 static s8 as3911Write(u8 cmd, const u8* values, u8 length);
+#ifdef CONF_AS3911_SHADOW_REGS
+static bool_t as3911ShadowCached(u8 reg);
+static void as3911ShadowStore(u8 reg, u8 val);
+static void as3911ShadowDrop(u8 reg);
+#endif
 
 /*
 ******************************************************************************
@@ -82,6 +126,15 @@ s8 as3911ReadRegister(u8 reg, u8* val)
     u8 buf[2];
     s8 err;
 
+#ifdef CONF_AS3911_SHADOW_REGS
+    if (!as3911ShadowBypass && as3911ShadowCached(reg))
+    {
+        *val = as3911Shadow[reg];
+        ++as3911ShadowStatistics.readHits;
+        return ERR_NONE;
+    }
+#endif
+
     buf[0] = reg | AS3911_READ_MODE;
     buf[1] = 0;
 
@@ -92,6 +145,17 @@ s8 as3911ReadRegister(u8 reg, u8* val)
     AS3911_SPI_DESELECT();
     *val = buf[1];
 
+#ifdef CONF_AS3911_SHADOW_REGS
+    if (as3911ShadowBypass)
+    {
+        as3911ShadowBypass = FALSE;
+    }
+    else if (ERR_NONE == err)
+    {
+        as3911ShadowStore(reg, buf[1]);
+    }
+#endif
+
     AS3911_IRQ_DEC_ENABLE();
 
     return err;
@@ -141,6 +205,16 @@ s8 as3911ReadMultipleRegisters(u8 reg, u8* val, u8 length)
     }
     val[i] = lastbyte;
 
+#ifdef CONF_AS3911_SHADOW_REGS
+    if (ERR_NONE == err)
+    {
+        for (i = 0; i < length; i++)
+        {
+            as3911ShadowStore(reg + i, val[i]);
+        }
+    }
+#endif
+
 out:
     AS3911_SPI_DESELECT();
     AS3911_IRQ_DEC_ENABLE();
@@ -177,8 +251,25 @@ s8 as3911WriteRegister(u8 reg, u8 val)
     AS3911_SPI_SELECT();
     err = spiTxRx(buf, NULL, 2);
     AS3911_SPI_DESELECT();
+#ifdef CONF_AS3911_SHADOW_REGS
+    if (ERR_NONE == err)
+    {
+        as3911ShadowStore(reg, val);
+    }
+    else
+    {
+        as3911ShadowDrop(reg);
+    }
+#endif
     AS3911_IRQ_DEC_ENABLE();
 
+#ifdef CONF_ENABLE_ENERGY_TRACE
+    if (AS3911_REG_OP_CONTROL == reg)
+    {
+        energySetOpControl(val);
+    }
+#endif
+
     return err;
 }
 
@@ -186,6 +277,7 @@ s8 as3911ModifyRegister(u8 reg, u8 clr_mask, u8 set_mask)
 {
     s8 err;
     u8 tmp;
+    u8 old;
 
     /* make this operation atomic */
     AS3911_IRQ_INC_DISABLE();
@@ -194,12 +286,26 @@ s8 as3911ModifyRegister(u8 reg, u8 clr_mask, u8 set_mask)
 
     if (ERR_NONE == err)
     {
+        old = tmp;
         /* mask out the bits we don't want to change */
         tmp &= ~clr_mask;
         /* set the new value */
         tmp |= set_mask;
+#ifdef CONF_AS3911_SHADOW_REGS
+        /* the chip holds the value already */
+        if ((tmp == old) && as3911ShadowCached(reg))
+        {
+            ++as3911ShadowStatistics.writesSkipped;
+            goto out;
+        }
+#else
+        (void)old;
+#endif
         err = as3911WriteRegister(reg, tmp);
     }
+#ifdef CONF_AS3911_SHADOW_REGS
+out:
+#endif
     AS3911_IRQ_DEC_ENABLE();
 
     return err;
@@ -207,12 +313,183 @@ s8 as3911ModifyRegister(u8 reg, u8 clr_mask, u8 set_mask)
 
 s8 as3911WriteMultipleRegisters(u8 reg, const u8* values, u8 length)
 {
+#ifdef CONF_ENABLE_ENERGY_TRACE
+    if ((reg <= AS3911_REG_OP_CONTROL) && (AS3911_REG_OP_CONTROL < reg + length))
+    {
+        energySetOpControl(values[AS3911_REG_OP_CONTROL - reg]);
+    }
+#endif
+
+#ifdef CONF_AS3911_SHADOW_REGS
+    s8 err;
+    u8 i;
+
+    AS3911_IRQ_INC_DISABLE();
+    err = as3911Write(reg | AS3911_WRITE_MODE, values, length);
+    for (i = 0; i < length; i++)
+    {
+        if (ERR_NONE == err)
+        {
+            as3911ShadowStore(reg + i, values[i]);
+        }
+        else
+        {
+            as3911ShadowDrop(reg + i);
+        }
+    }
+    AS3911_IRQ_DEC_ENABLE();
+
+    return err;
+#else
     reg |= AS3911_WRITE_MODE;
 
     return as3911Write(reg, values, length);
+#endif
 }
 
 
+s8 as3911WriteRegisterRange(u8 reg, const u8* values, u8 length)
+{
+#ifdef CONF_AS3911_SHADOW_REGS
+    s8 err = ERR_NONE;
+
+    AS3911_IRQ_INC_DISABLE();
+    /* leave out the registers at both ends that hold the value already */
+    while ((length > 0) && as3911ShadowCached(reg) &&
+           (as3911Shadow[reg] == values[0]))
+    {
+        reg++;
+        values++;
+        length--;
+    }
+    while ((length > 0) && as3911ShadowCached(reg + length - 1) &&
+           (as3911Shadow[reg + length - 1] == values[length - 1]))
+    {
+        length--;
+    }
+
+    if (length > 0)
+    {
+        err = as3911WriteMultipleRegisters(reg, values, length);
+    }
+    else
+    {
+        ++as3911ShadowStatistics.writesSkipped;
+    }
+    AS3911_IRQ_DEC_ENABLE();
+
+    return err;
+#else
+    return as3911WriteMultipleRegisters(reg, values, length);
+#endif
+}
+
+s8 as3911WriteRegisterTable(const u8* table)
+{
+    u8 buf[AS3911_TABLE_MAX_RUN];
+    u8 run[2];
+    s8 err = ERR_NONE;
+
+    for (;;)
+    {
+        memcpy_P(run, table, sizeof(run));
+        table += sizeof(run);
+        if (0 == run[1])
+        {
+            break;
+        }
+        memcpy_P(buf, table, run[1]);
+        table += run[1];
+
+        err = as3911WriteRegisterRange(run[0], buf, run[1]);
+        EVAL_ERR_NE_GOTO(ERR_NONE, err, out);
+    }
+
+out:
+    return err;
+}
+
+#ifdef CONF_SPI_ASYNC
+/*! TRUE from as3911FifoStart() until as3911FifoWait() */
+static bool_t as3911FifoPending = FALSE;
+
+/*! Sends the FIFO command and starts the transfer of the data */
+static s8 as3911FifoStart(u8 cmd, const u8* tx, u8* rx, u8 length)
+{
+    s8 err;
+
+    /* SEN and the AS3911 interrupt are released by as3911FifoWait() */
+    AS3911_IRQ_INC_DISABLE();
+    AS3911_SPI_SELECT();
+    err = spiTxRx(&cmd, NULL, 1);
+    if (ERR_NONE == err)
+    {
+        err = spiTxRxStart(tx, rx, length);
+    }
+
+    if (ERR_NONE == err)
+    {
+        as3911FifoPending = TRUE;
+    }
+    else
+    {
+        AS3911_SPI_DESELECT();
+        AS3911_IRQ_DEC_ENABLE();
+    }
+
+    return err;
+}
+
+/*! Starts writing \a values to the FIFO, ended by as3911FifoWait() */
+static s8 as3911WriteFifoStart(const u8* values, u8 length)
+{
+    return as3911FifoStart(AS3911_FIFO_LOAD, values, NULL, length);
+}
+
+/*! Starts reading the FIFO into \a buf, valid after as3911FifoWait() */
+static s8 as3911ReadFifoStart(u8* buf, u8 length)
+{
+    if (0 == length)
+    {
+        return ERR_NONE;
+    }
+
+    return as3911FifoStart(AS3911_FIFO_READ, buf, buf, length);
+}
+
+/*! Sleeps until the started transfer has finished, releases SEN and the
+ *  AS3911 interrupt */
+static void as3911FifoWait(void)
+{
+    if (as3911FifoPending)
+    {
+        spiTxRxWait();
+        as3911FifoPending = FALSE;
+        AS3911_SPI_DESELECT();
+        AS3911_IRQ_DEC_ENABLE();
+    }
+}
+
+s8 as3911WriteFifo(const u8* values, u8 length)
+{
+    s8 err;
+
+    err = as3911WriteFifoStart(values, length);
+    as3911FifoWait();
+
+    return err;
+}
+
+s8 as3911ReadFifo(u8* buf, u8 length)
+{
+    s8 err;
+
+    err = as3911ReadFifoStart(buf, length);
+    as3911FifoWait();
+
+    return err;
+}
+#else
 s8 as3911WriteFifo(const u8* values, u8 length)
 {
     s8 err;
@@ -258,10 +535,38 @@ s8 as3911ReadFifo(u8* buf, u8 length)
 
     return err;
 }
+#endif /* CONF_SPI_ASYNC */
 
 s8 as3911ExecuteCommand(u8 cmd)
 {
     s8 err;
+
+#ifdef CONF_AS3911_SHADOW_REGS
+    switch (cmd)
+    {
+        case AS3911_CMD_SET_DEFAULT:
+        case AS3911_CMD_LOAD_PPROM:
+            as3911ShadowInvalidate();
+            break;
+        case AS3911_CMD_ANALOG_PRESET:
+            /* presets the receiver configuration */
+            as3911ShadowDrop(AS3911_REG_RX_CONF1);
+            as3911ShadowDrop(AS3911_REG_RX_CONF2);
+            as3911ShadowDrop(AS3911_REG_RX_CONF3);
+            as3911ShadowDrop(AS3911_REG_RX_CONF4);
+            break;
+        case AS3911_CMD_INITIAL_RF_COLLISION:
+        case AS3911_CMD_RESPONSE_RF_COLLISION_N:
+        case AS3911_CMD_RESPONSE_RF_COLLISION_0:
+        case AS3911_CMD_NORMAL_NFC_MODE:
+            /* switch the field on and off by themselves */
+            as3911ShadowDrop(AS3911_REG_OP_CONTROL);
+            break;
+        default:
+            break;
+    }
+#endif
+
     cmd |= AS3911_CMD_MODE;
 
     AS3911_IRQ_INC_DISABLE();
@@ -277,6 +582,10 @@ s8 as3911TestPrefix()
 {
     s8 err;
     u8 cmd = AS3911_CMD_TEST_ACCESS;
+
+#ifdef CONF_AS3911_SHADOW_REGS
+    as3911ShadowBypass = TRUE;
+#endif
     AS3911_SPI_SELECT();
     err = spiTxRx(&cmd, NULL, 1);
 
@@ -307,3 +616,38 @@ static s8 as3911Write(u8 cmd, const u8* values, u8 length)
     return err;
 }
 
+#ifdef CONF_AS3911_SHADOW_REGS
+void as3911ShadowInvalidate(void)
+{
+    memset(as3911ShadowValid, 0, sizeof(as3911ShadowValid));
+}
+
+const as3911ShadowStats_t* as3911ShadowGetStats(void)
+{
+    return &as3911ShadowStatistics;
+}
+
+static bool_t as3911ShadowCached(u8 reg)
+{
+    return (reg < AS3911_SHADOW_SIZE) &&
+           (as3911ShadowValid[reg >> 3] & AS3911_SHADOW_BIT(reg));
+}
+
+static void as3911ShadowStore(u8 reg, u8 val)
+{
+    if ((reg < AS3911_SHADOW_SIZE) &&
+        (as3911ShadowCacheable[reg >> 3] & AS3911_SHADOW_BIT(reg)))
+    {
+        as3911Shadow[reg] = val;
+        as3911ShadowValid[reg >> 3] |= AS3911_SHADOW_BIT(reg);
+    }
+}
+
+static void as3911ShadowDrop(u8 reg)
+{
+    if (reg < AS3911_SHADOW_SIZE)
+    {
+        as3911ShadowValid[reg >> 3] &= ~AS3911_SHADOW_BIT(reg);
+    }
+}
+#endif
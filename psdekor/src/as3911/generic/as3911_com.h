@@ -42,9 +42,17 @@
  * - Modify Register: #as3911ModifyRegister
  * - Write Register: #as3911WriteRegister
  * - Write Multiple Registers: #as3911WriteMultipleRegisters
+ * - Write register table from program memory: #as3911WriteRegisterTable
  * - Load AS3911 FIFO with data: #as3911WriteFifo
  * - Read from AS3911 FIFO: #as3911ReadFifo
  * - Execute direct command: #as3911ExecuteCommand
+ *
+ * With CONF_AS3911_SHADOW_REGS the configuration registers are cached in a
+ * write-through shadow copy: reading them costs no SPI transaction and
+ * #as3911ModifyRegister only writes if the value changes.
+ *
+ * With CONF_SPI_ASYNC #as3911WriteFifo and #as3911ReadFifo shift the FIFO
+ * data from the SPI interrupt while the CPU sleeps (see #spiTxRxStart).
  */
 
 #ifndef AS3911_COM_H
@@ -141,6 +149,25 @@
 
 #define AS3911_REG_IC_IDENTITY                  0x3F        /*!< R  Chip Id: 0 for old silicon, v2 silicon: 0x09 */
 
+#ifdef CONF_AS3911_SHADOW_REGS
+/*! Savings of the register shadow copy, see #as3911ShadowGetStats */
+typedef struct
+{
+    u32 readHits;       /*!< register reads served from the shadow copy */
+    u32 writesSkipped;  /*!< modify operations that didn't change the value */
+} as3911ShadowStats_t;
+#endif
+
+/*! Longest run of a register table, see #as3911WriteRegisterTable */
+#define AS3911_TABLE_MAX_RUN 8
+
+/*! Starts a run of \a length registers from \a reg in a register table,
+    followed by the \a length values */
+#define AS3911_TABLE_RUN(reg, length) (reg), (length)
+
+/*! Ends a register table */
+#define AS3911_TABLE_END 0, 0
+
 /* Register bit definitions */
 
 #define AS3911_REG_IO_CONF1_lf_clk_off                     (1<<0)	
@@ -507,6 +534,43 @@ extern s8 as3911ModifyRegister(u8 reg, u8 clr_mask, u8 set_mask);
  */
 extern s8 as3911WriteMultipleRegisters(u8 reg, const u8* values, u8 length);
 
+/*! 
+ *****************************************************************************
+ *  \brief  Writes the registers of a range whose value changes
+ *
+ *  Like #as3911WriteMultipleRegisters, but with CONF_AS3911_SHADOW_REGS the
+ *  registers at both ends of the range that already hold their value are
+ *  left out, so nothing is sent if no value changes.
+ *
+ *  \param[in]  reg: Address of the frist register to write.
+ *  \param[in]  values: pointer to a buffer containing the values to be written.
+ *  \param[in]  length: Number of values to be written.
+ *
+ *  \return ERR_IO : Error during communication.
+ *  \return ERR_NONE : No error, \a length values written.
+ *
+ *****************************************************************************
+ */
+extern s8 as3911WriteRegisterRange(u8 reg, const u8* values, u8 length);
+
+/*! 
+ *****************************************************************************
+ *  \brief  Writes a register table from program memory
+ *
+ *  A table is a PROGMEM array of runs of contiguous registers, each started
+ *  with #AS3911_TABLE_RUN and followed by its values, at most
+ *  #AS3911_TABLE_MAX_RUN per run. #AS3911_TABLE_END ends the table.
+ *  Every run is written in one burst with #as3911WriteRegisterRange.
+ *
+ *  \param[in]  table: the table in program memory.
+ *
+ *  \return ERR_IO : Error during communication.
+ *  \return ERR_NONE : No error, all runs written.
+ *
+ *****************************************************************************
+ */
+extern s8 as3911WriteRegisterTable(const u8* table);
+
 /*! 
  *****************************************************************************
  *  \brief  Reads from multiple AS3911 registers
@@ -595,5 +659,28 @@ extern s8 as3911ExecuteCommand(u8 cmd);
  */
 extern s8 as3911TestPrefix (void);
 
+#ifdef CONF_AS3911_SHADOW_REGS
+/*! 
+ *****************************************************************************
+ *  \brief  Forgets the shadow copy of all registers
+ *
+ *  Needs to be called if the AS3911 lost its register contents other than
+ *  by #AS3911_CMD_SET_DEFAULT, e.g. after a power cycle.
+ *
+ *****************************************************************************
+ */
+extern void as3911ShadowInvalidate(void);
+
+/*! 
+ *****************************************************************************
+ *  \brief  Returns the savings of the register shadow copy
+ *
+ *  Every read hit and every skipped write saves one SPI transaction.
+ *
+ *****************************************************************************
+ */
+extern const as3911ShadowStats_t* as3911ShadowGetStats(void);
+#endif
+
 #endif /* AS3911_COM_H */
 
@@ -74,6 +74,14 @@
 */
 static u8 felicaSavedOpReg;
 
+/*! registers of the FeliCa mode besides AS3911_REG_OP_CONTROL */
+static const u8 felicaProfile[] PROGMEM = {
+    AS3911_TABLE_RUN(AS3911_REG_MODE, 2),
+        AS3911_REG_MODE_om_felica,
+        0x11, /* AS3911_REG_BIT_RATE : 212 kBit/s both direction */
+    AS3911_TABLE_END
+};
+
 /*
 ******************************************************************************
 * GLOBAL FUNCTIONS
@@ -82,23 +90,20 @@ static u8 felicaSavedOpReg;
 s8 felicaInitialize(u8 modulation_index)
 {
     s8 err;
-    u8 buf[3];
     u8 result;
 
     as3911ReadRegister(AS3911_REG_OP_CONTROL,&felicaSavedOpReg);
 
-    buf[0] = (felicaSavedOpReg
-           | AS3911_REG_OP_CONTROL_en
-           | AS3911_REG_OP_CONTROL_tx_en
-           | AS3911_REG_OP_CONTROL_rx_en
-           )
-           & ~AS3911_REG_OP_CONTROL_wu;
-
-    buf[1] = AS3911_REG_MODE_om_felica;
-    buf[2] = 0x11; /* AS3911_REG_BIT_RATE : 212 kBit/s both direction */
-
     /* set felica mode, lowest Rx and TX rate. Enable Rx and Tx */
-    err = as3911WriteMultipleRegisters(AS3911_REG_OP_CONTROL, buf, 3);
+    err = as3911WriteRegister(AS3911_REG_OP_CONTROL,
+            (felicaSavedOpReg
+             | AS3911_REG_OP_CONTROL_en
+             | AS3911_REG_OP_CONTROL_tx_en
+             | AS3911_REG_OP_CONTROL_rx_en
+            )
+            & ~AS3911_REG_OP_CONTROL_wu);
+    EVAL_ERR_NE_GOTO(ERR_NONE, err, out);
+    err = as3911WriteRegisterTable(felicaProfile);
     EVAL_ERR_NE_GOTO(ERR_NONE, err, out);
 
     as3911ModifyRegister(AS3911_REG_AUX, AS3911_REG_AUX_tr_am, AS3911_REG_AUX_tr_am);
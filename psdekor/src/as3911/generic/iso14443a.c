@@ -68,6 +68,10 @@
    communication. Limit to 100ms = 21186 * 64/fc. */
 #define ISO14443A_FRAME_DELAY_TIME  21186
 
+/* Time a PICC may answer an HLTA with (the command is then not acknowledged):
+   1.1ms according to ISO14443-3 */
+#define ISO14443A_HLTA_WAITING_TIME_US 1100
+
 /*
 ******************************************************************************
 * LOCAL FUNCTION PROTOTYPES
@@ -77,6 +81,16 @@ static s8 iso14443ADoAntiCollisionLoop(iso14443AProximityCard_t* card);
 static s8 iso14443AVerifyBcc(const u8* uid, u8 length, u8 bcc);
 static u8 iso14443aSavedOpReg;
 
+/*! registers of the ISO14443A mode besides AS3911_REG_OP_CONTROL */
+static const u8 iso14443aProfile[] PROGMEM = {
+    AS3911_TABLE_RUN(AS3911_REG_MODE, 2),
+        AS3911_REG_MODE_om_iso14443a,
+        0x00, /* AS3911_REG_BIT_RATE : 106 kBit/s both direction */
+    AS3911_TABLE_RUN(AS3911_REG_MASK_RX_TIMER, 1),
+        ISO14443A_MASK_RECEIVE_TIME,
+    AS3911_TABLE_END
+};
+
 /*
 ******************************************************************************
 * GLOBAL FUNCTIONS
@@ -85,27 +99,22 @@ static u8 iso14443aSavedOpReg;
 s8 iso14443AInitialize()
 {
     s8 err;
-    u8 buf[3];
 
     ISO_14443A_DEBUG(__func__);
 
     as3911ReadRegister(AS3911_REG_OP_CONTROL,&iso14443aSavedOpReg);
 
-    buf[0] = (iso14443aSavedOpReg
-           | AS3911_REG_OP_CONTROL_en
-           | AS3911_REG_OP_CONTROL_tx_en
-           | AS3911_REG_OP_CONTROL_rx_en
-           )
-           & ~AS3911_REG_OP_CONTROL_wu;
-
-    buf[1] = AS3911_REG_MODE_om_iso14443a;
-    buf[2] = 0x00; /* AS3911_REG_BIT_RATE : 106 kBit/s both direction */
-
     /* set iso14443 mode A, lowest Rx and TX rate. Enable Rx and Tx */
-    err = as3911WriteMultipleRegisters(AS3911_REG_OP_CONTROL, buf, 3);
+    err = as3911WriteRegister(AS3911_REG_OP_CONTROL,
+            (iso14443aSavedOpReg
+             | AS3911_REG_OP_CONTROL_en
+             | AS3911_REG_OP_CONTROL_tx_en
+             | AS3911_REG_OP_CONTROL_rx_en
+            )
+            & ~AS3911_REG_OP_CONTROL_wu);
+    EVAL_ERR_NE_GOTO(ERR_NONE, err, out);
+    err = as3911WriteRegisterTable(iso14443aProfile);
     EVAL_ERR_NE_GOTO(ERR_NONE, err, out);
-
-    as3911WriteRegister(AS3911_REG_MASK_RX_TIMER, ISO14443A_MASK_RECEIVE_TIME);
 
     as3911SetNoResponseTime_64fcs(ISO14443A_FRAME_DELAY_TIME);
 
@@ -252,7 +261,8 @@ s8 iso14443ASendHlta()
     /* according to ISO14443-3 we should wait here for 1.1ms.
        If any PICC responds within this time, HLTA command shall
        be interpreted as not acknowledged */
-     mask = as3911WaitForInterruptsTimed(AS3911_IRQ_MASK_RXS, 2);
+     mask = as3911WaitForInterruptsTimedUs(AS3911_IRQ_MASK_RXS,
+                                           ISO14443A_HLTA_WAITING_TIME_US);
 
      if (0 == mask)
      {
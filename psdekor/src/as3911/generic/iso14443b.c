@@ -90,6 +90,16 @@ static s8 iso14443BSendApfAndGetResult(iso14443BCommand_t cmd,
 
 static u8 iso14443bSavedOpReg;
 
+/*! registers of the ISO14443B mode besides AS3911_REG_OP_CONTROL */
+static const u8 iso14443bProfile[] PROGMEM = {
+    AS3911_TABLE_RUN(AS3911_REG_MODE, 2),
+        AS3911_REG_MODE_om_iso14443b,
+        0x00, /* AS3911_REG_BIT_RATE : 106 kBit/s both direction */
+    AS3911_TABLE_RUN(AS3911_REG_MASK_RX_TIMER, 1),
+        ISO14443B_MASK_RECEIVE_TIME,
+    AS3911_TABLE_END
+};
+
 /*
 ******************************************************************************
 * GLOBAL FUNCTIONS
@@ -97,24 +107,22 @@ static u8 iso14443bSavedOpReg;
 */
 s8 iso14443BInitialize(u8 mi, u8* result)
 {
-    u8 buf[3];
     s8 err;
 
     ISO_14443B_DEBUG(__func__);
 
     as3911ReadRegister(AS3911_REG_OP_CONTROL,&iso14443bSavedOpReg);
 
-    buf[0] = (iso14443bSavedOpReg
-           | AS3911_REG_OP_CONTROL_en
-           | AS3911_REG_OP_CONTROL_tx_en
-           | AS3911_REG_OP_CONTROL_rx_en
-           )
-           & ~AS3911_REG_OP_CONTROL_wu;
-    buf[1] = AS3911_REG_MODE_om_iso14443b;
-    buf[2] = 0x00; /* AS3911_REG_BIT_RATE : 106 kBit/s both direction */
-
     /* set iso14443 mode B, lowest Rx and TX rate. Enable Rx and Tx */
-    err = as3911WriteMultipleRegisters(AS3911_REG_OP_CONTROL, buf, 3);
+    err = as3911WriteRegister(AS3911_REG_OP_CONTROL,
+            (iso14443bSavedOpReg
+             | AS3911_REG_OP_CONTROL_en
+             | AS3911_REG_OP_CONTROL_tx_en
+             | AS3911_REG_OP_CONTROL_rx_en
+            )
+            & ~AS3911_REG_OP_CONTROL_wu);
+    EVAL_ERR_NE_GOTO(ERR_NONE, err, out);
+    err = as3911WriteRegisterTable(iso14443bProfile);
     EVAL_ERR_NE_GOTO(ERR_NONE, err, out);
 
     /* Set modulation depth to 10%. */
@@ -124,8 +132,6 @@ s8 iso14443BInitialize(u8 mi, u8* result)
     err = as3911CalibrateModulationDepth(result);
     EVAL_ERR_NE_GOTO(ERR_NONE, err, out);
 
-    as3911WriteRegister(AS3911_REG_MASK_RX_TIMER, ISO14443B_MASK_RECEIVE_TIME);
-
     as3911SetNoResponseTime_64fcs(ISO14443B_FRAME_DELAY_TIME);
 
     err = as3911ExecuteCommand(AS3911_CMD_ANALOG_PRESET);
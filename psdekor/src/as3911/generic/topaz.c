@@ -72,6 +72,16 @@
 */
 static u8 topazSavedOpReg;
 
+/*! registers of the Topaz mode besides AS3911_REG_OP_CONTROL */
+static const u8 topazProfile[] PROGMEM = {
+    AS3911_TABLE_RUN(AS3911_REG_MODE, 2),
+        AS3911_REG_MODE_om_topaz,
+        0x00, /* AS3911_REG_BIT_RATE : 106 kBit/s both direction */
+    AS3911_TABLE_RUN(AS3911_REG_MASK_RX_TIMER, 1),
+        TOPAZ_MASK_RECEIVE_TIME,
+    AS3911_TABLE_END
+};
+
 /*
 ******************************************************************************
 * GLOBAL FUNCTIONS
@@ -80,27 +90,22 @@ static u8 topazSavedOpReg;
 s8 topazInitialize()
 {
     s8 err;
-    u8 buf[3];
 
     TOPAZ_DEBUG(__func__);
 
     as3911ReadRegister(AS3911_REG_OP_CONTROL,&topazSavedOpReg);
 
-    buf[0] = (topazSavedOpReg
-           | AS3911_REG_OP_CONTROL_en
-           | AS3911_REG_OP_CONTROL_tx_en
-           | AS3911_REG_OP_CONTROL_rx_en
-           )
-           & ~AS3911_REG_OP_CONTROL_wu;
-
-    buf[1] = AS3911_REG_MODE_om_topaz;
-    buf[2] = 0x00; /* AS3911_REG_BIT_RATE : 106 kBit/s both direction */
-
     /* set topaz mode, lowest Rx and TX rate. Enable Rx and Tx */
-    err = as3911WriteMultipleRegisters(AS3911_REG_OP_CONTROL, buf, 3);
+    err = as3911WriteRegister(AS3911_REG_OP_CONTROL,
+            (topazSavedOpReg
+             | AS3911_REG_OP_CONTROL_en
+             | AS3911_REG_OP_CONTROL_tx_en
+             | AS3911_REG_OP_CONTROL_rx_en
+            )
+            & ~AS3911_REG_OP_CONTROL_wu);
+    EVAL_ERR_NE_GOTO(ERR_NONE, err, out);
+    err = as3911WriteRegisterTable(topazProfile);
     EVAL_ERR_NE_GOTO(ERR_NONE, err, out);
-
-    as3911WriteRegister(AS3911_REG_MASK_RX_TIMER, TOPAZ_MASK_RECEIVE_TIME);
 
     as3911SetNoResponseTime_64fcs(TOPAZ_INVENTORY_WAITING_TIME);
 
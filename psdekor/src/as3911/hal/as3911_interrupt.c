@@ -49,6 +49,7 @@
 #include "board_wrapper.h"
 #include "spi_driver.h"
 #include "as3911_enhanced_irq_control.h"
+#include "utils/event_queue.h"
 
 /*! \brief additional interrupts in AS3911_REG_IRQ_TIMER_NFC */
 #define AS3911_IRQ_MASK_TIM (0x02)
@@ -56,6 +57,9 @@
 /*! additional interrupts in AS3911_REG_IRQ_ERROR_WUP */
 #define AS3911_IRQ_MASK_ERR (0x01)
 
+/*! \brief wake-ups of the timer, posted as #EVENT_RF_WAKE_UP */
+#define AS3911_IRQ_MASK_WAKE_UP (AS3911_IRQ_MASK_WAM | AS3911_IRQ_MASK_WPH | AS3911_IRQ_MASK_WCAP)
+
 static s8 as3911ModifyInterrupts (u32 clr_mask, u32 set_mask);
 
 /*
@@ -81,6 +85,7 @@ void as3911_interrupt_handler (void)
 {
 	u8 iregs[3] = {0,0,0};
 	static u32 irqStatus;
+	irqflags_t flags;
 
 	/* clear the interrupt flag */
 	icClearInterrupt(IC_SOURCE_AS3911);
@@ -102,6 +107,16 @@ void as3911_interrupt_handler (void)
 		/* forward all interrupts, even masked ones to application. */
 		as3911InterruptStatus |= irqStatus;
 
+		/* the wake-up timer ends the sleep of the main loop. The
+		 * handler also runs from the main loop (as3911WaitForInterrupts,
+		 * AS3911_IRQ_DEC_ENABLE) where the other producers of the ring
+		 * can preempt it */
+		if (irqStatus & AS3911_IRQ_MASK_WAKE_UP) {
+			flags = cpu_irq_save ();
+			eventPost (EVENT_RF_WAKE_UP, 0);
+			cpu_irq_restore (flags);
+		}
+
 	} while (ioport_get_pin_level (AS3911_INTR_PIN) == 1);
 	/* AS3911 keeps INTR pin high as long as there are pending interrupts */
 }
@@ -156,17 +171,17 @@ s8 as3911ClearInterrupts ()
 	return err;
 }
 
-u32 as3911WaitForInterruptsTimed (u32 mask, u16 tmo)
+/*!
+ * \brief Waits for the interrupts in \a mask
+ * \param timed TRUE if the delay timer has been started for the timeout.
+ */
+static u32 as3911WaitForInterrupts (u32 mask, bool_t timed)
 {
 	u32 status = as3911InterruptStatus & mask;
 	bool_t timer_done = FALSE;
 
-
-	if (tmo)
-		delayNMilliSecondsStart(tmo);
-
 	while (!status && !timer_done) {
-		if (tmo) {
+		if (timed) {
 			/* We could sleep here but this will open a race
 			 * condition if the AS3911 interrupt occurs before
 			 * entering sleep which will lead to extra 1ms delay
@@ -175,9 +190,20 @@ u32 as3911WaitForInterruptsTimed (u32 mask, u16 tmo)
 			timer_done = delayNMilliSecondsIsDone(FALSE);
 		}
 		status = as3911InterruptStatus & mask;
+
+		if (!status && ioport_get_pin_level (AS3911_INTR_PIN) == 1) {
+			/* a rising edge is lost while the interrupt is disabled
+			 * (icDisableInterrupt clears the pin from INT0MASK), so
+			 * fetch the pending interrupts here */
+			icDisableInterrupt(IC_SOURCE_AS3911);
+			if (ioport_get_pin_level (AS3911_INTR_PIN) == 1)
+				as3911_interrupt_handler ();
+			icEnableInterrupt(IC_SOURCE_AS3911);
+			status = as3911InterruptStatus & mask;
+		}
 	}
 
-	if (tmo)
+	if (timed)
 		delayNMilliSecondsStop();
 
 	icDisableInterrupt(IC_SOURCE_AS3911);
@@ -187,6 +213,22 @@ u32 as3911WaitForInterruptsTimed (u32 mask, u16 tmo)
 	return status;
 }
 
+u32 as3911WaitForInterruptsTimed (u32 mask, u16 tmo)
+{
+	if (tmo)
+		delayNMilliSecondsStart(tmo);
+
+	return as3911WaitForInterrupts(mask, tmo != 0);
+}
+
+u32 as3911WaitForInterruptsTimedUs (u32 mask, u16 tmo_us)
+{
+	if (tmo_us)
+		delayNMicroSecondsStart(tmo_us);
+
+	return as3911WaitForInterrupts(mask, tmo_us != 0);
+}
+
 u32 as3911GetInterrupt (u32 mask)
 {
 	mask &= as3911InterruptStatus;
@@ -155,6 +155,24 @@ extern s8 as3911ClearInterrupts (void);
  */
 extern u32 as3911WaitForInterruptsTimed (u32 mask, u16 tmo);
 
+/*!
+ *****************************************************************************
+ *  \brief  Wait until an AS3911 interrupt occurs, timeout in micro seconds
+ *
+ *  Same as #as3911WaitForInterruptsTimed with a timeout of \a tmo_us micro
+ *  seconds, for protocol timeouts that aren't whole milliseconds.
+ *
+ *  \param[in] mask : mask indicating the interrupts to wait for.
+ *  \param[in] tmo_us : time in micro seconds until timeout occurs. If set
+ *                      to 0 the functions waits forever.
+ *
+ *  \return : 0 if timeout occured otherwise a mask indicating the cleared
+ *              interrupts.
+ *
+ *****************************************************************************
+ */
+extern u32 as3911WaitForInterruptsTimedUs (u32 mask, u16 tmo_us);
+
 /*!
  *****************************************************************************
  *  \brief  Get status for the given interrupt
@@ -43,6 +43,81 @@
 #include "platform.h"
 #include "clock.h"
 #include "as3911_hw_config.h"
+#ifdef CONF_CLOCK_PROFILE
+#include "delay_wrapper.h"
+#include "spi_driver.h"
+#include "uart.h"
+#include "buzzer/buzzer.h"
+#include "utils/trace_clock.h"
+#include "utils/energy.h"
+#endif
+
+/*
+******************************************************************************
+* LOCAL MACROS
+******************************************************************************
+*/
+#define CLK_RC2MHZ_HZ   U32_C(2000000)
+#define CLK_RC32MHZ_HZ  U32_C(32000000)
+
+/*
+******************************************************************************
+* LOCAL VARIABLES
+******************************************************************************
+*/
+#ifdef CONF_CLOCK_PROFILE
+/*! \brief Current profile */
+static clkProfile_t clkProfile = CLK_PROFILE_SLEEP;
+
+/*! \brief Current CPU clock, set by #clkInitialize */
+static u32 clkCpuHz;
+#endif
+
+/*
+******************************************************************************
+* LOCAL FUNCTIONS
+******************************************************************************
+*/
+#ifdef CONF_CLOCK_PROFILE
+
+/*! \brief Returns TRUE while a timer runs which can't follow a switch */
+static bool_t clkTimersBusy (void)
+{
+	/* the software timers run from the RTC */
+	return buzzerIsRunning ();
+}
+
+/*! \brief Switches the system clock and the drivers depending on it
+ *  \return ERR_BUSY if a timer is running which can't follow the switch.
+ */
+static s8 clkSwitch (u8 source, u32 hz)
+{
+	s8 err;
+
+	if (hz == clkCpuHz)
+		return ERR_NONE;
+
+	if (clkTimersBusy ())
+		return ERR_BUSY;
+
+	/* the baud rate must not change within a character */
+	uartFlush ();
+
+	IRQ_INC_DISABLE();
+	err = delayClockChanged (hz);
+	if (err == ERR_NONE) {
+		energySetClock (hz > CLK_RC2MHZ_HZ);
+		traceClockChanged (hz);
+		sysclk_set_source (source);
+		clkCpuHz = hz;
+		uartClockChanged (hz);
+		spiClockChanged (hz);
+	}
+	IRQ_DEC_ENABLE();
+
+	return err;
+}
+#endif /* CONF_CLOCK_PROFILE */
 
 /*
 ******************************************************************************
@@ -65,10 +140,22 @@ s8 clkInitialize ()
 	 *       done
 	 */
 	sysclk_enable_peripheral_clock (AS3911_DELAY_TIMER_MODULE);
+#ifdef CONF_CLOCK_PROFILE
+	clkCpuHz = sysclk_get_cpu_hz ();
+#endif
 
 	return ERR_NONE;
 }
 
+u32 clkGetCpuHz (void)
+{
+#ifdef CONF_CLOCK_PROFILE
+	return clkCpuHz;
+#else
+	return sysclk_get_cpu_hz ();
+#endif
+}
+
 s8 clkSetClockSource(clkSource_t source)
 {
 #ifdef CONF_CHANGE_CLOCK_ALLOWED
@@ -94,3 +181,42 @@ s8 clkSetClockSource(clkSource_t source)
 
     return ERR_NONE;
 }
+
+#ifdef CONF_CLOCK_PROFILE
+s8 clkSetProfile (clkProfile_t profile)
+{
+	s8 err;
+
+	if (profile == clkProfile)
+		return ERR_NONE;
+
+	if (profile == CLK_PROFILE_RF) {
+		/* don't start the oscillator for nothing */
+		if (clkTimersBusy ())
+			return ERR_BUSY;
+
+		osc_enable (OSC_ID_RC32MHZ);
+		energySetLoad (ENERGY_LOAD_RC32M, true);
+		while (!osc_is_ready (OSC_ID_RC32MHZ))
+			;
+		err = clkSwitch (SYSCLK_SRC_RC32MHZ, CLK_RC32MHZ_HZ);
+	} else {
+		err = clkSwitch (SYSCLK_SRC_RC2MHZ, CLK_RC2MHZ_HZ);
+	}
+
+	if (err != ERR_NONE) {
+		/* still on the old clock, but the 32 MHz oscillator runs */
+		clkProfile = (clkCpuHz == CLK_RC2MHZ_HZ) ? CLK_PROFILE_IDLE
+		                                         : CLK_PROFILE_RF;
+		return err;
+	}
+
+	if (profile == CLK_PROFILE_SLEEP) {
+		osc_disable (OSC_ID_RC32MHZ);
+		energySetLoad (ENERGY_LOAD_RC32M, false);
+	}
+	clkProfile = profile;
+
+	return ERR_NONE;
+}
+#endif /* CONF_CLOCK_PROFILE */
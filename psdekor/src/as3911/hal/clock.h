@@ -43,6 +43,8 @@
  * API:
  * - Initialize clock driver #clkInitialize
  * - Switch to new clock source #clkSetClockSource
+ * - Switch between the 2 MHz and 32 MHz RC oscillators #clkSetProfile
+ * - Get the current CPU clock #clkGetCpuHz
  */
 
 #ifndef CLOCK_H
@@ -54,6 +56,7 @@
 ******************************************************************************
 */
 #include "platform.h"
+#include "conf_board.h"
 
 /*
 ******************************************************************************
@@ -66,6 +69,14 @@ typedef enum
     CLK_SOURCE_EXTERNAL
 }clkSource_t;
 
+/*! \brief Clock profiles of #clkSetProfile */
+typedef enum
+{
+    CLK_PROFILE_SLEEP, /*!< 2 MHz, 32 MHz oscillator off */
+    CLK_PROFILE_IDLE,  /*!< 2 MHz, 32 MHz oscillator kept running */
+    CLK_PROFILE_RF     /*!< 32 MHz */
+}clkProfile_t;
+
 /*
 ******************************************************************************
 * GLOBAL FUNCTION PROTOTYPES
@@ -97,5 +108,45 @@ extern s8 clkInitialize(void);
  */
 extern s8 clkSetClockSource(clkSource_t source);
 
+/*! 
+ *****************************************************************************
+ *  \brief  Get the current CPU (and peripheral) clock
+ *
+ *  Unlike sysclk_get_cpu_hz(), which is derived from conf_clock.h at compile
+ *  time, this follows the switches of #clkSetProfile.
+ *
+ *  \return CPU clock in Hertz.
+ *
+ *****************************************************************************
+ */
+extern u32 clkGetCpuHz(void);
+
+#ifdef CONF_CLOCK_PROFILE
+/*! 
+ *****************************************************************************
+ *  \brief  Switch to a clock profile
+ *
+ *  CLK_PROFILE_RF runs the CPU from the 32 MHz RC oscillator so an RF
+ *  transaction (anticollision, select) spends less time on the SPI and in
+ *  the CPU, the other profiles run it from the 2 MHz RC oscillator.
+ *  CLK_PROFILE_IDLE keeps the 32 MHz oscillator running if it was started,
+ *  so the next switch to CLK_PROFILE_RF doesn't wait for it; use
+ *  CLK_PROFILE_SLEEP to stop it before sleeping.
+ *
+ *  The parameters of the delay timer, the UART baud rate and the SPI
+ *  divider are reprogrammed for the new clock. The switch is refused while
+ *  a timer runs which can't follow it: the delay timer or the buzzer (the
+ *  software timers of soft_timer.h run from the RTC).
+ *
+ *  \param[in] profile : Profile to switch to.
+ *
+ *  \return ERR_NONE : No error, profile switched.
+ *  \return ERR_BUSY : A timer is running, the CPU clock wasn't changed.
+ *
+ *****************************************************************************
+ */
+extern s8 clkSetProfile(clkProfile_t profile);
+#endif
+
 #endif /* CLOCK_H */
 
@@ -43,8 +43,10 @@
 #include "platform.h"
 #include "delay_wrapper.h"
 #include "ic.h"
+#include "clock.h"
 #include "logger.h"
 #include "as3911_hw_config.h"
+#include "utils/wait_trace.h"
 
 /*
 ******************************************************************************
@@ -76,6 +78,16 @@ struct Uint32_s {
 	};
 };
 
+/*!
+ * \brief Clock dependent parameters of the delay module.
+ */
+struct DelayClockStruct {
+	u32             bus_hz;     /**< Clock of the timer module in use
+	                             *   (AS3911_DELAY_TIMER_MODULE) */
+	u16             cyclesPerMs; /**< Timer clock cycles per milli second */
+	u8              cyclesPerUs; /**< Timer clock cycles per micro second */
+};
+
 /*!
  * \brief Info structure for delay module.
  *
@@ -87,25 +99,27 @@ struct DelayInfoStruct {
 	volatile bool_t cascade;    /**< Use multiple interrupts to handle
 	                             *   long timeout periods (cascade mode) */
 	volatile u32    remaining;  /**< Remainder (only in cascade mode) */
-	struct Uint32_s equ_hz;     /**< Frequency of the timer module in use
-	                             *   (AS3911_DELAY_TIMER_MODULE) */
-	u8              shiftUp;    /**< Used to determine divider settings */
-	u8              shiftDown;  /**< Used to determine divider settings */
+	struct DelayClockStruct clk; /**< Parameters of the current clock */
 };
 
 /*! \brief Divider settings of timer module */
 struct TCModeSettings {
-	u8 divMode;   /**< Configuration for specific divider setting */
-	u8 divShift;  /**< Number of right-shift operations for specific divider
+	u8  divMode;  /**< Configuration for specific divider setting */
+	u8  divShift; /**< Number of right-shift operations for specific divider
 	               *   setting */
+	u32 limit;    /**< Clock cycles from which PER overflows with this
+	               *   setting (0x10000 << divShift) */
 };
 
 /*! \brief All Divider configurations for timer module */
 const struct TCModeSettings ModeSettings[] = {
-	{TC_CLKSEL_DIV1_gc, 0}, {TC_CLKSEL_DIV2_gc, 1},
-	{TC_CLKSEL_DIV4_gc, 2}, {TC_CLKSEL_DIV8_gc, 3},
-	{TC_CLKSEL_DIV64_gc, 6}, {TC_CLKSEL_DIV256_gc, 8},
-	{TC_CLKSEL_DIV1024_gc, 10}
+	{TC_CLKSEL_DIV1_gc, 0, U32_C(0x10000)},
+	{TC_CLKSEL_DIV2_gc, 1, U32_C(0x20000)},
+	{TC_CLKSEL_DIV4_gc, 2, U32_C(0x40000)},
+	{TC_CLKSEL_DIV8_gc, 3, U32_C(0x80000)},
+	{TC_CLKSEL_DIV64_gc, 6, U32_C(0x400000)},
+	{TC_CLKSEL_DIV256_gc, 8, U32_C(0x1000000)},
+	{TC_CLKSEL_DIV1024_gc, 10, U32_C(0x4000000)}
 };
 
 /*!
@@ -114,6 +128,36 @@ const struct TCModeSettings ModeSettings[] = {
  */
 static struct DelayInfoStruct DelayInfo;
 
+/*!
+ * \brief Parameters of the clock used before the last #delayClockChanged, so
+ *        switching back doesn't calculate them again
+ */
+static struct DelayClockStruct DelayOtherClock;
+
+#ifdef CONF_ENABLE_WAIT_TRACE
+/*! \brief Pending delayNMilliSecondsStart wait (for the wait trace) */
+static struct {
+	bool_t pending;
+	u32 us;
+	const void *caller;
+	wait_time_t start;
+} PollTrace;
+
+/*! \brief Records the pending delayNMilliSecondsStart wait, if any */
+static void tracePollFinish (void)
+{
+	if (PollTrace.pending) {
+		PollTrace.pending = false;
+		waitTraceRecord (WAIT_KIND_DELAY_POLL, PollTrace.caller,
+		                 PollTrace.us, PollTrace.start);
+	}
+}
+
+# define TRACE_POLL_FINISH() tracePollFinish ()
+#else
+# define TRACE_POLL_FINISH() do { } while (0)
+#endif
+
 
 /*
 ******************************************************************************
@@ -128,7 +172,7 @@ static struct DelayInfoStruct DelayInfo;
 */
 
 static s8 delaySetupParameters (u32 bus_hz);
-static s8 delayStartTimerMS (u16 ms);
+static s8 delayStartTimer (u32 cycles);
 
 INTERRUPT(delayIsr)
 {
@@ -166,35 +210,12 @@ clear_int:
  */
 static s8 delaySetupParameters (u32 bus_hz)
 {
-	DelayInfo.equ_hz.v32 = bus_hz;
-	DelayInfo.shiftUp = 0;
-
-	if ((DelayInfo.equ_hz.v8_3 != 0) || /* if equ_hz > '0x003f ffff': */
-	    (DelayInfo.equ_hz.v8_2 > 0x3f)) {
-		/* has to be shifted down three bits */
-		DelayInfo.equ_hz.v32 = (DelayInfo.equ_hz.v32 / U32_C(125));
-		DelayInfo.shiftDown = 3;
-	} else {
-		/* has to be shifted down ten bits */
-		DelayInfo.equ_hz.v32 = (DelayInfo.equ_hz.v32 << 7) / U32_C(125);
-		DelayInfo.shiftDown = 10;
-	}
+	DelayInfo.clk.bus_hz = bus_hz;
+	DelayInfo.clk.cyclesPerMs = bus_hz / U32_C(1000);
+	DelayInfo.clk.cyclesPerUs = bus_hz / U32_C(1000000);
 
-	while ((DelayInfo.equ_hz.v8_2 != 0) || (DelayInfo.equ_hz.v8_3 != 0)) {
-		DelayInfo.equ_hz.v32 >>= 1;
-		++DelayInfo.shiftUp;
-	}
-
-	/* Normalize shiftUp and shiftDown: */
-	if (DelayInfo.shiftUp > DelayInfo.shiftDown) {
-		DelayInfo.shiftUp -= DelayInfo.shiftDown;
-		DelayInfo.shiftDown = 0;
-	} else {
-		DelayInfo.shiftDown -= DelayInfo.shiftUp;
-		DelayInfo.shiftUp = 0;
-	}
-
-	if (unlikely(DelayInfo.equ_hz.v32 == 0)) {
+	if (unlikely((DelayInfo.clk.cyclesPerUs == 0) ||
+	             (bus_hz > U32_C(65535000)))) {
 		return ERR_REQUEST;
 	}
 
@@ -203,57 +224,38 @@ static s8 delaySetupParameters (u32 bus_hz)
 
 /*
  * \brief Starts delay timer.
- * \param ms Timeout period of the timer module (in milliseconds).
- * \note This method could be improved (as suggested in the source code) -
- *       however, it wasn't necessary and therefore only not done -
- *       Since it has already been evaluated which part of the algorithm
- *       could be improved and how much it affects the timing,
- *       these notes have been left in the source code - ON PURPOSE!
+ * \param cycles Timeout period in clock cycles of the timer module.
+ *
+ * The cycles per milli and micro second are set up per clock by
+ * #delaySetupParameters, so a start costs one multiplication by the caller,
+ * a compare per divider setting and one shift.
  */
-static s8 delayStartTimerMS (u16 ms)
+static s8 delayStartTimer (u32 cycles)
 {
 	const u8 settings_count = sizeof(ModeSettings) /
 	                          sizeof(ModeSettings[0]);
 	struct Uint32_s tmp;
 	u8 i;
-	u8 shift_down;
-	u32 result;
 
-	/* HINT: inline asm mul 16x16->32 (but only affects 20% of
-	 *       extra execution time)
-	 */
-	result = ((u32)DelayInfo.equ_hz.lo16 * (u32)ms);
+	/* smallest divider that fits the period into PER, else the largest
+	 * one in cascade mode */
+	for (i = 0; i < (settings_count - 1); ++i) {
+		if (cycles < ModeSettings[i].limit)
+			break;
+	}
+	tmp.v32 = cycles >> ModeSettings[i].divShift;
 	AS3911_DELAY_TIMER_MODULE->CNT = U16_C(0);
 
-	/* HINT: This loop is very inefficient (especially shifting 32 bits).
-	 *       This loop affects ~80% of extra execution time
-	 *       (shift operation).
-	 */
-	for (i = 0; i < settings_count; ++i) {
-		shift_down = ModeSettings[i].divShift + DelayInfo.shiftDown;
-
-		tmp.v32 = result;
-		if (unlikely(shift_down < DelayInfo.shiftUp)) {
-			tmp.v32 <<= (DelayInfo.shiftUp - shift_down);
-		} else {
-			tmp.v32 >>= (shift_down - DelayInfo.shiftUp);
+	if (likely(tmp.hi16 == U16_C(0))) {
+		if (unlikely(tmp.lo16 == U16_C(0))) {
+			/* shorter than one clock cycle */
+			return ERR_REQUEST;
 		}
 
-		if (tmp.hi16 == U16_C(0)) {
-			if (unlikely(tmp.lo16 == U16_C(0))) {
-				/* Since divider settings are monotonically
-				 * nondecreasing, this means that none of the
-				 * remaining settings matches the requested
-				 * timeout (clock is too slow; -> unlikely)
-				 */
-				return ERR_REQUEST;
-			}
-
-			DelayInfo.cascade = false;
-			AS3911_DELAY_TIMER_MODULE->PER = tmp.lo16;
-			AS3911_DELAY_TIMER_MODULE->CTRLA = ModeSettings[i].divMode;
-			goto exit_timer_running;
-		}
+		DelayInfo.cascade = false;
+		AS3911_DELAY_TIMER_MODULE->PER = tmp.lo16;
+		AS3911_DELAY_TIMER_MODULE->CTRLA = ModeSettings[i].divMode;
+		goto exit_timer_running;
 	}
 
 	/* Timeout period is too long for 16bit timer -> use extra 32 bits
@@ -261,7 +263,7 @@ static s8 delayStartTimerMS (u16 ms)
 	AS3911_DELAY_TIMER_MODULE->PER = U16_C(0xffff);
 
 	IRQ_INC_DISABLE();
-	AS3911_DELAY_TIMER_MODULE->CTRLA = ModeSettings[settings_count - 1].divMode;
+	AS3911_DELAY_TIMER_MODULE->CTRLA = ModeSettings[i].divMode;
 	DelayInfo.remaining = tmp.v32 - U32_C(0xffff);
 	DelayInfo.cascade = true;
 	IRQ_DEC_ENABLE();
@@ -290,7 +292,28 @@ s8 delayInitialize()
 	DelayInfo.delayDone = false;
 	DelayInfo.cascade = false;
 
-	return delaySetupParameters (sysclk_get_peripheral_bus_hz (AS3911_DELAY_TIMER_MODULE));;
+	return delaySetupParameters (clkGetCpuHz ());
+}
+
+s8 delayClockChanged (u32 bus_hz)
+{
+	struct DelayClockStruct old = DelayInfo.clk;
+	s8 err = ERR_NONE;
+
+	if (AS3911_DELAY_TIMER_MODULE->CTRLA != TC_CLKSEL_OFF_gc)
+		return ERR_BUSY;
+
+	if (bus_hz == DelayOtherClock.bus_hz)
+		DelayInfo.clk = DelayOtherClock;
+	else
+		err = delaySetupParameters (bus_hz);
+
+	if (err == ERR_NONE)
+		DelayOtherClock = old;
+	else
+		DelayInfo.clk = old;
+
+	return err;
 }
 
 s8 delayDeinitialize()
@@ -306,7 +329,13 @@ s8 delayDeinitialize()
 
 s8 delayNMilliSeconds(u16 ms)
 {
-	s8 err = delayStartTimerMS (ms);
+	wait_time_t start = waitTraceNow ();
+	s8 err;
+
+	/* restarting the timer ends a pending delayNMilliSecondsStart wait */
+	TRACE_POLL_FINISH();
+
+	err = delayStartTimer ((u32)ms * DelayInfo.clk.cyclesPerMs);
 	EVAL_ERR_NE_GOTO(err, ERR_NONE, out);
 
 	cpu_irq_disable();
@@ -315,6 +344,9 @@ s8 delayNMilliSeconds(u16 ms)
 		cpu_irq_disable();
 	}
 	cpu_irq_enable();
+
+	waitTraceRecord (WAIT_KIND_DELAY, WAIT_TRACE_CALLER(), (u32)ms * U32_C(1000),
+	                 start);
 out:
 	return err;
 }
@@ -322,11 +354,38 @@ out:
 void delayNMilliSecondsStop()
 {
 	AS3911_DELAY_TIMER_MODULE->CTRLA = TC_CLKSEL_OFF_gc;
+	TRACE_POLL_FINISH();
+}
+
+/*! \brief Starts a polled wait, common part of the Start functions */
+static s8 delayStartPoll (u32 cycles, u32 us, const void *caller)
+{
+	s8 err;
+
+	TRACE_POLL_FINISH();
+	err = delayStartTimer (cycles);
+#ifdef CONF_ENABLE_WAIT_TRACE
+	if (err == ERR_NONE) {
+		PollTrace.pending = true;
+		PollTrace.us = us;
+		PollTrace.caller = caller;
+		PollTrace.start = waitTraceNow ();
+	}
+#endif
+
+	return err;
 }
 
 s8 delayNMilliSecondsStart(u16 ms)
 {
-	return delayStartTimerMS (ms);
+	return delayStartPoll ((u32)ms * DelayInfo.clk.cyclesPerMs,
+	                       (u32)ms * U32_C(1000), WAIT_TRACE_CALLER());
+}
+
+s8 delayNMicroSecondsStart(u16 us)
+{
+	return delayStartPoll ((u32)us * DelayInfo.clk.cyclesPerUs, us,
+	                       WAIT_TRACE_CALLER());
 }
 
 bool_t delayNMilliSecondsIsDone(bool_t do_sleep)
@@ -338,11 +397,15 @@ bool_t delayNMilliSecondsIsDone(bool_t do_sleep)
 		cpu_irq_enable();
 	}
 
+	if (DelayInfo.delayDone)
+		TRACE_POLL_FINISH();
+
 	 return DelayInfo.delayDone;
 }
 
 s8 delayNMicroSeconds(u16 us)
 {
-	delay_us (us);
+	/* delay_us counts the cycles of the clock configured in conf_clock.h */
+	delay_cycles ((u32)us * DelayInfo.clk.cyclesPerUs);
 	return ERR_NONE;
 }
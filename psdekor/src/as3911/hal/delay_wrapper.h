@@ -46,6 +46,9 @@
  * - Delay for N micro seconds: #delayNMicroSeconds
  * - Prepare for later micro seconds delay: #delayNMicroSecondsPrepare
  * - Run previously prepared delay: #delayNMicroSecondsRun
+ * - Start a polled timeout: #delayNMilliSecondsStart,
+ *   #delayNMicroSecondsStart, poll it with #delayNMilliSecondsIsDone and
+ *   end it with #delayNMilliSecondsStop
  */
 
 #ifndef DELAY_WRAPPER_H
@@ -69,13 +72,9 @@
  *  \brief  Initialize delay modules
  *
  *  This function initializes the delay module. It sets up the corresponding
- *  timers and local variables.
- *  \note System frequency must not be changed since timer calculation
- *  is done on base of a fixed frequency (#SYSCLK define)
- *
- *  Clock source is configured in config file. If clock source is changed, this
- *  module will stop working properly (this is due to the bad implementation of
- *  the ASF sysclk module).
+ *  timers and local variables for the current clock (#clkGetCpuHz).
+ *  \note If the clock is changed afterwards, #delayClockChanged must be
+ *  called (#clkSetProfile does that).
  *
  *  \return ERR_NONE : No error, delay module initialized.
  *
@@ -97,6 +96,24 @@ extern s8 delayInitialize (void);
  */
 extern s8 delayDeinitialize (void);
 
+/*! 
+ *****************************************************************************
+ *  \brief  Adapt the delay module to a new clock
+ *
+ *  Recalculates the clock cycles per milli and micro second of the delay
+ *  timer and #delayNMicroSeconds. Call it with interrupts disabled right before the
+ *  clock is switched.
+ *
+ *  \param[in] bus_hz: clock of the delay timer after the switch
+ *
+ *  \return ERR_NONE : No error, parameters recalculated.
+ *  \return ERR_BUSY : A delay is running, nothing changed.
+ *  \return ERR_REQUEST : The clock is too slow for the delay timer.
+ *
+ *****************************************************************************
+ */
+extern s8 delayClockChanged (u32 bus_hz);
+
 /*! 
  *****************************************************************************
  *  \brief  Delay the program for a given number of milli seconds
@@ -133,5 +150,23 @@ extern void delayNMilliSecondsStop (void);
 extern s8 delayNMilliSecondsStart (u16 ms);
 extern bool_t delayNMilliSecondsIsDone (bool_t do_sleep);
 
+/*! 
+ *****************************************************************************
+ *  \brief  Start a timeout of a given number of micro seconds
+ *
+ *  Like #delayNMilliSecondsStart but with micro second resolution, so
+ *  protocol timeouts shorter than a milli second or between two milli
+ *  seconds aren't rounded up. Poll it with #delayNMilliSecondsIsDone and
+ *  end it with #delayNMilliSecondsStop.
+ *
+ *  \param[in] us: timeout in micro seconds
+ *
+ *  \return ERR_NONE : No error, timer started.
+ *  \return ERR_REQUEST : \a us is 0.
+ *
+ *****************************************************************************
+ */
+extern s8 delayNMicroSecondsStart (u16 us);
+
 #endif /* DELAY_WRAPPER_H */
 
@@ -48,6 +48,7 @@
 #include "utils.h"
 #include <string.h>
 #include "as3911_hw_config.h"
+#include "utils/energy.h"
 
 /*
 ******************************************************************************
@@ -64,24 +65,30 @@ extern volatile umword IRQ_COUNT;
 #define SLEEP_CPU_LOCKED() do { \
 	sleep_set_mode(SLEEP_SMODE_IDLE_gc); \
 	sleep_enable(); \
+	energySetMode(ENERGY_MODE_IDLE); \
 	cpu_irq_enable(); \
 	sleep_enter(); \
+	energySetMode(ENERGY_MODE_ACTIVE); \
 	sleep_disable(); \
 } while (0)
 
 #define PSAVE_MCU_LOCKED() do { \
 	sleep_set_mode(SLEEP_MODE_PWR_SAVE); \
 	sleep_enable(); \
+	energySetMode(ENERGY_MODE_PSAVE); \
 	cpu_irq_enable(); \
 	sleep_enter(); \
+	energySetMode(ENERGY_MODE_ACTIVE); \
 	sleep_disable(); \
 } while (0)
 
 #define PDOWN_MCU_LOCKED() do { \
 	sleep_set_mode(SLEEP_MODE_PWR_DOWN); \
 	sleep_enable(); \
+	energySetMode(ENERGY_MODE_PDOWN); \
 	cpu_irq_enable(); \
 	sleep_enter(); \
+	energySetMode(ENERGY_MODE_ACTIVE); \
 	sleep_disable(); \
 } while (0)
 
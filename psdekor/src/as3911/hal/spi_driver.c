@@ -41,6 +41,7 @@
 #include "ams_types.h"
 #include "errno.h"
 #include "spi_driver.h"
+#include "clock.h"
 #include "logger.h"
 #include "ams_types.h"
 #include "platform.h"
@@ -51,6 +52,18 @@
 ******************************************************************************
 */
 
+#ifdef CONF_SPI_ASYNC
+#ifndef SPI_ASYNC_vect
+/*! \brief Interrupt vector of the SPI module used for #spiTxRxStart */
+# define SPI_ASYNC_vect    SPIC_INT_vect
+#endif
+
+#ifndef SPI_ASYNC_INTLVL
+/*! \brief Level of the SPI interrupt, above the delay timer and the AS3911 */
+# define SPI_ASYNC_INTLVL  SPI_INTLVL_MED_gc
+#endif
+#endif /* CONF_SPI_ASYNC */
+
 /*
 ******************************************************************************
 * LOCAL DATATYPES
@@ -67,6 +80,25 @@ static struct spiConfig current_config = {
 	.spi_dev = NULL
 };
 
+/*! \brief Prescaler settings for the SPI clock dividers 2, 4, ..., 128 */
+static const u8 spiPrescaler[] = {
+	SPI_CLK2X_bm | SPI_PRESCALER_DIV4_gc, SPI_PRESCALER_DIV4_gc,
+	SPI_CLK2X_bm | SPI_PRESCALER_DIV16_gc, SPI_PRESCALER_DIV16_gc,
+	SPI_CLK2X_bm | SPI_PRESCALER_DIV64_gc, SPI_PRESCALER_DIV64_gc,
+	SPI_PRESCALER_DIV128_gc
+};
+
+#ifdef CONF_SPI_ASYNC
+/*! \brief State of the transfer started by spiTxRxStart */
+static struct {
+	const u8 *tx;
+	u8 *rx;
+	u16 remaining;
+	volatile bool_t busy;
+	bool_t enabled;   /**< byte time allows the interrupt */
+} Async;
+#endif
+
 /*
 ******************************************************************************
 * LOCAL VARIABLES
@@ -78,6 +110,33 @@ static struct spiConfig current_config = {
 * LOCAL FUNCTIONS
 ******************************************************************************
 */
+
+/*! \brief Programs the SPI divider for the peripheral clock
+ *
+ * Takes the smallest divider (2 to 128) that doesn't exceed the configured
+ * baud rate. Only shifts, it's called on every clock switch.
+ */
+static void spiSetClock (u32 per_hz)
+{
+	u32 bus_hz = per_hz >> 1;
+	u8 i = 0;
+
+	while ((i < (sizeof(spiPrescaler) - 1)) &&
+	       (bus_hz > current_config.baudrate)) {
+		bus_hz >>= 1;
+		++i;
+	}
+
+	current_config.spi_dev->CTRL = (current_config.spi_dev->CTRL &
+	                                ~(SPI_CLK2X_bm | SPI_PRESCALER_gm)) |
+	                               spiPrescaler[i];
+#ifdef CONF_SPI_ASYNC
+	/* decides whether spiTxRxStart uses the interrupt: 8 bits of the
+	 * divider (2 << i) */
+	Async.enabled = (U16_C(16) << i) >= SPI_ASYNC_MIN_BYTE_CYCLES;
+#endif
+}
+
 /*
 ******************************************************************************
 * GLOBAL FUNCTIONS
@@ -108,6 +167,7 @@ s8 spiInitialize (const spiConfig_t *config)
 	                         config->flags,
 	                         config->baudrate,
 	                         0 /* Not used */);
+	spiSetClock (clkGetCpuHz ());
 	spi_enable (config->spi_dev);
 
 	SPI_LOG ("[spi] Activated SPI channel");
@@ -134,6 +194,7 @@ s8 spiReinitialize (void)
 			                         current_config.flags,
 			                         current_config.baudrate,
 			                         0 /* Not used */);
+			spiSetClock (clkGetCpuHz ());
 		}
 		IRQ_DEC_ENABLE();
 
@@ -158,6 +219,20 @@ s8 spiPause (void)
 	}
 }
 
+s8 spiClockChanged (u32 per_hz)
+{
+	if (unlikely(current_config.spi_dev == NULL))
+		return ERR_REQUEST;
+
+	/* a paused interface is set up by spiReinitialize */
+	IRQ_INC_DISABLE();
+	if (!current_config.needs_reinit)
+		spiSetClock (per_hz);
+	IRQ_DEC_ENABLE();
+
+	return ERR_NONE;
+}
+
 s8 spiDeinitialize (void)
 {
 	if (unlikely (current_config.spi_dev == NULL)) {
@@ -188,6 +263,13 @@ s8 spiTxRx (const u8 *txData, u8 *rxData, u16 length)
 		return ERR_REQUEST;
 	}
 
+#ifdef CONF_SPI_ASYNC
+	if (unlikely (Async.busy)) {
+		SPI_LOG ("[spi] Transfer in progress; Request failed!\r\n");
+		return ERR_BUSY;
+	}
+#endif
+
 	SPI_LOG("[spi] write:");
 	for (i = 0; i < length; ++i) {
 
@@ -221,6 +303,73 @@ s8 spiTxRx (const u8 *txData, u8 *rxData, u16 length)
 	return ERR_NONE;
 }
 
+#ifdef CONF_SPI_ASYNC
+s8 spiTxRxStart (const u8 *txData, u8 *rxData, u16 length)
+{
+	SPI_t *spi = current_config.spi_dev;
+
+	if (Async.busy)
+		return ERR_BUSY;
+
+	if ((length < SPI_ASYNC_MIN_LENGTH) || !Async.enabled ||
+	    !cpu_irq_is_enabled ())
+		return spiTxRx (txData, rxData, length);
+
+	if (unlikely (txData == NULL)) {
+		SPI_LOG ("[spi] Illegal parameter in 'spiTxRxStart'\r\n");
+		return ERR_PARAM;
+	}
+
+	if (unlikely (spi == NULL)) {
+		SPI_LOG ("[spi] SPI has not been initialized; Request failed!\r\n");
+		return ERR_REQUEST;
+	}
+
+	Async.tx = txData + 1;
+	Async.rx = rxData;
+	Async.remaining = length;
+	Async.busy = true;
+
+	/* the first byte is written here, the interrupt writes the others */
+	spi->INTCTRL = SPI_ASYNC_INTLVL;
+	spi_put (spi, txData [0]);
+
+	return ERR_NONE;
+}
+
+void spiTxRxWait (void)
+{
+	if (!Async.busy)
+		return;
+
+	cpu_irq_disable ();
+	while (Async.busy) {
+		SLEEP_CPU_LOCKED ();
+		cpu_irq_disable ();
+	}
+	cpu_irq_enable ();
+}
+
+ISR(SPI_ASYNC_vect)
+{
+	SPI_t *spi = current_config.spi_dev;
+	u8 tmp;
+
+	/* executing the vector has cleared IF */
+	tmp = spi_get (spi);
+	if (Async.rx != NULL)
+		*Async.rx++ = tmp;
+
+	if (--Async.remaining) {
+		spi_put (spi, *Async.tx++);
+		return;
+	}
+
+	spi->INTCTRL = SPI_INTLVL_OFF_gc;
+	Async.busy = false;
+}
+#endif /* CONF_SPI_ASYNC */
+
 void spiActivateSEN (void)
 {
 	bool_t lvl_en;
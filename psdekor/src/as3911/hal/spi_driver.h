@@ -41,7 +41,10 @@
  * API:
  * - Initialize SPI driver: #spiInitialize
  * - Deinitialize SPI driver: #spiDeinitialize
+ * - Follow a switch of the system clock: #spiClockChanged
  * - Transmit data: #spiTxRx
+ * - Transmit data in the background (CONF_SPI_ASYNC): #spiTxRxStart,
+ *   #spiTxRxWait
  */
 
 #ifndef SPI_H
@@ -54,7 +57,8 @@ struct spiConfig {
 	                         * (chip selected -> 1, chip deselected -> 0) */
 	Bool invert_sen;        /**< true if logic is inverted (chip select) */
 	spi_flags_t flags;      /**< SPI mode */
-	unsigned long baudrate; /**< SPI baudrate */
+	unsigned long baudrate; /**< highest SPI baudrate, the driver takes the
+	                         *   fastest divider of the clock below it */
 	Bool needs_reinit;      /**< internal flag, used to support deep sleep
 	                         *   modes. DO NOT MODIFY! */
 };
@@ -67,6 +71,7 @@ typedef struct spiConfig spiConfig_t;
 ******************************************************************************
 */
 #include "ams_types.h"
+#include "conf_board.h"
 
 /*
 ******************************************************************************
@@ -74,6 +79,17 @@ typedef struct spiConfig spiConfig_t;
 ******************************************************************************
 */
 
+#ifndef SPI_ASYNC_MIN_LENGTH
+/*! \brief Shorter transfers of #spiTxRxStart are done by polling */
+# define SPI_ASYNC_MIN_LENGTH 4
+#endif
+
+#ifndef SPI_ASYNC_MIN_BYTE_CYCLES
+/*! \brief CPU cycles a byte has to take on the bus for #spiTxRxStart to
+ *         use the interrupt, a byte of a faster SPI is polled */
+# define SPI_ASYNC_MIN_BYTE_CYCLES 64
+#endif
+
 /*
 ******************************************************************************
 * GLOBAL DATATYPES
@@ -156,6 +172,21 @@ extern s8 spiPause (void);
  */
 extern s8 spiReinitialize (void);
 
+/*!
+ *****************************************************************************
+ * \brief Adapts the SPI divider to a new peripheral clock
+ *
+ * Call it with interrupts disabled after the system clock has been switched
+ * (#clkSetProfile does that), not during a transfer.
+ *
+ * \param[in] per_hz : Peripheral clock after the switch.
+ *
+ * \return ERR_REQUEST if no spi interface has been configured, else
+ *         ERR_NONE.
+ *****************************************************************************
+ */
+extern s8 spiClockChanged (u32 per_hz);
+
 /*!
  *****************************************************************************
  *  \brief  Deinitialize SPI interface
@@ -192,4 +223,45 @@ extern s8 spiDeinitialize (void);
  */
 extern s8 spiTxRx (const u8* txData, u8* rxData, u16 length);
 
+#ifdef CONF_SPI_ASYNC
+/*!
+ *****************************************************************************
+ *  \brief  Start the transfer of a buffer of given length
+ *
+ *  Like #spiTxRx, but the bytes are shifted from the interrupt of the SPI
+ *  module, so the CPU may sleep until the transfer has finished. The buffers
+ *  must stay valid until then and SEN must not be changed. \a txData and
+ *  \a rxData may be the same buffer.
+ *
+ *  Transfers shorter than #SPI_ASYNC_MIN_LENGTH, transfers started with the
+ *  interrupts disabled and all transfers while a byte takes less than
+ *  #SPI_ASYNC_MIN_BYTE_CYCLES (the interrupt would slow the SPI down) are
+ *  done by polling before this function returns.
+ *  The interrupt handler only shifts the bytes and calls nothing, so it saves
+ *  few registers; call #spiTxRxWait for the end.
+ *
+ *  \param[in] txData: Buffer of size \a length to be transmitted.
+ *  \param[out] rxData: Buffer of size \a length for the received data OR
+ *              NULL in order to perform a write-only operation.
+ *  \param[in] length: Number of bytes to be transfered.
+ *
+ *  \return ERR_BUSY : A transfer is still running.
+ *  \return ERR_NONE : No error, transfer started.
+ *
+ *****************************************************************************
+ */
+extern s8 spiTxRxStart (const u8* txData, u8* rxData, u16 length);
+
+/*!
+ *****************************************************************************
+ *  \brief  Sleep until the transfer started by #spiTxRxStart has finished
+ *
+ *  Must not be called from an interrupt of the same or a higher level than
+ *  the SPI interrupt.
+ *
+ *****************************************************************************
+ */
+extern void spiTxRxWait (void);
+#endif /* CONF_SPI_ASYNC */
+
 #endif /* SPI_H */
@@ -41,6 +41,7 @@
 #include "uart.h"
 #include "board_wrapper.h"
 #include "as3911_hw_config.h"
+#include "clock.h"
 #include <asf.h>
 
 /*
@@ -49,6 +50,31 @@
 ******************************************************************************
 */
 
+/*
+******************************************************************************
+* LOCAL VARIABLES
+******************************************************************************
+*/
+#ifdef CONF_CLOCK_PROFILE
+/*! \brief Baud rate set by #uartInitialize, 0 if not initialized */
+static u32 uartBaudrate;
+
+/*! \brief TRUE if a byte has been written since the last #uartFlush */
+static bool_t uartTxPending;
+
+/*! \brief Clock the baud rate registers are set up for */
+static u32 uartHz;
+
+/*!
+ * \brief Baud rate registers of the clock used before the last
+ *        #uartClockChanged, so switching back doesn't calculate them again
+ */
+static struct {
+	u32 hz;
+	u8 baudctrla;
+	u8 baudctrlb;
+} uartOtherClock;
+#endif
 
 /*
 ******************************************************************************
@@ -76,10 +102,20 @@ s8 uartInitialize (u32 baudrate, u32* actbaudrate)
 	 *       easily
 	 */
 
-	if (usart_init_rs232 (AS3911_HAL_DEBUG_UART, &opt))
-		return ERR_NONE;
-	else
+	if (!usart_init_rs232 (AS3911_HAL_DEBUG_UART, &opt))
 		return ERR_PARAM;
+
+#ifdef CONF_CLOCK_PROFILE
+	/* usart_init_rs232 assumes the clock of conf_clock.h */
+	if (baudrate != uartBaudrate)
+		uartOtherClock.hz = 0;
+	uartBaudrate = baudrate;
+	uartHz = sysclk_get_cpu_hz ();
+	uartTxPending = false;
+	return uartClockChanged (clkGetCpuHz ());
+#else
+	return ERR_NONE;
+#endif
 }
 
 s8 uartDeinitialize (void)
@@ -112,6 +148,11 @@ s8 uartTxNBytes (const u8* buffer, u16 length)
 		++buffer;
 
 		usart_putchar (AS3911_HAL_DEBUG_UART, c);
+#ifdef CONF_CLOCK_PROFILE
+		/* TXCIF is set once this byte has been shifted out */
+		usart_clear_tx_complete (AS3911_HAL_DEBUG_UART);
+		uartTxPending = true;
+#endif
 
 		/* Wait until transmit shift register is empty
 		 *  - usart_putchar does that already */
@@ -119,3 +160,39 @@ s8 uartTxNBytes (const u8* buffer, u16 length)
 
 	return ERR_NONE;
 }
+
+#ifdef CONF_CLOCK_PROFILE
+void uartFlush (void)
+{
+	if (uartTxPending) {
+		while (!usart_tx_is_complete (AS3911_HAL_DEBUG_UART))
+			;
+		uartTxPending = false;
+	}
+}
+
+s8 uartClockChanged (u32 cpu_hz)
+{
+	USART_t *usart = AS3911_HAL_DEBUG_UART;
+	u8 baudctrla = usart->BAUDCTRLA;
+	u8 baudctrlb = usart->BAUDCTRLB;
+
+	if (!uartBaudrate || (cpu_hz == uartHz))
+		return ERR_NONE;
+
+	if (cpu_hz == uartOtherClock.hz) {
+		/* BAUDCTRLA updates the baud rate, write it last */
+		usart->BAUDCTRLB = uartOtherClock.baudctrlb;
+		usart->BAUDCTRLA = uartOtherClock.baudctrla;
+	} else if (!usart_set_baudrate (usart, uartBaudrate, cpu_hz)) {
+		return ERR_PARAM;
+	}
+
+	uartOtherClock.hz = uartHz;
+	uartOtherClock.baudctrla = baudctrla;
+	uartOtherClock.baudctrlb = baudctrlb;
+	uartHz = cpu_hz;
+
+	return ERR_NONE;
+}
+#endif
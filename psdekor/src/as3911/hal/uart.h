@@ -53,6 +53,7 @@
 ******************************************************************************
 */
 #include "platform.h"
+#include "conf_board.h"
 
 /*
 ******************************************************************************
@@ -65,8 +66,8 @@
  *
  *  This function initializes the UART interface, i.e. sets the requested
  *  baudrate and enables reception and transmission.
- *  \note System frequency must not be changed since baudrate calculation is
- *  done on base of a fixed frequency.
+ *  \note If the system clock is changed afterwards, #uartClockChanged must
+ *  be called (#clkSetProfile does that).
  *
  *  \param[in] baudrate: Baudrate to set, e.g. 115200
  *  \param[out] actbaudrate: Actual set baudrate which normally differs from
@@ -122,4 +123,30 @@ extern s8 uartTxNBytes (const u8* buffer, u16 length);
  */
 extern s8 uartTxByte (u8 dat);
 
+#ifdef CONF_CLOCK_PROFILE
+/*!
+ *****************************************************************************
+ *  \brief  Wait until the last byte has been shifted out
+ *
+ *  Call this before the system clock is switched, so no character is sent
+ *  with two baud rates.
+ *
+ *****************************************************************************
+ */
+extern void uartFlush (void);
+
+/*!
+ *****************************************************************************
+ *  \brief  Adapt the baud rate divider to a new clock
+ *
+ *  \param[in] cpu_hz: Peripheral clock after the switch.
+ *
+ *  \return ERR_NONE : No error, baud rate kept.
+ *  \return ERR_PARAM : The baud rate can't be reached at \a cpu_hz.
+ *
+ *****************************************************************************
+ */
+extern s8 uartClockChanged (u32 cpu_hz);
+#endif
+
 #endif /* UART_H__ */
@@ -38,8 +38,15 @@
  *        unit1StartScan() stops scanning (defined in Rfid.h).
  */
 #define RFID_UNIT1_MAX_SCAN_ATTEMPTS          20
-/*! \brief baud rate of SPI bus (in Hertz) used in Rfid.h */
-#define RFID_UNIT1_SPI_BAUDRATE          2000000
+#ifndef RFID_UNIT1_SPI_BAUDRATE
+/*!
+ * \brief Highest baud rate of SPI bus (in Hertz) used in Rfid.h
+ *
+ * The SPI runs at most at half the CPU clock, so this is 1 MHz at 2 MHz and
+ * 4 MHz at 32 MHz (the AS3911 accepts up to 6 MHz).
+ */
+# define RFID_UNIT1_SPI_BAUDRATE         4000000
+#endif
 /*! \brief spi device instance to use in Rfid.h */
 #define RFID_UNIT1_SPI_DEVICE              &SPIC
 
@@ -190,6 +190,7 @@ static void play_next_tone (void)
 		TCD1.CCABUF = tone->per;
 		ccreg_buf = (tone->ccreg << fade_divider);
 		TCD1.CTRLA = tone->divider;
+		energySetLoad (ENERGY_LOAD_BUZZER, true);
 		repetitions = tone->repetitions;
 		TCD1.INTFLAGS |= TC1_OVFIF_bm; /* Reset interrupt flag */
 		IRQ_DEC_ENABLE();
@@ -207,6 +208,7 @@ static void play_next_tone (void)
 	if (buz_state != BUZZER_RUNNING) {
 		IRQ_INC_DISABLE();
 		TCD1.CTRLA = TC_CLKSEL_OFF_gc;
+		energySetLoad (ENERGY_LOAD_BUZZER, false);
 		tone = &dummy_tone;
 
 		TCD1.INTFLAGS |= TC1_OVFIF_bm; /* Reset interrupt flag */
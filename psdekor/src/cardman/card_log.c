@@ -0,0 +1,234 @@
+/*
+ * card_log.c
+ *
+ * Append-only record log for the card database, see card_log.h.
+ */
+
+#include "cardman/card_log.h"
+
+#ifdef CONF_CARDMAN_LOG_STORE
+
+#include "crc.h"
+#include "cardman/eeprom_queue.h"
+
+#define SLOTS_PER_PAGE            (EEPROM_PAGE_SIZE / CARD_LOG_RECORD_SIZE)
+#define CRC_PRELOAD               U16_C(0xffff)
+
+/*! \brief Sequence number of the oldest record of the log (snapshot start) */
+static u16 s_head = 0;
+/*! \brief Sequence number of the next record */
+static u16 s_next = 0;
+/*! \brief Bit per slot known to be erased, the writes are queued so the
+ *         EEPROM can't be read to find out */
+static u8 s_blank[CARD_LOG_SLOTS / 8];
+
+static u8 slot_of (u16 seq)
+{
+	return seq % CARD_LOG_SLOTS;
+}
+
+static u16 record_crc (const struct card_log_record *record)
+{
+	return crcCalculateCcitt (CRC_PRELOAD, (const u8 *)record,
+	                          offsetof(struct card_log_record, crc));
+}
+
+static bool_t slot_is_blank (u8 slot)
+{
+	return (s_blank[slot >> 3] & (1 << (slot & 0x7))) != 0;
+}
+
+static void set_slot_blank (u8 slot, bool_t blank)
+{
+	if (blank)
+		s_blank[slot >> 3] |= (1 << (slot & 0x7));
+	else
+		s_blank[slot >> 3] &= ~(1 << (slot & 0x7));
+}
+
+static bool_t data_is_blank (const void *data)
+{
+	const u8 *ptr = data;
+	u8 i;
+
+	for (i = 0; i < CARD_LOG_RECORD_SIZE; ++i) {
+		if (ptr[i] != 0xff)
+			return false;
+	}
+
+	return true;
+}
+
+static bool_t record_is_valid (const struct card_log_record *record)
+{
+	return (CARD_LOG_TYPE(record) >= CARD_LOG_COMMIT) &&
+	       (CARD_LOG_TYPE(record) <= CARD_LOG_MIGRATE) &&
+	       (CARD_LOG_LEN(record) <= MAX_KEY_UID_LENGTH) &&
+	       (record->crc == record_crc (record));
+}
+
+/*!
+ * \brief Reads the record with sequence number seq
+ * \return TRUE if the slot holds a valid record with this sequence number.
+ */
+static bool_t read_record (u16 seq, struct card_log_record *record)
+{
+	nvm_eeprom_read_buffer ((u16)slot_of (seq) * CARD_LOG_RECORD_SIZE,
+	                        record, sizeof(*record));
+
+	return (record->seq == seq) && record_is_valid (record);
+}
+
+/*!
+ * \brief Queues the write of a record to its slot
+ * Blank slots (erased by #cardLogCommit) are written without erase.
+ */
+static void write_record (const struct card_log_record *record)
+{
+	u8 slot = slot_of (record->seq);
+
+	eepromQueueWriteBytes (slot / SLOTS_PER_PAGE,
+	                       (slot % SLOTS_PER_PAGE) * CARD_LOG_RECORD_SIZE,
+	                       record, CARD_LOG_RECORD_SIZE, slot_is_blank (slot));
+	set_slot_blank (slot, false);
+}
+
+/*! \brief Queues erasing the slots of count records starting with seq */
+static void erase_records (u16 seq, u16 count)
+{
+	u8 slot;
+	u8 page = 0;
+	u8 offset = 0;
+	u8 len = 0;
+
+	for (; count; --count, ++seq) {
+		slot = slot_of (seq);
+		if (slot_is_blank (slot))
+			continue;
+		set_slot_blank (slot, true);
+
+		/* adjacent slots of a page are erased together */
+		if (len && ((page != slot / SLOTS_PER_PAGE) ||
+		            (offset + len != (slot % SLOTS_PER_PAGE) * CARD_LOG_RECORD_SIZE))) {
+			eepromQueueEraseBytes (page, offset, len);
+			len = 0;
+		}
+		if (!len) {
+			page = slot / SLOTS_PER_PAGE;
+			offset = (slot % SLOTS_PER_PAGE) * CARD_LOG_RECORD_SIZE;
+		}
+		len += CARD_LOG_RECORD_SIZE;
+	}
+
+	if (len)
+		eepromQueueEraseBytes (page, offset, len);
+}
+
+s8 cardLogLoad (card_log_apply_t apply)
+{
+	struct card_log_record record;
+	bool_t found = false;
+	bool_t commit = false;
+	u16 tail = 0;
+	u16 head = 0;
+	u16 seq;
+	u16 n;
+
+	eepromQueueFlush ();
+
+	/* The newest valid record is the tail of the log */
+	for (n = 0; n < CARD_LOG_SLOTS; ++n) {
+		nvm_eeprom_read_buffer (n * CARD_LOG_RECORD_SIZE, &record,
+		                        sizeof(record));
+		set_slot_blank (n, data_is_blank (&record));
+		if ((slot_of (record.seq) != n) || !record_is_valid (&record))
+			continue;
+		if (!found || ((s16)(record.seq - tail) > 0)) {
+			tail = record.seq;
+			found = true;
+		}
+	}
+
+	if (!found)
+		return ERR_NOTFOUND;
+
+	/* Walk back to the start of the newest snapshot, all records from
+	 * there to the tail must be intact
+	 */
+	for (seq = tail, n = 0; n < CARD_LOG_SLOTS; --seq, ++n) {
+		if (!read_record (seq, &record))
+			return ERR_BAD_DATA;
+
+		if (!commit && (CARD_LOG_TYPE(&record) == CARD_LOG_COMMIT)) {
+			commit = true;
+			head = seq - record.extra;
+		}
+		if (commit && (seq == head))
+			break;
+	}
+
+	if (n == CARD_LOG_SLOTS)
+		return ERR_BAD_DATA;
+
+	for (seq = head; seq != (u16)(tail + 1); ++seq) {
+		read_record (seq, &record);
+		if (CARD_LOG_TYPE(&record) != CARD_LOG_COMMIT)
+			apply (&record);
+	}
+
+	s_head = head;
+	s_next = tail + 1;
+
+	return ERR_NONE;
+}
+
+void cardLogFormat (u16 seq)
+{
+	s_head = seq;
+	s_next = seq;
+}
+
+u8 cardLogFree (void)
+{
+	return CARD_LOG_SLOTS - (u16)(s_next - s_head);
+}
+
+s8 cardLogAppend (u8 type, const struct card_entry *card, u8 extra)
+{
+	struct card_log_record record;
+	u8 len = card ? card->len : 0;
+
+	if (unlikely(!cardLogFree ()))
+		return ERR_NO_MEMORY;
+
+	memset (&record, 0xff, sizeof(record));
+	record.seq = s_next;
+	record.type_len = (type << 4) | len;
+	record.extra = extra;
+	if (len)
+		memcpy (record.uid, card->uid, len);
+	record.crc = record_crc (&record);
+
+	write_record (&record);
+	++s_next;
+
+	return ERR_NONE;
+}
+
+s8 cardLogCommit (u8 count)
+{
+	u16 head = s_next - count;
+	u16 old_head = s_head;
+	s8 err;
+
+	err = cardLogAppend (CARD_LOG_COMMIT, NULL, count);
+	if (err)
+		return err;
+
+	s_head = head;
+	erase_records (old_head, (u16)(head - old_head));
+
+	return ERR_NONE;
+}
+
+#endif /* CONF_CARDMAN_LOG_STORE */
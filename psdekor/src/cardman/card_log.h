@@ -0,0 +1,104 @@
+/*
+ * card_log.h
+ *
+ * Append-only record log for the card database. Every change of the
+ * database is appended as a 16 byte record with a sequence number and a
+ * CRC; record n lives in EEPROM slot n % CARD_LOG_SLOTS, so the writes
+ * rotate over the whole EEPROM. A snapshot of the database (closed by a
+ * CARD_LOG_COMMIT record) is written when the log runs full, after which
+ * the records before the snapshot are erased.
+ *
+ * The log is only compiled in if CONF_CARDMAN_LOG_STORE is defined in
+ * conf_board.h. Records are written and erased through cardman/eeprom_queue.h,
+ * with CONF_EEPROM_WRITE_QUEUE from the NVM interrupt.
+ */
+
+
+#ifndef CARD_LOG_H_
+#define CARD_LOG_H_
+
+#include "conf_board.h"
+#include "cardman/cards_manager.h"
+
+#ifdef CONF_CARDMAN_LOG_STORE
+
+/*! \brief Size of one record */
+#define CARD_LOG_RECORD_SIZE      16
+
+/*! \brief Number of records in the EEPROM */
+#define CARD_LOG_SLOTS            (EEPROM_SIZE / CARD_LOG_RECORD_SIZE)
+
+/*! \brief Record types */
+enum card_log_type {
+	CARD_LOG_COMMIT = 1,    /*!< ends a snapshot of extra records */
+	CARD_LOG_SW_FUNCTION,   /*!< extra: current software function */
+	CARD_LOG_OPEN_DELAY,    /*!< extra: open delay */
+	CARD_LOG_PROG,          /*!< card: programming card */
+	CARD_LOG_SOFT,          /*!< card: software card, extra: sw function */
+	CARD_LOG_KEY_ADD,       /*!< card: key */
+	CARD_LOG_KEY_DELETE,    /*!< card: key */
+	CARD_LOG_KEYS_CLEAR,    /*!< deletes all keys */
+	CARD_LOG_MIGRATE        /*!< uid[0]: key generation of a version 1
+	                         *   database, extra: its keys left to move */
+};
+
+/*! \brief One record of the log */
+struct card_log_record {
+	u16 seq;
+	u8 type_len;            /*!< type << 4 | length of the UID */
+	u8 extra;
+	u8 uid[MAX_KEY_UID_LENGTH];
+	u16 crc;                /*!< CCITT over the bytes before */
+};
+
+/*! \brief Type of a record */
+#define CARD_LOG_TYPE(record)    ((record)->type_len >> 4)
+
+/*! \brief Length of the UID of a record */
+#define CARD_LOG_LEN(record)     ((record)->type_len & 0x0f)
+
+/*! \brief Applies one replayed record to the database in RAM */
+typedef void (*card_log_apply_t) (const struct card_log_record *record);
+
+/*!
+ * \brief Replays the log from the last complete snapshot
+ * \param apply Called for every record except CARD_LOG_COMMIT, the
+ *              database in RAM has to be empty before.
+ * \return ERR_NOTFOUND if the EEPROM holds no log.
+ *         ERR_BAD_DATA if no complete snapshot could be found.
+ *         ERR_NONE if the log has been replayed.
+ */
+extern s8 cardLogLoad (card_log_apply_t apply);
+
+/*!
+ * \brief Starts a new, empty log
+ * \param seq Sequence number of the first record.
+ *
+ * Nothing is written; the log exists once the first snapshot has been
+ * committed. Call after #cardLogLoad, which finds the erased slots.
+ */
+extern void cardLogFormat (u16 seq);
+
+/*! \brief Number of records that can be appended before the log is full */
+extern u8 cardLogFree (void);
+
+/*!
+ * \brief Appends a record
+ * \param type enum card_log_type
+ * \param card Card of the record, NULL for none.
+ * \param extra Extra byte of the record.
+ * \return ERR_NO_MEMORY if the log is full.
+ *         ERR_NONE if the record has been written.
+ */
+extern s8 cardLogAppend (u8 type, const struct card_entry *card, u8 extra);
+
+/*!
+ * \brief Commits a snapshot and erases the records before it
+ * \param count Number of records of the snapshot, appended just before.
+ * \return see #cardLogAppend
+ */
+extern s8 cardLogCommit (u8 count);
+
+#endif /* CONF_CARDMAN_LOG_STORE */
+
+#endif /* CARD_LOG_H_ */
@@ -23,6 +23,22 @@ bool_t cardIsEqual (const u8 *uid, const u8 len, const struct card *cmp_card)
 	return true;
 }
 
+s8 cardCompare (const u8 *uid, const u8 len, const struct card_entry *cmp)
+{
+	u8 i;
+
+	if (len != cmp->len)
+		return (len < cmp->len) ? -1 : 1;
+
+	for (i = 0; i < len; ++i) {
+		if (uid[i] != cmp->uid[i]) {
+			return (uid[i] < cmp->uid[i]) ? -1 : 1;
+		}
+	}
+
+	return 0;
+}
+
 s8 cardCopy (const u8 *uid, const u8 len, struct card_entry *dest)
 {
 	u8 i;
@@ -22,6 +22,18 @@ extern bool_t cardIsEqual (const u8 *uid,
                            const u8 len,
                            const struct card *cmp_card);
 
+/*!
+ * \brief Orders cards by UID length, then by UID (bytewise)
+ * \param uid UID of the first card
+ * \param len Length of uid
+ * \param cmp card to compare to
+ * \return 0 if both are equal, < 0 if the first card sorts before cmp,
+ *         > 0 if it sorts after cmp.
+ */
+extern s8 cardCompare (const u8 *uid,
+                       const u8 len,
+                       const struct card_entry *cmp);
+
 /*!
  * \brief Copies a UID to a destination structure
  * \param uid UID to copy (source)
@@ -7,6 +7,9 @@
 #include "cardman/cards_manager.h"
 #include "cardman/compiler_checks.h"
 #include "cardman/card_utils.h"
+#include "cardman/card_log.h"
+#include "cardman/eeprom_queue.h"
+#include "cardman/flash_keys.h"
 #include "application/software_functions.h"
 
 /************************************************************************/
@@ -22,47 +25,71 @@
 #endif
 
 
-static struct card sw_std_group =  {
-	.card.uid = { 0x5e, 0xa6, 0x3d, 0xeb },
-	.card.len = 4,
-	.extra[0] = SW_FUNCTION_SLAVE
+/*!
+ * \brief Hard-coded software cards
+ * Sorted by length and UID (see #cardCompare) for the binary search in
+ * #cardmanGetCardType, kept in flash.
+ */
+static const struct sw_card {
+	struct card card;
+	u8 type;
+} sw_cards[] PROGMEM = {
+	{ /* gym 12 */
+		.card.card.uid = { 0x1e, 0x12, 0x2a, 0xcc },
+		.card.card.len = 4,
+		.card.extra[0] = 0x00,
+		.type = CARD_TYPE_GYM_SOFTWARD_CARD_12
+	},
+	{ /* std group */
+		.card.card.uid = { 0x5e, 0xa6, 0x3d, 0xeb },
+		.card.card.len = 4,
+		.card.extra[0] = SW_FUNCTION_SLAVE,
+		.type = CARD_TYPE_SOFTWARE_CARD
+	},
+	{ /* gym 6 */
+		.card.card.uid = { 0x6e, 0x4f, 0x26, 0xab },
+		.card.card.len = 4,
+		.card.extra[0] = 0x00,
+		.type = CARD_TYPE_GYM_SOFTWARD_CARD_6
+	},
+	{ /* gym 24 */
+		.card.card.uid = { 0x6e, 0x8c, 0x26, 0xce },
+		.card.card.len = 4,
+		.card.extra[0] = 0x00,
+		.type = CARD_TYPE_GYM_SOFTWARD_CARD_24
+	},
+	{ /* alarm */
+		.card.card.uid = { 0xae, 0xec, 0x3d, 0xeb },
+		.card.card.len = 4,
+		.card.extra[0] = SW_FUNCTION_ALARM,
+		.type = CARD_TYPE_SOFTWARE_CARD
+	},
+	{ /* bolt */
+		.card.card.uid = { 0xda, 0xcf, 0x32, 0xe9 },
+		.card.card.len = 4,
+		.card.extra[0] = SW_FUNCTION_LATCH,
+		.type = CARD_TYPE_SOFTWARE_CARD
+	},
+	{ /* gym */
+		.card.card.uid = { 0xf7, 0xa8, 0x33, 0x3b },
+		.card.card.len = 4,
+		.card.extra[0] = 0x00,
+		.type = CARD_TYPE_GYM_SOFTWARD_CARD
+	},
 };
 
-static struct card sw_bolt =  {
-	.card.uid = { 0xda, 0xcf, 0x32, 0xe9 },
-	.card.len = 4,
-	.extra[0] = SW_FUNCTION_LATCH
-};
+#define NUMBER_OF_SW_CARDS  (sizeof(sw_cards) / sizeof(sw_cards[0]))
 
-static struct card sw_alarm =  {
-	.card.uid = { 0xae, 0xec, 0x3d, 0xeb },
-	.card.len = 4,
-	.extra[0] = SW_FUNCTION_ALARM
-};
+/*! \brief RAM copy of the software card last returned by #cardmanGetCardType */
+static struct card sw_card_result;
 
-static struct card gym_software_card = {
-	.card.uid = { 0xF7, 0xA8, 0x33, 0x3B },
-	.card.len = 4,
-	.extra[0] = 0x00
-};
-
-static struct card gym_software_card_6 = {
-	.card.uid = { 0x6e, 0x4f, 0x26, 0xab },
-	.card.len = 4,
-	.extra[0] = 0x00
-};
-static struct card gym_software_card_12 = {
-	.card.uid = { 0x1e, 0x12, 0x2a, 0xcc },
-	.card.len = 4,
-	.extra[0] = 0x00
-};
-static struct card gym_software_card_24 = {
-	.card.uid = { 0x6e, 0x8c, 0x26, 0xce },
-	.card.len = 4,
-	.extra[0] = 0x00
-};
+#ifdef CONF_CARDMAN_FLASH_KEYS
+/*! \brief RAM copy of the flash key last returned by #cardmanGetCardType */
+static struct card flash_key_result;
+#endif
 
 #define DATABASE_CURRENT_VERSION  1
+#define DATABASE_LOG_VERSION      2
 #define DATABASE_UNINITIALIZED    U16_C(0xffff)
 #define DATABASE_PROG_START_PAGE  2
 #define DATABASE_SOFT_START_PAGE  3
@@ -73,6 +100,36 @@ static struct card gym_software_card_24 = {
 
 #define ENTRY_USED                1
 
+#if defined(CONF_CARDMAN_LAZY_ERASE) && !defined(CONF_CARDMAN_LOG_STORE)
+# define CARDMAN_LAZY_ERASE
+#endif
+
+#define KEY_PAGES_USED_SIZE       ((MAX_NUMBER_OF_KEY_CARDS + 7) >> 3)
+
+#ifdef CONF_CARDMAN_FLASH_KEYS
+/* Set in card.len of a key page and in extra[0] of the key table: the page
+ * deletes the key from the flash instead of adding it
+ */
+# define KEY_PAGE_TOMBSTONE       0x80
+# if (DATABASE_KEY_START_PAGE + MAX_NUMBER_OF_KEY_CARDS) > KEY_PAGE_TOMBSTONE
+#  error "Key page numbers must leave bit 7 for KEY_PAGE_TOMBSTONE!"
+# endif
+#endif
+
+/* A new log starts in the pages not used by a version 1 database */
+#define LOG_FIRST_SEQ             (((DATABASE_KEY_START_PAGE + MAX_NUMBER_OF_KEY_CARDS) * \
+                                    EEPROM_PAGE_SIZE) / CARD_LOG_RECORD_SIZE)
+
+#ifdef CONF_CARDMAN_LOG_STORE
+/* The settings of a migrated version 1 database (software function, open
+ * delay, programming card, soft cards, marker and commit) must be committed
+ * before the log wraps onto the version 1 pages
+ */
+# if (5 + MAX_NUMBER_OF_SOFT_CARDS) > (CARD_LOG_SLOTS - LOG_FIRST_SEQ)
+#  error "The settings of a version 1 database don't fit behind its pages!"
+# endif
+#endif
+
 #define HEADER_1_PAGE             0
 #define HEADER_2_PAGE             1
 
@@ -117,6 +174,13 @@ static struct cardman_ctrl_s {
 	struct header_entry header;
 	u8 next_header_index;
 	u8 comb_header_state;
+	u8 key_pages_used[KEY_PAGES_USED_SIZE]; /*!< bit per key page */
+#ifdef CARDMAN_LAZY_ERASE
+	u8 key_pages_stale[KEY_PAGES_USED_SIZE]; /*!< pages left to erase */
+#endif
+#ifdef CONF_CARDMAN_FLASH_KEYS
+	u8 ntomb; /*!< tombstones in key_card */
+#endif
 	union {
 		struct card mapped_card[1 + MAX_NUMBER_OF_SOFT_CARDS +
 		                        MAX_NUMBER_OF_KEY_CARDS];
@@ -164,11 +228,13 @@ static enum header_state_e decode_header_state (u8 state_value);
  */
 static s8 load_db_version1 (void);
 
+#ifndef CONF_CARDMAN_LOG_STORE
 /*!
  * \brief Initializes a new database (version 1)
  * \return Error if eeprom_write_buffer_to_page fails, else ERR_NONE.
  */
 static s8 init_db_version1 (void);
+#endif
 
 /*!
  * \brief Copies uid and len to entry address
@@ -180,6 +246,120 @@ static void copy_to_entry (struct card_entry *entry,
                            const u8 *uid,
                            const u8 len);
 
+/*!
+ * \brief Binary search in the sorted key table
+ * \param uid UID to search for.
+ * \param len Length of uid.
+ * \param index Index of the key if found, else index the key has to be
+ *              inserted at to keep the table sorted.
+ * \return TRUE if the key has been found, else FALSE.
+ */
+static bool_t find_key (const u8 *uid, const u8 len, u8 *index);
+
+/*!
+ * \brief Inserts a key into the sorted key table (nkeys is incremented)
+ * \param index Insert position returned by #find_key
+ * \param entry Card to insert.
+ * \param page EEPROM page of the key.
+ */
+static void insert_key (u8 index, const struct card_entry *entry, u8 page);
+
+#ifndef CONF_CARDMAN_LOG_STORE
+/*!
+ * \brief Writes a key to an unused key page and inserts it into the key table
+ * \param card Key to add.
+ * \param flags KEY_PAGE_TOMBSTONE or 0.
+ * \return ERR_BAD_DATA if no unused page could be found, else ERR_NONE.
+ */
+static s8 add_key_page (const struct card_entry *card, u8 flags);
+
+/*!
+ * \brief Erases the page of a key and removes it from the key table
+ * \param index Index of the key.
+ */
+static void delete_key_page (u8 index);
+
+/*!
+ * \brief Finds an unused key page in the key_pages_used bitmap
+ * \param page EEPROM page of the unused slot.
+ * \return TRUE if an unused page has been found, else FALSE.
+ */
+static bool_t find_free_key_page (u8 *page);
+#endif
+
+/*!
+ * \brief Removes a key from the sorted key table (nkeys is decremented)
+ * \param index Index of the key.
+ */
+static void remove_key (u8 index);
+
+/*!
+ * \brief Updates the bit of a key page in a bitmap
+ * \param bitmap key_pages_used or key_pages_stale.
+ * \param page EEPROM page of the key.
+ * \param set New value of the bit.
+ */
+static void set_key_page_bit (u8 *bitmap, u8 page, bool_t set);
+
+#ifndef CONF_CARDMAN_LOG_STORE
+/*!
+ * \brief Reads the bit of a key page in a bitmap
+ * \param bitmap key_pages_used or key_pages_stale.
+ * \param page EEPROM page of the key.
+ */
+static bool_t key_page_bit (const u8 *bitmap, u8 page);
+#endif
+
+/*!
+ * \brief Used value of valid key pages
+ * Databases written before the key generation read as ENTRY_USED.
+ */
+static u8 key_generation (void);
+
+#ifdef CARDMAN_LAZY_ERASE
+/*!
+ * \brief Erases all pages of the key_pages_stale bitmap
+ * Waits until the last erase has finished.
+ */
+static void erase_stale_pages (void);
+#endif
+
+#ifdef CONF_CARDMAN_FLASH_KEYS
+/*!
+ * \brief Number of keys in the flash bank of the header
+ */
+static u16 flash_key_count (void);
+
+/*!
+ * \brief Binary search in the flash bank of the header
+ * \param uid UID to search for.
+ * \param len Length of uid.
+ * \return TRUE if the key is in the flash, else FALSE.
+ */
+static bool_t flash_has_key (const u8 *uid, const u8 len);
+
+/*!
+ * \brief Merges the key table into the flash bank not in use
+ * \return ERR_NO_MEMORY if the keys don't fit into a bank, else ERR_NONE.
+ *
+ * The key pages merged are erased after the header has been switched to the
+ * new bank. Keys too long for the flash stay in their pages.
+ */
+static s8 merge_flash_keys (void);
+#endif
+
+/*!
+ * \brief Binary search in the hard-coded software cards
+ * \param uid UID to search for.
+ * \param len Length of uid.
+ * \param result Card found, copied to RAM.
+ * \return Type of the software card, CARD_TYPE_UNKNOWN if not found.
+ */
+static enum card_type find_sw_card (const u8 *uid,
+                                    const u8 len,
+                                    struct card *result);
+
+#ifndef CONF_CARDMAN_LOG_STORE
 /*!
  * \brief Prepares the next write of the header
  * Determines the next header-state and which header will be replaced.
@@ -190,7 +370,9 @@ static void prepare_next_write (void);
  * \brief Writes header to eeprom.
  */
 static void write_header (void);
+#endif
 
+#ifndef CONF_CARDMAN_LOG_STORE
 /*!
  * \brief Writes a page to the eeprom
  * \param page_addr Address of the eeprom-page
@@ -201,31 +383,103 @@ static void write_header (void);
  *         ERR_NONE if call was successful.
  */
 static s8 eeprom_write_buffer_to_page (u8 page_addr, void *buffer, u8 len);
+#endif
+
+#ifdef CONF_CARDMAN_LOG_STORE
+/*!
+ * \brief Clears the database in RAM (keys, soft cards, programming card)
+ */
+static void reset_db (void);
+
+/*!
+ * \brief Loads the database from the record log
+ * \return Error codes of cardLogLoad.
+ */
+static s8 load_db_log (void);
+
+/*!
+ * \brief Starts a new record log with the database in RAM
+ * \return Error codes of cardLogAppend.
+ */
+static s8 init_db_log (void);
+
+/*!
+ * \brief Moves a version 1 database into a new log
+ * \return Error codes of cardLogCommit.
+ *
+ * The settings are committed first, behind the version 1 pages. The keys
+ * follow in the order of their pages; the log wraps onto the pages of the
+ * keys already moved only, so a power loss leaves either the version 1
+ * database or a log to resume from (see migrate_keys).
+ */
+static s8 migrate_db_version1 (void);
+
+/*!
+ * \brief Moves the keys left in the version 1 pages into the log
+ * \return Error codes of cardLogCommit.
+ *
+ * Ends the migration with a snapshot of the database in RAM.
+ */
+static s8 migrate_keys (void);
+
+/*!
+ * \brief Reads a key page of a version 1 database
+ * \param page Key page.
+ * \param gen Key generation of the database.
+ * \param card Receives the key.
+ * \return TRUE if the page holds a key.
+ */
+static bool_t read_key_version1 (u8 page, u8 gen, struct card_entry *card);
+
+/*!
+ * \brief Applies a replayed record to the database in RAM
+ * \param record Record of the log.
+ */
+static void log_apply (const struct card_log_record *record);
+
+/*!
+ * \brief Number of records of a snapshot of the database in RAM
+ */
+static u8 log_snapshot_size (void);
+
+/*!
+ * \brief Appends the settings of the database in RAM to the log
+ * \return Number of records appended.
+ */
+static u8 log_snapshot_settings (void);
+
+/*!
+ * \brief Writes a snapshot of the database in RAM to the log
+ * \return Error codes of cardLogAppend.
+ */
+static s8 log_snapshot (void);
+
+/*!
+ * \brief Appends a change to the log, compacts the log first if needed
+ * \param type enum card_log_type
+ * \param card Card of the record, NULL for none.
+ * \param extra Extra byte of the record.
+ */
+static void log_write (u8 type, const struct card_entry *card, u8 extra);
+#endif
 
 /************************************************************************/
 /* LOCAL FUNCTIONS DEFINITIONS                                          */
 /************************************************************************/
 
+#ifndef CONF_CARDMAN_LOG_STORE
 static s8 eeprom_write_buffer_to_page (u8 page_addr, void *buffer, u8 len)
 {
-	u8 i = 0;
-	u8 *ptr = buffer;
-
 	if (unlikely((len > EEPROM_PAGE_SIZE) ||
 	    (page_addr > (EEPROM_SIZE/EEPROM_PAGE_SIZE)))) {
 		return ERR_PARAM;
 	}
 
-	nvm_wait_until_ready ();
-	nvm_eeprom_flush_buffer ();
-
-	for (i = 0; i < len; ++i, ++ptr) {
-		nvm_eeprom_load_byte_to_buffer (i, *ptr);
-	}
-	nvm_eeprom_atomic_write_page (page_addr);
+	eepromQueueWrite (page_addr, buffer, len);
 
 	return ERR_NONE;
 }
+#endif
 
 static enum header_state_e decode_header_state (u8 state_value)
 {
@@ -242,6 +496,7 @@ static enum header_state_e decode_header_state (u8 state_value)
 	}
 }
 
+#ifndef CONF_CARDMAN_LOG_STORE
 static void prepare_next_write (void)
 {
 	enum header_state_e decoded_state;
@@ -320,13 +575,14 @@ static void prepare_next_write (void)
 		);
 	}
 }
+#endif
 
 static s8 read_header (void)
 {
 	struct header_entry entry[2];
 
-	nvm_eeprom_read_buffer (HEADER_ADDR_1, &entry[0], HEADER_ENTRY_SIZE);
-	nvm_eeprom_read_buffer (HEADER_ADDR_2, &entry[1], HEADER_ENTRY_SIZE);
+	nvm_eeprom_read_buffer (HEADER_ADDR_1, &entry[0], sizeof(entry[0]));
+	nvm_eeprom_read_buffer (HEADER_ADDR_2, &entry[1], sizeof(entry[1]));
 
 	cardman_ctrl.comb_header_state = (
 		(decode_header_state (entry[0].state) << 4) |
@@ -375,7 +631,6 @@ static s8 load_db_version1 (void)
 	u8 i;
 	union union_card_page tmp;
 	u8 nsoft = 0;
-	u8 nkeys = 0;
 
 	if (cardman_ctrl.header.nkeys > MAX_NUMBER_OF_KEY_CARDS)
 		return ERR_BAD_DATA;
@@ -407,43 +662,90 @@ static s8 load_db_version1 (void)
 		}
 	}
 
+	/* Keys are kept sorted for cardmanGetCardType */
+	cardman_ctrl.header.nkeys = 0;
+#ifdef CONF_CARDMAN_FLASH_KEYS
+	cardman_ctrl.ntomb = 0;
+#endif
+	memset (cardman_ctrl.key_pages_used, 0,
+	        sizeof(cardman_ctrl.key_pages_used));
+#ifdef CARDMAN_LAZY_ERASE
+	memset (cardman_ctrl.key_pages_stale, 0,
+	        sizeof(cardman_ctrl.key_pages_stale));
+#endif
 	for (i = 0; i < MAX_NUMBER_OF_KEY_CARDS; ++i) {
 		u8 page = DATABASE_KEY_START_PAGE + i;
 		u16 addr = (EEPROM_PAGE_SIZE * (u16)page);
+		u8 index;
+		u8 flags = 0;
 
 		nvm_eeprom_read_buffer (addr, &tmp.key, sizeof(tmp.key));
-		if (tmp.key.used == ENTRY_USED) {
-			cardman_ctrl.key_card[nkeys].card = tmp.key.card;
-			cardman_ctrl.key_card[nkeys].extra[0] = page;
-			++nkeys;
+#ifdef CONF_CARDMAN_FLASH_KEYS
+		flags = tmp.key.card.len & KEY_PAGE_TOMBSTONE;
+		tmp.key.card.len &= ~KEY_PAGE_TOMBSTONE;
+#endif
+		if ((tmp.key.used == key_generation ()) &&
+		    (tmp.key.card.len <= MAX_KEY_UID_LENGTH)) {
+#ifdef CONF_CARDMAN_FLASH_KEYS
+			bool_t in_flash = flash_has_key (tmp.key.card.uid,
+			                                 tmp.key.card.len);
+
+			/* An add of a key in the flash or a tombstone of a key not
+			 * in the flash is left by a merge interrupted before
+			 * erasing its pages
+			 */
+			if (flags ? !in_flash : in_flash) {
+				CARDMAN_DLOG("[cardman] Erase merged page %hhd\r\n", page);
+				eepromQueueErase (page);
+				eepromQueueFlush ();
+				continue;
+			}
+			if (flags)
+				++cardman_ctrl.ntomb;
+#endif
+			find_key (tmp.key.card.uid, tmp.key.card.len, &index);
+			insert_key (index, &tmp.key.card, page | flags);
+			set_key_page_bit (cardman_ctrl.key_pages_used, page, true);
+		}
+#ifdef CARDMAN_LAZY_ERASE
+		else if (tmp.key.used != 0xff) {
+			/* Older generation, left by cardmanDeleteAllKeys */
+			set_key_page_bit (cardman_ctrl.key_pages_stale, page, true);
 		}
+#endif
 	}
 
 	/* NOTE: Currently there are no consistency checks with header
 	 *       information. (What should be done if there is
 	 *       a missmatch??
 	 */
-	cardman_ctrl.header.nkeys = nkeys;
 	cardman_ctrl.header.nsoft_cards = nsoft;
 
 	return ERR_NONE;
 }
 
+#ifndef CONF_CARDMAN_LOG_STORE
 static s8 init_db_version1 (void)
 {
 	cardman_ctrl.header.nkeys = 0;
+	memset (cardman_ctrl.key_pages_used, 0,
+	        sizeof(cardman_ctrl.key_pages_used));
 	cardman_ctrl.header.nsoft_cards = 0;
 	cardman_ctrl.header.db_version = DATABASE_CURRENT_VERSION;
 	cardman_ctrl.header.state = HEADER_STATE_VALUE_X;
 	cardman_ctrl.header.current_sw = DEFAULT_SOFTWARE_FUNCTION;
+	cardman_ctrl.header.key_gen = ENTRY_USED;
+	cardman_ctrl.header.flash_bank = FLASH_KEYS_NO_BANK;
+	cardman_ctrl.header.flash_nkeys = 0;
 	cardman_ctrl.next_header_index = HEADER_1;
 	cardman_ctrl.comb_header_state = HEADER_STATE2_XF;
-	nvm_eeprom_erase_bytes_in_page (HEADER_2_PAGE);
+	eepromQueueErase (HEADER_2_PAGE);
 
 	return eeprom_write_buffer_to_page (HEADER_1_PAGE,
 	                                    &cardman_ctrl.header,
 	                                    sizeof(cardman_ctrl.header));
 }
+#endif
 
 static void copy_to_entry (struct card_entry *entry,
                            const u8 *uid,
@@ -457,6 +759,304 @@ static void copy_to_entry (struct card_entry *entry,
 	}
 }
 
+static bool_t find_key (const u8 *uid, const u8 len, u8 *index)
+{
+	u8 lo = 0;
+	u8 hi = cardman_ctrl.header.nkeys;
+	u8 mid;
+	s8 cmp;
+
+	while (lo < hi) {
+		mid = (lo + hi) >> 1;
+		cmp = cardCompare (uid, len, &cardman_ctrl.key_card[mid].card);
+		if (cmp == 0) {
+			*index = mid;
+			return true;
+		}
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	*index = lo;
+	return false;
+}
+
+#ifndef CONF_CARDMAN_LOG_STORE
+static bool_t find_free_key_page (u8 *page)
+{
+	u8 i;
+	u8 bit;
+	u8 used;
+
+	for (i = 0; i < KEY_PAGES_USED_SIZE; ++i) {
+		used = cardman_ctrl.key_pages_used[i];
+		if (used == 0xff)
+			continue;
+
+		for (bit = 0; used & (1 << bit); ++bit)
+			;
+		if (((i << 3) + bit) >= MAX_NUMBER_OF_KEY_CARDS)
+			break;
+
+		*page = DATABASE_KEY_START_PAGE + (i << 3) + bit;
+		return true;
+	}
+
+	return false;
+}
+
+static s8 add_key_page (const struct card_entry *card, u8 flags)
+{
+	struct key_page key;
+	u8 page_addr;
+	u8 index;
+
+	if (unlikely(!find_free_key_page (&page_addr)))
+		return ERR_BAD_DATA;
+
+	key.card = *card;
+	key.card.len |= flags;
+	key.used = key_generation ();
+	eeprom_write_buffer_to_page (page_addr, &key, sizeof(key));
+	find_key (card->uid, card->len, &index);
+	insert_key (index, card, page_addr | flags);
+	set_key_page_bit (cardman_ctrl.key_pages_used, page_addr, true);
+#ifdef CARDMAN_LAZY_ERASE
+	/* The write has replaced a stale key */
+	set_key_page_bit (cardman_ctrl.key_pages_stale, page_addr, false);
+#endif
+	write_header ();
+
+	return ERR_NONE;
+}
+
+static void delete_key_page (u8 index)
+{
+	u8 page_addr = cardman_ctrl.key_card[index].extra[0];
+
+#ifdef CONF_CARDMAN_FLASH_KEYS
+	if (page_addr & KEY_PAGE_TOMBSTONE)
+		--cardman_ctrl.ntomb;
+	page_addr &= ~KEY_PAGE_TOMBSTONE;
+#endif
+	CARDMAN_DLOG("Delete page %hhd\r\n", page_addr);
+	eepromQueueErase (page_addr);
+	remove_key (index);
+	set_key_page_bit (cardman_ctrl.key_pages_used, page_addr, false);
+	write_header ();
+}
+#endif
+
+static void set_key_page_bit (u8 *bitmap, u8 page, bool_t set)
+{
+	u8 slot = page - DATABASE_KEY_START_PAGE;
+
+	if (set)
+		bitmap[slot >> 3] |= (1 << (slot & 0x7));
+	else
+		bitmap[slot >> 3] &= ~(1 << (slot & 0x7));
+}
+
+#ifndef CONF_CARDMAN_LOG_STORE
+static bool_t key_page_bit (const u8 *bitmap, u8 page)
+{
+	u8 slot = page - DATABASE_KEY_START_PAGE;
+
+	return (bitmap[slot >> 3] & (1 << (slot & 0x7))) != 0;
+}
+#endif
+
+static u8 key_generation (void)
+{
+	u8 gen = cardman_ctrl.header.key_gen;
+
+	return ((gen == 0) || (gen == 0xff)) ? ENTRY_USED : gen;
+}
+
+#ifdef CARDMAN_LAZY_ERASE
+static void erase_stale_pages (void)
+{
+	u8 page;
+
+	for (page = DATABASE_KEY_START_PAGE;
+	     page < (DATABASE_KEY_START_PAGE + MAX_NUMBER_OF_KEY_CARDS); ++page) {
+		if (key_page_bit (cardman_ctrl.key_pages_stale, page))
+			eepromQueueErase (page);
+	}
+	memset (cardman_ctrl.key_pages_stale, 0,
+	        sizeof(cardman_ctrl.key_pages_stale));
+	eepromQueueFlush ();
+}
+#endif
+
+#ifdef CONF_CARDMAN_FLASH_KEYS
+static u16 flash_key_count (void)
+{
+	if ((cardman_ctrl.header.flash_bank > 1) ||
+	    (cardman_ctrl.header.flash_nkeys > FLASH_KEYS_PER_BANK))
+		return 0;
+
+	return cardman_ctrl.header.flash_nkeys;
+}
+
+static bool_t flash_has_key (const u8 *uid, const u8 len)
+{
+	return flashKeysFind (cardman_ctrl.header.flash_bank,
+	                      flash_key_count (), uid, len);
+}
+
+static s8 merge_flash_keys (void)
+{
+	u8 old_used[KEY_PAGES_USED_SIZE];
+	struct card_entry flash_key;
+	struct card *key = cardman_ctrl.key_card;
+	struct card *end = key + cardman_ctrl.header.nkeys;
+	u8 old_bank = cardman_ctrl.header.flash_bank;
+	u8 bank = (old_bank == 0) ? 1 : 0;
+	u16 nflash = flash_key_count ();
+	u16 n = 0;
+	u8 kept = 0;
+	u8 page;
+	s8 cmp;
+	s8 err = ERR_NONE;
+
+	/* Every tombstone hides a key of the flash; don't wear the flash if
+	 * the result can't fit
+	 */
+	for (; key < end; ++key) {
+		if ((key->card.len <= FLASH_KEYS_MAX_UID_LENGTH) &&
+		    !(key->extra[0] & KEY_PAGE_TOMBSTONE))
+			++n;
+	}
+	if ((nflash + n - cardman_ctrl.ntomb) > FLASH_KEYS_PER_BANK) {
+		CARDMAN_DLOG("[cardman] Flash bank full\r\n");
+		return ERR_NO_MEMORY;
+	}
+	key = cardman_ctrl.key_card;
+	n = 0;
+
+	CARDMAN_DLOG("[cardman] Merge %hhd keys into flash bank %hhd\r\n",
+	             cardman_ctrl.header.nkeys, bank);
+
+	/* The flash is written by the NVM controller too */
+	eepromQueueFlush ();
+
+	/* Both tables are sorted, a tombstone sorts next to its key */
+	flashKeysWriteBegin (bank);
+	if (nflash)
+		flashKeysRead (old_bank, 0, &flash_key);
+	while ((err == ERR_NONE) && ((n < nflash) || (key < end))) {
+		if ((key < end) && (key->card.len > FLASH_KEYS_MAX_UID_LENGTH)) {
+			++key;
+			continue;
+		}
+
+		if (n == nflash)
+			cmp = -1;
+		else if (key == end)
+			cmp = 1;
+		else
+			cmp = cardCompare (key->card.uid, key->card.len, &flash_key);
+
+		if (cmp <= 0) {
+			if (!(key->extra[0] & KEY_PAGE_TOMBSTONE))
+				err = flashKeysWrite (&key->card);
+			++key;
+		} else {
+			err = flashKeysWrite (&flash_key);
+		}
+
+		if ((cmp >= 0) && (++n < nflash))
+			flashKeysRead (old_bank, n, &flash_key);
+	}
+
+	if (err != ERR_NONE) {
+		CARDMAN_DLOG("[cardman] Flash bank full\r\n");
+		return err;
+	}
+
+	cardman_ctrl.header.flash_bank = bank;
+	cardman_ctrl.header.flash_nkeys = flashKeysWriteEnd ();
+
+	/* Only the keys too long for the flash stay in the key table */
+	memcpy (old_used, cardman_ctrl.key_pages_used, sizeof(old_used));
+	for (key = cardman_ctrl.key_card; key < end; ++key) {
+		if (key->card.len > FLASH_KEYS_MAX_UID_LENGTH) {
+			cardman_ctrl.key_card[kept++] = *key;
+			continue;
+		}
+		set_key_page_bit (cardman_ctrl.key_pages_used,
+		                  key->extra[0] & ~KEY_PAGE_TOMBSTONE, false);
+	}
+	cardman_ctrl.header.nkeys = kept;
+	cardman_ctrl.ntomb = 0;
+	write_header ();
+
+	for (page = DATABASE_KEY_START_PAGE;
+	     page < (DATABASE_KEY_START_PAGE + MAX_NUMBER_OF_KEY_CARDS); ++page) {
+		if (key_page_bit (old_used, page) &&
+		    !key_page_bit (cardman_ctrl.key_pages_used, page))
+			eepromQueueErase (page);
+	}
+
+	CARDMAN_DLOG("[cardman] %hd keys in flash, %hhd in EEPROM\r\n",
+	             cardman_ctrl.header.flash_nkeys, kept);
+
+	return ERR_NONE;
+}
+#endif
+
+static void insert_key (u8 index, const struct card_entry *entry, u8 page)
+{
+	struct card *key = &cardman_ctrl.key_card[index];
+
+
+	memmove (key + 1, key,
+	         (cardman_ctrl.header.nkeys - index) * sizeof(*key));
+	key->card = *entry;
+	key->extra[0] = page;
+	++cardman_ctrl.header.nkeys;
+}
+
+static void remove_key (u8 index)
+{
+	struct card *key = &cardman_ctrl.key_card[index];
+
+	--cardman_ctrl.header.nkeys;
+	memmove (key, key + 1,
+	         (cardman_ctrl.header.nkeys - index) * sizeof(*key));
+}
+
+static enum card_type find_sw_card (const u8 *uid,
+                                    const u8 len,
+                                    struct card *result)
+{
+	struct sw_card tmp;
+	u8 lo = 0;
+	u8 hi = NUMBER_OF_SW_CARDS;
+	u8 mid;
+	s8 cmp;
+
+	while (lo < hi) {
+		mid = (lo + hi) >> 1;
+		memcpy_P (&tmp, &sw_cards[mid], sizeof(tmp));
+		cmp = cardCompare (uid, len, &tmp.card.card);
+		if (cmp == 0) {
+			*result = tmp.card;
+			return tmp.type;
+		}
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return CARD_TYPE_UNKNOWN;
+}
+
+#ifndef CONF_CARDMAN_LOG_STORE
 static void write_header (void)
 {
 	u8 page_addr;
@@ -477,6 +1077,248 @@ static void write_header (void)
 	eeprom_write_buffer_to_page(page_addr, &cardman_ctrl.header,
 	                            sizeof (cardman_ctrl.header));
 }
+#endif
+
+#ifdef CONF_CARDMAN_LOG_STORE
+
+/*! \brief Version 1 database being moved into the log, see log_apply */
+static struct {
+	bool_t pending;     /*!< a migration has to be finished */
+	u8 key_gen;         /*!< key generation of the version 1 pages */
+	u8 keys;            /*!< keys left in the version 1 pages */
+	u8 page;            /*!< next version 1 key page to move */
+} migration;
+
+static void reset_db (void)
+{
+	cardman_ctrl.header.nkeys = 0;
+	cardman_ctrl.header.nsoft_cards = 0;
+	cardman_ctrl.header.current_sw = DEFAULT_SOFTWARE_FUNCTION;
+	cardman_ctrl.prog_card.extra[0] = 0;
+}
+
+static s8 load_db_log (void)
+{
+	reset_db ();
+	migration.pending = false;
+	cardman_ctrl.header.db_version = DATABASE_LOG_VERSION;
+
+	return cardLogLoad (log_apply);
+}
+
+static s8 init_db_log (void)
+{
+	cardman_ctrl.header.db_version = DATABASE_LOG_VERSION;
+	cardLogFormat (LOG_FIRST_SEQ);
+
+	return log_snapshot ();
+}
+
+static s8 migrate_db_version1 (void)
+{
+	struct card_entry card;
+	u8 count;
+	u8 page;
+	s8 err;
+
+	migration.key_gen = key_generation ();
+	migration.keys = 0;
+	migration.page = DATABASE_KEY_START_PAGE;
+	for (page = DATABASE_KEY_START_PAGE;
+	     page < (DATABASE_KEY_START_PAGE + MAX_NUMBER_OF_KEY_CARDS); ++page) {
+		if (read_key_version1 (page, migration.key_gen, &card))
+			++migration.keys;
+	}
+
+	CARDMAN_DLOG("[cardman] Migrate db version 1, %hhd keys\r\n",
+	             migration.keys);
+
+	cardman_ctrl.header.db_version = DATABASE_LOG_VERSION;
+	cardLogFormat (LOG_FIRST_SEQ);
+
+	count = log_snapshot_settings ();
+	card.len = 1;
+	card.uid[0] = migration.key_gen;
+	cardLogAppend (CARD_LOG_MIGRATE, &card, migration.keys);
+	err = cardLogCommit (count + 1);
+	if (err != ERR_NONE)
+		return err;
+
+	migration.pending = true;
+	return migrate_keys ();
+}
+
+static s8 migrate_keys (void)
+{
+	struct card_entry card;
+	u8 index;
+	s8 err;
+
+	/* Record n of the keys lands at most n slots past the start of the
+	 * EEPROM, the page of key n is past the pages of the header, the
+	 * programming and the soft cards and the n keys before
+	 */
+	for (; migration.keys &&
+	       (migration.page < (DATABASE_KEY_START_PAGE + MAX_NUMBER_OF_KEY_CARDS));
+	     ++migration.page) {
+		if (!read_key_version1 (migration.page, migration.key_gen, &card))
+			continue;
+
+		err = cardLogAppend (CARD_LOG_KEY_ADD, &card, migration.page);
+		if (err != ERR_NONE)
+			return err;
+		if (!find_key (card.uid, card.len, &index) &&
+		    (cardman_ctrl.header.nkeys < MAX_NUMBER_OF_KEY_CARDS))
+			insert_key (index, &card, 0);
+		--migration.keys;
+	}
+
+	/* The snapshot drops the marker and overwrites the version 1 pages
+	 * of the keys moved
+	 */
+	migration.pending = false;
+	return log_snapshot ();
+}
+
+static bool_t read_key_version1 (u8 page, u8 gen, struct card_entry *card)
+{
+	struct key_page key;
+
+	/* the records of the keys moved before may still be queued */
+	eepromQueueFlush ();
+	nvm_eeprom_read_buffer (EEPROM_PAGE_SIZE * (u16)page, &key, sizeof(key));
+	*card = key.card;
+
+	return (key.used == gen) && (key.card.len <= MAX_KEY_UID_LENGTH);
+}
+
+static void log_apply (const struct card_log_record *record)
+{
+	struct card_entry card;
+	u8 index;
+
+	card.len = CARD_LOG_LEN(record);
+	memcpy (card.uid, record->uid, sizeof(card.uid));
+
+	switch (CARD_LOG_TYPE(record)) {
+	case CARD_LOG_SW_FUNCTION:
+		cardman_ctrl.header.current_sw = record->extra;
+		break;
+
+	case CARD_LOG_OPEN_DELAY:
+		cardman_ctrl.header.open_delay = record->extra;
+		break;
+
+	case CARD_LOG_PROG:
+		cardman_ctrl.prog_card.card = card;
+		cardman_ctrl.prog_card.extra[0] = ENTRY_USED;
+		break;
+
+	case CARD_LOG_SOFT:
+		for (index = 0; index < cardman_ctrl.header.nsoft_cards; ++index) {
+			if (cardIsEqual (card.uid, card.len,
+			                 &cardman_ctrl.soft_card[index]))
+				break;
+		}
+		if (index == MAX_NUMBER_OF_SOFT_CARDS)
+			break;
+		if (index == cardman_ctrl.header.nsoft_cards)
+			++cardman_ctrl.header.nsoft_cards;
+		cardman_ctrl.soft_card[index].card = card;
+		cardman_ctrl.soft_card[index].extra[0] = record->extra;
+		break;
+
+	case CARD_LOG_KEY_ADD:
+		if (!find_key (card.uid, card.len, &index) &&
+		    (cardman_ctrl.header.nkeys < MAX_NUMBER_OF_KEY_CARDS))
+			insert_key (index, &card, 0);
+		/* Moved from a version 1 page by an unfinished migration */
+		if (migration.pending && (record->extra >= DATABASE_KEY_START_PAGE)) {
+			migration.page = record->extra + 1;
+			if (migration.keys)
+				--migration.keys;
+		}
+		break;
+
+	case CARD_LOG_KEY_DELETE:
+		if (find_key (card.uid, card.len, &index))
+			remove_key (index);
+		break;
+
+	case CARD_LOG_KEYS_CLEAR:
+		cardman_ctrl.header.nkeys = 0;
+		break;
+
+	case CARD_LOG_MIGRATE:
+		migration.pending = true;
+		migration.key_gen = record->uid[0];
+		migration.keys = record->extra;
+		migration.page = DATABASE_KEY_START_PAGE;
+		break;
+
+	default:
+		break;
+	}
+}
+
+static u8 log_snapshot_size (void)
+{
+	/* software function, open delay and commit */
+	return 3 + (cardman_ctrl.prog_card.extra[0] ? 1 : 0) +
+	       cardman_ctrl.header.nsoft_cards + cardman_ctrl.header.nkeys;
+}
+
+static u8 log_snapshot_settings (void)
+{
+	u8 count = 0;
+	u8 i;
+
+	cardLogAppend (CARD_LOG_SW_FUNCTION, NULL,
+	               cardman_ctrl.header.current_sw);
+	cardLogAppend (CARD_LOG_OPEN_DELAY, NULL,
+	               cardman_ctrl.header.open_delay);
+	count += 2;
+
+	if (cardman_ctrl.prog_card.extra[0]) {
+		cardLogAppend (CARD_LOG_PROG, &cardman_ctrl.prog_card.card, 0);
+		++count;
+	}
+
+	for (i = 0; i < cardman_ctrl.header.nsoft_cards; ++i, ++count) {
+		cardLogAppend (CARD_LOG_SOFT, &cardman_ctrl.soft_card[i].card,
+		               cardman_ctrl.soft_card[i].extra[0]);
+	}
+
+	return count;
+}
+
+static s8 log_snapshot (void)
+{
+	u8 count;
+	u8 i;
+
+	CARDMAN_DLOG("[cardman] Log snapshot, %hhd records\r\n",
+	             log_snapshot_size ());
+
+	count = log_snapshot_settings ();
+	for (i = 0; i < cardman_ctrl.header.nkeys; ++i, ++count)
+		cardLogAppend (CARD_LOG_KEY_ADD, &cardman_ctrl.key_card[i].card, 0);
+
+	return cardLogCommit (count);
+}
+
+static void log_write (u8 type, const struct card_entry *card, u8 extra)
+{
+	/* The snapshot has to fit into the log after this record, it grows
+	 * by at most one record per change
+	 */
+	if (cardLogFree () < (log_snapshot_size () + 2))
+		log_snapshot ();
+
+	cardLogAppend (type, card, extra);
+}
+
+#endif /* CONF_CARDMAN_LOG_STORE */
 
 /************************************************************************/
 /* GLOBAL FUNCTIONS                                                     */
@@ -486,6 +1328,35 @@ s8 cardmanInitialize (void)
 {
 	s8 err;
 
+	/* The database is read directly from the EEPROM */
+	eepromQueueFlush ();
+
+#ifdef CONF_CARDMAN_LOG_STORE
+	err = load_db_log ();
+	if (err == ERR_NONE) {
+		CARDMAN_DLOG("[cardman] Load db log, %hhd keys\r\n",
+		             cardman_ctrl.header.nkeys);
+		if (!migration.pending)
+			return ERR_NONE;
+
+		/* Power was lost while moving a version 1 database */
+		CARDMAN_DLOG("[cardman] Resume migration, %hhd keys left\r\n",
+		             migration.keys);
+		return migrate_keys ();
+	}
+
+	/* No log yet: move a version 1 database into a new log */
+	CARDMAN_DLOG("[cardman] No db log (%hhd), creating it\r\n", err);
+	err = read_header ();
+	if ((err == ERR_NONE) &&
+	    (cardman_ctrl.header.db_version == DATABASE_CURRENT_VERSION) &&
+	    (load_db_version1 () == ERR_NONE)) {
+		err = migrate_db_version1 ();
+	} else {
+		reset_db ();
+		err = init_db_log ();
+	}
+#else
 	err = read_header ();
 	EVAL_ERR_NE_GOTO (err, ERR_NONE, out)
 
@@ -513,48 +1384,50 @@ s8 cardmanInitialize (void)
 	}
 
 out:
+#endif
 	return err;
 }
 
 s8 cardmanAddKey (const u8 *uid, const u8 len)
 {
-	u8 i;
+#if defined(CONF_CARDMAN_LOG_STORE) || defined(CONF_CARDMAN_FLASH_KEYS)
+	u8 index;
+#endif
 	struct key_page key;
 	enum card_type type = cardmanGetCardType (uid, len, NULL);
 
 	switch (type) {
 	case CARD_TYPE_UNKNOWN:
 		/* Go ahead */
+#ifdef CONF_CARDMAN_FLASH_KEYS
+		if (find_key (uid, len, &index)) {
+			/* Deleted from the flash, drop the tombstone */
+			delete_key_page (index);
+			return ERR_NONE;
+		}
+		if (cardman_ctrl.header.nkeys >= MAX_NUMBER_OF_KEY_CARDS)
+			merge_flash_keys ();
+#endif
 		if (unlikely(cardman_ctrl.header.nkeys >=
 		             MAX_NUMBER_OF_KEY_CARDS)) {
 			return ERR_NO_MEMORY;
 		}
 
-		/* HINT: Search strategy could be optimized */
-		for (i = 0; i < MAX_NUMBER_OF_KEY_CARDS; ++i) {
-			u16 addr = DATABASE_KEY_START_ADDR + (EEPROM_PAGE_SIZE * i);
-			nvm_eeprom_read_buffer (addr, &key, sizeof(key));
-			if (key.used != ENTRY_USED) {
-				u8 page_addr = DATABASE_KEY_START_PAGE + i;
-				copy_to_entry (&key.card, uid, len);
-				key.used = 1;
-				eeprom_write_buffer_to_page (page_addr,
-				                             &key,
-				                             sizeof(key));
-				cardman_ctrl.key_card[cardman_ctrl.header.nkeys].card = key.card;
-				cardman_ctrl.key_card[cardman_ctrl.header.nkeys].extra[0] = page_addr;
-				++cardman_ctrl.header.nkeys;
-				write_header ();
-				CARDMAN_DLOG("HEADER: db: %hd, nkeys: %hhd, nsoft: %hhd, comb_h: %hhx\r\n",
-				             cardman_ctrl.header.db_version,
-				             cardman_ctrl.header.nkeys,
-				             cardman_ctrl.header.nsoft_cards,
-				             cardman_ctrl.comb_header_state);
-				return ERR_NONE;
-			}
-		}
-
-		return ERR_BAD_DATA;
+		copy_to_entry (&key.card, uid, len);
+#ifdef CONF_CARDMAN_LOG_STORE
+		find_key (uid, len, &index);
+		insert_key (index, &key.card, 0);
+		log_write (CARD_LOG_KEY_ADD, &key.card, 0);
+#else
+		if (unlikely(add_key_page (&key.card, 0) != ERR_NONE))
+			return ERR_BAD_DATA;
+#endif
+		CARDMAN_DLOG("HEADER: db: %hd, nkeys: %hhd, nsoft: %hhd, comb_h: %hhx\r\n",
+		             cardman_ctrl.header.db_version,
+		             cardman_ctrl.header.nkeys,
+		             cardman_ctrl.header.nsoft_cards,
+		             cardman_ctrl.comb_header_state);
+		return ERR_NONE;
 
 	case CARD_TYPE_PROGRAMMING_CARD:
 	case CARD_TYPE_SOFTWARE_CARD:
@@ -566,33 +1439,33 @@ s8 cardmanAddKey (const u8 *uid, const u8 len)
 
 s8 cardmanDeleteKey (const u8 *uid, const u8 len)
 {
-	u8 page_addr;
 	struct card *ptr;
 	enum card_type type = cardmanGetCardType (uid, len, &ptr);
 
 	switch (type) {
 	case CARD_TYPE_KEY:
 		/* Go ahead */
-		page_addr = ptr->extra[0];
-		CARDMAN_DLOG("Delete page %hhd\r\n", page_addr);
-		nvm_eeprom_fill_buffer_with_value(0xff);
-		nvm_eeprom_erase_bytes_in_page (page_addr);
-		nvm_eeprom_flush_buffer ();
-		--cardman_ctrl.header.nkeys;
-		CARDMAN_DLOG("HEADER: db: %hd, nkeys: %hhd, nsoft: %hhd, comb_h: %hhx\r\n",
-		             cardman_ctrl.header.db_version,
-		             cardman_ctrl.header.nkeys,
-		             cardman_ctrl.header.nsoft_cards,
-		             cardman_ctrl.comb_header_state);
-		write_header ();
-		CARDMAN_DLOG("HEADER: db: %hd, nkeys: %hhd, nsoft: %hhd, comb_h: %hhx\r\n",
-		             cardman_ctrl.header.db_version,
-		             cardman_ctrl.header.nkeys,
-		             cardman_ctrl.header.nsoft_cards,
-		             cardman_ctrl.comb_header_state);
-
-		/* HINT: This is VERY inefficient -> Could be optimized */
-		cardmanInitialize ();
+#ifdef CONF_CARDMAN_LOG_STORE
+		log_write (CARD_LOG_KEY_DELETE, &ptr->card, 0);
+		remove_key (ptr - cardman_ctrl.key_card);
+#else
+# ifdef CONF_CARDMAN_FLASH_KEYS
+		if (ptr == &flash_key_result) {
+			/* Only in the flash, hide it with a tombstone */
+			if (cardman_ctrl.header.nkeys >= MAX_NUMBER_OF_KEY_CARDS)
+				merge_flash_keys ();
+			if (unlikely(cardman_ctrl.header.nkeys >=
+			             MAX_NUMBER_OF_KEY_CARDS)) {
+				return ERR_NO_MEMORY;
+			}
+			if (unlikely(add_key_page (&ptr->card,
+			                           KEY_PAGE_TOMBSTONE) != ERR_NONE))
+				return ERR_BAD_DATA;
+			++cardman_ctrl.ntomb;
+		} else
+# endif
+		delete_key_page (ptr - cardman_ctrl.key_card);
+#endif
 		CARDMAN_DLOG("HEADER: db: %hd, nkeys: %hhd, nsoft: %hhd, comb_h: %hhx\r\n",
 		             cardman_ctrl.header.db_version,
 		             cardman_ctrl.header.nkeys,
@@ -612,19 +1485,45 @@ s8 cardmanDeleteKey (const u8 *uid, const u8 len)
 
 s8 cardmanDeleteAllKeys (void)
 {
-	u8 i;
+#ifdef CONF_CARDMAN_FLASH_KEYS
+	/* The bank is rewritten by the next merge */
+	cardman_ctrl.header.flash_nkeys = 0;
+	cardman_ctrl.ntomb = 0;
+#endif
+#ifdef CONF_CARDMAN_LOG_STORE
+	cardman_ctrl.header.nkeys = 0;
+	log_write (CARD_LOG_KEYS_CLEAR, NULL, 0);
+#elif defined(CARDMAN_LAZY_ERASE)
+	u8 gen = key_generation ();
+
+	if (cardman_ctrl.header.nkeys) {
+		/* The generation may only come back to a value once no page
+		 * of that value is left
+		 */
+		erase_stale_pages ();
+		memcpy (cardman_ctrl.key_pages_stale, cardman_ctrl.key_pages_used,
+		        sizeof(cardman_ctrl.key_pages_stale));
+		memset (cardman_ctrl.key_pages_used, 0,
+		        sizeof(cardman_ctrl.key_pages_used));
+		cardman_ctrl.header.key_gen = (gen >= 0xfe) ? ENTRY_USED : (gen + 1);
+	}
 
 	cardman_ctrl.header.nkeys = 0;
 	write_header ();
+#else
+	u8 page;
 
-	for (i = 0; i < MAX_NUMBER_OF_KEY_CARDS; ++i) {
-		/* HINT: Could be optimized if only pages that have actually
-		 *       been used.
-		 */
-		nvm_eeprom_fill_buffer_with_value(0xff);
-		nvm_eeprom_erase_bytes_in_page (DATABASE_KEY_START_PAGE + i);
-		nvm_eeprom_flush_buffer ();
+	cardman_ctrl.header.nkeys = 0;
+	write_header ();
+
+	for (page = DATABASE_KEY_START_PAGE;
+	     page < (DATABASE_KEY_START_PAGE + MAX_NUMBER_OF_KEY_CARDS); ++page) {
+		if (key_page_bit (cardman_ctrl.key_pages_used, page))
+			eepromQueueErase (page);
 	}
+	memset (cardman_ctrl.key_pages_used, 0,
+	        sizeof(cardman_ctrl.key_pages_used));
+#endif
 
 	return ERR_NONE;
 }
@@ -634,50 +1533,13 @@ enum card_type cardmanGetCardType (const u8 *uid,
                                    struct card **result)
 {
 	u8 i;
+	enum card_type type;
 
-
-	if (cardIsEqual (uid, len, &sw_std_group )) {
-		if (result != NULL)
-		*result = &sw_std_group ;
-		return CARD_TYPE_SOFTWARE_CARD;
-	}
-
-	if (cardIsEqual (uid, len, &sw_bolt )) {
-		if (result != NULL)
-		*result = &sw_bolt ;
-		return CARD_TYPE_SOFTWARE_CARD;
-	}
-
-	if (cardIsEqual (uid, len, &sw_alarm )) {
+	type = find_sw_card (uid, len, &sw_card_result);
+	if (type != CARD_TYPE_UNKNOWN) {
 		if (result != NULL)
-		*result = &sw_alarm ;
-		return CARD_TYPE_SOFTWARE_CARD;
-	}
-
-	if (cardIsEqual (uid, len, &gym_software_card)) {
-		if (result != NULL)
-		*result = &gym_software_card;
-		return CARD_TYPE_GYM_SOFTWARD_CARD;
-	}
-	
-
-	
-	if (cardIsEqual (uid, len, &gym_software_card_6)) {
-		if (result != NULL)
-		*result = &gym_software_card_6;
-		return CARD_TYPE_GYM_SOFTWARD_CARD_6;
-	}
-
-	if (cardIsEqual (uid, len, &gym_software_card_12)) {
-		if (result != NULL)
-		*result = &gym_software_card_12;
-		return CARD_TYPE_GYM_SOFTWARD_CARD_12;
-	}
-
-	if (cardIsEqual (uid, len, &gym_software_card_24)) {
-		if (result != NULL)
-		*result = &gym_software_card_24;
-		return CARD_TYPE_GYM_SOFTWARD_CARD_24;
+			*result = &sw_card_result;
+		return type;
 	}
 
 	if (cardman_ctrl.prog_card.extra[0] &&
@@ -695,14 +1557,25 @@ enum card_type cardmanGetCardType (const u8 *uid,
 		}
 	}
 
-	for (i = 0; i < cardman_ctrl.header.nkeys; ++i) {
-		if (cardIsEqual (uid, len, &cardman_ctrl.key_card[i])) {
-			if (result != NULL)
-				*result = &cardman_ctrl.key_card[i];
-			return CARD_TYPE_KEY;
-		}
+	if (find_key (uid, len, &i)) {
+#ifdef CONF_CARDMAN_FLASH_KEYS
+		if (cardman_ctrl.key_card[i].extra[0] & KEY_PAGE_TOMBSTONE)
+			return CARD_TYPE_UNKNOWN;
+#endif
+		if (result != NULL)
+			*result = &cardman_ctrl.key_card[i];
+		return CARD_TYPE_KEY;
 	}
 
+#ifdef CONF_CARDMAN_FLASH_KEYS
+	if (flash_has_key (uid, len)) {
+		copy_to_entry (&flash_key_result.card, uid, len);
+		if (result != NULL)
+			*result = &flash_key_result;
+		return CARD_TYPE_KEY;
+	}
+#endif
+
 	return CARD_TYPE_UNKNOWN;
 }
 
@@ -723,9 +1596,13 @@ s8 cardmanSetProgrammingCard (const u8 *uid, const u8 len)
 		copy_to_entry (&prog_card.card, uid, len);
 		cardman_ctrl.prog_card.card = prog_card.card;
 		cardman_ctrl.prog_card.extra[0] = prog_card.used;
+#ifdef CONF_CARDMAN_LOG_STORE
+		log_write (CARD_LOG_PROG, &prog_card.card, 0);
+#else
 		eeprom_write_buffer_to_page (DATABASE_PROG_START_PAGE,
 		                             &prog_card,
 		                             sizeof(prog_card));
+#endif
 		return ERR_NONE;
 
 	
@@ -743,14 +1620,23 @@ u8 cardmanGetSoftwareFunction (void)
 void cardmanSetSoftwareFunction (u8 sw_function)
 {
 	cardman_ctrl.header.current_sw = sw_function;
+#ifdef CONF_CARDMAN_LOG_STORE
+	log_write (CARD_LOG_SW_FUNCTION, NULL, sw_function);
+#else
 	write_header();
+#endif
 }
 
 void cardmanSetSoftwareFunctionOpenDelay (u8 sw_function, u8 delay)
 {
 	cardman_ctrl.header.open_delay = delay;
 	cardman_ctrl.header.current_sw = sw_function;
+#ifdef CONF_CARDMAN_LOG_STORE
+	log_write (CARD_LOG_OPEN_DELAY, NULL, delay);
+	log_write (CARD_LOG_SW_FUNCTION, NULL, sw_function);
+#else
 	write_header();
+#endif
 }
 
 u8 cardmanGetOpenDelay() {
@@ -759,5 +1645,30 @@ u8 cardmanGetOpenDelay() {
 
 u8 cardmanGetNumberOfKeys (void)
 {
+#ifdef CONF_CARDMAN_FLASH_KEYS
+	/* Every tombstone is in nkeys and hides a key of the flash */
+	u16 n = flash_key_count () + cardman_ctrl.header.nkeys -
+	        2 * cardman_ctrl.ntomb;
+
+	return (n > 0xff) ? 0xff : n;
+#else
 	return cardman_ctrl.header.nkeys;
+#endif
 }
+
+#ifdef CARDMAN_LAZY_ERASE
+void cardmanEraseStalePage (void)
+{
+	u8 page;
+
+	for (page = DATABASE_KEY_START_PAGE;
+	     page < (DATABASE_KEY_START_PAGE + MAX_NUMBER_OF_KEY_CARDS); ++page) {
+		if (key_page_bit (cardman_ctrl.key_pages_stale, page)) {
+			CARDMAN_DLOG("[cardman] Erase stale page %hhd\r\n", page);
+			set_key_page_bit (cardman_ctrl.key_pages_stale, page, false);
+			eepromQueueErase (page);
+			return;
+		}
+	}
+}
+#endif
@@ -10,6 +10,7 @@
 #ifndef CARDS_MANAGER_H_
 #define CARDS_MANAGER_H_
 
+#include "conf_board.h"
 #include "platform.h"
 #include "iso14443a.h"
 
@@ -20,7 +21,10 @@
 /*! \brief Maximum size of UID of cards */
 #define MAX_KEY_UID_LENGTH         (ISO14443A_MAX_UID_LENGTH)
 
-/*! \brief Maximum number of key cards */
+/*! \brief Maximum number of key cards (key pages in the EEPROM)
+ * With CONF_CARDMAN_FLASH_KEYS the key pages hold the changes to the keys
+ * in the flash, see flash_keys.h.
+ */
 #define MAX_NUMBER_OF_KEY_CARDS    50
 
 /*! \brief Number of software cards must be a multiple of 2 */
@@ -67,10 +71,12 @@ struct header_entry {
 	u8 nsoft_cards;
 	u8 current_sw;
 	u8 open_delay;
-	u8 dummy;
+	u8 key_gen;     /*!< used value of valid key pages, 0 and 0xff read as 1 */
+	u8 flash_bank;  /*!< bank of the flash key store, other than 0/1: none */
+	u16 flash_nkeys; /*!< number of keys in the flash bank */
 };
 /*! \brief Size of header structure */
-#define HEADER_ENTRY_SIZE          8
+#define HEADER_ENTRY_SIZE          11
 
 /*! \brief Structure that holds information of one key card */
 struct key_page {
@@ -127,6 +133,9 @@ extern s8 cardmanInitialize (void);
  *         ERR_NO_MEMORY if the header indicates that the maximum
  *         number of cards has been stored in the database.
  *         ERR_NONE if key card has been added to database.
+ *
+ * With CONF_CARDMAN_FLASH_KEYS the keys of the EEPROM are merged into the
+ * flash when all key pages are in use.
  */
 extern s8 cardmanAddKey (const u8 *uid, const u8 len);
 
@@ -136,6 +145,8 @@ extern s8 cardmanAddKey (const u8 *uid, const u8 len);
  * \param len Length of the UID of the card to delete.
  * \return ERR_REQUEST if card can't be deleted (because it's
  *         a software or programming card)
+ *         ERR_NO_MEMORY if a key of the flash can't be deleted because
+ *         all key pages hold keys that don't fit into the flash.
  *         ERR_NONE if card has been deleted successfully (or
  *         has never existed in database).
  */
@@ -144,9 +155,27 @@ extern s8 cardmanDeleteKey (const u8 *uid, const u8 len);
 /*!
  * \brief Deletes all key cards from database
  * \return ERR_NONE
+ *
+ * Only the key pages in use are erased. With CONF_CARDMAN_LAZY_ERASE the
+ * pages are invalidated by a new key generation in the header instead and
+ * erased later by #cardmanEraseStalePage. The keys in the flash
+ * (CONF_CARDMAN_FLASH_KEYS) are dropped by the header, the flash is not
+ * written.
  */
 extern s8 cardmanDeleteAllKeys (void);
 
+#if defined(CONF_CARDMAN_LAZY_ERASE) && !defined(CONF_CARDMAN_LOG_STORE)
+/*!
+ * \brief Starts erasing one key page invalidated by #cardmanDeleteAllKeys
+ *
+ * Call this when the MCU is idle; the erase runs in the background until
+ * the next EEPROM access.
+ */
+extern void cardmanEraseStalePage (void);
+#else
+# define cardmanEraseStalePage() do { } while (0)
+#endif
+
 /*!
  * \brief Retrieves the type of card (by checking the database)
  * \param uid UID of the card to check.
@@ -186,7 +215,7 @@ extern void cardmanSetSoftwareFunction (u8 sw_function);
 
 /*!
  * \brief Retrieves number of keys in database.
- * \return Number of keys in the database.
+ * \return Number of keys in the database, at most 255.
  */
 extern u8 cardmanGetNumberOfKeys (void);
 
@@ -26,4 +26,40 @@
 # error "EEPROM too small for requested number of pages!"
 #endif
 
+#ifdef CONF_CARDMAN_LOG_STORE
+# include "cardman/card_log.h"
+
+# if MAX_KEY_UID_LENGTH != 10
+#  error "struct card_log_record must be CARD_LOG_RECORD_SIZE bytes!"
+# endif
+
+# if (EEPROM_PAGE_SIZE % CARD_LOG_RECORD_SIZE) != 0
+#  error "EEPROM_PAGE_SIZE must be a multiple of CARD_LOG_RECORD_SIZE!"
+# endif
+
+# if (CARD_LOG_SLOTS > 128) || ((65536UL % CARD_LOG_SLOTS) != 0)
+#  error "CARD_LOG_SLOTS must be a power of 2 and at most 128!"
+# endif
+
+# if CARD_LOG_SLOTS < (2 * (3 + 1 + MAX_NUMBER_OF_SOFT_CARDS + MAX_NUMBER_OF_KEY_CARDS))
+#  error "EEPROM too small for the card log!"
+# endif
+#endif
+
+#ifdef CONF_CARDMAN_FLASH_KEYS
+# include "cardman/flash_keys.h"
+
+# ifdef CONF_CARDMAN_LOG_STORE
+#  error "CONF_CARDMAN_FLASH_KEYS can't be used with CONF_CARDMAN_LOG_STORE!"
+# endif
+
+# if (FLASH_KEYS_BANK_SIZE % FLASH_PAGE_SIZE) != 0
+#  error "FLASH_KEYS_BANK_SIZE must be a multiple of FLASH_PAGE_SIZE!"
+# endif
+
+# if (FLASH_PAGE_SIZE % FLASH_KEYS_RECORD_SIZE) != 0
+#  error "FLASH_PAGE_SIZE must be a multiple of FLASH_KEYS_RECORD_SIZE!"
+# endif
+#endif
+
 #endif /* EEPROM_COMPILER_CHECKS_H_ */
\ No newline at end of file
@@ -0,0 +1,175 @@
+/*
+ * eeprom_queue.c
+ *
+ * Write-behind queue for EEPROM pages, see eeprom_queue.h.
+ */
+
+#include "cardman/eeprom_queue.h"
+
+/*! \brief NVM command of a request */
+enum eeprom_op {
+	EEPROM_OP_WRITE,                /*!< erase and write (atomic) */
+	EEPROM_OP_WRITE_ERASED,         /*!< write only (split) */
+	EEPROM_OP_ERASE                 /*!< erase only */
+};
+
+/*!
+ * \brief Loads the page buffer and starts the NVM command
+ * \param op enum eeprom_op
+ * \param data Bytes to write, NULL to erase.
+ *
+ * Only the loaded bytes of the page are erased and written.
+ */
+static void start_request (u8 op, u8 page, u8 offset, const u8 *data, u8 len)
+{
+	u8 i;
+
+	nvm_wait_until_ready ();
+	nvm_eeprom_flush_buffer ();
+	for (i = 0; i < len; ++i)
+		nvm_eeprom_load_byte_to_buffer (offset + i, data ? data[i] : 0xff);
+
+	switch (op) {
+	case EEPROM_OP_WRITE:
+		nvm_eeprom_atomic_write_page (page);
+		break;
+	case EEPROM_OP_WRITE_ERASED:
+		nvm_eeprom_split_write_page (page);
+		break;
+	default:
+		nvm_eeprom_erase_bytes_in_page (page);
+		break;
+	}
+}
+
+#ifdef CONF_EEPROM_WRITE_QUEUE
+
+/*! \brief One queued page request */
+struct eeprom_request {
+	u8 op;                          /*!< enum eeprom_op */
+	u8 page;
+	u8 offset;
+	u8 len;
+	u8 data[EEPROM_PAGE_SIZE];
+};
+
+static struct eeprom_request s_queue[EEPROM_QUEUE_LENGTH];
+/*! \brief Index of the oldest request */
+static volatile u8 s_head = 0;
+/*! \brief Number of requests not started yet */
+static volatile u8 s_count = 0;
+
+/*! \brief Called while the NVM is ready (level interrupt) */
+ISR(NVM_EE_vect)
+{
+	if (!s_count) {
+		NVM.INTCTRL &= ~NVM_EELVL_gm;
+		return;
+	}
+
+	start_request (s_queue[s_head].op, s_queue[s_head].page,
+	               s_queue[s_head].offset,
+	               (s_queue[s_head].op == EEPROM_OP_ERASE) ? NULL
+	                                                      : s_queue[s_head].data,
+	               s_queue[s_head].len);
+	s_head = (s_head + 1) % EEPROM_QUEUE_LENGTH;
+	--s_count;
+}
+
+/*! \brief Returns the next free entry, waits if the queue is full */
+static struct eeprom_request *reserve_request (void)
+{
+	irqflags_t flags;
+	u8 index;
+
+	/* The NVM interrupt frees an entry within one page write */
+	while (s_count == EEPROM_QUEUE_LENGTH)
+		;
+
+	flags = cpu_irq_save ();
+	index = (s_head + s_count) % EEPROM_QUEUE_LENGTH;
+	cpu_irq_restore (flags);
+
+	return &s_queue[index];
+}
+
+/*! \brief Hands the entry returned by #reserve_request to the interrupt */
+static void commit_request (void)
+{
+	irqflags_t flags = cpu_irq_save ();
+
+	++s_count;
+	NVM.INTCTRL = (NVM.INTCTRL & ~NVM_EELVL_gm) | NVM_EELVL_LO_gc;
+	cpu_irq_restore (flags);
+}
+
+/*! \brief Queues a request, waits if the queue is full */
+static void queue_request (u8 op, u8 page, u8 offset, const void *buffer,
+                           u8 len)
+{
+	struct eeprom_request *req = reserve_request ();
+
+	req->op = op;
+	req->page = page;
+	req->offset = offset;
+	req->len = len;
+	if (buffer)
+		memcpy (req->data, buffer, len);
+	commit_request ();
+}
+
+void eepromQueueWrite (u8 page, const void *buffer, u8 len)
+{
+	queue_request (EEPROM_OP_WRITE, page, 0, buffer, len);
+}
+
+void eepromQueueErase (u8 page)
+{
+	queue_request (EEPROM_OP_ERASE, page, 0, NULL, EEPROM_PAGE_SIZE);
+}
+
+void eepromQueueWriteBytes (u8 page, u8 offset, const void *buffer,
+                            u8 len, bool_t erased)
+{
+	queue_request (erased ? EEPROM_OP_WRITE_ERASED : EEPROM_OP_WRITE,
+	               page, offset, buffer, len);
+}
+
+void eepromQueueEraseBytes (u8 page, u8 offset, u8 len)
+{
+	queue_request (EEPROM_OP_ERASE, page, offset, NULL, len);
+}
+
+void eepromQueueFlush (void)
+{
+	while (s_count)
+		;
+
+	nvm_wait_until_ready ();
+}
+
+#else
+
+void eepromQueueWrite (u8 page, const void *buffer, u8 len)
+{
+	start_request (EEPROM_OP_WRITE, page, 0, buffer, len);
+}
+
+void eepromQueueErase (u8 page)
+{
+	start_request (EEPROM_OP_ERASE, page, 0, NULL, EEPROM_PAGE_SIZE);
+}
+
+void eepromQueueWriteBytes (u8 page, u8 offset, const void *buffer,
+                            u8 len, bool_t erased)
+{
+	start_request (erased ? EEPROM_OP_WRITE_ERASED : EEPROM_OP_WRITE,
+	               page, offset, buffer, len);
+}
+
+void eepromQueueEraseBytes (u8 page, u8 offset, u8 len)
+{
+	start_request (EEPROM_OP_ERASE, page, offset, NULL, len);
+}
+
+#endif /* CONF_EEPROM_WRITE_QUEUE */
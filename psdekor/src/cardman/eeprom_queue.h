@@ -0,0 +1,82 @@
+/*
+ * eeprom_queue.h
+ *
+ * Write-behind queue for EEPROM pages. Page writes and erases are queued
+ * and started one after the other by the NVM EEPROM ready interrupt, so the
+ * caller does not wait for the NVM. The queue keeps the order of the
+ * requests: a header queued after its data is written after it.
+ *
+ * The queue is only compiled in if CONF_EEPROM_WRITE_QUEUE is defined in
+ * conf_board.h. Otherwise every request is executed synchronously and
+ * eepromQueueFlush is an empty macro.
+ *
+ * While requests are queued no other code may use the NVM controller
+ * (EEPROM reads, calibration row); call eepromQueueFlush before.
+ */
+
+
+#ifndef EEPROM_QUEUE_H_
+#define EEPROM_QUEUE_H_
+
+#include "conf_board.h"
+#include "platform.h"
+
+#ifndef EEPROM_QUEUE_LENGTH
+/*! \brief Number of page requests that can be queued */
+# define EEPROM_QUEUE_LENGTH 4
+#endif
+
+/*!
+ * \brief Queues a write to the start of an EEPROM page
+ * \param page EEPROM page.
+ * \param buffer Data to write, copied before returning.
+ * \param len Number of bytes (at most EEPROM_PAGE_SIZE); only these bytes
+ *            of the page are erased and written.
+ *
+ * Waits for a free entry if the queue is full.
+ */
+extern void eepromQueueWrite (u8 page, const void *buffer, u8 len);
+
+/*!
+ * \brief Queues erasing an EEPROM page
+ * \param page EEPROM page.
+ */
+extern void eepromQueueErase (u8 page);
+
+/*!
+ * \brief Queues a write of bytes within an EEPROM page
+ * \param page EEPROM page.
+ * \param offset First byte in the page.
+ * \param buffer Data to write, copied before returning.
+ * \param len Number of bytes (offset + len at most EEPROM_PAGE_SIZE).
+ * \param erased TRUE if the bytes are erased already, they are written
+ *               without erase (split write).
+ */
+extern void eepromQueueWriteBytes (u8 page, u8 offset, const void *buffer,
+                                   u8 len, bool_t erased);
+
+/*!
+ * \brief Queues erasing bytes within an EEPROM page
+ * \param page EEPROM page.
+ * \param offset First byte in the page.
+ * \param len Number of bytes (offset + len at most EEPROM_PAGE_SIZE).
+ */
+extern void eepromQueueEraseBytes (u8 page, u8 offset, u8 len);
+
+#ifdef CONF_EEPROM_WRITE_QUEUE
+
+/*!
+ * \brief Waits until all queued requests have been written
+ *
+ * Call before sleeping (the NVM interrupt doesn't wake the MCU from
+ * power-save) and before a reset.
+ */
+extern void eepromQueueFlush (void);
+
+#else
+
+# define eepromQueueFlush() do { } while (0)
+
+#endif /* CONF_EEPROM_WRITE_QUEUE */
+
+#endif /* EEPROM_QUEUE_H_ */
@@ -0,0 +1,108 @@
+/*
+ * flash_keys.c
+ *
+ * Sorted key table in the flash, see flash_keys.h.
+ */
+
+#include "cardman/flash_keys.h"
+
+#ifdef CONF_CARDMAN_FLASH_KEYS
+
+#include "cardman/card_utils.h"
+
+/*! \brief Page buffer of #flashKeysWrite */
+static u8 s_page[FLASH_PAGE_SIZE];
+/*! \brief Flash address of s_page */
+static flash_addr_t s_addr;
+/*! \brief Bytes used in s_page */
+static u16 s_fill;
+/*! \brief Keys written since #flashKeysWriteBegin */
+static u16 s_count;
+
+static flash_addr_t bank_start (u8 bank)
+{
+	return FLASH_KEYS_START + (flash_addr_t)bank * FLASH_KEYS_BANK_SIZE;
+}
+
+void flashKeysRead (u8 bank, u16 index, struct card_entry *card)
+{
+	struct flash_key_record record;
+
+	nvm_flash_read_buffer (bank_start (bank) +
+	                       (flash_addr_t)index * FLASH_KEYS_RECORD_SIZE,
+	                       &record, sizeof(record));
+	card->len = record.len;
+	memcpy (card->uid, record.uid, sizeof(record.uid));
+}
+
+bool_t flashKeysFind (u8 bank, u16 nkeys, const u8 *uid, u8 len)
+{
+	struct card_entry card;
+	u16 lo = 0;
+	u16 hi = nkeys;
+	u16 mid;
+	s8 cmp;
+
+	if (len > FLASH_KEYS_MAX_UID_LENGTH)
+		return false;
+
+	while (lo < hi) {
+		mid = (lo + hi) >> 1;
+		flashKeysRead (bank, mid, &card);
+		cmp = cardCompare (uid, len, &card);
+		if (cmp == 0)
+			return true;
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return false;
+}
+
+/*! \brief Erases and writes s_page, padded with 0xff */
+static void write_page (void)
+{
+	memset (s_page + s_fill, 0xff, sizeof(s_page) - s_fill);
+	nvm_flash_erase_and_write_buffer (s_addr, s_page, sizeof(s_page), true);
+	s_addr += sizeof(s_page);
+	s_fill = 0;
+}
+
+void flashKeysWriteBegin (u8 bank)
+{
+	s_addr = bank_start (bank);
+	s_fill = 0;
+	s_count = 0;
+}
+
+s8 flashKeysWrite (const struct card_entry *card)
+{
+	struct flash_key_record *record;
+
+	if (unlikely(s_count >= FLASH_KEYS_PER_BANK))
+		return ERR_NO_MEMORY;
+
+	record = (struct flash_key_record *)&s_page[s_fill];
+	record->len = card->len;
+	memset (record->uid, 0xff, sizeof(record->uid));
+	memcpy (record->uid, card->uid, card->len);
+	s_fill += FLASH_KEYS_RECORD_SIZE;
+	++s_count;
+
+	if (s_fill == sizeof(s_page))
+		write_page ();
+
+	return ERR_NONE;
+}
+
+u16 flashKeysWriteEnd (void)
+{
+	if (s_fill)
+		write_page ();
+
+	return s_count;
+}
+
+#endif /* CONF_CARDMAN_FLASH_KEYS */
@@ -0,0 +1,96 @@
+/*
+ * flash_keys.h
+ *
+ * Key cards stored in the application table section of the flash. A bank
+ * holds packed 8 byte records sorted like the key table in RAM (see
+ * #cardCompare), so a key is found by a binary search on the flash without
+ * copying the bank to RAM. Two banks are used alternately: a merge writes
+ * the new table into the bank not in use, the header in the EEPROM is
+ * switched to it afterwards.
+ *
+ * Only UIDs of up to FLASH_KEYS_MAX_UID_LENGTH bytes fit into a record.
+ *
+ * The store is only compiled in if CONF_CARDMAN_FLASH_KEYS is defined in
+ * conf_board.h.
+ */
+
+
+#ifndef FLASH_KEYS_H_
+#define FLASH_KEYS_H_
+
+#include "conf_board.h"
+#include "cardman/cards_manager.h"
+
+/*! \brief Bank value of the header if the flash holds no keys */
+#define FLASH_KEYS_NO_BANK         0xff
+
+#ifdef CONF_CARDMAN_FLASH_KEYS
+
+#ifndef FLASH_KEYS_START
+/*! \brief Flash address of bank 0, must be page aligned */
+# define FLASH_KEYS_START          APPTABLE_SECTION_START
+#endif
+
+#ifndef FLASH_KEYS_BANK_SIZE
+/*! \brief Size of one bank, a multiple of FLASH_PAGE_SIZE */
+# define FLASH_KEYS_BANK_SIZE      (APPTABLE_SECTION_SIZE / 2)
+#endif
+
+/*! \brief Size of one record */
+#define FLASH_KEYS_RECORD_SIZE     8
+
+/*! \brief Longest UID stored in the flash */
+#define FLASH_KEYS_MAX_UID_LENGTH  (FLASH_KEYS_RECORD_SIZE - 1)
+
+/*! \brief Number of keys per bank */
+#define FLASH_KEYS_PER_BANK        (FLASH_KEYS_BANK_SIZE / FLASH_KEYS_RECORD_SIZE)
+
+/*! \brief One record of a bank */
+struct flash_key_record {
+	u8 len;
+	u8 uid[FLASH_KEYS_MAX_UID_LENGTH];
+};
+
+/*!
+ * \brief Reads the key with the given index of a bank
+ * \param bank 0 or 1.
+ * \param index Index of the key.
+ * \param card Key read.
+ */
+extern void flashKeysRead (u8 bank, u16 index, struct card_entry *card);
+
+/*!
+ * \brief Binary search in a bank
+ * \param bank 0 or 1.
+ * \param nkeys Number of keys in the bank.
+ * \param uid UID to search for.
+ * \param len Length of uid.
+ * \return TRUE if the key is in the bank, else FALSE.
+ */
+extern bool_t flashKeysFind (u8 bank, u16 nkeys, const u8 *uid, u8 len);
+
+/*!
+ * \brief Starts writing a new table into a bank
+ * \param bank 0 or 1.
+ *
+ * The keys have to be written in ascending order with #flashKeysWrite.
+ * The EEPROM must not be written until #flashKeysWriteEnd.
+ */
+extern void flashKeysWriteBegin (u8 bank);
+
+/*!
+ * \brief Appends a key to the table started by #flashKeysWriteBegin
+ * \param card Key, at most FLASH_KEYS_MAX_UID_LENGTH bytes.
+ * \return ERR_NO_MEMORY if the bank is full, else ERR_NONE.
+ */
+extern s8 flashKeysWrite (const struct card_entry *card);
+
+/*!
+ * \brief Writes the last page of the table
+ * \return Number of keys in the table.
+ */
+extern u16 flashKeysWriteEnd (void);
+
+#endif /* CONF_CARDMAN_FLASH_KEYS */
+
+#endif /* FLASH_KEYS_H_ */
@@ -12,4 +12,40 @@
 #define CONF_ENABLE_DBG_UART
 #define DBG_UART_BUFFER_LENGTH 256
 
+/* Record blocking waits and main state latencies (uses TCC1, see utils/wait_trace.h) */
+//#define CONF_ENABLE_WAIT_TRACE
+
+/* Account time and charge per main state, sleep mode and load (see utils/energy.h) */
+//#define CONF_ENABLE_ENERGY_TRACE
+
+/* Store the card database as a wear-levelled record log (see cardman/card_log.h).
+ * Migrates a version 1 database on the first start. */
+//#define CONF_CARDMAN_LOG_STORE
+
+/* Delete all keys by bumping the key generation in the header and erase the
+ * old key pages while idle (see cardmanEraseStalePage). */
+//#define CONF_CARDMAN_LAZY_ERASE
+
+/* Write the card database pages from the NVM EEPROM interrupt instead of
+ * waiting for each page (see cardman/eeprom_queue.h). */
+//#define CONF_EEPROM_WRITE_QUEUE
+
+/* Keep the key cards in a sorted table in the application table section of
+ * the flash; the EEPROM key pages only hold the changes since the last merge
+ * (see cardman/flash_keys.h). Not together with CONF_CARDMAN_LOG_STORE. */
+//#define CONF_CARDMAN_FLASH_KEYS
+
+/* Keep a write-through copy of the AS3911 configuration registers, so reading
+ * them and unchanged modifies need no SPI transaction (see as3911_com.h). */
+//#define CONF_AS3911_SHADOW_REGS
+
+/* Shift the AS3911 FIFO data from the SPI interrupt and sleep meanwhile
+ * instead of polling every byte (see spiTxRxStart in spi_driver.h). */
+//#define CONF_SPI_ASYNC
+
+/* Run the RF transactions of a scan from the 32 MHz RC oscillator and the
+ * rest from 2 MHz; delay timer, UART and SPI follow the switches (see
+ * clkSetProfile in clock.h). */
+//#define CONF_CLOCK_PROFILE
+
 #endif // CONF_BOARD_H
@@ -20,7 +20,9 @@
 #include "delay_wrapper.h"
 #include "sorex_hal/Communication/Rfid.h"
 #include "utils/debug.h"
-#include "utils/reschedule.h"
+#include "utils/soft_timer.h"
+#include "utils/wait_trace.h"
+#include "utils/energy.h"
 #include "buzzer/sounds.h"
 #include "cardman/cards_manager.h"
 #include "application/application.h"
@@ -197,8 +199,9 @@ static void AppInitialize (void)
 	icInitialize();
 	uartInitialize(115200, NULL);
 	delayInitialize();
-	err = rsched_init(TC_CLKSEL_DIV1024_gc);
-	DLOG("[rsched] Initialize returned %hhd\r\n", err);
+	waitTraceInit();
+	energyInit();
+	softTimerInit();
 
 	err = SoundsInitialize();
 	DLOG ("[buzzer] Initialize returned %hhd\r\n", err);
@@ -11,7 +11,9 @@
  */
 #include <asf.h>
 #include "sorex_hal/Communication/Rfid.h"
+#include "sorex_hal/Communication/RfidPolicy.h"
 #include "spi_driver.h"
+#include "clock.h"
 #include "ic.h"
 #include "delay_wrapper.h"
 #include "as3911.h"
@@ -19,6 +21,7 @@
 #include "iso14443a.h"
 #include "iso14443b.h"
 #include "as3911_hw_config.h"
+#include "utils/counter.h"
 
 /*! \brief Describes the state of Unit1 */
 enum Unit1State
@@ -40,6 +43,10 @@ struct Unit1InfoStruct
 	volatile enum Unit1State State;
 	/*! TRUE during a scan as long as #RfidStopScan() hasn't been called */
 	volatile bool_t StoppingScan;
+	/*! Number of cards read by the last scan */
+	u8 TagsFound;
+	/*! TRUE if the last scan ended on the no response limit of its policy */
+	bool_t GaveUp;
 
 	union {
 		iso14443AProximityCard_t card_a;
@@ -51,6 +58,18 @@ struct Unit1InfoStruct
 /*! \brief Information structure of Unit1 */
 static struct Unit1InfoStruct Unit1Info;
 
+#ifdef CONF_CLOCK_PROFILE
+/*!
+ * \brief Switches the clock profile around the RF transactions of a scan
+ *
+ * A refused switch (ERR_BUSY, e.g. while the buzzer plays) leaves the clock
+ * as it is, the scan works at either clock.
+ */
+# define UNIT1_CLOCK_PROFILE(profile) clkSetProfile (profile)
+#else
+# define UNIT1_CLOCK_PROFILE(profile) do { } while (0)
+#endif
+
 /*!
  * \brief Initializes Unit1 (AS3911 stack)
  *
@@ -79,14 +98,27 @@ static s8 unit1Deinitialize (void);
  *                 in the source code) that use the same callback functions.
  * \param callback Callback function that will be called for every card that
  *                 has been found.
+ * \param policy   Number of attempts, delay between them and when to give up.
  * \return Error code if an enumeration is currently running, or if some error
  *         in the as3911 stack has occured, else ERR_NONE.
  *
  * This functions will wake up all cards in range and try to enumerate them.
- * It tries to select a card #RFID_UNIT1_MAX_SCAN_ATTEMPTS times. Everytime a card
- * is found, it starts over again - until all cards have been found.
+ * It tries to select a card \a policy->Attempts times. Everytime a card is
+ * found, it starts over again with \a policy->PollsAfterTag attempts - until
+ * all cards have been found. With \a policy->NreLimit set, the scan ends
+ * early after that many polls in a row nothing answered.
  */
-static s8 unit1StartScan (byte scanId, RfidScanFinishedCallback callback);
+static s8 unit1StartScan (byte scanId, RfidScanFinishedCallback callback,
+                          const struct RfidScanPolicy *policy);
+
+/*! \brief Policy of #RfidStartScan */
+static const struct RfidScanPolicy default_policy = {
+	.Attempts = RFID_UNIT1_MAX_SCAN_ATTEMPTS,
+	.PollsAfterTag = RFID_UNIT1_MAX_SCAN_ATTEMPTS,
+	.DelayMs = 5,
+	.NreLimit = 0,
+	.Class = RfidPolicyStrong
+};
 
 
 Status RfidInitialize (UnitId unitId, RfidInitializedCallBack callback)
@@ -212,7 +244,33 @@ Status RfidStartScan (UnitId unitId,
 
 	switch (unitId) {
 	case RFID_UNIT_1:
-		err = unit1StartScan (scanId, scanFinishedCallback);
+		err = unit1StartScan (scanId, scanFinishedCallback, &default_policy);
+		break;
+
+	default:
+		err = ERR_PARAM;
+	}
+
+	return err;
+}
+
+Status RfidStartScanFast (UnitId unitId,
+                          byte scanId,
+                          byte pollsAfterTag,
+                          RfidScanFinishedCallback scanFinishedCallback)
+{
+	struct RfidScanPolicy policy;
+	s8 err;
+
+	switch (unitId) {
+	case RFID_UNIT_1:
+		if (unlikely (pollsAfterTag == 0)) {
+			err = ERR_PARAM;
+			break;
+		}
+		policy = default_policy;
+		policy.PollsAfterTag = pollsAfterTag;
+		err = unit1StartScan (scanId, scanFinishedCallback, &policy);
 		break;
 
 	default:
@@ -222,9 +280,36 @@ Status RfidStartScan (UnitId unitId,
 	return err;
 }
 
-static s8 unit1StartScan (byte scanId, RfidScanFinishedCallback callback)
+Status RfidStartScanPolicy (UnitId unitId,
+                            byte scanId,
+                            const struct RfidScanPolicy *policy,
+                            RfidScanFinishedCallback scanFinishedCallback)
 {
-	u8 count = RFID_UNIT1_MAX_SCAN_ATTEMPTS;
+	s8 err;
+
+	switch (unitId) {
+	case RFID_UNIT_1:
+		if (unlikely (policy->Attempts == 0 || policy->PollsAfterTag == 0)) {
+			err = ERR_PARAM;
+			break;
+		}
+		err = unit1StartScan (scanId, scanFinishedCallback, policy);
+		if (err == ERR_NONE)
+			RfidPolicyRecord (policy, Unit1Info.TagsFound, Unit1Info.GaveUp);
+		break;
+
+	default:
+		err = ERR_PARAM;
+	}
+
+	return err;
+}
+
+static s8 unit1StartScan (byte scanId, RfidScanFinishedCallback callback,
+                          const struct RfidScanPolicy *policy)
+{
+	u8 count = policy->Attempts;
+	u8 nre = 0;
 	s8 err;
 
 	if (unlikely (Unit1Info.State != Unit1StateReady)) {
@@ -235,17 +320,25 @@ static s8 unit1StartScan (byte scanId, RfidScanFinishedCallback callback)
 	/* Stopping is only valid during a scan operation! */
 	Unit1Info.StoppingScan = false;
 	Unit1Info.State = Unit1StateScanning;
+	Unit1Info.TagsFound = 0;
+	Unit1Info.GaveUp = false;
 
+	UNIT1_CLOCK_PROFILE (CLK_PROFILE_RF);
 	err = iso14443AInitialize ();
-	EVAL_ERR_NE_GOTO (err, ERR_NONE, out_no_cleanup);
+	UNIT1_CLOCK_PROFILE (CLK_PROFILE_IDLE);
+	EVAL_ERR_NE_GOTO (err, ERR_NONE, out_clock);
 
 	delayNMilliSeconds (5);
 
 	/* Wake cards! */
+	UNIT1_CLOCK_PROFILE (CLK_PROFILE_RF);
 	err = iso14443ASelect (ISO14443A_CMD_WUPA, &Unit1Info.card_a);
+	UNIT1_CLOCK_PROFILE (CLK_PROFILE_IDLE);
 	while (1) {
 		if (err == ERR_NONE) {
-			count = RFID_UNIT1_MAX_SCAN_ATTEMPTS;
+			count = policy->PollsAfterTag;
+			nre = 0;
+			counterInc8 (&Unit1Info.TagsFound);
 			callback (RFID_UNIT_1, scanId, &Unit1Info.card_a);
 			/* TODO: What should be done with the error code ????
 			 *       RfidScanFinishedCallback lacks documentation!
@@ -253,11 +346,22 @@ static s8 unit1StartScan (byte scanId, RfidScanFinishedCallback callback)
 			 *       done by this function?
 			 */
 
+			UNIT1_CLOCK_PROFILE (CLK_PROFILE_RF);
 			err = iso14443ASendHlta ();
+			UNIT1_CLOCK_PROFILE (CLK_PROFILE_IDLE);
 			EVAL_ERR_NE_GOTO (err, ERR_NONE, out_deinit_protocol);
 		} else {
-			--count;
-			delayNMilliSeconds (5);
+			/* Nothing answered at all, not even with a collision */
+			if (err != ERR_TIMEOUT)
+				nre = 0;
+			else if (++nre == policy->NreLimit) {
+				Unit1Info.GaveUp = true;
+				count = 1;
+			}
+
+			/* No need to wait after the last attempt */
+			if (--count)
+				delayNMilliSeconds (policy->DelayMs);
 		}
 
 		if ((count == 0) || Unit1Info.StoppingScan) {
@@ -265,7 +369,9 @@ static s8 unit1StartScan (byte scanId, RfidScanFinishedCallback callback)
 		}
 
 		/* Only check cards that haven't been read */
+		UNIT1_CLOCK_PROFILE (CLK_PROFILE_RF);
 		err = iso14443ASelect (ISO14443A_CMD_REQA, &Unit1Info.card_a);
+		UNIT1_CLOCK_PROFILE (CLK_PROFILE_IDLE);
 	}
 
 	err = ERR_NONE;
@@ -274,6 +380,9 @@ out_deinit_protocol:
 	iso14443ADeinitialize (0);
 	Unit1Info.State = Unit1StateReady;
 
+out_clock:
+	UNIT1_CLOCK_PROFILE (CLK_PROFILE_SLEEP);
+
 out_no_cleanup:
 	return err;
 }
@@ -9,6 +9,7 @@
 
 #include "sorex_hal/Core/Types.h"
 #include "sorex_hal/Core/Result.h"
+#include "sorex_hal/Communication/RfidPolicy.h"
 
 /** \brief First AS3911 unit */
 #define RFID_UNIT_1             0
@@ -84,6 +85,54 @@ Status RfidStartScan (UnitId unitId,
                       byte scanId,
                       RfidScanFinishedCallback scanFinishedCallback);
 
+/**
+ * \brief Starts scanning for RFID tags, returns soon after a tag was found.
+ *
+ * Like \see RfidStartScan, but once a tag has been read the scan ends after
+ * \a pollsAfterTag polls without an answer instead of the full number of
+ * attempts. Every poll still wakes tags not read yet, so several tags in
+ * the field are reported as with \see RfidStartScan.
+ *
+ * \param unitId Implementation/hardware specific identifier of the
+ *               <b>RFID</b> unit.
+ * \param scanId Identifier for the scanning process
+ * \param pollsAfterTag Polls without an answer after the last tag found
+ *                      before the scan ends (at least 1).
+ * \param scanFinishedCallback Function called when the hardware finished
+ *                             scanning.
+ *
+ * \return Hardware specific return value. Should return S_OK if the operation
+ *         succeeded, otherwise a negative value describing the cause of the
+ *         problem.
+ */
+Status RfidStartScanFast (UnitId unitId,
+                          byte scanId,
+                          byte pollsAfterTag,
+                          RfidScanFinishedCallback scanFinishedCallback);
+
+/**
+ * \brief Starts scanning for RFID tags with a retry policy.
+ *
+ * Like \see RfidStartScan, but the number of polls, the delay between them
+ * and when to give up are taken from \a policy (see \see RfidPolicySelect).
+ * The scan is counted in the statistics of the policy.
+ *
+ * \param unitId Implementation/hardware specific identifier of the
+ *               <b>RFID</b> unit.
+ * \param scanId Identifier for the scanning process
+ * \param policy Retry policy of the scan.
+ * \param scanFinishedCallback Function called when the hardware finished
+ *                             scanning.
+ *
+ * \return Hardware specific return value. Should return S_OK if the operation
+ *         succeeded, otherwise a negative value describing the cause of the
+ *         problem.
+ */
+Status RfidStartScanPolicy (UnitId unitId,
+                            byte scanId,
+                            const struct RfidScanPolicy *policy,
+                            RfidScanFinishedCallback scanFinishedCallback);
+
 /**
  * \brief Stops/interrupts scanning for RFID tags.
  *
@@ -0,0 +1,52 @@
+/*!
+ * \file RfidPolicy.c
+ * \brief Retry policy of the wake-up scan, see RfidPolicy.h
+ */
+#include "sorex_hal/Communication/RfidPolicy.h"
+#include "as3911_hw_config.h"
+#include "utils/counter.h"
+#include "utils/debug.h"
+
+/*! \brief Statistics per policy class */
+static struct RfidPolicyStats stats[RFID_POLICY_CLASSES];
+
+void RfidPolicySelect (enum RfidWakeReason reason, u8 delta,
+                       bool_t card_like, struct RfidScanPolicy *policy)
+{
+	u8 strong = (reason == RfidWakePhase) ? RFID_POLICY_PHASE_STRONG_DELTA
+	                                      : RFID_POLICY_CAPACITANCE_STRONG_DELTA;
+
+	policy->DelayMs = RFID_POLICY_DELAY_MS;
+
+	if (card_like || (delta >= strong)) {
+		policy->Attempts = RFID_UNIT1_MAX_SCAN_ATTEMPTS;
+		policy->PollsAfterTag = RFID_UNIT1_MAX_SCAN_ATTEMPTS;
+		policy->NreLimit = 0;
+		policy->Class = RfidPolicyStrong;
+	} else {
+		policy->Attempts = RFID_POLICY_MARGINAL_ATTEMPTS;
+		policy->PollsAfterTag = RFID_POLICY_MARGINAL_ATTEMPTS;
+		policy->NreLimit = RFID_POLICY_MARGINAL_NRE_LIMIT;
+		policy->Class = RfidPolicyMarginal;
+	}
+}
+
+void RfidPolicyRecord (const struct RfidScanPolicy *policy, u8 tags,
+                       bool_t gave_up)
+{
+	struct RfidPolicyStats *s = &stats[policy->Class];
+
+	counterInc16 (&s->Scans);
+	if (tags)
+		counterInc16 (&s->Hits);
+	else if (gave_up)
+		counterInc16 (&s->GaveUp);
+
+	DLOG("Scan policy %hu: %hu cards, scans %u, hits %u, gave up %u\r\n",
+	     (u16)policy->Class, (u16)tags, s->Scans, s->Hits, s->GaveUp);
+}
+
+const struct RfidPolicyStats *RfidPolicyGetStats (enum RfidPolicyClass cls)
+{
+	return &stats[cls];
+}
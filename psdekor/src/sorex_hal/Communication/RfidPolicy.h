@@ -0,0 +1,116 @@
+/*!
+ * \file RfidPolicy.h
+ * \brief Retry policy of the wake-up scan
+ *
+ * After the AS3911 woke the MCU, the application measures how far the
+ * phase (or capacitance) moved away from the reference of the wake-up
+ * timer. A large change means a card is in the field, so the scan polls as
+ * long as a normal scan. A change just above the wake-up threshold is
+ * usually noise: the scan polls fewer times and gives up as soon as several
+ * polls in a row ended with a clean no response timeout (nothing answered,
+ * not even with a collision).
+ *
+ * Every scan started with #RfidStartScanPolicy is counted per policy class,
+ * the counters are printed with the debug log so the thresholds can be tuned
+ * from field logs.
+ */
+
+#ifndef __RFID_POLICY_H
+#define __RFID_POLICY_H
+
+#include "platform.h"
+
+#ifndef RFID_POLICY_PHASE_STRONG_DELTA
+/*! \brief Phase change from the reference of a strong wake-up */
+# define RFID_POLICY_PHASE_STRONG_DELTA       5
+#endif
+
+#ifndef RFID_POLICY_CAPACITANCE_STRONG_DELTA
+/*! \brief Capacitance change from the reference of a strong wake-up */
+# define RFID_POLICY_CAPACITANCE_STRONG_DELTA 5
+#endif
+
+#ifndef RFID_POLICY_MARGINAL_ATTEMPTS
+/*! \brief Polls without a card before a marginal wake-up scan ends */
+# define RFID_POLICY_MARGINAL_ATTEMPTS        6
+#endif
+
+#ifndef RFID_POLICY_MARGINAL_NRE_LIMIT
+/*! \brief Clean no response timeouts in a row ending a marginal scan */
+# define RFID_POLICY_MARGINAL_NRE_LIMIT       3
+#endif
+
+#ifndef RFID_POLICY_DELAY_MS
+/*! \brief Delay between two polls (in milliseconds) */
+# define RFID_POLICY_DELAY_MS                 5
+#endif
+
+/*! \brief Source of the wake-up */
+enum RfidWakeReason
+{
+	RfidWakePhase,       /**< Phase measurement of the wake-up timer */
+	RfidWakeCapacitance  /**< Capacitance measurement of the wake-up timer */
+};
+
+/*! \brief Class of a policy, index of #RfidPolicyGetStats */
+enum RfidPolicyClass
+{
+	RfidPolicyStrong,    /**< Large change, a card is expected */
+	RfidPolicyMarginal,  /**< Change just above the wake-up threshold */
+	RFID_POLICY_CLASSES
+};
+
+/*! \brief Parameters of one scan */
+struct RfidScanPolicy
+{
+	/*! Polls without a card before the scan ends */
+	u8 Attempts;
+	/*! Polls without a card after a card has been read */
+	u8 PollsAfterTag;
+	/*! Delay between two polls (in milliseconds) */
+	u8 DelayMs;
+	/*! Clean no response timeouts in a row ending the scan, 0 = never */
+	u8 NreLimit;
+	/*! Class the scan is counted in */
+	enum RfidPolicyClass Class;
+};
+
+/*! \brief Statistics of a policy class */
+struct RfidPolicyStats
+{
+	/*! Scans started */
+	u16 Scans;
+	/*! Scans that read at least one card */
+	u16 Hits;
+	/*! Scans without a card that ended on the no response limit */
+	u16 GaveUp;
+};
+
+/*!
+ * \brief Selects the policy of a wake-up scan
+ * \param reason What woke the reader up.
+ * \param delta Difference of the measurement after the wake-up to the
+ *              reference of the wake-up timer.
+ * \param card_like TRUE if the qualification of the wake-up saw the
+ *                  signature of a card (RfidQualify.h), selects a strong scan.
+ * \param policy Policy selected.
+ */
+extern void RfidPolicySelect (enum RfidWakeReason reason, u8 delta,
+                              bool_t card_like, struct RfidScanPolicy *policy);
+
+/*!
+ * \brief Counts a finished scan
+ * \param policy Policy of the scan.
+ * \param tags Number of cards read.
+ * \param gave_up TRUE if the scan ended on the no response limit.
+ */
+extern void RfidPolicyRecord (const struct RfidScanPolicy *policy, u8 tags,
+                              bool_t gave_up);
+
+/*!
+ * \brief Returns the statistics of a policy class
+ * \param cls Class, less than RFID_POLICY_CLASSES.
+ */
+extern const struct RfidPolicyStats *RfidPolicyGetStats (enum RfidPolicyClass cls);
+
+#endif /* __RFID_POLICY_H */
@@ -0,0 +1,110 @@
+/*!
+ * \file RfidQualify.c
+ * \brief Qualification of a wake-up before the scan, see RfidQualify.h
+ */
+#include "sorex_hal/Communication/RfidQualify.h"
+#include "as3911.h"
+#include "as3911_com.h"
+#include "utils/counter.h"
+#include "utils/debug.h"
+
+/*! \brief References, valid after #RfidQualifyCalibrate */
+static struct RfidWakeSignature reference;
+static bool_t reference_valid = false;
+
+/*! \brief Verdicts given */
+static u16 stats[RFID_QUALIFY_VERDICTS];
+
+/*! \brief Distance of two measurements */
+static u8 distance (u8 a, u8 b)
+{
+	return (a > b) ? a - b : b - a;
+}
+
+/*!
+ * \brief Measures phase and amplitude (burst) and the capacitance
+ * \param sig Receives the means.
+ */
+static void measure_burst (struct RfidWakeSignature *sig)
+{
+	u16 phase_sum = 0;
+	u16 amplitude_sum = 0;
+	u8 phase;
+	u8 amplitude;
+	u8 i;
+
+	as3911ExecuteCommandAndGetResult (AS3911_CMD_MEASURE_CAPACITANCE,
+	                                  AS3911_REG_AD_RESULT, 100,
+	                                  &sig->Capacitance);
+
+	as3911WriteRegister (AS3911_REG_OP_CONTROL, AS3911_REG_OP_CONTROL_en);
+	for (i = 0; i < RFID_QUALIFY_BURST; ++i) {
+		as3911MeasureAntennaResonance (&phase);
+		as3911MeasureRF (&amplitude);
+		phase_sum += phase;
+		amplitude_sum += amplitude;
+	}
+	as3911WriteRegister (AS3911_REG_OP_CONTROL, 0);
+
+	sig->Phase = (phase_sum + RFID_QUALIFY_BURST / 2) / RFID_QUALIFY_BURST;
+	sig->Amplitude = (amplitude_sum + RFID_QUALIFY_BURST / 2) / RFID_QUALIFY_BURST;
+}
+
+void RfidQualifyCalibrate (void)
+{
+	u8 val;
+
+	as3911ExecuteCommandAndGetResult (AS3911_CMD_CALIBRATE_C_SENSOR,
+	                                  AS3911_REG_CAP_SENSOR_RESULT, 255, &val);
+	measure_burst (&reference);
+	reference_valid = true;
+
+	DLOG("Qualify reference: phase %hu, amplitude %hu, capacitance %hu\r\n",
+	     (u16)reference.Phase, (u16)reference.Amplitude,
+	     (u16)reference.Capacitance);
+}
+
+enum RfidQualifyVerdict RfidQualifyWake (u8 phase_ref,
+                                         struct RfidWakeSignature *sig)
+{
+	enum RfidQualifyVerdict verdict = RfidQualifyUnsure;
+	bool_t loaded;
+
+	measure_burst (sig);
+
+	if (reference_valid) {
+		loaded = (reference.Amplitude >= sig->Amplitude + RFID_QUALIFY_AMPLITUDE_LOAD);
+
+		if (loaded)
+			verdict = RfidQualifyCard;
+		else if (distance (sig->Capacitance, reference.Capacitance) >= RFID_QUALIFY_CAPACITANCE_HAND)
+			verdict = RfidQualifyHand;
+		else if ((distance (sig->Phase, phase_ref) < RFID_QUALIFY_PHASE_SETTLED) ||
+		         (distance (sig->Phase, reference.Phase) < RFID_QUALIFY_PHASE_SETTLED))
+			verdict = RfidQualifySettled;
+	}
+
+	counterInc16 (&stats[verdict]);
+
+	return verdict;
+}
+
+void RfidQualifyLearn (const struct RfidWakeSignature *sig)
+{
+	if (!reference_valid)
+		return;
+
+	reference.Phase = sig->Phase;
+	reference.Amplitude = sig->Amplitude;
+	reference.Capacitance = sig->Capacitance;
+}
+
+const struct RfidWakeSignature *RfidQualifyGetReference (void)
+{
+	return &reference;
+}
+
+u16 RfidQualifyGetStats (enum RfidQualifyVerdict verdict)
+{
+	return stats[verdict];
+}
@@ -0,0 +1,107 @@
+/*!
+ * \file RfidQualify.h
+ * \brief Qualification of a wake-up before the scan
+ *
+ * The wake-up timer only sees one quantity moving. Before a wake-up costs a
+ * scan, a short burst of phase and amplitude measurements and one
+ * capacitance measurement (the measurements of the test mode, see
+ * measure_all in main.c) are compared with references taken at start-up.
+ * The test mode shows the signatures:
+ *
+ * - a card loads the field: the amplitude drops together with the phase, the
+ *   capacitance hardly changes,
+ * - a hand changes the capacitance without loading the field,
+ * - a door slam or noise moves the phase only for a moment, and a hand or
+ *   card taken away leaves the empty field: at the burst the phase is back at
+ *   the reference of the wake-up timer or at the empty field.
+ *
+ * A card-like signature gets the full scan, settled antennas get none,
+ * everything else the scan selected by the phase change. A hand may hold a
+ * card at the edge of the range that hardly loads the field, so unless the
+ * phase moved like a card, it gets a scan of #RFID_QUALIFY_HAND_ATTEMPTS
+ * polls.
+ */
+
+#ifndef __RFID_QUALIFY_H
+#define __RFID_QUALIFY_H
+
+#include "platform.h"
+
+#ifndef RFID_QUALIFY_BURST
+/*! \brief Phase and amplitude measurements of a burst */
+# define RFID_QUALIFY_BURST                4
+#endif
+
+#ifndef RFID_QUALIFY_PHASE_SETTLED
+/*! \brief Phase change below which the antenna is back at a reference */
+# define RFID_QUALIFY_PHASE_SETTLED        2
+#endif
+
+#ifndef RFID_QUALIFY_AMPLITUDE_LOAD
+/*! \brief Amplitude drop of a card loading the field */
+# define RFID_QUALIFY_AMPLITUDE_LOAD       3
+#endif
+
+#ifndef RFID_QUALIFY_CAPACITANCE_HAND
+/*! \brief Capacitance change of a hand near the antenna */
+# define RFID_QUALIFY_CAPACITANCE_HAND     6
+#endif
+
+#ifndef RFID_QUALIFY_HAND_ATTEMPTS
+/*! \brief Polls of the scan of a hand with a marginal phase change */
+# define RFID_QUALIFY_HAND_ATTEMPTS        2
+#endif
+
+/*! \brief Result of a qualification, index of #RfidQualifyGetStats */
+enum RfidQualifyVerdict
+{
+	RfidQualifyCard,     /**< Signature of a card, full scan */
+	RfidQualifyUnsure,   /**< Scan selected by the phase change */
+	RfidQualifySettled,  /**< Antenna back at the reference, no scan */
+	RfidQualifyHand,     /**< Capacitance without field load, short scan */
+	RFID_QUALIFY_VERDICTS
+};
+
+/*! \brief Measurements of a burst (means) or the references of the empty field */
+struct RfidWakeSignature
+{
+	u8 Phase;
+	u8 Amplitude;
+	u8 Capacitance;
+};
+
+/*!
+ * \brief Calibrates the capacitive sensor and takes the references
+ *
+ * Call once with an empty field.
+ */
+extern void RfidQualifyCalibrate (void);
+
+/*!
+ * \brief Qualifies a wake-up
+ * \param phase_ref Phase reference, the auto-average of the wake-up timer
+ *                  if it measures the phase.
+ * \param sig Measurements of the burst.
+ * \return Verdict, the wake-up needs a scan unless #RfidQualifySettled.
+ */
+extern enum RfidQualifyVerdict RfidQualifyWake (u8 phase_ref,
+                                                struct RfidWakeSignature *sig);
+
+/*!
+ * \brief Takes a burst as references after nothing answered the scan
+ * \param sig Measurements of the burst.
+ */
+extern void RfidQualifyLearn (const struct RfidWakeSignature *sig);
+
+/*!
+ * \brief Returns the references
+ */
+extern const struct RfidWakeSignature *RfidQualifyGetReference (void);
+
+/*!
+ * \brief Returns how often a verdict has been given
+ * \param verdict Verdict, less than RFID_QUALIFY_VERDICTS.
+ */
+extern u16 RfidQualifyGetStats (enum RfidQualifyVerdict verdict);
+
+#endif /* __RFID_QUALIFY_H */
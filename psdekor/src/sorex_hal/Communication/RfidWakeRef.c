@@ -0,0 +1,116 @@
+/*!
+ * \file RfidWakeRef.c
+ * \brief Reference tracker of the wake-up timer, see RfidWakeRef.h
+ */
+#include "sorex_hal/Communication/RfidWakeRef.h"
+#include "utils/counter.h"
+#include "utils/debug.h"
+
+/*! \brief Weight of a new sample of the noise band (1 / 2^n) */
+#define NOISE_WEIGHT_SHIFT 2
+
+/*! \brief State of the tracker */
+static struct {
+	u8 baseline;            /*!< reference of the next re-arm */
+	u16 noise;              /*!< filtered spread, in 1/16 */
+	u8 cycles;              /*!< re-arms since the last measurement */
+	u8 wake_delta;          /*!< measurement that woke up to the average */
+	bool_t fresh;           /*!< baseline followed the last sleep */
+	bool_t valid;           /*!< baseline has been measured once */
+	bool_t card;            /*!< a card was read before the measurement */
+	bool_t card_armed;      /*!< the timer runs with such a baseline */
+} ref;
+
+static struct RfidWakeRefStats stats;
+
+/*! \brief Filters a difference to the reference into the noise band */
+static void add_noise (u8 delta)
+{
+	s16 diff = (s16)((u16)delta << 4) - (s16)ref.noise;
+
+	ref.noise += diff >> NOISE_WEIGHT_SHIFT;
+}
+
+bool_t RfidWakeRefNeedsMeasurement (void)
+{
+	return !ref.valid || !ref.fresh ||
+	       (ref.cycles >= RFID_WAKE_REF_CALIBRATE_CYCLES);
+}
+
+void RfidWakeRefMeasured (u8 value)
+{
+	/* a calibration shows how far the tracked baseline was off */
+	if (ref.valid && ref.fresh)
+		add_noise ((value > ref.baseline) ? value - ref.baseline
+		                                  : ref.baseline - value);
+
+	ref.baseline = value;
+	ref.cycles = 0;
+	ref.valid = true;
+	ref.card_armed = ref.card;
+	ref.card = false;
+	counterInc16 (&stats.Measurements);
+}
+
+u8 RfidWakeRefArm (void)
+{
+	ref.fresh = false;
+	counterInc8 (&ref.cycles);
+	counterInc16 (&stats.Arms);
+
+	return ref.baseline;
+}
+
+u8 RfidWakeRefThreshold (void)
+{
+	u16 delta = 1 + (ref.noise * RFID_WAKE_REF_NOISE_GAIN + 15) / 16;
+
+	if (delta < RFID_WAKE_REF_MIN_DELTA)
+		return RFID_WAKE_REF_MIN_DELTA;
+	if (delta > RFID_WAKE_REF_MAX_DELTA)
+		return RFID_WAKE_REF_MAX_DELTA;
+	return delta;
+}
+
+void RfidWakeRefTracked (u8 average, u8 last)
+{
+	ref.card_armed = false;
+	add_noise ((last > average) ? last - average : average - last);
+	ref.baseline = average;
+	ref.fresh = true;
+}
+
+void RfidWakeRefWoke (u8 average, u8 last)
+{
+	counterInc16 (&stats.Wakes);
+	ref.wake_delta = (last > average) ? last - average : average - last;
+}
+
+void RfidWakeRefFalseWake (u8 value)
+{
+	/* the card may still have been in the field when the baseline was measured */
+	if (ref.card_armed) {
+		counterInc16 (&stats.CardLeft);
+	} else {
+		counterInc16 (&stats.FalseWakes);
+		add_noise (ref.wake_delta);
+	}
+	ref.baseline = value;
+	ref.fresh = true;
+	ref.card_armed = false;
+
+	DLOG("Wake-up reference %hu, threshold %hu, false wake-ups %u of %u\r\n",
+	     (u16)ref.baseline, (u16)RfidWakeRefThreshold (), stats.FalseWakes,
+	     stats.Wakes);
+}
+
+void RfidWakeRefInvalidate (void)
+{
+	ref.fresh = false;
+	ref.card = true;
+}
+
+const struct RfidWakeRefStats *RfidWakeRefGetStats (void)
+{
+	return &stats;
+}
@@ -0,0 +1,118 @@
+/*!
+ * \file RfidWakeRef.h
+ * \brief Reference tracker of the wake-up timer
+ *
+ * The wake-up timer of the AS3911 compares every measurement with a
+ * reference and wakes the MCU if they differ by more than a threshold.
+ * Instead of measuring a fresh reference before every sleep, the tracker
+ * keeps a baseline across wake-ups:
+ *
+ * - after a sleep without a wake-up of the timer, the auto-average of the
+ *   timer (which followed the slow drift while the MCU slept) becomes the
+ *   baseline,
+ * - after a false wake-up (nothing answered the scan), the measurement taken
+ *   after the wake-up does, so a step of the environment (metal door,
+ *   temperature) is absorbed after one false wake-up,
+ * - after a card has been read or when nothing is known, the next re-arm
+ *   measures; every #RFID_WAKE_REF_CALIBRATE_CYCLES re-arms it measures
+ *   anyway. The wake-up caused by taking the card away isn't counted as a
+ *   false wake-up.
+ *
+ * The spread of the measurements around the auto-average is filtered into a
+ * noise band, the threshold of the timer follows it between
+ * #RFID_WAKE_REF_MIN_DELTA and #RFID_WAKE_REF_MAX_DELTA.
+ */
+
+#ifndef __RFID_WAKE_REF_H
+#define __RFID_WAKE_REF_H
+
+#include "platform.h"
+
+#ifndef RFID_WAKE_REF_MIN_DELTA
+/*! \brief Smallest threshold of the wake-up timer */
+# define RFID_WAKE_REF_MIN_DELTA       3
+#endif
+
+#ifndef RFID_WAKE_REF_MAX_DELTA
+/*! \brief Largest threshold, a card at the edge of the range must exceed it */
+# define RFID_WAKE_REF_MAX_DELTA       6
+#endif
+
+#ifndef RFID_WAKE_REF_NOISE_GAIN
+/*! \brief Threshold above the reference in multiples of the noise band */
+# define RFID_WAKE_REF_NOISE_GAIN      2
+#endif
+
+#ifndef RFID_WAKE_REF_CALIBRATE_CYCLES
+/*! \brief Re-arms with the tracked reference before one is measured again */
+# define RFID_WAKE_REF_CALIBRATE_CYCLES 64
+#endif
+
+/*! \brief Counters of the tracker, FalseWakes / Wakes is the false wake-up rate */
+struct RfidWakeRefStats
+{
+	/*! Re-arms of the wake-up timer */
+	u16 Arms;
+	/*! Re-arms that measured the reference */
+	u16 Measurements;
+	/*! Wake-ups of the timer */
+	u16 Wakes;
+	/*! Wake-ups of the timer without a card */
+	u16 FalseWakes;
+	/*! Wake-ups without a card after a baseline measured right after a card
+	 *  had been read: the card has been taken away */
+	u16 CardLeft;
+};
+
+/*!
+ * \brief Returns TRUE if the next re-arm has to measure the reference
+ */
+extern bool_t RfidWakeRefNeedsMeasurement (void);
+
+/*!
+ * \brief Sets the baseline to a measurement taken to re-arm the timer
+ * \param value Measurement.
+ */
+extern void RfidWakeRefMeasured (u8 value);
+
+/*!
+ * \brief Returns the reference for the next re-arm and counts it
+ */
+extern u8 RfidWakeRefArm (void);
+
+/*!
+ * \brief Returns the threshold of the wake-up timer (0 .. 15)
+ */
+extern u8 RfidWakeRefThreshold (void);
+
+/*!
+ * \brief Follows the timer after a sleep it didn't end
+ * \param average Auto-average of the timer.
+ * \param last Last measurement of the timer.
+ */
+extern void RfidWakeRefTracked (u8 average, u8 last);
+
+/*!
+ * \brief Counts a wake-up of the timer
+ * \param average Auto-average of the timer.
+ * \param last Measurement that woke the MCU up.
+ */
+extern void RfidWakeRefWoke (u8 average, u8 last);
+
+/*!
+ * \brief Takes over the environment after a wake-up nothing answered
+ * \param value Measurement after the wake-up.
+ */
+extern void RfidWakeRefFalseWake (u8 value);
+
+/*!
+ * \brief Marks the baseline as stale, a card has been in the field
+ */
+extern void RfidWakeRefInvalidate (void);
+
+/*!
+ * \brief Returns the counters of the tracker
+ */
+extern const struct RfidWakeRefStats *RfidWakeRefGetStats (void);
+
+#endif /* __RFID_WAKE_REF_H */
@@ -0,0 +1,89 @@
+/*!
+ * \file RfidWakeSchedule.c
+ * \brief Period of the wake-up timer from the usage, see RfidWakeSchedule.h
+ */
+#include "sorex_hal/Communication/RfidWakeSchedule.h"
+#include "utils/counter.h"
+#include "utils/debug.h"
+
+/*! \brief State of the schedule */
+static struct {
+	u8 score[RFID_WAKE_SCHEDULE_SLOTS]; /*!< cards per slot, decaying per day */
+	u8 slot;                /*!< current slot */
+	u8 seen;                /*!< slots ended since power-up, up to a day */
+	u8 cards;               /*!< cards read in the current slot */
+} sched;
+
+static struct RfidWakeScheduleStats stats;
+
+/*! \brief Score of the cards read in the current slot */
+static u8 current_score (void)
+{
+	u16 score = (u16)sched.cards * RFID_WAKE_SCHEDULE_CARD_SCORE;
+
+	return (score > 0xff) ? 0xff : (u8)score;
+}
+
+/*! \brief Load of the current slot */
+static enum RfidWakeLoad load (void)
+{
+	u8 next = (sched.slot + 1) % RFID_WAKE_SCHEDULE_SLOTS;
+	u8 score = current_score ();
+
+	if (sched.seen >= RFID_WAKE_SCHEDULE_SLOTS) {
+		if (sched.score[sched.slot] > score)
+			score = sched.score[sched.slot];
+		if (sched.score[next] > score)
+			score = sched.score[next];
+		if (score == 0)
+			return RfidWakeQuiet;
+	}
+
+	return (score >= RFID_WAKE_SCHEDULE_BUSY) ? RfidWakeBusy : RfidWakeNormal;
+}
+
+enum RfidWakeLoad RfidWakeScheduleNextSlot (void)
+{
+	u8 *score = &sched.score[sched.slot];
+	u8 today = current_score ();
+	enum RfidWakeLoad l;
+
+	*score -= (*score + 3) >> 2;
+	*score = (*score > 0xff - today) ? 0xff : *score + today;
+
+	sched.cards = 0;
+	sched.slot = (sched.slot + 1) % RFID_WAKE_SCHEDULE_SLOTS;
+	if (sched.seen < RFID_WAKE_SCHEDULE_SLOTS)
+		++sched.seen;
+	l = load ();
+	counterInc16 (&stats.Slots[l]);
+
+	DLOG("Wake-up slot %hu, score %hu, load %hu\r\n", (u16)sched.slot,
+	     (u16)sched.score[sched.slot], (u16)l);
+
+	return l;
+}
+
+void RfidWakeScheduleCard (void)
+{
+	counterInc8 (&sched.cards);
+	counterInc16 (&stats.Cards);
+}
+
+enum RfidWakeLoad RfidWakeScheduleArm (void)
+{
+	enum RfidWakeLoad l = load ();
+
+	counterInc16 (&stats.Arms[l]);
+	return l;
+}
+
+u8 RfidWakeScheduleSlot (void)
+{
+	return sched.slot;
+}
+
+const struct RfidWakeScheduleStats *RfidWakeScheduleGetStats (void)
+{
+	return &stats;
+}
@@ -0,0 +1,97 @@
+/*!
+ * \file RfidWakeSchedule.h
+ * \brief Period of the wake-up timer from the usage of the locker
+ *
+ * The wake-up timer of the AS3911 measures the antenna once per period; a
+ * short period answers a card sooner, a long one saves the measurements.
+ * The schedule splits the day (counted by the RTC from power-up, the
+ * locker has no wall clock) into #RFID_WAKE_SCHEDULE_SLOTS slots and learns
+ * how many wake-ups read a card in each of them. A slot whose score (and
+ * the score of the following slot, so the period is short before the
+ * people arrive) is
+ *
+ * - zero runs the long period: nobody tapped at that time for days,
+ * - at least #RFID_WAKE_SCHEDULE_BUSY runs the short period,
+ * - otherwise runs the normal period.
+ *
+ * A card read in the current slot lifts a quiet slot to the normal period
+ * at once. The first day, before every slot has been seen, runs the normal
+ * period. The score of a slot decays by a quarter per day, a single card
+ * keeps its slot out of the long period for about four days.
+ */
+
+#ifndef __RFID_WAKE_SCHEDULE_H
+#define __RFID_WAKE_SCHEDULE_H
+
+#include "platform.h"
+
+#ifndef RFID_WAKE_SCHEDULE_SLOTS
+/*! \brief Slots per day */
+# define RFID_WAKE_SCHEDULE_SLOTS     24
+#endif
+
+#ifndef RFID_WAKE_SCHEDULE_SLOT_MS
+/*! \brief Length of a slot (in milliseconds) */
+# define RFID_WAKE_SCHEDULE_SLOT_MS   U32_C(3600000)
+#endif
+
+#ifndef RFID_WAKE_SCHEDULE_CARD_SCORE
+/*! \brief Score of a card read in a slot */
+# define RFID_WAKE_SCHEDULE_CARD_SCORE 4
+#endif
+
+#ifndef RFID_WAKE_SCHEDULE_BUSY
+/*! \brief Score of a busy slot, two cards per slot and day in the long run */
+# define RFID_WAKE_SCHEDULE_BUSY      32
+#endif
+
+/*! \brief Usage of a slot, selects the period of the wake-up timer */
+enum RfidWakeLoad
+{
+	RfidWakeQuiet,       /**< Nobody taps, long period */
+	RfidWakeNormal,      /**< Normal period */
+	RfidWakeBusy,        /**< Peak hours, short period */
+	RFID_WAKE_LOADS
+};
+
+/*! \brief Counters of the schedule */
+struct RfidWakeScheduleStats
+{
+	/*! Slots started per load (enum RfidWakeLoad) */
+	u16 Slots[RFID_WAKE_LOADS];
+	/*! Re-arms of the wake-up timer per load */
+	u16 Arms[RFID_WAKE_LOADS];
+	/*! Wake-ups that read a card */
+	u16 Cards;
+};
+
+/*!
+ * \brief Ends the current slot and starts the next one
+ * \return Load of the new slot, the wake-up timer needs another period if it
+ *         changed.
+ *
+ * Call every #RFID_WAKE_SCHEDULE_SLOT_MS.
+ */
+extern enum RfidWakeLoad RfidWakeScheduleNextSlot (void);
+
+/*!
+ * \brief Counts a wake-up that read a card in the current slot
+ */
+extern void RfidWakeScheduleCard (void);
+
+/*!
+ * \brief Returns the load of the current slot and counts a re-arm
+ */
+extern enum RfidWakeLoad RfidWakeScheduleArm (void);
+
+/*!
+ * \brief Returns the current slot (0 .. RFID_WAKE_SCHEDULE_SLOTS - 1)
+ */
+extern u8 RfidWakeScheduleSlot (void);
+
+/*!
+ * \brief Returns the counters of the schedule
+ */
+extern const struct RfidWakeScheduleStats *RfidWakeScheduleGetStats (void);
+
+#endif /* __RFID_WAKE_SCHEDULE_H */
@@ -0,0 +1,35 @@
+/*
+ * counter.h
+ *
+ * Statistics counters that stop at their maximum instead of wrapping, so a
+ * long running locker reports "at least" rather than a small number.
+ */
+
+
+#ifndef COUNTER_H_
+#define COUNTER_H_
+
+#include "platform.h"
+
+/*! \brief Increments an 8 bit counter, saturated */
+static inline void counterInc8 (u8 *counter)
+{
+	if (*counter < U8_C(0xff))
+		++*counter;
+}
+
+/*! \brief Increments a 16 bit counter, saturated */
+static inline void counterInc16 (u16 *counter)
+{
+	if (*counter < U16_C(0xffff))
+		++*counter;
+}
+
+/*! \brief Increments a 32 bit counter, saturated */
+static inline void counterInc32 (u32 *counter)
+{
+	if (*counter < U32_C(0xffffffff))
+		++*counter;
+}
+
+#endif /* COUNTER_H_ */
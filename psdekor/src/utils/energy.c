@@ -0,0 +1,196 @@
+/*
+ * energy.c
+ *
+ * Energy accounting, see energy.h.
+ */
+
+#include "utils/energy.h"
+
+#ifdef CONF_ENABLE_ENERGY_TRACE
+
+#include <string.h>
+#include <asf.h>
+#include "as3911_com.h"
+#include "utils/debug.h"
+#include "utils/counter.h"
+
+static const u32 mode_ua[ENERGY_MODE_COUNT] = {
+	ENERGY_UA_ACTIVE, ENERGY_UA_IDLE, ENERGY_UA_PSAVE, ENERGY_UA_PDOWN
+};
+
+static const u32 mode_ua_32m[ENERGY_MODE_COUNT] = {
+	ENERGY_UA_ACTIVE_32M, ENERGY_UA_IDLE_32M, ENERGY_UA_PSAVE, ENERGY_UA_PDOWN
+};
+
+static const u32 load_ua[ENERGY_LOAD_COUNT] = {
+	ENERGY_UA_AS3911, ENERGY_UA_RF_FIELD, ENERGY_UA_MOTOR, ENERGY_UA_BUZZER,
+	ENERGY_UA_RC32M
+};
+
+static struct energy_summary s_sum;
+static trace_time_t s_last = 0;
+static u8 s_state = 0xff;     /* start-up, only in the totals */
+static u8 s_mode = ENERGY_MODE_ACTIVE;
+static u8 s_loads = 0;
+static bool_t s_fast = false;
+
+static void bucket_add (struct energy_bucket *b, u32 dt, energy_charge_t charge)
+{
+	b->time_us += dt;
+	b->charge += charge;
+}
+
+/*! \brief Accounts the time since the last event, call with IRQs disabled */
+static void account (void)
+{
+	trace_time_t now = traceClockNow ();
+	u32 dt = now - s_last;
+	energy_charge_t charge;
+	energy_charge_t sum;
+	u8 i;
+
+	s_last = now;
+	if (!dt)
+		return;
+
+	sum = (energy_charge_t)(s_fast ? mode_ua_32m : mode_ua)[s_mode] * dt;
+	bucket_add (&s_sum.mode[s_mode], dt, sum);
+	if (s_fast)
+		bucket_add (&s_sum.fast, dt, sum);
+
+	for (i = 0; i < ENERGY_LOAD_COUNT; ++i) {
+		if (s_loads & (1 << i)) {
+			charge = (energy_charge_t)load_ua[i] * dt;
+			bucket_add (&s_sum.load[i], dt, charge);
+			sum += charge;
+		}
+	}
+
+	bucket_add (&s_sum.total, dt, sum);
+	if (s_state < ENERGY_STATES)
+		bucket_add (&s_sum.state[s_state], dt, sum);
+	s_sum.cycle += sum;
+}
+
+void energyInit (void)
+{
+	irqflags_t flags = cpu_irq_save ();
+
+	traceClockInit ();
+	memset (&s_sum, 0, sizeof s_sum);
+	s_last = traceClockNow ();
+	cpu_irq_restore (flags);
+}
+
+void energySetState (u8 state)
+{
+	irqflags_t flags = cpu_irq_save ();
+
+	account ();
+	s_state = state;
+	cpu_irq_restore (flags);
+}
+
+void energySetMode (u8 mode)
+{
+	irqflags_t flags = cpu_irq_save ();
+
+	account ();
+	s_mode = mode;
+	cpu_irq_restore (flags);
+}
+
+void energySetLoad (u8 load, bool_t on)
+{
+	irqflags_t flags = cpu_irq_save ();
+	u8 loads = on ? (s_loads | (1 << load)) : (s_loads & ~(1 << load));
+
+	if (loads != s_loads) {
+		account ();
+		s_loads = loads;
+	}
+	cpu_irq_restore (flags);
+}
+
+void energySetClock (bool_t fast)
+{
+	irqflags_t flags = cpu_irq_save ();
+
+	if (fast != s_fast) {
+		account ();
+		s_fast = fast;
+	}
+	cpu_irq_restore (flags);
+}
+
+void energySetOpControl (u8 op_control)
+{
+	bool_t en = (op_control & AS3911_REG_OP_CONTROL_en) != 0;
+
+	energySetLoad (ENERGY_LOAD_AS3911, en);
+	energySetLoad (ENERGY_LOAD_RF_FIELD,
+	               en && (op_control & AS3911_REG_OP_CONTROL_tx_en));
+}
+
+void energyWakeCycle (void)
+{
+	irqflags_t flags = cpu_irq_save ();
+
+	account ();
+	counterInc32 (&s_sum.cycles);
+	s_sum.last_cycle = s_sum.cycle;
+	if (s_sum.cycle > s_sum.max_cycle)
+		s_sum.max_cycle = s_sum.cycle;
+	s_sum.cycle = 0;
+	cpu_irq_restore (flags);
+}
+
+const struct energy_summary *energySummary (void)
+{
+	irqflags_t flags = cpu_irq_save ();
+
+	account ();
+	cpu_irq_restore (flags);
+
+	return &s_sum;
+}
+
+/*! \brief Charge in nanoampere hours */
+static unsigned long nah (energy_charge_t charge)
+{
+	return (unsigned long)(charge / (ENERGY_PC_PER_UAH / 1000));
+}
+
+static unsigned long ms (u64 time_us)
+{
+	return (unsigned long)(time_us / 1000);
+}
+
+void energyDump (void)
+{
+	const struct energy_summary *sum = energySummary ();
+	u8 i;
+
+	DLOG("[energy] total %lu ms %lu nAh, %lu cycles, last %lu nAh, max %lu nAh\r\n",
+	     ms (sum->total.time_us), nah (sum->total.charge),
+	     (unsigned long)sum->cycles, nah (sum->last_cycle),
+	     nah (sum->max_cycle));
+	for (i = 0; i < ENERGY_STATES; ++i) {
+		if (!sum->state[i].time_us)
+			continue;
+		DLOG("[energy] state %hhu %lu ms %lu nAh\r\n", i,
+		     ms (sum->state[i].time_us), nah (sum->state[i].charge));
+	}
+	for (i = 0; i < ENERGY_MODE_COUNT; ++i) {
+		DLOG("[energy] mode %hhu %lu ms %lu nAh\r\n", i,
+		     ms (sum->mode[i].time_us), nah (sum->mode[i].charge));
+	}
+	for (i = 0; i < ENERGY_LOAD_COUNT; ++i) {
+		DLOG("[energy] load %hhu %lu ms %lu nAh\r\n", i,
+		     ms (sum->load[i].time_us), nah (sum->load[i].charge));
+	}
+	DLOG("[energy] 32 MHz %lu ms %lu nAh\r\n",
+	     ms (sum->fast.time_us), nah (sum->fast.charge));
+}
+
+#endif /* CONF_ENABLE_ENERGY_TRACE */
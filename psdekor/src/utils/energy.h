@@ -0,0 +1,151 @@
+/*
+ * energy.h
+ *
+ * Energy accounting: integrates configurable current figures over the time
+ * spent in each main state, in each sleep mode and with each load (AS3911,
+ * RF field, motor, buzzer) switched on, and sums the charge per wake-up
+ * cycle.
+ *
+ * The accounting is only compiled in if CONF_ENABLE_ENERGY_TRACE is defined
+ * in conf_board.h. Otherwise all functions below are empty macros.
+ */
+
+
+#ifndef ENERGY_H_
+#define ENERGY_H_
+
+#include "conf_board.h"
+#include "ams_types.h"
+#include "utils/trace_clock.h"
+
+/*! \brief Sleep modes of the MCU */
+enum energy_mode {
+	ENERGY_MODE_ACTIVE,
+	ENERGY_MODE_IDLE,       /*!< SLEEP_CPU_LOCKED */
+	ENERGY_MODE_PSAVE,      /*!< PSAVE_MCU_LOCKED */
+	ENERGY_MODE_PDOWN,      /*!< PDOWN_MCU_LOCKED */
+	ENERGY_MODE_COUNT
+};
+
+/*! \brief Loads switched by the firmware */
+enum energy_load {
+	ENERGY_LOAD_AS3911,     /*!< AS3911_REG_OP_CONTROL_en (ready mode) */
+	ENERGY_LOAD_RF_FIELD,   /*!< AS3911_REG_OP_CONTROL_tx_en */
+	ENERGY_LOAD_MOTOR,
+	ENERGY_LOAD_BUZZER,
+	ENERGY_LOAD_RC32M,      /*!< 32 MHz RC oscillator (see clkSetProfile) */
+	ENERGY_LOAD_COUNT
+};
+
+#ifdef CONF_ENABLE_ENERGY_TRACE
+
+/*
+ * Current figures in microampere. The defaults are typical data sheet values
+ * of the ATxmega32A4U at 2 MHz, the AS3911 and the fitted parts; override
+ * them in conf_board.h with values measured on the board.
+ */
+#ifndef ENERGY_UA_ACTIVE
+# define ENERGY_UA_ACTIVE       800UL   /*!< MCU running, rest of the board */
+#endif
+#ifndef ENERGY_UA_IDLE
+# define ENERGY_UA_IDLE         300UL
+#endif
+#ifndef ENERGY_UA_ACTIVE_32M
+# define ENERGY_UA_ACTIVE_32M   10000UL /*!< same at 32 MHz (CONF_CLOCK_PROFILE) */
+#endif
+#ifndef ENERGY_UA_IDLE_32M
+# define ENERGY_UA_IDLE_32M     4000UL
+#endif
+#ifndef ENERGY_UA_PSAVE
+# define ENERGY_UA_PSAVE        5UL     /*!< incl. AS3911 wake-up mode */
+#endif
+#ifndef ENERGY_UA_PDOWN
+# define ENERGY_UA_PDOWN        2UL
+#endif
+#ifndef ENERGY_UA_AS3911
+# define ENERGY_UA_AS3911       4500UL
+#endif
+#ifndef ENERGY_UA_RF_FIELD
+# define ENERGY_UA_RF_FIELD     60000UL
+#endif
+#ifndef ENERGY_UA_MOTOR
+# define ENERGY_UA_MOTOR        150000UL
+#endif
+#ifndef ENERGY_UA_BUZZER
+# define ENERGY_UA_BUZZER       15000UL
+#endif
+#ifndef ENERGY_UA_RC32M
+# define ENERGY_UA_RC32M        435UL
+#endif
+
+#ifndef ENERGY_STATES
+/*! \brief Number of main states accounted separately */
+# define ENERGY_STATES 20
+#endif
+
+/*! \brief Charge in picocoulomb (microampere x microsecond) */
+typedef u64 energy_charge_t;
+
+/*! \brief Picocoulomb per microampere hour */
+#define ENERGY_PC_PER_UAH 3600000000ULL
+
+/*! \brief Time and charge of one bucket */
+struct energy_bucket {
+	u64 time_us;
+	energy_charge_t charge;
+};
+
+/*! \brief RAM summary of the accounting */
+struct energy_summary {
+	struct energy_bucket total;
+	struct energy_bucket state[ENERGY_STATES];      /*!< by enum MainState */
+	struct energy_bucket mode[ENERGY_MODE_COUNT];   /*!< base current only */
+	struct energy_bucket load[ENERGY_LOAD_COUNT];   /*!< time switched on */
+	struct energy_bucket fast;      /*!< base current at 32 MHz */
+	u32 cycles;                     /*!< completed wake-up cycles */
+	energy_charge_t cycle;          /*!< charge of the running cycle */
+	energy_charge_t last_cycle;
+	energy_charge_t max_cycle;
+};
+
+/*! \brief Starts the accounting (and the trace clock) */
+extern void energyInit (void);
+
+/*! \brief Accounts following time to a main state (enum MainState) */
+extern void energySetState (u8 state);
+
+/*! \brief Accounts following time to a sleep mode (enum energy_mode) */
+extern void energySetMode (u8 mode);
+
+/*! \brief Switches a load (enum energy_load) on or off */
+extern void energySetLoad (u8 load, bool_t on);
+
+/*! \brief Accounts following time to the 2 MHz or the 32 MHz CPU clock */
+extern void energySetClock (bool_t fast);
+
+/*! \brief Updates the AS3911 loads from a value written to AS3911_REG_OP_CONTROL */
+extern void energySetOpControl (u8 op_control);
+
+/*! \brief Ends the running wake-up cycle (called on every wake-up) */
+extern void energyWakeCycle (void);
+
+/*! \brief Accounts the time up to now and returns the summary */
+extern const struct energy_summary *energySummary (void);
+
+/*! \brief Writes the summary to the debug UART */
+extern void energyDump (void);
+
+#else
+
+# define energyInit() do { } while (0)
+# define energySetState(state) do { } while (0)
+# define energySetMode(mode) do { } while (0)
+# define energySetLoad(load, on) do { } while (0)
+# define energySetClock(fast) do { } while (0)
+# define energySetOpControl(op_control) do { } while (0)
+# define energyWakeCycle() do { } while (0)
+# define energyDump() do { } while (0)
+
+#endif /* CONF_ENABLE_ENERGY_TRACE */
+
+#endif /* ENERGY_H_ */
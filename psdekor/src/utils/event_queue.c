@@ -0,0 +1,76 @@
+/*
+ * event_queue.c
+ *
+ * Ring of the interrupt events, see event_queue.h.
+ */
+
+#include <asf.h>
+#include "utils/event_queue.h"
+#include "utils/counter.h"
+
+#if (EVENT_QUEUE_SIZE & (EVENT_QUEUE_SIZE - 1)) || (EVENT_QUEUE_SIZE > 128)
+# error "EVENT_QUEUE_SIZE must be a power of two up to 128"
+#endif
+
+#define EVENT_QUEUE_MASK (EVENT_QUEUE_SIZE - 1)
+
+static struct event s_events[EVENT_QUEUE_SIZE];
+
+/*! \brief Events posted, written by the producer only */
+static volatile u8 s_head = 0;
+
+/*! \brief Events taken, written by the consumer only */
+static volatile u8 s_tail = 0;
+
+static struct event_queue_stats s_stats;
+
+bool_t eventPost (u8 type, u8 arg)
+{
+	u8 head = s_head;
+	u8 queued = head - s_tail;
+	struct event *ev;
+
+	if (queued >= EVENT_QUEUE_SIZE) {
+		counterInc16 (&s_stats.dropped);
+		return false;
+	}
+
+	ev = &s_events[head & EVENT_QUEUE_MASK];
+	ev->type = type;
+	ev->arg = arg;
+	/* the entry must be complete before the consumer sees it */
+	barrier ();
+	s_head = head + 1;
+
+	counterInc16 (&s_stats.posted);
+	if (queued >= s_stats.peak)
+		s_stats.peak = queued + 1;
+
+	return true;
+}
+
+bool_t eventGet (struct event *ev)
+{
+	u8 tail = s_tail;
+
+	if (tail == s_head)
+		return false;
+
+	barrier ();
+	*ev = s_events[tail & EVENT_QUEUE_MASK];
+	/* the entry must be copied before the producer reuses it */
+	barrier ();
+	s_tail = tail + 1;
+
+	return true;
+}
+
+bool_t eventPending (void)
+{
+	return s_tail != s_head;
+}
+
+const struct event_queue_stats *eventQueueGetStats (void)
+{
+	return &s_stats;
+}
@@ -0,0 +1,80 @@
+/*
+ * event_queue.h
+ *
+ * Events of the interrupts for the main state machine. The interrupts post
+ * typed events into a ring, the main loop takes them out in the order they
+ * happened and sleeps while the ring is empty.
+ *
+ * The ring has a single producer and a single consumer and takes no lock:
+ * the producer only writes the head, the consumer only the tail, both are
+ * bytes. All producers are interrupts of the low level, which don't nest,
+ * so they are one producer; post from the main loop only with interrupts
+ * disabled. An event that doesn't fit is dropped and counted.
+ */
+
+
+#ifndef EVENT_QUEUE_H_
+#define EVENT_QUEUE_H_
+
+#include "platform.h"
+
+#ifndef EVENT_QUEUE_SIZE
+/*! \brief Entries of the ring, a power of two up to 128 */
+# define EVENT_QUEUE_SIZE 16
+#endif
+
+/*! \brief Events of the firmware */
+enum event_type {
+	EVENT_LEARN,        /*!< learn button pressed */
+	EVENT_DOOR,         /*!< door switch changed */
+	EVENT_TIMEOUT,      /*!< timeout of rtcStartINTR, arg: enum soft_timer */
+	EVENT_RF_WAKE_UP,   /*!< wake-up timer of the AS3911 fired */
+	EVENT_SCHEDULE,     /*!< slot of the wake-up schedule ended */
+	EVENT_TYPES
+};
+
+/*! \brief An event */
+struct event {
+	u8 type;            /*!< enum event_type */
+	u8 arg;             /*!< argument of the type */
+};
+
+/*! \brief Counters of the ring */
+struct event_queue_stats {
+	u16 posted;         /*!< events posted */
+	u16 dropped;        /*!< events lost to a full ring */
+	u8 peak;            /*!< most events queued at once */
+};
+
+/*!
+ * \brief Posts an event
+ * \param type enum event_type
+ * \param arg Argument of the type.
+ * \return FALSE if the ring is full and the event has been dropped.
+ *
+ * Call from interrupts of the low level or with interrupts disabled.
+ */
+extern bool_t eventPost (u8 type, u8 arg);
+
+/*!
+ * \brief Takes the oldest event out of the ring
+ * \param ev Receives the event.
+ * \return FALSE if there is none.
+ *
+ * Call from the main loop only.
+ */
+extern bool_t eventGet (struct event *ev);
+
+/*!
+ * \brief Returns TRUE if an event is queued
+ *
+ * Check with interrupts disabled before the MCU sleeps.
+ */
+extern bool_t eventPending (void);
+
+/*!
+ * \brief Returns the counters of the ring
+ */
+extern const struct event_queue_stats *eventQueueGetStats (void);
+
+#endif /* EVENT_QUEUE_H_ */
@@ -0,0 +1,313 @@
+/*
+ * soft_timer.c
+ *
+ * Software timers on the RTC compare, see soft_timer.h.
+ */
+
+#include <asf.h>
+#include "utils/soft_timer.h"
+#include "utils/wait_trace.h"
+
+/*!
+ * \brief Largest compare step (63.75 s), keeps the distances to RTC.CNT
+ *        unambiguous. Longer timers wake the MCU once per step.
+ */
+#define SOFT_TIMER_MAX_STEP U16_C(0xff00)
+
+/*!
+ * \brief Smallest compare step: a compare written less than two RTC cycles
+ *        ahead would only match after the counter wrapped
+ */
+#define SOFT_TIMER_MIN_STEP 3
+
+/*! \brief State of one timer */
+struct soft_timer_slot {
+	u32 remaining;                   /*!< ticks from s_last */
+	u32 duration;                    /*!< ticks from the start */
+	soft_timer_callback_t *callback;
+	bool_t running;
+#ifdef CONF_ENABLE_WAIT_TRACE
+	const void *caller;
+	wait_time_t start;
+	u32 ms;
+#endif
+};
+
+static struct soft_timer_slot s_timers[SOFT_TIMERS];
+
+/*! \brief RTC.CNT the remaining times refer to */
+static u16 s_last = 0;
+
+/*! \brief Set while the RTC interrupt calls the callbacks */
+static bool_t s_dispatching = false;
+
+/*! \brief RTC.COMP of the nearest deadline (capped to a step) */
+static u16 s_compare = 0;
+
+/*! \brief Set while s_compare still has to be written to RTC.COMP */
+static bool_t s_compare_pending = false;
+
+/*! \brief Set while the compare interrupt is enabled */
+static bool_t s_armed = false;
+
+#ifdef CONF_ENABLE_WAIT_TRACE
+# define TRACE_START(t, time, call) do {                                        \
+	(t)->caller = (call);                                                   \
+	(t)->ms = (time);                                                       \
+	(t)->start = waitTraceNow ();                                           \
+} while (0)
+# define TRACE_FINISH(t) waitTraceRecord (WAIT_KIND_TIMER, (t)->caller,         \
+                                          (t)->ms * U32_C(1000), (t)->start)
+#else
+# define TRACE_START(t, time, call) do { } while (0)
+# define TRACE_FINISH(t) do { } while (0)
+#endif
+
+/*! \brief Converts milliseconds to RTC ticks (1024 / 1000 = 1 + 3 / 125) */
+static u32 ms_to_ticks (u32 ms)
+{
+	return ms + (ms * 3) / 125;
+}
+
+/*! \brief Converts RTC ticks to milliseconds (1000 / 1024 = 1 - 3 / 128) */
+static u32 ticks_to_ms (u32 ticks)
+{
+	return ticks - (ticks * 3) / 128;
+}
+
+/*! \brief Moves the reference of the remaining times to the current count */
+static void advance (void)
+{
+	u16 now = RTC.CNT;
+	u16 elapsed = now - s_last;
+	struct soft_timer_slot *t;
+	u8 i;
+
+	s_last = now;
+	for (i = 0; i < SOFT_TIMERS; ++i) {
+		t = &s_timers[i];
+		if (!t->running)
+			continue;
+		if (t->remaining > elapsed)
+			t->remaining -= elapsed;
+		else
+			t->remaining = 0;
+	}
+}
+
+/*!
+ * \brief Writes the pending compare unless the RTC still synchronises the
+ *        previous write (a write while SYNCBUSY is set would be lost)
+ * \return TRUE if nothing is pending anymore.
+ */
+static bool_t write_compare (void)
+{
+	u16 late;
+
+	if (!s_compare_pending)
+		return true;
+	if (RTC.STATUS & RTC_SYNCBUSY_bm)
+		return false;
+
+	/* the counter moved on since the timers were updated */
+	late = (u16)(RTC.CNT - s_last) + SOFT_TIMER_MIN_STEP;
+	if ((u16)(s_compare - s_last) < late)
+		s_compare = s_last + late;
+	RTC.COMP = s_compare;
+	RTC.INTFLAGS = RTC_COMPIF_bm;
+	s_compare_pending = false;
+
+	return true;
+}
+
+/*!
+ * \brief Waits until the pending compare has been written
+ *
+ * Must be called with interrupts disabled. Waits at most two RTC cycles,
+ * only if two compares changed within them.
+ */
+static void flush_compare (void)
+{
+	while (!write_compare ());
+}
+
+/*!
+ * \brief Programs the compare for the nearest deadline
+ *
+ * Must be called with interrupts disabled, right after #advance. Doesn't
+ * wait for the RTC: if it still synchronises, the compare is written by
+ * the caller (#flush_compare) or, in the interrupt, by the next call of the
+ * API.
+ */
+static void program_compare (void)
+{
+	u32 next = U32_C(0xffffffff);
+	u16 step;
+	u8 i;
+
+	for (i = 0; i < SOFT_TIMERS; ++i) {
+		if (s_timers[i].running && (s_timers[i].remaining < next))
+			next = s_timers[i].remaining;
+	}
+
+	if (next == U32_C(0xffffffff)) {
+		/* INTCTRL isn't synchronised, the compare may stay */
+		RTC.INTCTRL = RTC_OVFINTLVL_OFF_gc | RTC_COMPINTLVL_OFF_gc;
+		s_compare_pending = false;
+		s_armed = false;
+		return;
+	}
+
+	step = (next > SOFT_TIMER_MAX_STEP) ? SOFT_TIMER_MAX_STEP : (u16)next;
+	if (s_armed && !s_compare_pending && ((u16)(s_last + step) == s_compare))
+		return;         /* the compare already points there */
+
+	s_compare = s_last + step;
+	s_compare_pending = true;
+	write_compare ();
+	RTC.INTCTRL = RTC_OVFINTLVL_OFF_gc | RTC_COMPINTLVL_LO_gc;
+	s_armed = true;
+}
+
+ISR(RTC_COMP_vect)
+{
+	struct soft_timer_slot *t;
+	u8 i;
+
+	/* retry a compare held back by a write just before */
+	write_compare ();
+	advance ();
+
+	s_dispatching = true;
+	for (i = 0; i < SOFT_TIMERS; ++i) {
+		t = &s_timers[i];
+		if (!t->running || (t->remaining != 0))
+			continue;
+
+		t->running = false;
+		TRACE_FINISH(t);
+		if (t->callback)
+			t->callback (i);
+	}
+	s_dispatching = false;
+
+	program_compare ();
+}
+
+void softTimerInit (void)
+{
+	u8 i;
+
+	for (i = 0; i < SOFT_TIMERS; ++i)
+		s_timers[i].running = false;
+
+	sysclk_enable_peripheral_clock (&RTC);
+	CLK.RTCCTRL = CLK_RTCSRC_ULP_gc | CLK_RTCEN_bm;
+
+	/* CNT (0) and PER (0xffff) keep their reset values, the RTC runs free */
+	RTC.INTCTRL = RTC_OVFINTLVL_OFF_gc | RTC_COMPINTLVL_OFF_gc;
+	RTC.CTRL = RTC_PRESCALER_DIV1_gc;
+
+	s_last = 0;
+	s_compare_pending = false;
+	s_armed = false;
+}
+
+void softTimerStartFrom (u8 timer, u32 ms, soft_timer_callback_t *callback,
+                         const void *caller)
+{
+	struct soft_timer_slot *t = &s_timers[timer];
+	irqflags_t flags;
+
+	if (ms == 0) {
+		softTimerStop (timer);
+		return;
+	}
+
+	flags = cpu_irq_save ();
+
+	if (!s_dispatching)
+		advance ();
+	if (t->running)
+		TRACE_FINISH(t);
+
+	/* counted from s_last, which lags behind by the time since advance */
+	t->duration = ms_to_ticks (ms);
+	t->remaining = t->duration + (u16)(RTC.CNT - s_last);
+	t->callback = callback;
+	t->running = true;
+	TRACE_START(t, ms, caller);
+
+	/* the interrupt programs the compare after the callbacks; a caller
+	 * busy-polling the timer never reaches softTimerSync */
+	if (!s_dispatching) {
+		program_compare ();
+		flush_compare ();
+	}
+
+	cpu_irq_restore (flags);
+}
+
+void softTimerStop (u8 timer)
+{
+	struct soft_timer_slot *t = &s_timers[timer];
+	irqflags_t flags;
+
+	flags = cpu_irq_save ();
+
+	if (t->running) {
+		t->running = false;
+		TRACE_FINISH(t);
+		/* a compare left over would wake the MCU for nothing */
+		if (!s_dispatching) {
+			advance ();
+			program_compare ();
+			flush_compare ();
+		}
+	}
+
+	cpu_irq_restore (flags);
+}
+
+void softTimerSync (void)
+{
+	irqflags_t flags;
+
+	flags = cpu_irq_save ();
+	flush_compare ();
+	cpu_irq_restore (flags);
+}
+
+bool_t softTimerIsRunning (u8 timer)
+{
+	irqflags_t flags;
+
+	/* a compare held back by the interrupt, written once the RTC is done */
+	if (s_compare_pending) {
+		flags = cpu_irq_save ();
+		write_compare ();
+		cpu_irq_restore (flags);
+	}
+
+	return s_timers[timer].running;
+}
+
+u32 softTimerElapsedMs (u8 timer)
+{
+	struct soft_timer_slot *t = &s_timers[timer];
+	u32 elapsed = 0;
+	u32 done;
+	irqflags_t flags;
+
+	flags = cpu_irq_save ();
+
+	if (t->running) {
+		done = (u16)(RTC.CNT - s_last);
+		elapsed = (t->remaining > done) ? (t->duration - (t->remaining - done))
+		                                : t->duration;
+	}
+
+	cpu_irq_restore (flags);
+
+	return ticks_to_ms (elapsed);
+}
@@ -0,0 +1,101 @@
+/*
+ * soft_timer.h
+ *
+ * Software timers multiplexed onto the compare register of the RTC. The RTC
+ * counts the 1.024 kHz output of the ULP oscillator and keeps running in
+ * power-save, the compare is always programmed for the nearest deadline of
+ * all running timers, so the MCU only wakes up when a timer expires.
+ *
+ * Every user has its own timer (enum soft_timer): starting or stopping one
+ * doesn't affect the others.
+ *
+ * The RTC runs free, arming a timer is a write of RTC.COMP. A write to the
+ * RTC takes two RTC cycles to synchronise; a compare that changes again
+ * meanwhile is kept back. Starting or stopping a timer outside the RTC
+ * interrupt waits until it is written; one kept back by the interrupt is
+ * written by the next #softTimerIsRunning or #softTimerSync.
+ */
+
+
+#ifndef SOFT_TIMER_H_
+#define SOFT_TIMER_H_
+
+#include "platform.h"
+#include "utils/wait_trace.h"
+
+/*! \brief Timers of the firmware */
+enum soft_timer {
+	SOFT_TIMER_DOOR_OPEN,   /*!< re-enables the door open interrupt */
+	SOFT_TIMER_DOOR_CLOSED, /*!< re-enables the door closed interrupt */
+	SOFT_TIMER_MODE,        /*!< learn and programming mode timeouts */
+	SOFT_TIMER_MOTOR,       /*!< motor timeout */
+	SOFT_TIMER_LOCK_OPEN,   /*!< time the lock stays open for a key */
+	SOFT_TIMER_ALARM,       /*!< alarm of the software function */
+	SOFT_TIMER_GYM,         /*!< GYM auto open */
+	SOFT_TIMER_BACKOFF,     /*!< probes of a backoff after false wake-ups */
+	SOFT_TIMER_FALSE_WAKE,  /*!< time since the last false wake-up */
+	SOFT_TIMER_SCHEDULE,    /*!< slots of the wake-up schedule */
+	SOFT_TIMERS
+};
+
+/*! \brief Clock of the timers (RTC counting the 1.024 kHz ULP output) */
+#define SOFT_TIMER_HZ 1024UL
+
+/*!
+ * \brief Called from the RTC interrupt when a timer expires
+ * \param timer enum soft_timer
+ */
+typedef void soft_timer_callback_t (u8 timer);
+
+/*!
+ * \brief Starts the RTC, no timer is running afterwards
+ */
+extern void softTimerInit (void);
+
+/*!
+ * \brief Starts (or restarts) a timer
+ * \param timer enum soft_timer
+ * \param ms Timeout in milliseconds, 0 stops the timer.
+ * \param callback Called from the RTC interrupt when the timer expires, may
+ *                 be NULL.
+ * \param caller Reported by the wait trace (#WAIT_TRACE_CALLER).
+ *
+ * May be called from interrupts and from callbacks.
+ */
+extern void softTimerStartFrom (u8 timer, u32 ms,
+                                soft_timer_callback_t *callback,
+                                const void *caller);
+
+/*! \brief #softTimerStartFrom reporting the caller of the calling function */
+#define softTimerStart(timer, ms, callback) \
+	softTimerStartFrom ((timer), (ms), (callback), WAIT_TRACE_CALLER())
+
+/*!
+ * \brief Stops a timer, its callback isn't called
+ * \param timer enum soft_timer
+ */
+extern void softTimerStop (u8 timer);
+
+/*!
+ * \brief Writes a compare held back while the RTC synchronised
+ *
+ * Call before the MCU goes to sleep in a mode only the RTC wakes it from;
+ * waits at most two RTC cycles, only if two compares changed within them.
+ */
+extern void softTimerSync (void);
+
+/*!
+ * \brief Returns TRUE from #softTimerStart until the timer expired or
+ *        has been stopped
+ * \param timer enum soft_timer
+ */
+extern bool_t softTimerIsRunning (u8 timer);
+
+/*!
+ * \brief Returns the milliseconds since a running timer has been started
+ * \param timer enum soft_timer
+ * \return Elapsed time, 0 if the timer isn't running.
+ */
+extern u32 softTimerElapsedMs (u8 timer);
+
+#endif /* SOFT_TIMER_H_ */
@@ -0,0 +1,101 @@
+/*
+ * trace_clock.c
+ *
+ * Microsecond time source of the debug traces, see trace_clock.h.
+ */
+
+#include "utils/trace_clock.h"
+
+#ifdef CONF_ENABLE_TRACE_CLOCK
+
+#include <asf.h>
+
+/*! \brief Timer of the default time source */
+#define TRACE_CLOCK_TIMER_UNIT  (&TCC1)
+#define TRACE_CLOCK_ISR         TCC1_OVF_vect
+
+static trace_clock_t *s_clock = NULL;
+static u32 s_timer_hz = 0;
+static volatile u32 s_overflows = 0;
+static trace_time_t s_base = 0;
+
+
+ISR(TRACE_CLOCK_ISR)
+{
+	++s_overflows;
+}
+
+/*!
+ * \brief Default time source: TCC1 free running at DIV8
+ *
+ * The timer runs from the peripheral clock, its tick rate is sampled in
+ * traceClockInit and updated by traceClockChanged. The time up to the last
+ * clock switch is kept in s_base.
+ */
+static trace_time_t timer_clock (void)
+{
+	irqflags_t flags;
+	u32 overflows;
+	u16 cnt;
+
+	flags = cpu_irq_save ();
+	cnt = TRACE_CLOCK_TIMER_UNIT->CNT;
+	overflows = s_overflows;
+	if (TRACE_CLOCK_TIMER_UNIT->INTFLAGS & TC1_OVFIF_bm) {
+		/* overflow not yet handled, CNT may have wrapped before it was read */
+		cnt = TRACE_CLOCK_TIMER_UNIT->CNT;
+		++overflows;
+	}
+	cpu_irq_restore (flags);
+
+	return s_base +
+	       (trace_time_t)(((((u64)overflows << 16) | cnt) * U32_C(1000000)) /
+	                      s_timer_hz);
+}
+
+void traceClockInit (void)
+{
+	if (s_clock)
+		return;
+
+	sysclk_enable_peripheral_clock (TRACE_CLOCK_TIMER_UNIT);
+	s_timer_hz = sysclk_get_peripheral_bus_hz (TRACE_CLOCK_TIMER_UNIT) >> 3;
+
+	TRACE_CLOCK_TIMER_UNIT->CTRLA = TC_CLKSEL_OFF_gc;
+	TRACE_CLOCK_TIMER_UNIT->CTRLB = 0x00;
+	TRACE_CLOCK_TIMER_UNIT->PER = U16_C(0xffff);
+	TRACE_CLOCK_TIMER_UNIT->CNT = U16_C(0);
+	TRACE_CLOCK_TIMER_UNIT->INTFLAGS = TC1_OVFIF_bm;
+	TRACE_CLOCK_TIMER_UNIT->INTCTRLA = TC_OVFINTLVL_LO_gc;
+	TRACE_CLOCK_TIMER_UNIT->CTRLA = TC_CLKSEL_DIV8_gc;
+
+	s_clock = timer_clock;
+}
+
+void traceClockSet (trace_clock_t *clock)
+{
+	s_clock = clock;
+}
+
+void traceClockChanged (u32 hz)
+{
+	irqflags_t flags;
+
+	if (s_clock != timer_clock)
+		return;
+
+	flags = cpu_irq_save ();
+	s_base = timer_clock ();
+	s_overflows = 0;
+	TRACE_CLOCK_TIMER_UNIT->CNT = U16_C(0);
+	TRACE_CLOCK_TIMER_UNIT->INTFLAGS = TC1_OVFIF_bm;
+	s_timer_hz = hz >> 3;
+	cpu_irq_restore (flags);
+}
+
+trace_time_t traceClockNow (void)
+{
+	return s_clock ? s_clock () : 0;
+}
+
+#endif /* CONF_ENABLE_TRACE_CLOCK */
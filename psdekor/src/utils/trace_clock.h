@@ -0,0 +1,60 @@
+/*
+ * trace_clock.h
+ *
+ * Microsecond time source of the debug traces (wait_trace, energy).
+ *
+ * Only compiled in if one of the traces is enabled in conf_board.h.
+ */
+
+
+#ifndef TRACE_CLOCK_H_
+#define TRACE_CLOCK_H_
+
+#include "conf_board.h"
+#include "ams_types.h"
+
+#if defined(CONF_ENABLE_WAIT_TRACE) || defined(CONF_ENABLE_ENERGY_TRACE)
+# define CONF_ENABLE_TRACE_CLOCK
+#endif
+
+/*! \brief Timestamps of the traces (microseconds, wrapping after 71 minutes) */
+typedef u32 trace_time_t;
+
+#ifdef CONF_ENABLE_TRACE_CLOCK
+
+/*! \brief Time source, returns the current time in microseconds */
+typedef trace_time_t trace_clock_t (void);
+
+/*!
+ * \brief Starts the default time source unless another one is set
+ *
+ * The default time source is a free running TCC1. It stops while the MCU
+ * is in power-save, so time spent in deep sleep is not counted. Host
+ * builds set their virtual clock with #traceClockSet instead.
+ */
+extern void traceClockInit (void);
+
+/*! \brief Replaces the time source */
+extern void traceClockSet (trace_clock_t *clock);
+
+/*! \brief Current time of the time source */
+extern trace_time_t traceClockNow (void);
+
+/*!
+ * \brief Adapts the default time source to a new peripheral clock
+ * \param hz Peripheral clock after the switch (see clkSetProfile).
+ *
+ * Call right before the clock is switched.
+ */
+extern void traceClockChanged (u32 hz);
+
+#else
+
+# define traceClockInit() do { } while (0)
+# define traceClockSet(clock) do { } while (0)
+# define traceClockNow() 0
+# define traceClockChanged(hz) do { } while (0)
+
+#endif /* CONF_ENABLE_TRACE_CLOCK */
+
+#endif /* TRACE_CLOCK_H_ */
@@ -0,0 +1,173 @@
+/*
+ * wait_trace.c
+ *
+ * Records the blocking waits of the firmware, see wait_trace.h.
+ */
+
+#include "utils/wait_trace.h"
+
+#ifdef CONF_ENABLE_WAIT_TRACE
+
+#include <string.h>
+#include <asf.h>
+#include "utils/debug.h"
+#include "utils/counter.h"
+
+static struct wait_trace_entry s_entries[WAIT_TRACE_ENTRIES];
+static u8 s_count = 0;
+static u16 s_dropped = 0;
+
+static struct wait_trace_state s_states[WAIT_TRACE_STATES];
+static u8 s_state = WAIT_TRACE_STATE_NONE;
+static u16 s_budget_ms = 0;
+static wait_time_t s_state_start = 0;
+static u32 s_state_wait_us = 0;
+
+
+void waitTraceInit (void)
+{
+	waitTraceReset ();
+	traceClockInit ();
+	s_state_start = waitTraceNow ();
+}
+
+static struct wait_trace_entry *find_entry (u8 kind, const void *caller)
+{
+	struct wait_trace_entry *e;
+	u8 i;
+
+	for (i = 0; i < s_count; ++i) {
+		e = &s_entries[i];
+		if ((e->caller == caller) && (e->kind == kind) && (e->state == s_state))
+			return e;
+	}
+
+	if (s_count == WAIT_TRACE_ENTRIES)
+		return NULL;
+
+	e = &s_entries[s_count++];
+	e->caller = caller;
+	e->state = s_state;
+	e->kind = kind;
+	e->count = 0;
+	e->requested_us = 0;
+	e->actual_us = 0;
+	e->max_actual_us = 0;
+
+	return e;
+}
+
+void waitTraceRecord (u8 kind, const void *caller, u32 requested_us,
+                      wait_time_t start)
+{
+	struct wait_trace_entry *e;
+	wait_time_t now = waitTraceNow ();
+	u32 actual_us = now - start;
+	irqflags_t flags;
+
+	/* expired software timers record from interrupt context */
+	flags = cpu_irq_save ();
+
+	/* software timers run in the background, only delays block */
+	if ((kind == WAIT_KIND_DELAY) || (kind == WAIT_KIND_DELAY_POLL)) {
+		if ((now - s_state_start) < actual_us)
+			s_state_wait_us += now - s_state_start;
+		else
+			s_state_wait_us += actual_us;
+	}
+
+	e = find_entry (kind, caller);
+	if (!e) {
+		++s_dropped;
+		goto out;
+	}
+
+	counterInc16 (&e->count);
+	e->requested_us += requested_us;
+	e->actual_us += actual_us;
+	if (actual_us > e->max_actual_us)
+		e->max_actual_us = actual_us;
+out:
+	cpu_irq_restore (flags);
+}
+
+void waitTraceStateEnter (u8 state, u16 budget_ms)
+{
+	s_state = state;
+	s_budget_ms = budget_ms;
+	s_state_wait_us = 0;
+	s_state_start = waitTraceNow ();
+}
+
+void waitTraceStateLeave (void)
+{
+	struct wait_trace_state *st;
+	u32 elapsed_us = waitTraceNow () - s_state_start;
+
+	if (s_state >= WAIT_TRACE_STATES)
+		return;
+
+	st = &s_states[s_state];
+	counterInc16 (&st->count);
+	st->total_us += elapsed_us;
+	st->wait_us += s_state_wait_us;
+	if (elapsed_us > st->max_us)
+		st->max_us = elapsed_us;
+	if (s_budget_ms && (elapsed_us > (u32)s_budget_ms * U32_C(1000))) {
+		counterInc16 (&st->over_budget);
+		DLOG("[wait] state %hhu took %lu us (budget %u ms)\r\n", s_state,
+		     (unsigned long)elapsed_us, s_budget_ms);
+	}
+}
+
+const struct wait_trace_entry *waitTraceEntries (u8 *count)
+{
+	*count = s_count;
+	return s_entries;
+}
+
+const struct wait_trace_state *waitTraceStates (void)
+{
+	return s_states;
+}
+
+void waitTraceReset (void)
+{
+	irqflags_t flags = cpu_irq_save ();
+
+	s_count = 0;
+	s_dropped = 0;
+	memset (s_states, 0, sizeof s_states);
+	cpu_irq_restore (flags);
+}
+
+void waitTraceDump (void)
+{
+	const struct wait_trace_entry *e;
+	const struct wait_trace_state *st;
+	u8 i;
+
+	/* caller is a word address on AVR, multiply by 2 to find it in the map file */
+	DLOG("[wait] state kind caller count requested_us actual_us max_us\r\n");
+	for (i = 0; i < s_count; ++i) {
+		e = &s_entries[i];
+		DLOG("[wait] %hhu %hhu %lx %u %lu %lu %lu\r\n", e->state, e->kind,
+		     (unsigned long)(uintptr_t)e->caller, e->count,
+		     (unsigned long)e->requested_us, (unsigned long)e->actual_us,
+		     (unsigned long)e->max_actual_us);
+	}
+	if (s_dropped)
+		DLOG("[wait] %u waits not recorded (table full)\r\n", s_dropped);
+
+	DLOG("[wait] state count total_us wait_us max_us over_budget\r\n");
+	for (i = 0; i < WAIT_TRACE_STATES; ++i) {
+		st = &s_states[i];
+		if (!st->count)
+			continue;
+		DLOG("[wait] %hhu %u %lu %lu %lu %u\r\n", i, st->count,
+		     (unsigned long)st->total_us, (unsigned long)st->wait_us,
+		     (unsigned long)st->max_us, st->over_budget);
+	}
+}
+
+#endif /* CONF_ENABLE_WAIT_TRACE */
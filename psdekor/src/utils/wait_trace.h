@@ -0,0 +1,128 @@
+/*
+ * wait_trace.h
+ *
+ * Records every blocking wait of the firmware (delay timer, software
+ * timers) as (main state, caller, requested time, actual time) so latency
+ * budgets can be derived per state of MainStateMachine.
+ *
+ * The trace is only compiled in if CONF_ENABLE_WAIT_TRACE is defined in
+ * conf_board.h. Otherwise all functions below are empty macros.
+ */
+
+
+#ifndef WAIT_TRACE_H_
+#define WAIT_TRACE_H_
+
+#include "conf_board.h"
+#include "platform.h"
+#include "utils/trace_clock.h"
+
+/*! \brief Kind of wait */
+enum wait_kind {
+	WAIT_KIND_DELAY,        /*!< delayNMilliSeconds (sleeps on the delay timer) */
+	WAIT_KIND_DELAY_POLL,   /*!< delayNMilliSecondsStart .. Stop/IsDone */
+	WAIT_KIND_TIMER,        /*!< softTimerStart (rtcStart, rtcStartINTR) ..
+	                         *   expiry or stop */
+	WAIT_KIND_COUNT
+};
+
+/*! \brief State of waits before the first #waitTraceStateEnter (start-up) */
+#define WAIT_TRACE_STATE_NONE 0xff
+
+/*! \brief Timestamps of the trace */
+typedef trace_time_t wait_time_t;
+
+#ifdef CONF_ENABLE_WAIT_TRACE
+
+#ifndef WAIT_TRACE_ENTRIES
+/*! \brief Number of distinct (state, kind, caller) combinations recorded */
+# define WAIT_TRACE_ENTRIES 16
+#endif
+
+#ifndef WAIT_TRACE_STATES
+/*! \brief Number of main states with latency statistics */
+# define WAIT_TRACE_STATES 20
+#endif
+
+/*! \brief Accumulated waits of one (state, kind, caller) combination */
+struct wait_trace_entry {
+	const void *caller;     /*!< return address of the wait function */
+	u8 state;               /*!< enum MainState while waiting */
+	u8 kind;                /*!< enum wait_kind */
+	u16 count;
+	u32 requested_us;       /*!< sum of the requested times */
+	u32 actual_us;          /*!< sum of the measured times */
+	u32 max_actual_us;
+};
+
+/*! \brief Latency of one main state (one MainStateMachine call each) */
+struct wait_trace_state {
+	u16 count;
+	u16 over_budget;        /*!< calls that took longer than the budget */
+	u32 total_us;           /*!< sum of the call durations */
+	u32 wait_us;            /*!< part of total_us spent blocked in delays */
+	u32 max_us;
+};
+
+/*! \brief Return address of the current function (identifies the caller) */
+# define WAIT_TRACE_CALLER() __builtin_return_address(0)
+
+/*!
+ * \brief Initializes the trace and its time source (see trace_clock.h)
+ * \note Waits spent in power-save are measured too short with the default
+ *       time source.
+ */
+extern void waitTraceInit (void);
+
+/*! \brief Current time of the trace time source */
+# define waitTraceNow() traceClockNow ()
+
+/*!
+ * \brief Starts the latency measurement of a main state
+ * \param state enum MainState, following waits are accounted to it
+ * \param budget_ms Latency budget of the state, 0 for none
+ */
+extern void waitTraceStateEnter (u8 state, u16 budget_ms);
+
+/*! \brief Ends the latency measurement started by #waitTraceStateEnter */
+extern void waitTraceStateLeave (void);
+
+/*!
+ * \brief Records a finished wait
+ * \param kind enum wait_kind
+ * \param caller Caller of the wait function (#WAIT_TRACE_CALLER)
+ * \param requested_us Requested wait time
+ * \param start Time (#waitTraceNow) the wait started
+ */
+extern void waitTraceRecord (u8 kind, const void *caller, u32 requested_us,
+                             wait_time_t start);
+
+/*!
+ * \brief Returns the recorded entries
+ * \param count Number of valid entries
+ */
+extern const struct wait_trace_entry *waitTraceEntries (u8 *count);
+
+/*! \brief Returns the latency statistics, indexed by state */
+extern const struct wait_trace_state *waitTraceStates (void);
+
+/*! \brief Clears all entries */
+extern void waitTraceReset (void);
+
+/*! \brief Writes all entries to the debug UART */
+extern void waitTraceDump (void);
+
+#else
+
+# define WAIT_TRACE_CALLER() NULL
+# define waitTraceInit() do { } while (0)
+# define waitTraceNow() 0
+# define waitTraceStateEnter(state, budget_ms) do { } while (0)
+# define waitTraceStateLeave() do { } while (0)
+# define waitTraceRecord(kind, caller, requested_us, start) ((void)(start))
+# define waitTraceReset() do { } while (0)
+# define waitTraceDump() do { } while (0)
+
+#endif /* CONF_ENABLE_WAIT_TRACE */
+
+#endif /* WAIT_TRACE_H_ */